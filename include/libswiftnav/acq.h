@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ACQ_H
+#define LIBSWIFTNAV_ACQ_H
+
+#include "almanac.h"
+#include "common.h"
+#include "constants.h"
+#include "fft.h"
+
+/** \addtogroup acq
+ * \{ */
+
+/** Acquisition plan for one sampling configuration.
+ * Should be initialised with acq_plan_init(). A plan is read only once
+ * initialised and may be shared between threads.
+ */
+typedef struct {
+  double fs;          /**< Sample rate in Hz. */
+  double if_freq;     /**< Intermediate frequency in Hz. */
+  u32 n_samples;      /**< Number of samples in one code period. */
+  u32 n_fft;          /**< FFT length, one code period is resampled to
+                           this many points. */
+  u32* sample_index;  /**< Input sample used for each FFT point. */
+  fft_plan_t fft;     /**< FFT tables. */
+  /** Cached code spectra of each PRN, see acq_code_spectrum_cached(). */
+  void* code_spectra[MAX_SATS];
+} acq_plan_t;
+
+/** Result of an acquisition search for one PRN. */
+typedef struct {
+  float cp;   /**< Code phase of the first sample in chips. */
+  float cf;   /**< Carrier Doppler in Hz. */
+  float snr;  /**< Correlation peak power over the mean power of the
+                   search grid. With noise alone this is around the
+                   natural log of the number of grid points. */
+} acq_result_t;
+
+/** Satellite predicted to be visible and the Doppler range to search. */
+typedef struct {
+  u8 prn;        /**< PRN number, zero based as in the almanac. */
+  float el;      /**< Predicted elevation in radians. */
+  float cf;      /**< Predicted carrier Doppler in Hz. */
+  float cf_min;  /**< Lowest Doppler to search in Hz. */
+  float cf_max;  /**< Highest Doppler to search in Hz. */
+} acq_candidate_t;
+
+/** \} */
+
+s8 acq_plan_init(acq_plan_t* plan, double fs, double if_freq);
+void acq_plan_destroy(acq_plan_t* plan);
+u32 acq_n_bins(float cf_min, float cf_max, float cf_bin_width);
+float acq_index_to_cp(const acq_plan_t* plan, u32 index);
+void acq_code_spectrum(const acq_plan_t* plan, u8 prn, fft_cpx_t* out);
+const fft_cpx_t* acq_code_spectrum_cached(const acq_plan_t* plan, u8 prn);
+void acq_signal_spectrum(const acq_plan_t* plan, const s8* samples, float cf,
+                         fft_cpx_t* out);
+bool acq_spectrum_shift_bins(const acq_plan_t* plan, float cf_from,
+                             float cf_to, s32* shift);
+void acq_signal_spectrum_shift(const acq_plan_t* plan,
+                               const fft_cpx_t* signal, s32 shift,
+                               fft_cpx_t* out);
+void acq_correlate(const acq_plan_t* plan, const fft_cpx_t* signal,
+                   const fft_cpx_t* code, fft_cpx_t* work, float* power);
+s8 acq_search(const acq_plan_t* plan, const s8* samples, u8 prn,
+              float cf_min, float cf_max, float cf_bin_width,
+              float* grid, acq_result_t* result);
+u8 acq_almanac_candidates(const almanac_t alm[], u8 n_alm, double t,
+                          s16 week, const double ref[3], double pos_unc,
+                          double t_unc, float cf_unc, float elev_mask,
+                          acq_candidate_t cands[]);
+
+#endif /* LIBSWIFTNAV_ACQ_H */
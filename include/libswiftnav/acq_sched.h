@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ACQ_SCHED_H
+#define LIBSWIFTNAV_ACQ_SCHED_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "acq.h"
+
+/** \addtogroup acq_sched
+ * \{ */
+
+/** Maximum number of worker threads in an ::acq_pool_t. */
+#define ACQ_POOL_MAX_THREADS 64
+
+/** Range of work units owned by one worker, packed as
+ * `(begin << 32) | end` so that it can be updated with a single atomic
+ * compare and swap. Padded to a cache line to avoid false sharing. */
+typedef struct {
+  u64 range;             /**< Packed range of unit indices. */
+  u8 pad[56];            /**< Padding to 64 bytes. */
+} acq_pool_queue_t;
+
+/** Worker thread pool running parallel loops with work stealing.
+ * Should be initialised with acq_pool_init().
+ */
+typedef struct {
+  u8 n_threads;                       /**< Number of worker threads. */
+  pthread_t threads[ACQ_POOL_MAX_THREADS];  /**< Worker threads. */
+  pthread_mutex_t lock;               /**< Protects the fields below. */
+  pthread_cond_t start;               /**< Signalled when a loop starts. */
+  pthread_cond_t done;                /**< Signalled when a loop ends. */
+  u32 generation;                     /**< Number of loops started. */
+  u8 n_busy;                          /**< Workers still in the loop. */
+  bool quit;                          /**< Set to stop the workers. */
+  /** Loop body, called with the unit index and worker number. */
+  void (*fn)(void* ctx, u32 unit, u8 worker);
+  void* ctx;                          /**< Context passed to `fn`. */
+  /** Work queue of each worker. */
+  acq_pool_queue_t queues[ACQ_POOL_MAX_THREADS];
+} acq_pool_t;
+
+/** \} */
+
+s8 acq_pool_init(acq_pool_t* pool, u8 n_threads);
+void acq_pool_destroy(acq_pool_t* pool);
+void acq_pool_run(acq_pool_t* pool, u32 n_units,
+                  void (*fn)(void* ctx, u32 unit, u8 worker), void* ctx);
+s8 acq_search_prns(acq_pool_t* pool, const acq_plan_t* plan,
+                   const s8* samples, u8 n_prns, const u8 prns[],
+                   float cf_min, float cf_max, float cf_bin_width,
+                   float early_stop_snr, acq_result_t results[]);
+s8 acq_search_candidates(acq_pool_t* pool, const acq_plan_t* plan,
+                         const s8* samples, u8 n_cands,
+                         const acq_candidate_t cands[], float cf_bin_width,
+                         float early_stop_snr, acq_result_t results[]);
+
+#endif /* LIBSWIFTNAV_ACQ_SCHED_H */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_ACQ_WEAK_H
+#define LIBSWIFTNAV_ACQ_WEAK_H
+
+#include "common.h"
+#include "acq.h"
+
+/** \addtogroup acq_weak
+ * \{ */
+
+/** Length of a navigation data bit in code periods. */
+#define ACQ_WEAK_BIT_LEN 20
+
+/** Coherent block SNR assumed to be needed for detection by
+ * acq_weak_cost(), roughly a 90% detection probability at a false alarm
+ * rate of 1e-3 per cell. */
+#define ACQ_WEAK_DETECT_SNR 25.0
+
+/** Integration parameters of a weak signal search. */
+typedef struct {
+  u8 coh_len;      /**< Coherent block length in code periods, a divisor
+                        of `ACQ_WEAK_BIT_LEN`. */
+  u16 n_noncoh;    /**< Number of coherent blocks combined
+                        non-coherently. */
+  u8 n_edges;      /**< Number of bit edge alignments to try, from 1 to
+                        `coh_len`. */
+  float cf_min;        /**< Lowest Doppler to search in Hz. */
+  float cf_max;        /**< Highest Doppler to search in Hz. */
+  float cf_bin_width;  /**< Doppler bin spacing in Hz. */
+} acq_weak_config_t;
+
+/** Cost and approximate sensitivity of a weak signal search. */
+typedef struct {
+  u32 n_periods;      /**< Code periods of samples needed. */
+  u32 n_bins;         /**< Number of Doppler bins. */
+  u32 n_ffts;         /**< Forward and inverse FFTs per PRN. */
+  double flops;       /**< Approximate floating point operations per PRN. */
+  float coh_gain;     /**< Coherent integration gain over one period, dB. */
+  float noncoh_gain;  /**< Non-coherent integration gain after the
+                           squaring loss, dB. */
+  float loss;         /**< Worst case bit edge and Doppler bin straddle
+                           loss, dB. */
+  float cn0_min;      /**< Approximate weakest detectable C/N0, dB-Hz. */
+} acq_weak_cost_t;
+
+/** \} */
+
+s8 acq_weak_cost(const acq_plan_t* plan, const acq_weak_config_t* cfg,
+                 acq_weak_cost_t* cost);
+s8 acq_search_weak(const acq_plan_t* plan, const s8* samples,
+                   u32 n_samples, u8 prn, const acq_weak_config_t* cfg,
+                   acq_result_t* result, u8* bit_edge);
+
+#endif /* LIBSWIFTNAV_ACQ_WEAK_H */
+
@@ -14,7 +14,7 @@
 #define LIBSWIFTNAV_ALMANAC_H
 
 #include "common.h"
-#include "almanac.h"
+#include "gpstime.h"
 
 /** \addtogroup almanac
  * \{ */
@@ -45,5 +45,6 @@ void calc_sat_az_el_almanac(const almanac_t* alm, double t, s16 week,
                             const double ref[3], double* az, double* el);
 double calc_sat_doppler_almanac(const almanac_t* alm, double t, s16 week,
                                 const double ref[3]);
+s8 decode_almanac(const u32 words[8], gps_time_t t, almanac_t *alm);
 
 #endif /* LIBSWIFTNAV_ALMANAC_H */
@@ -18,6 +18,7 @@
 u8 parity(u32 x);
 u32 getbitu(const u8 *buff, u32 pos, u8 len);
 s32 getbits(const u8 *buff, u32 pos, u8 len);
+s32 getbits_navword(u32 word, u8 last, u8 len);
 void setbitu(u8 *buff, u32 pos, u32 len, u32 data);
 void setbits(u8 *buff, u32 pos, u32 len, s32 data);
 
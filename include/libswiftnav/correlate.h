@@ -14,6 +14,55 @@
 #define LIBSWIFTNAV_CORRELATE_H
 
 #include "common.h"
+#include "replica.h"
+#include "samples.h"
+
+/** \addtogroup corr
+ * \{ */
+
+/** Correlator implementations, see track_correlate_set_impl(). */
+typedef enum {
+  CORR_IMPL_AUTO = -1, /**< Fastest implementation supported by the CPU. */
+  CORR_IMPL_C = 0,     /**< Portable C implementation. */
+  CORR_IMPL_SSSE3,     /**< SSSE3, one sample per iteration. */
+  CORR_IMPL_AVX2,      /**< AVX2, 8 samples per iteration. */
+  CORR_IMPL_AVX512,    /**< AVX-512F, 16 samples per iteration. */
+} corr_impl_t;
+
+/** Number of samples correlated per channel before moving on to the next
+ * channel in track_correlate_multi(), sized so that a chunk stays in L1. */
+#define CORR_MULTI_CHUNK_LEN 4096
+
+/** Number of samples unpacked at a time by track_correlate_packed(). */
+#define CORR_PACKED_CHUNK_LEN 2048
+
+/** Maximum number of taps for track_correlate_taps(). */
+#define CORR_MAX_TAPS 16
+
+/** One chip in the Q32.32 code phase used by track_correlate_int(). */
+#define CORR_INT_CODE_ONE ((u64)1 << 32)
+/** One cycle in the Q0.32 carrier phase used by track_correlate_int(). */
+#define CORR_INT_CARR_CYCLE 4294967296.0
+/** Amplitude of the local carrier in track_correlate_int(). */
+#define CORR_INT_CARR_AMP 64
+
+/** Channel state for track_correlate_multi(). */
+typedef struct {
+  const s8* code;     /**< Spreading code, padded as for track_correlate(). */
+  double code_phase;  /**< Code phase of the first sample in chips, updated. */
+  double code_step;   /**< Code phase increment per sample in chips. */
+  double carr_phase;  /**< Carrier phase of the first sample in radians,
+                           updated. */
+  double carr_step;   /**< Carrier phase increment per sample in radians. */
+  double corr[6];     /**< Output correlations,
+                           [I_E, Q_E, I_P, Q_P, I_L, Q_L]. */
+  u32 num_samples;    /**< Output number of samples correlated. */
+} corr_channel_t;
+
+/** \} */
+
+s8 track_correlate_set_impl(corr_impl_t impl);
+corr_impl_t track_correlate_get_impl(void);
 
 void track_correlate(s8* samples, s8* code,
                      double* init_code_phase, double code_step,
@@ -22,6 +71,57 @@ void track_correlate(s8* samples, s8* code,
                      double* I_P, double* Q_P,
                      double* I_L, double* Q_L,
                      u32* num_samples);
+s8 track_correlate_replica(const s8* samples, const code_replica_t* replica,
+                           double* init_code_phase, double code_step,
+                           double* init_carr_phase, double carr_step,
+                           double* I_E, double* Q_E,
+                           double* I_P, double* Q_P,
+                           double* I_L, double* Q_L,
+                           u32* num_samples);
+u32 track_correlate_periods(const s8* samples, u32 max_samples,
+                            const s8* code,
+                            double* init_code_phase, double code_step,
+                            double* init_carr_phase, double carr_step,
+                            u32 max_periods, double corr_periods[][6],
+                            double corr_sum[6], u32* num_samples);
+void track_correlate_iq(const s8* samples, const s8* code,
+                        double* init_code_phase, double code_step,
+                        double* init_carr_phase, double carr_step,
+                        double* I_E, double* Q_E,
+                        double* I_P, double* Q_P,
+                        double* I_L, double* Q_L,
+                        u32* num_samples);
+void track_correlate_packed(const u8* samples, u32 sample_offset,
+                            sample_fmt_t fmt, const s8* code,
+                            double* init_code_phase, double code_step,
+                            double* init_carr_phase, double carr_step,
+                            double* I_E, double* Q_E,
+                            double* I_P, double* Q_P,
+                            double* I_L, double* Q_L,
+                            u32* num_samples);
+s8 track_correlate_taps(const s8* samples, const s8* code,
+                        double* init_code_phase, double code_step,
+                        double* init_carr_phase, double carr_step,
+                        u8 n_taps, const double offsets[],
+                        double I[], double Q[], u32* num_samples);
+void track_correlate_int(const s8* samples, const s8* code,
+                         u64* init_code_phase, u64 code_step,
+                         u32* init_carr_phase, u32 carr_step,
+                         s32* I_E, s32* Q_E,
+                         s32* I_P, s32* Q_P,
+                         s32* I_L, s32* Q_L,
+                         u32* num_samples);
+s8 track_correlate_ring(const sample_ring_t* ring, u64* pos, const s8* code,
+                        double* init_code_phase, double code_step,
+                        double* init_carr_phase, double carr_step,
+                        double* I_E, double* Q_E,
+                        double* I_P, double* Q_P,
+                        double* I_L, double* Q_L,
+                        u32* num_samples);
+void track_correlate_multi(const s8* samples, u8 n_channels,
+                           corr_channel_t chans[]);
+s8 track_correlate_multi_ring(const sample_ring_t* ring, u64 pos,
+                              u8 n_channels, corr_channel_t chans[]);
 
 #endif /* LIBSWIFTNAV_CORRELATE_H */
 
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_FFT_H
+#define LIBSWIFTNAV_FFT_H
+
+#include "common.h"
+
+/** \addtogroup fft
+ * \{ */
+
+/** Single precision complex value. */
+typedef struct {
+  float re;  /**< Real part. */
+  float im;  /**< Imaginary part. */
+} fft_cpx_t;
+
+/** Precomputed tables for FFTs of one length.
+ * Should be initialised with fft_plan_init(). A plan is read only once
+ * initialised and may be shared between threads.
+ */
+typedef struct {
+  u32 n;                /**< Transform length, a power of two. */
+  fft_cpx_t* twiddle;   /**< Twiddle factors of every stage, `n - 1`
+                             entries. */
+  u32* bitrev;          /**< Bit reversal permutation, `n` entries. */
+} fft_plan_t;
+
+/** \} */
+
+s8 fft_plan_init(fft_plan_t* plan, u32 n);
+void fft_plan_destroy(fft_plan_t* plan);
+void fft_forward(const fft_plan_t* plan, fft_cpx_t* x);
+void fft_inverse(const fft_plan_t* plan, fft_cpx_t* x);
+
+#endif /* LIBSWIFTNAV_FFT_H */
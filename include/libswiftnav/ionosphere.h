@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_IONOSPHERE_H
+#define LIBSWIFTNAV_IONOSPHERE_H
+
+#include "common.h"
+
+/** \addtogroup ionosphere
+ * \{ */
+
+/** Broadcast Klobuchar ionospheric model parameters. */
+typedef struct {
+  double a0; /**< Amplitude coefficient alpha_0 in s. */
+  double a1; /**< Amplitude coefficient alpha_1 in s/semicircle. */
+  double a2; /**< Amplitude coefficient alpha_2 in s/semicircle^2. */
+  double a3; /**< Amplitude coefficient alpha_3 in s/semicircle^3. */
+  double b0; /**< Period coefficient beta_0 in s. */
+  double b1; /**< Period coefficient beta_1 in s/semicircle. */
+  double b2; /**< Period coefficient beta_2 in s/semicircle^2. */
+  double b3; /**< Period coefficient beta_3 in s/semicircle^3. */
+  u8 valid;  /**< Parameters are valid. */
+} ionosphere_t;
+
+/** Broadcast GPS to UTC time conversion parameters. */
+typedef struct {
+  double a0;  /**< Constant term of GPS - UTC in s. */
+  double a1;  /**< First order term of GPS - UTC in s/s. */
+  u32 tot;    /**< Reference time of week in s. */
+  u8 wnt;     /**< Reference week number, modulo 256. */
+  s8 dt_ls;   /**< Current leap second count in s. */
+  u8 wn_lsf;  /**< Week number of the next leap second, modulo 256. */
+  u8 dn;      /**< Day of week of the next leap second, 1-7. */
+  s8 dt_lsf;  /**< Leap second count after the next leap second in s. */
+  u8 valid;   /**< Parameters are valid. */
+} utc_params_t;
+
+/** \} */
+
+s8 decode_iono_utc(const u32 words[8], ionosphere_t *iono, utc_params_t *utc);
+
+#endif /* LIBSWIFTNAV_IONOSPHERE_H */
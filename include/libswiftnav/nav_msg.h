@@ -15,6 +15,8 @@
 
 #include "common.h"
 #include "ephemeris.h"
+#include "almanac.h"
+#include "ionosphere.h"
 
 #define NAV_MSG_SUBFRAME_BITS_LEN 14 /* Buffer 448 nav bits. */
 
@@ -43,6 +45,10 @@ typedef struct {
   u8 next_subframe_id;
   s8 bit_polarity;
 
+  u32 page_words[8];  /**< Words 3..10 of the last subframe 4 or 5. */
+  u32 page_tow;       /**< TOW count of the HOW of `page_words`. */
+  bool page_ready;    /**< `page_words` holds a page not yet processed. */
+
   u8 bitsync_count;
   s32 bitsync_prev_corr[20];
   u32 bitsync_histogram[20];
@@ -50,8 +56,15 @@ typedef struct {
 
 void nav_msg_init(nav_msg_t *n);
 s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms);
+s32 nav_msg_update_block(nav_msg_t *n, u32 n_corr,
+                         const s32 corr_prompt_real[], u8 ms);
+void nav_msg_update_batch(u8 n_channels, nav_msg_t *n[], u32 n_corr,
+                          const s32 corr_prompt_real[], u8 ms, s32 TOW_ms[]);
+u8 nav_subframe_parity(u32 prev, const u32 raw[10], u32 words[10]);
 bool subframe_ready(nav_msg_t *n);
 s8 process_subframe(nav_msg_t *n, ephemeris_t *e);
+s8 process_page(nav_msg_t *n, u16 week, almanac_t alm[],
+                ionosphere_t *iono, utc_params_t *utc);
 
 #endif /* LIBSWIFTNAV_NAV_MSG_H */
 
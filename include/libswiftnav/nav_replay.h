@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_NAV_REPLAY_H
+#define LIBSWIFTNAV_NAV_REPLAY_H
+
+#include "common.h"
+#include "ephemeris.h"
+#include "nav_msg.h"
+
+/** \addtogroup nav_replay
+ * \{ */
+
+/** Number of satellites that can be replayed at once, indexed by PRN. */
+#define NAV_REPLAY_MAX_SATS 32
+/** Size of the bit buffer of each satellite. */
+#define NAV_REPLAY_BUFF_BITS 8192
+/** Longest run of correlations handed to the nav message decoder before
+ * checking for a complete subframe, in ms. */
+#define NAV_REPLAY_CORR_BLOCK_MS 1000
+
+/** Function called with each new ephemeris decoded by the replay. */
+typedef void (*nav_replay_callback_t)(const ephemeris_t *e, void *context);
+
+/** Replay statistics. */
+typedef struct {
+  u64 n_bits;          /**< Nav bits processed. */
+  u64 n_corrs;         /**< Correlations processed. */
+  u32 n_subframes;     /**< Subframes found with correct parity. */
+  u32 n_ephemerides;   /**< Ephemerides decoded, including repeats. */
+  u32 n_unique;        /**< New ephemerides passed to the callback. */
+  u32 n_iode_mismatch; /**< Subframes 1 to 3 with mismatched issues of
+                            data, dropped. */
+  double time;         /**< Processor time spent decoding in s. */
+} nav_replay_stats_t;
+
+/** Replay state of one satellite. */
+typedef struct {
+  /** Buffered nav bits, most significant bit first, padded so that a word
+   * can be read from any bit. */
+  u8 buff[NAV_REPLAY_BUFF_BITS / 8 + 8];
+  u32 n_bits;            /**< Number of bits in `buff`. */
+  u32 pos;               /**< Next bit of `buff` to search from. */
+  u32 frame_words[3][8]; /**< Words 3 to 10 of subframes 1 to 3. */
+  u8 have_subframes;     /**< Bit `i` set if subframe `i + 1` is held. */
+  u32 last_tow;          /**< TOW count of the last subframe held. */
+  nav_msg_t nav;         /**< Nav message decoder for correlations. */
+  bool have_eph;         /**< Whether `eph` holds an ephemeris yet. */
+  ephemeris_t eph;       /**< Last new ephemeris. */
+} nav_replay_sat_t;
+
+/** Offline decoder of recorded nav data for many satellites.
+ * Should be initialised with nav_replay_init().
+ */
+typedef struct {
+  nav_replay_sat_t sats[NAV_REPLAY_MAX_SATS];
+  nav_replay_callback_t callback; /**< New ephemeris callback. */
+  void *context;                  /**< Context passed to `callback`. */
+  nav_replay_stats_t stats;       /**< Statistics. */
+} nav_replay_t;
+
+/** \} */
+
+void nav_replay_init(nav_replay_t *r, nav_replay_callback_t callback,
+                     void *context);
+s8 nav_replay_bits(nav_replay_t *r, u8 prn, const u8 *bits, u32 n_bits);
+s8 nav_replay_corrs(nav_replay_t *r, u8 n_sats, const u8 prns[],
+                    u32 n_corr, const s32 corrs[], u8 ms);
+double nav_replay_throughput(const nav_replay_t *r);
+
+#endif /* LIBSWIFTNAV_NAV_REPLAY_H */
@@ -15,8 +15,13 @@
 
 #include "common.h"
 
+/** Length of an unpacked C/A code including one chip of padding at each end,
+ * see ca_code_unpack(). */
+#define CA_CODE_UNPACKED_LEN 1025
+
 const u8* ca_code(u8 prn);
 s8 get_chip(u8* code, u32 chip_num);
+void ca_code_unpack(u8 prn, s8 code[CA_CODE_UNPACKED_LEN]);
 
 #endif /* LIBSWIFTNAV_PRNS_H */
 
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_QUEUE_H
+#define LIBSWIFTNAV_QUEUE_H
+
+#include "common.h"
+
+/** \addtogroup queue
+ * \{ */
+
+/** Size in bytes of one slot of an ::mpsc_queue_t holding elements of
+ * `elem_size` bytes, i.e. a sequence number followed by the element. */
+#define MPSC_QUEUE_SLOT_SIZE(elem_size) (8 + (((elem_size) + 7) & ~7u))
+
+/** Bounded single producer, single consumer lock-free queue of fixed size
+ * elements. The producer and consumer indices live on separate cache lines,
+ * each side keeping a cached copy of the other's index so it only touches
+ * the other line when the queue looks full or empty.
+ * Should be initialised with spsc_queue_init().
+ */
+typedef struct {
+  u8* buff;       /**< Element storage. */
+  u32 elem_size;  /**< Size of an element in bytes. */
+  u32 mask;       /**< Number of elements minus one. */
+  /** Index of the next element to push, written by the producer. */
+  u32 tail __attribute__((aligned(64)));
+  u32 head_cache; /**< Producer's copy of `head`. */
+  /** Index of the next element to pop, written by the consumer. */
+  u32 head __attribute__((aligned(64)));
+  u32 tail_cache; /**< Consumer's copy of `tail`. */
+} spsc_queue_t;
+
+/** Bounded multiple producer, single consumer lock-free queue of fixed size
+ * elements. Producers claim a slot with a compare and swap on `tail` and
+ * publish it through the slot's sequence number, so a slow producer never
+ * blocks the others.
+ * Should be initialised with mpsc_queue_init().
+ */
+typedef struct {
+  u8* buff;       /**< Slot storage, see MPSC_QUEUE_SLOT_SIZE(). */
+  u32 elem_size;  /**< Size of an element in bytes. */
+  u32 slot_size;  /**< Size of a slot in bytes. */
+  u32 mask;       /**< Number of slots minus one. */
+  /** Index of the next slot to claim, shared by the producers. */
+  u32 tail __attribute__((aligned(64)));
+  /** Index of the next slot to pop, owned by the consumer. */
+  u32 head __attribute__((aligned(64)));
+} mpsc_queue_t;
+
+/** \} */
+
+s8 spsc_queue_init(spsc_queue_t* q, void* buff, u32 elem_size, u32 n_elems);
+s8 spsc_queue_push(spsc_queue_t* q, const void* elem);
+s8 spsc_queue_pop(spsc_queue_t* q, void* elem);
+u32 spsc_queue_count(const spsc_queue_t* q);
+
+s8 mpsc_queue_init(mpsc_queue_t* q, void* buff, u32 elem_size, u32 n_elems);
+s8 mpsc_queue_push(mpsc_queue_t* q, const void* elem);
+s8 mpsc_queue_pop(mpsc_queue_t* q, void* elem);
+
+#endif /* LIBSWIFTNAV_QUEUE_H */
+
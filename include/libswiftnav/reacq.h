@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_REACQ_H
+#define LIBSWIFTNAV_REACQ_H
+
+#include "common.h"
+#include "track.h"
+
+/** \addtogroup reacq
+ * \{ */
+
+/** Spacing of the code phase taps searched by reacq_search(), in chips. */
+#define REACQ_TAP_SPACING 0.5
+
+/** Result of a reacquisition search. */
+typedef struct {
+  double code_phase;  /**< Code phase of the first sample in chips. */
+  double carr_freq;   /**< Carrier Doppler in Hz. */
+  double code_freq;   /**< Code phase rate offset from the nominal chipping
+                           rate in chips/s, as for aided_tl_init(). */
+  float snr;          /**< Peak power over the expected noise power of a
+                           cell. With noise alone each cell averages one. */
+} reacq_result_t;
+
+/** \} */
+
+void reacq_predict(const channel_measurement_t* meas, double carr_freq_rate,
+                   double t, double* code_phase, double* carr_freq);
+void reacq_window(double dt, double carr_freq_unc, double carr_rate_unc,
+                  double* code_width, double* carr_width);
+s8 reacq_search(const s8* samples, u32 n_samples, double fs, double if_freq,
+                u8 prn, double code_phase, double carr_freq,
+                double code_width, double carr_width, double carr_bin_width,
+                u8 n_periods, reacq_result_t* result);
+void reacq_tl_restore(aided_tl_state_t* s, const reacq_result_t* r);
+
+#endif /* LIBSWIFTNAV_REACQ_H */
+
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_RECEIVER_H
+#define LIBSWIFTNAV_RECEIVER_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "ephemeris.h"
+#include "nav_msg.h"
+#include "pvt.h"
+#include "queue.h"
+#include "samples.h"
+#include "track.h"
+#include "track_engine.h"
+
+/** \addtogroup receiver
+ * \{ */
+
+/** Maximum number of channels of a ::receiver_t. */
+#define RECEIVER_MAX_CHANNELS 32
+
+/** Maximum number of correlation threads of a ::receiver_t. */
+#define RECEIVER_MAX_CORR_THREADS 8
+
+/** Number of threads of a ::receiver_t besides the correlation threads,
+ * i.e. loop closure, navigation message decoding, measurement and PVT. */
+#define RECEIVER_N_STAGE_THREADS 4
+
+/** Length of the queues carrying per code period messages. */
+#define RECEIVER_QUEUE_LEN 256
+
+/** Length of the queue of ingested sample blocks. */
+#define RECEIVER_BLOCK_QUEUE_LEN 256
+
+/** Length of the ephemeris queue. */
+#define RECEIVER_EPH_QUEUE_LEN 16
+
+/** Length of the queue of measurement epochs waiting for a PVT solution. */
+#define RECEIVER_EPOCH_QUEUE_LEN 4
+
+/** Length of the queue of solutions waiting for receiver_get_fix(). */
+#define RECEIVER_FIX_QUEUE_LEN 16
+
+/** Correlations of one code period, sent from a correlation thread to loop
+ * closure. */
+typedef struct {
+  u8 channel;          /**< Channel index. */
+  u8 gen;              /**< Channel start count, see ::receiver_channel_t. */
+  u8 prn;              /**< Satellite PRN. */
+  bool first;          /**< First period since the channel was started. */
+  u32 n_samples;       /**< Number of samples in the period. */
+  u64 pos;             /**< Ring index of the end of the period. */
+  double code_phase;   /**< Code phase at `pos` in chips. */
+  float code_freq;     /**< Code NCO Doppler used for the period in Hz. */
+  float carr_freq;     /**< Carrier NCO Doppler used for the period in Hz. */
+  correlation_t cs[3]; /**< Early, prompt and late correlations. */
+} receiver_corr_msg_t;
+
+/** Updated NCO frequencies, sent from loop closure back to the correlation
+ * thread of a channel. */
+typedef struct {
+  u8 channel;          /**< Channel index. */
+  u8 gen;              /**< Channel start count. */
+  float code_freq;     /**< Code Doppler in Hz. */
+  float carr_freq;     /**< Carrier Doppler in Hz. */
+} receiver_nco_msg_t;
+
+/** Tracking state at the end of one code period, sent from loop closure to
+ * navigation message decoding, which fills in the time of week and passes
+ * it on to the measurement stage. */
+typedef struct {
+  u8 channel;                 /**< Channel index. */
+  u8 gen;                     /**< Channel start count. */
+  bool first;                 /**< First period since the channel was
+                                   started. */
+  bool locked;                /**< Pessimistic lock detector output. */
+  s32 I_P;                    /**< Prompt in-phase correlation. */
+  u64 pos;                    /**< Ring index of the end of the period. */
+  channel_measurement_t meas; /**< Measurement at `pos`. */
+} receiver_track_msg_t;
+
+/** Block of samples written by receiver_ingest(). */
+typedef struct {
+  u64 end;             /**< Ring index one past the last sample. */
+  double t;            /**< Monotonic clock time of the write in seconds. */
+} receiver_block_t;
+
+/** Navigation measurements of one epoch, sent from the measurement stage
+ * to PVT. */
+typedef struct {
+  double receiver_time;  /**< Epoch in seconds of receiver time. */
+  double t_ingest;       /**< Monotonic clock time at which the sample at
+                              the epoch was ingested, in seconds. */
+  u8 n;                  /**< Number of measurements. */
+  navigation_measurement_t nav_meas[RECEIVER_MAX_CHANNELS]; /**< Measurements. */
+} receiver_epoch_t;
+
+/** Position, velocity and time solution output by a ::receiver_t. */
+typedef struct {
+  gnss_solution soln;    /**< Solution. */
+  dops_t dops;           /**< Dilution of precision of the solution. */
+  double receiver_time;  /**< Epoch in seconds of receiver time, i.e. ring
+                              index divided by the sampling frequency. */
+  double latency;        /**< Time from ingesting the sample at the epoch
+                              to the solution in seconds. */
+} receiver_fix_t;
+
+/** Wake-up of a pipeline stage thread. A stage runs until it has nothing
+ * left to do and then sleeps until another thread bumps `ticket`. */
+typedef struct {
+  pthread_mutex_t lock;  /**< Protects the wait. */
+  pthread_cond_t cond;   /**< Signalled when `ticket` is bumped. */
+  u32 ticket;            /**< Bumped each time there is new work. */
+  bool sleeping;         /**< Stage is waiting on `cond`. */
+} receiver_stage_t;
+
+/** Channel control, shared by receiver_start_channel() and the
+ * correlation thread of the channel. */
+typedef struct {
+  u8 prn;              /**< Satellite PRN. */
+  u64 start_pos;       /**< Ring index of the first sample to track. */
+  double code_phase;   /**< Code phase at `start_pos` in chips. */
+  double carr_freq;    /**< Initial carrier Doppler in Hz. */
+  u8 gen;              /**< Incremented each time the channel is started,
+                            tagging the messages of that run. */
+  bool active;         /**< Channel is tracking. */
+  bool overrun;        /**< Channel was stopped because it fell more than a
+                            ring behind. */
+  u64 pos;             /**< Ring index of the next sample to correlate. */
+} receiver_channel_t;
+
+/** Correlator state of a channel, owned by its correlation thread. */
+typedef struct {
+  u8 gen;              /**< Start count of the current run. */
+  bool first;          /**< Next period is the first of the run. */
+  bool waiting;        /**< Waiting for the NCO update of the last period. */
+  u8 prn;              /**< Satellite PRN. */
+  const s8* code;      /**< Unpacked spreading code. */
+  u64 pos;             /**< Ring index of the next period. */
+  double code_phase;   /**< Code phase at `pos` in chips. */
+  double carr_phase;   /**< Carrier phase at `pos` in radians. */
+  float code_freq;     /**< Code Doppler in Hz. */
+  float carr_freq;     /**< Carrier Doppler in Hz. */
+} receiver_corr_state_t;
+
+/** Loop closure state of a channel, owned by the loop closure thread. */
+typedef struct {
+  u8 gen;                 /**< Start count of the current run. */
+  aided_tl_state_t tl;    /**< Tracking loop state. */
+  lock_detect_t ld;       /**< Lock detector state. */
+  cn0_est_state_t cn0_est; /**< \f$ C / N_0 \f$ estimator state. */
+  float cn0;              /**< Last \f$ C / N_0 \f$ estimate in dBHz. */
+  double carr_cycles;     /**< Accumulated carrier Doppler phase in
+                               cycles. */
+  u16 lock_counter;       /**< Incremented on each start or loss of lock. */
+} receiver_loop_state_t;
+
+/** Navigation message decoding state of a channel, owned by the decoding
+ * thread. */
+typedef struct {
+  u8 gen;              /**< Start count of the current run. */
+  nav_msg_t nav;       /**< Navigation message decoder state. */
+  ephemeris_t eph;     /**< Ephemeris being decoded. */
+  s32 TOW_ms;          /**< Time of week of the last period end, or
+                            `TOW_INVALID`. */
+} receiver_nav_state_t;
+
+/** Software receiver running sample ingest, correlation, loop closure,
+ * navigation message decoding, measurement and PVT as a pipeline of
+ * threads.
+ * Should be initialised with receiver_init().
+ */
+typedef struct {
+  sample_ring_t ring;            /**< Ingested samples. */
+  double fs;                     /**< Sampling frequency in Hz. */
+  double if_freq;                /**< Intermediate frequency in Hz. */
+  double epoch_period;           /**< Time between measurement epochs in
+                                      seconds. */
+  track_engine_params_t params;  /**< Loop parameters. */
+  u8 n_channels;                 /**< Number of channels. */
+  u8 n_corr_threads;             /**< Number of correlation threads. */
+  u8 n_threads;                  /**< Number of threads started. */
+  bool quit;                     /**< Set to stop the threads. */
+  u32 fixes_dropped;             /**< Solutions dropped because the fix
+                                      queue was full. */
+
+  /** Threads, the correlation threads followed by the stage threads. */
+  pthread_t threads[RECEIVER_MAX_CORR_THREADS + RECEIVER_N_STAGE_THREADS];
+  /** Held by each correlation thread while it updates its channels. */
+  pthread_mutex_t corr_lock[RECEIVER_MAX_CORR_THREADS];
+  pthread_mutex_t start_lock;    /**< Held while the threads are created. */
+
+  receiver_stage_t corr_stage[RECEIVER_MAX_CORR_THREADS]; /**< Wake-ups of
+                                      the correlation threads. */
+  receiver_stage_t loop_stage;   /**< Wake-up of loop closure. */
+  receiver_stage_t nav_stage;    /**< Wake-up of message decoding. */
+  receiver_stage_t meas_stage;   /**< Wake-up of the measurement stage. */
+  receiver_stage_t pvt_stage;    /**< Wake-up of PVT. */
+
+  /** Correlations, correlation threads to loop closure. */
+  mpsc_queue_t corr_q;
+  /** NCO updates, loop closure to each correlation thread. */
+  spsc_queue_t nco_q[RECEIVER_MAX_CORR_THREADS];
+  spsc_queue_t track_q;          /**< Loop closure to message decoding. */
+  spsc_queue_t meas_q;           /**< Message decoding to measurement. */
+  mpsc_queue_t eph_q;            /**< Ephemerides, from message decoding
+                                      and receiver_set_ephemeris(). */
+  spsc_queue_t block_q;          /**< Sample blocks, ingest to
+                                      measurement. */
+  spsc_queue_t epoch_q;          /**< Measurement to PVT. */
+  spsc_queue_t fix_q;            /**< PVT to receiver_get_fix(). */
+
+  receiver_channel_t channels[RECEIVER_MAX_CHANNELS]; /**< Channel
+                                      control. */
+  receiver_corr_state_t corr[RECEIVER_MAX_CHANNELS];  /**< Correlators. */
+  receiver_loop_state_t loop[RECEIVER_MAX_CHANNELS];  /**< Tracking
+                                      loops. */
+  receiver_nav_state_t nav[RECEIVER_MAX_CHANNELS];    /**< Message
+                                      decoders. */
+
+  /* Measurement stage state. */
+  receiver_track_msg_t last[RECEIVER_MAX_CHANNELS]; /**< Last tracking
+                                      state of each channel. */
+  ephemeris_t ephemerides[32];   /**< Ephemerides indexed by PRN. */
+  receiver_block_t block;        /**< Oldest block not before the next
+                                      epoch. */
+  bool have_block;               /**< `block` is valid. */
+  u32 epoch_count;               /**< Index of the next epoch. */
+  receiver_epoch_t epoch;        /**< Epoch being assembled. */
+
+  receiver_epoch_t pvt_epoch;    /**< Epoch being solved by PVT. */
+
+  /* Queue storage. */
+  u8 corr_q_buff[RECEIVER_QUEUE_LEN
+                 * MPSC_QUEUE_SLOT_SIZE(sizeof(receiver_corr_msg_t))]
+    __attribute__((aligned(8)));
+  receiver_nco_msg_t nco_q_buff[RECEIVER_MAX_CORR_THREADS]
+                               [RECEIVER_MAX_CHANNELS];
+  receiver_track_msg_t track_q_buff[RECEIVER_QUEUE_LEN];
+  receiver_track_msg_t meas_q_buff[RECEIVER_QUEUE_LEN];
+  u8 eph_q_buff[RECEIVER_EPH_QUEUE_LEN
+                * MPSC_QUEUE_SLOT_SIZE(sizeof(ephemeris_t))]
+    __attribute__((aligned(8)));
+  receiver_block_t block_q_buff[RECEIVER_BLOCK_QUEUE_LEN];
+  receiver_epoch_t epoch_q_buff[RECEIVER_EPOCH_QUEUE_LEN];
+  receiver_fix_t fix_q_buff[RECEIVER_FIX_QUEUE_LEN];
+} receiver_t;
+
+/** \} */
+
+s8 receiver_init(receiver_t* r, s8* ring_buff, u32 ring_size,
+                 double fs, double if_freq, u8 n_channels,
+                 u8 n_corr_threads, const track_engine_params_t* params,
+                 double epoch_period);
+void receiver_destroy(receiver_t* r);
+s8 receiver_start_channel(receiver_t* r, u8 channel, u8 prn, u64 pos,
+                          double code_phase, double carr_freq);
+void receiver_stop_channel(receiver_t* r, u8 channel);
+s8 receiver_set_ephemeris(receiver_t* r, const ephemeris_t* e);
+s8 receiver_ingest(receiver_t* r, const s8* samples, u32 n);
+s8 receiver_get_fix(receiver_t* r, receiver_fix_t* fix);
+
+#endif /* LIBSWIFTNAV_RECEIVER_H */
+
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_REPLICA_H
+#define LIBSWIFTNAV_REPLICA_H
+
+#include "common.h"
+
+/** \addtogroup replica
+ * \{ */
+
+/** Number of quantisation steps per sample for the initial code phase of a
+ * cached replica. */
+#define CODE_REPLICA_PHASE_STEPS 16
+
+/** Quantisation of the code phase increment per sample of a cached replica,
+ * in chips. */
+#define CODE_REPLICA_STEP_RES (1.0 / (1 << 20))
+
+/** Code replica resampled to the sample rate.
+ *
+ * Holds the Early, Prompt and Late chips for every sample of one code period
+ * so that the correlator can use plain vector loads instead of computing and
+ * gathering a chip index per sample and tap.
+ */
+typedef struct {
+  u8 prn;          /**< PRN number. */
+  s32 step_key;    /**< Quantised code phase increment per sample. */
+  u32 phase_key;   /**< Quantised initial code phase. */
+  u32 len;         /**< Number of samples in each replica, zero if unused. */
+  u32 last_used;   /**< Cache tick of the last lookup returning the replica. */
+  s8* E;           /**< Early replica, 32 byte aligned. */
+  s8* P;           /**< Prompt replica, 32 byte aligned. */
+  s8* L;           /**< Late replica, 32 byte aligned. */
+} code_replica_t;
+
+/** Fixed size cache of resampled code replicas.
+ * Should be initialised with code_replica_cache_init().
+ */
+typedef struct {
+  u16 n_slots;            /**< Number of replica slots. */
+  u32 max_len;            /**< Maximum replica length in samples. */
+  u32 tick;               /**< Lookup counter used for LRU eviction. */
+  u32 hits;               /**< Number of lookups served from the cache. */
+  u32 misses;             /**< Number of lookups that generated a replica. */
+  code_replica_t* slots;  /**< Replica slots. */
+  void* buff;             /**< Backing storage for the replicas. */
+} code_replica_cache_t;
+
+/** \} */
+
+const s8* ca_code_unpacked(u8 prn);
+
+s8 code_replica_cache_init(code_replica_cache_t* c, u16 n_slots, u32 max_len);
+void code_replica_cache_destroy(code_replica_cache_t* c);
+const code_replica_t* code_replica_get(code_replica_cache_t* c, u8 prn,
+                                       double code_phase, double code_step);
+
+#endif /* LIBSWIFTNAV_REPLICA_H */
+
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_RESAMPLE_H
+#define LIBSWIFTNAV_RESAMPLE_H
+
+#include "common.h"
+
+/** \addtogroup resample
+ * \{ */
+
+/** Filter taps per unit of decimation ratio `fs_in / fs_out`, enough for
+ * the stopband of the Blackman windowed prototype to be 50 dB down. */
+#define RESAMPLE_TAPS_PER_RATIO 24
+/** Largest decimation ratio `fs_in / fs_out` supported. */
+#define RESAMPLE_MAX_RATIO 8
+/** Largest number of taps of each polyphase filter branch. */
+#define RESAMPLE_MAX_TAPS (RESAMPLE_TAPS_PER_RATIO * RESAMPLE_MAX_RATIO)
+/** log2 of the number of polyphase filter branches. */
+#define RESAMPLE_PHASE_BITS 6
+/** Number of polyphase filter branches, i.e. fractional delay steps per
+ * input sample. */
+#define RESAMPLE_PHASES (1 << RESAMPLE_PHASE_BITS)
+/** Number of input samples buffered by the resampler at a time. */
+#define RESAMPLE_CHUNK_LEN 1024
+
+/** Streaming polyphase resampler state.
+ * Should be initialised with resampler_init().
+ */
+typedef struct {
+  /** Filter taps of each branch, Q14. */
+  s16 taps[RESAMPLE_PHASES][RESAMPLE_MAX_TAPS] __attribute__((aligned(32)));
+  /** Buffered input samples. */
+  s16 buff[RESAMPLE_MAX_TAPS - 1 + RESAMPLE_CHUNK_LEN]
+    __attribute__((aligned(32)));
+  u32 n_buff;   /**< Number of samples in `buff`. */
+  u64 step;     /**< Input samples per output sample, Q32.32. */
+  u64 t;        /**< Position of the next output in `buff`, Q32.32. */
+  u16 n_taps;   /**< Number of taps of each branch, a multiple of 8. */
+  u16 delay;    /**< Delay of the output in input samples, output sample
+                     `k` is the input signal interpolated at input sample
+                     `k * fs_in / fs_out + delay`. */
+  u8 shift;     /**< Right shift applied to the filter output. */
+} resampler_t;
+
+/** \} */
+
+s8 resampler_init(resampler_t* r, double fs_in, double fs_out, u8 gain_log2);
+u32 resampler_max_out(const resampler_t* r, u32 n_in);
+u32 resampler_process(resampler_t* r, const s8* in, u32 n_in, s8* out);
+
+#endif /* LIBSWIFTNAV_RESAMPLE_H */
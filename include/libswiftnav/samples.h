@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_SAMPLES_H
+#define LIBSWIFTNAV_SAMPLES_H
+
+#include "common.h"
+
+/** \addtogroup samples
+ * \{ */
+
+/** Sample formats delivered by RF front-ends.
+ *
+ * Packed formats are stored MSB first, i.e. the first sample of a byte is in
+ * its most significant bits.
+ */
+typedef enum {
+  SAMPLE_FMT_S8 = 0, /**< One signed byte per sample. */
+  SAMPLE_FMT_1BIT,   /**< 1-bit sign, 8 samples per byte, 0 is +1, 1 is -1. */
+  SAMPLE_FMT_2BIT,   /**< 2-bit sign/magnitude, 4 samples per byte, sign in
+                          the high bit. 00 is +1, 01 is +3, 10 is -1 and
+                          11 is -3. */
+} sample_fmt_t;
+
+/** Single producer ring buffer of `s8` samples.
+ *
+ * Samples are addressed by their absolute index in the stream, so a reader
+ * cursor is simply the index of the next sample it wants and never needs to
+ * be wrapped. Any number of readers may each keep their own cursor.
+ * Should be initialised with sample_ring_init().
+ */
+typedef struct {
+  s8* buff;           /**< Sample storage. */
+  u32 size;           /**< Number of samples in `buff`. */
+  u64 write_count;    /**< Total number of samples written. */
+  u64 reserve_count;  /**< Total number of samples written or being
+                           written, see sample_ring_reserve(). */
+} sample_ring_t;
+
+/** \} */
+
+u8 sample_fmt_bits(sample_fmt_t fmt);
+void samples_unpack(const u8* packed, sample_fmt_t fmt, u32 first, u32 n,
+                    s8* out);
+
+
+void sample_ring_init(sample_ring_t* ring, s8* buff, u32 size);
+void sample_ring_write(sample_ring_t* ring, const s8* samples, u32 n);
+void sample_ring_reserve(sample_ring_t* ring, u32 n);
+void sample_ring_commit(sample_ring_t* ring, u32 n);
+u64 sample_ring_head(const sample_ring_t* ring);
+bool sample_ring_overwritten(const sample_ring_t* ring, u64 pos);
+s8 sample_ring_segments(const sample_ring_t* ring, u64 pos, u32 n,
+                        const s8** seg0, u32* n0, const s8** seg1);
+
+#endif /* LIBSWIFTNAV_SAMPLES_H */
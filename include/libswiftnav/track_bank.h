@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_TRACK_BANK_H
+#define LIBSWIFTNAV_TRACK_BANK_H
+
+#include "common.h"
+#include "track.h"
+
+/** \addtogroup track_bank
+ * \{ */
+
+/** Largest number of channels updated together, the bank capacity is
+ * rounded up to a multiple of this. */
+#define TRACK_BANK_LANES 16
+
+/** Tracking bank update implementations, see track_bank_set_impl(). */
+typedef enum {
+  TRACK_BANK_IMPL_AUTO = -1, /**< Widest implementation supported by the
+                                  CPU. */
+  TRACK_BANK_IMPL_C = 0,     /**< Portable C implementation. */
+  TRACK_BANK_IMPL_SSE2,      /**< SSE2, 4 channels at a time. */
+  TRACK_BANK_IMPL_AVX2,      /**< AVX2, 8 channels at a time. */
+  TRACK_BANK_IMPL_AVX512,    /**< AVX-512F, 16 channels at a time. */
+} track_bank_impl_t;
+
+/** Tracking loop, lock detector and \f$ C / N_0 \f$ estimator state of
+ * many channels, stored as one array per field.
+ *
+ * Field `x` of channel `i` is `x[i]`. All float arrays are 64 byte aligned
+ * and padded to the bank capacity. The fields mirror those of
+ * ::aided_tl_state_t, ::lock_detect_t and ::cn0_est_state_t, use
+ * track_bank_set() and track_bank_get() to convert from and to them.
+ */
+typedef struct {
+  u32 n_channels;  /**< Number of channels. */
+  u32 capacity;    /**< Allocated channels, a multiple of
+                        `TRACK_BANK_LANES`. */
+
+  /* Aided tracking loop. */
+  float* carr_freq;          /**< Carrier frequency, the carrier loop
+                                  filter output. */
+  float* carr_b0;            /**< Carrier loop filter coefficient. */
+  float* carr_b1;            /**< Carrier loop filter coefficient. */
+  float* carr_aiding_igain;  /**< Carrier loop FLL aiding integral gain. */
+  float* carr_prev_error;    /**< Carrier loop previous error. */
+  float* code_freq;          /**< Code frequency. */
+  float* code_b0;            /**< Code loop filter coefficient. */
+  float* code_b1;            /**< Code loop filter coefficient. */
+  float* code_prev_error;    /**< Code loop previous error. */
+  float* code_y;             /**< Code loop filter output. */
+  float* prev_I;             /**< Previous prompt in-phase correlation. */
+  float* prev_Q;             /**< Previous prompt quadrature correlation. */
+  float* carr_to_code;       /**< Ratio of carrier to code frequencies, or
+                                  zero to disable carrier aiding. */
+
+  /* Lock detector. */
+  float* lock_k1i;           /**< In-phase LPF coefficient. */
+  float* lock_k1q;           /**< Quadrature LPF coefficient. */
+  float* lock_yi;            /**< In-phase LPF state. */
+  float* lock_yq;            /**< Quadrature LPF state. */
+  float* lock_k2;            /**< In-phase scale factor. */
+  u16* lock_lo;              /**< Optimistic count threshold. */
+  u16* lock_lp;              /**< Pessimistic count threshold. */
+  u16* lock_pcount1;         /**< Pessimistic counter. */
+  u16* lock_pcount2;         /**< Optimistic counter. */
+  u8* lock_outo;             /**< Optimistic lock indicator. */
+  u8* lock_outp;             /**< Pessimistic lock indicator. */
+
+  /* C/N0 estimator. */
+  float* cn0_log_bw;         /**< Noise bandwidth in dBHz. */
+  float* cn0_b;              /**< IIR filter coefficient. */
+  float* cn0_a;              /**< IIR filter coefficient. */
+  float* cn0_I_prev_abs;     /**< Abs. value of the previous in-phase
+                                  correlation. */
+  float* cn0_Q_prev_abs;     /**< Abs. value of the previous quadrature
+                                  correlation. */
+  float* cn0_nsr;            /**< Noise-to-signal ratio. */
+  float* cn0_xn;             /**< Last pre-filter sample. */
+  float* cn0;                /**< Last \f$ C / N_0 \f$ estimate in dBHz. */
+
+  /* Correlations of the current update. */
+  float* I_E;                /**< Early in-phase correlation. */
+  float* Q_E;                /**< Early quadrature correlation. */
+  float* I_P;                /**< Prompt in-phase correlation. */
+  float* Q_P;                /**< Prompt quadrature correlation. */
+  float* I_L;                /**< Late in-phase correlation. */
+  float* Q_L;                /**< Late quadrature correlation. */
+
+  void* buff;                /**< Backing storage. */
+} track_bank_t;
+
+/** \} */
+
+s8 track_bank_set_impl(track_bank_impl_t impl);
+track_bank_impl_t track_bank_get_impl(void);
+s8 track_bank_init(track_bank_t* b, u32 n_channels);
+void track_bank_destroy(track_bank_t* b);
+void track_bank_set(track_bank_t* b, u32 i, const aided_tl_state_t* tl,
+                    const lock_detect_t* ld, const cn0_est_state_t* cn0);
+void track_bank_get(const track_bank_t* b, u32 i, aided_tl_state_t* tl,
+                    lock_detect_t* ld, cn0_est_state_t* cn0);
+void track_bank_lock_update(track_bank_t* b, float DT);
+void track_bank_cn0_update(track_bank_t* b);
+void track_bank_update(track_bank_t* b, const correlation_t cs[][3],
+                       float DT);
+float track_bank_atan(float x);
+float track_bank_log10(float x);
+
+#endif /* LIBSWIFTNAV_TRACK_BANK_H */
+
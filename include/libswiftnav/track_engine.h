@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_TRACK_ENGINE_H
+#define LIBSWIFTNAV_TRACK_ENGINE_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "nav_msg.h"
+#include "samples.h"
+#include "track.h"
+
+/** \addtogroup track_engine
+ * \{ */
+
+/** Maximum number of channels of a ::track_engine_t. */
+#define TRACK_ENGINE_MAX_CHANNELS 32
+
+/** Maximum number of worker threads of a ::track_engine_t. */
+#define TRACK_ENGINE_MAX_THREADS 16
+
+/** Tracking loop, lock detector and \f$ C / N_0 \f$ estimator parameters
+ * of a ::track_engine_t. See aided_tl_init(), lock_detect_init() and
+ * cn0_est_init() for their meaning. */
+typedef struct {
+  float code_bw;        /**< Code loop noise bandwidth in Hz. */
+  float code_zeta;      /**< Code loop damping ratio. */
+  float code_k;         /**< Code loop gain. */
+  float carr_bw;        /**< Carrier loop noise bandwidth in Hz. */
+  float carr_zeta;      /**< Carrier loop damping ratio. */
+  float carr_k;         /**< Carrier loop gain. */
+  float carr_fll_gain;  /**< FLL aiding integral gain, zero to disable. */
+  float lock_k1;        /**< Lock detector LPF coefficient. */
+  float lock_k2;        /**< Lock detector I scale factor. */
+  u16 lock_lp;          /**< Lock detector pessimistic count threshold. */
+  u16 lock_lo;          /**< Lock detector optimistic count threshold. */
+  float cn0_init;       /**< Initial \f$ C / N_0 \f$ estimate in dBHz. */
+  float cn0_cutoff;     /**< \f$ C / N_0 \f$ filter cutoff in Hz. */
+} track_engine_params_t;
+
+/** State of one channel of a ::track_engine_t.
+ *
+ * Apart from the snapshot, which is read with track_engine_measure(), the
+ * fields are owned by the worker thread the channel is assigned to.
+ */
+typedef struct {
+  u32 snap_seq;                  /**< Snapshot sequence count, odd while
+                                      the snapshot is being written. */
+  channel_measurement_t snap;    /**< Measurement at the last code period
+                                      boundary. */
+  bool snap_locked;              /**< Pessimistic lock at the snapshot. */
+
+  bool active;                   /**< Channel is tracking. */
+  bool overrun;                  /**< Channel was stopped because it fell
+                                      more than a ring behind. */
+  u8 prn;                        /**< Satellite PRN. */
+  const s8* code;                /**< Unpacked spreading code. */
+  u64 pos;                       /**< Ring index of the next code period. */
+  double code_phase;             /**< Code phase at `pos` in chips. */
+  double carr_phase;             /**< Local carrier phase at `pos` in
+                                      radians. */
+  double carr_cycles;            /**< Accumulated carrier Doppler phase in
+                                      cycles. */
+  aided_tl_state_t tl;           /**< Tracking loop state. */
+  lock_detect_t ld;              /**< Lock detector state. */
+  cn0_est_state_t cn0_est;       /**< \f$ C / N_0 \f$ estimator state. */
+  float cn0;                     /**< Last \f$ C / N_0 \f$ estimate in
+                                      dBHz. */
+  nav_msg_t nav;                 /**< Navigation message decoder state. */
+  s32 TOW_ms;                    /**< Time of week of the code period
+                                      boundary at `pos`, or `TOW_INVALID`. */
+  u16 lock_counter;              /**< Incremented on each loss of lock. */
+  u32 n_periods;                 /**< Code periods tracked. */
+} track_engine_channel_t;
+
+/** Tracking engine, running the tracking channels of a sample ring buffer
+ * on a set of worker threads.
+ * Should be initialised with track_engine_init().
+ */
+typedef struct {
+  const sample_ring_t* ring;     /**< Sample ring buffer. */
+  double fs;                     /**< Sampling frequency in Hz. */
+  double if_freq;                /**< Intermediate frequency in Hz. */
+  track_engine_params_t params;  /**< Loop parameters. */
+  u8 n_channels;                 /**< Number of channels. */
+  u8 n_threads;                  /**< Number of worker threads. */
+  /** Channel states, channel `i` runs on worker `i % n_threads`. */
+  track_engine_channel_t channels[TRACK_ENGINE_MAX_CHANNELS];
+  pthread_t threads[TRACK_ENGINE_MAX_THREADS];  /**< Worker threads. */
+  /** Held by each worker while it updates its channels. */
+  pthread_mutex_t worker_lock[TRACK_ENGINE_MAX_THREADS];
+  pthread_mutex_t lock;          /**< Protects the fields below. */
+  pthread_cond_t wake;           /**< Signalled by track_engine_notify(). */
+  u32 notify_count;              /**< Number of notifications. */
+  bool quit;                     /**< Set to stop the workers. */
+} track_engine_t;
+
+/** \} */
+
+void track_engine_default_params(track_engine_params_t* params);
+s8 track_engine_init(track_engine_t* e, const sample_ring_t* ring,
+                     double fs, double if_freq, u8 n_channels,
+                     u8 n_threads, const track_engine_params_t* params);
+void track_engine_destroy(track_engine_t* e);
+s8 track_engine_start_channel(track_engine_t* e, u8 channel, u8 prn,
+                              u64 pos, double code_phase, double carr_freq);
+void track_engine_stop_channel(track_engine_t* e, u8 channel);
+void track_engine_notify(track_engine_t* e);
+u64 track_engine_tail(track_engine_t* e);
+u8 track_engine_measure(track_engine_t* e, double t,
+                        channel_measurement_t meas[]);
+
+#endif /* LIBSWIFTNAV_TRACK_ENGINE_H */
+
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef LIBSWIFTNAV_TRACK_FIXED_H
+#define LIBSWIFTNAV_TRACK_FIXED_H
+
+#include "common.h"
+
+/** \addtogroup track_fixed
+ * \{ */
+
+/** One in Q15, the format of the discriminator outputs. */
+#define Q15_ONE (1 << 15)
+
+/** One in Q31, the format of the carrier to code aiding ratio. */
+#define Q31_ONE ((s64)1 << 31)
+
+/** Fractional bits of the code and carrier frequencies. Define before
+ * building to trade range for resolution, the default of 16 covers
+ * \f$ \pm 32 \f$ kHz in steps of 1.5e-5 Hz. */
+#ifndef TRACK_FIXED_FREQ_BITS
+#define TRACK_FIXED_FREQ_BITS 16
+#endif
+
+/** One in the frequency format. */
+#define TRACK_FIXED_FREQ_ONE (1 << TRACK_FIXED_FREQ_BITS)
+
+/** Fractional bits of the loop filter gains. The integral gain of a loop,
+ * \f$ b_0 + b_1 \f$, is a small difference of large coefficients, so the
+ * coefficients need finer steps than the frequencies. The default of 20
+ * covers gains up to 2048, i.e. loop bandwidths up to several hundred Hz. */
+#ifndef TRACK_FIXED_GAIN_BITS
+#define TRACK_FIXED_GAIN_BITS 20
+#endif
+
+/** One in the gain format. */
+#define TRACK_FIXED_GAIN_ONE (1 << TRACK_FIXED_GAIN_BITS)
+
+/** Integer complex valued correlation, as read from a hardware
+ * correlator. */
+typedef struct {
+  s32 I; /**< In-phase correlation. */
+  s32 Q; /**< Quadrature correlation. */
+} correlation_q_t;
+
+/** Fixed-point state of the simple loop filter, see ::simple_lf_state_t.
+ * Should be initialised with simple_lf_init_q().
+ */
+typedef struct {
+  s32 b0;         /**< Filter coefficient, gain format. */
+  s32 b1;         /**< Filter coefficient, gain format. */
+  s16 prev_error; /**< Previous error, Q15. */
+  s64 acc;        /**< Output variable, unrounded. */
+  s32 y;          /**< Output variable. */
+} simple_lf_state_q_t;
+
+/** Fixed-point state of the I-aided loop filter, see ::aided_lf_state_t.
+ * Should be initialised with aided_lf_init_q().
+ */
+typedef struct {
+  s32 b0;            /**< Filter coefficient, gain format. */
+  s32 b1;            /**< Filter coefficient, gain format. */
+  s32 aiding_igain;  /**< Aiding integral gain, gain format. */
+  s16 prev_error;    /**< Previous error, Q15. */
+  s64 acc;           /**< Output variable, unrounded. */
+  s32 y;             /**< Output variable. */
+} aided_lf_state_q_t;
+
+/** Fixed-point state of an aided tracking loop, see ::aided_tl_state_t.
+ * Should be initialised with aided_tl_init_q().
+ */
+typedef struct {
+  s32 carr_freq;                 /**< Carrier frequency. */
+  aided_lf_state_q_t carr_filt;  /**< Carrier loop filter state. */
+  s32 code_freq;                 /**< Code frequency. */
+  simple_lf_state_q_t code_filt; /**< Code loop filter state. */
+  s32 prev_I, prev_Q;            /**< Previous prompt correlation, for
+                                      the FLL. */
+  s32 code_per_carr;             /**< Ratio of code to carrier frequencies
+                                      in Q31, or zero to disable carrier
+                                      aiding. */
+} aided_tl_state_q_t;
+
+/** Fixed-point state of a simple tracking loop, see ::simple_tl_state_t.
+ * Should be initialised with simple_tl_init_q().
+ */
+typedef struct {
+  s32 code_freq;                 /**< Code phase rate (i.e. frequency). */
+  s32 carr_freq;                 /**< Carrier frequency. */
+  simple_lf_state_q_t code_filt; /**< Code loop filter state. */
+  simple_lf_state_q_t carr_filt; /**< Carrier loop filter state. */
+} simple_tl_state_q_t;
+
+/** \} */
+
+s32 float_to_freq_q(float x);
+float freq_q_to_float(s32 x);
+s32 float_to_gain_q(float x);
+
+s16 atan2_q15(s64 y, s64 x);
+
+void calc_loop_gains_q(float bw, float zeta, float k, float loop_freq,
+                       s32 *b0, s32 *b1);
+s16 costas_discriminator_q15(s32 I, s32 Q);
+s16 frequency_discriminator_q15(s32 I, s32 Q, s32 prev_I, s32 prev_Q);
+s16 dll_discriminator_q15(const correlation_q_t cs[3]);
+
+void simple_lf_init_q(simple_lf_state_q_t *s, s32 y0, s32 b0, s32 b1);
+s32 simple_lf_update_q(simple_lf_state_q_t *s, s16 error);
+void aided_lf_init_q(aided_lf_state_q_t *s, s32 y0, s32 b0, s32 b1,
+                     s32 aiding_igain);
+s32 aided_lf_update_q(aided_lf_state_q_t *s, s16 p_i_error,
+                      s16 aiding_error);
+
+void simple_tl_init_q(simple_tl_state_q_t *s, float loop_freq,
+                      float code_freq, float code_bw,
+                      float code_zeta, float code_k,
+                      float carr_freq, float carr_bw,
+                      float carr_zeta, float carr_k);
+void simple_tl_update_q(simple_tl_state_q_t *s, const correlation_q_t cs[3]);
+
+void aided_tl_init_q(aided_tl_state_q_t *s, float loop_freq,
+                     float code_freq,
+                     float code_bw, float code_zeta, float code_k,
+                     float carr_to_code,
+                     float carr_freq,
+                     float carr_bw, float carr_zeta, float carr_k,
+                     float carr_freq_b1);
+void aided_tl_update_q(aided_tl_state_q_t *s, const correlation_q_t cs[3]);
+
+#endif /* LIBSWIFTNAV_TRACK_FIXED_H */
+
@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq.h"
+#include "constants.h"
+#include "coord_system.h"
+#include "linear_algebra.h"
+#include "prns.h"
+
+/** \defgroup acq Acquisition
+ * Parallel code phase search acquisition using FFTs.
+ *
+ * One code period of samples is resampled by nearest neighbour to a power of
+ * two length, mixed down to baseband for a Doppler bin and transformed. The
+ * product with the conjugate code spectrum is transformed back, giving the
+ * correlation power at every code phase of that Doppler bin at once.
+ *
+ * The spectrum of the mixed down samples does not depend on the PRN and the
+ * code spectra do not depend on the samples, so searches over many PRNs can
+ * share both by using acq_signal_spectrum(), acq_code_spectrum() and
+ * acq_correlate() directly rather than acq_search().
+ *
+ * Mixing down by a further whole number of FFT bins, i.e. multiples of one
+ * over the code period, only rotates the spectrum. The spectrum of such a
+ * Doppler bin is obtained from another with acq_signal_spectrum_shift()
+ * rather than a forward FFT, see acq_spectrum_shift_bins().
+ * \{ */
+
+/** Initialise an acquisition plan.
+ *
+ * Remember to free the plan with acq_plan_destroy().
+ *
+ * \param plan    Plan to initialise.
+ * \param fs      Sample rate in Hz.
+ * \param if_freq Intermediate frequency in Hz.
+ * \return 0 on success, -1 on a malloc() failure.
+ */
+s8 acq_plan_init(acq_plan_t* plan, double fs, double if_freq)
+{
+  plan->fs = fs;
+  plan->if_freq = if_freq;
+  plan->n_samples = (u32)lround(fs * 1023 / GPS_CA_CHIPPING_RATE);
+
+  plan->n_fft = 2;
+  while (plan->n_fft < plan->n_samples)
+    plan->n_fft *= 2;
+
+  memset(plan->code_spectra, 0, sizeof(plan->code_spectra));
+  plan->sample_index = malloc(plan->n_fft * sizeof(u32));
+  if (!plan->sample_index)
+    return -1;
+  if (fft_plan_init(&plan->fft, plan->n_fft)) {
+    free(plan->sample_index);
+    plan->sample_index = 0;
+    return -1;
+  }
+
+  for (u32 k = 0; k < plan->n_fft; k++)
+    plan->sample_index[k] = (u32)(((u64)k * plan->n_samples) / plan->n_fft);
+
+  return 0;
+}
+
+/** Free the tables held by an acquisition plan.
+ *
+ * \param plan Plan to destroy.
+ */
+void acq_plan_destroy(acq_plan_t* plan)
+{
+  free(plan->sample_index);
+  plan->sample_index = 0;
+  fft_plan_destroy(&plan->fft);
+  for (u8 prn = 0; prn < MAX_SATS; prn++) {
+    free(plan->code_spectra[prn]);
+    plan->code_spectra[prn] = 0;
+  }
+}
+
+/** Number of Doppler bins searched between two frequencies.
+ *
+ * \param cf_min       Lowest Doppler in Hz.
+ * \param cf_max       Highest Doppler in Hz.
+ * \param cf_bin_width Doppler bin spacing in Hz.
+ * \return Number of bins, bin `i` is centred on `cf_min + i * cf_bin_width`.
+ */
+u32 acq_n_bins(float cf_min, float cf_max, float cf_bin_width)
+{
+  return (u32)floor((cf_max - cf_min) / cf_bin_width + 0.5) + 1;
+}
+
+/** Code phase of the first sample corresponding to a correlation index.
+ *
+ * \param plan  Acquisition plan.
+ * \param index Index into the output of acq_correlate().
+ * \return Code phase in chips.
+ */
+float acq_index_to_cp(const acq_plan_t* plan, u32 index)
+{
+  return (float)((plan->n_fft - index) % plan->n_fft) * 1023.0
+         / plan->n_fft;
+}
+
+/** Conjugate spectrum of the C/A code sampled at `plan->n_fft` points per
+ * code period.
+ *
+ * \param plan Acquisition plan.
+ * \param prn  PRN number.
+ * \param out  Output spectrum, `plan->n_fft` values.
+ */
+void acq_code_spectrum(const acq_plan_t* plan, u8 prn, fft_cpx_t* out)
+{
+  u8* code = (u8*)ca_code(prn);
+
+  for (u32 k = 0; k < plan->n_fft; k++) {
+    out[k].re = get_chip(code, (u32)(((u64)k * 1023) / plan->n_fft));
+    out[k].im = 0;
+  }
+
+  fft_forward(&plan->fft, out);
+
+  for (u32 k = 0; k < plan->n_fft; k++)
+    out[k].im = -out[k].im;
+}
+
+/* Align a code spectrum allocation to 32 bytes. */
+static const fft_cpx_t* code_spectrum_align(void* raw)
+{
+  return (const fft_cpx_t*)(((uintptr_t)raw + 31) & ~(uintptr_t)31);
+}
+
+/** Conjugate code spectrum of a PRN from the plan's cache.
+ *
+ * As acq_code_spectrum(), but the spectrum is only computed on the first
+ * call for each PRN and then kept with the plan until acq_plan_destroy().
+ * The code spectra depend only on the FFT length, so a plan's cache stays
+ * valid for every search made with it. It is safe to call this function
+ * concurrently from several threads, if two threads race to fill the same
+ * entry one of the copies is discarded.
+ *
+ * \param plan Acquisition plan.
+ * \param prn  PRN number.
+ * \return Pointer to `plan->n_fft` values, 32 byte aligned, or NULL on a
+ *         malloc() failure.
+ */
+const fft_cpx_t* acq_code_spectrum_cached(const acq_plan_t* plan, u8 prn)
+{
+  /* The cache is not part of the plan's logical state. */
+  void** entry = &((acq_plan_t*)plan)->code_spectra[prn];
+
+  void* raw = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+  if (raw)
+    return code_spectrum_align(raw);
+
+  raw = malloc(plan->n_fft * sizeof(fft_cpx_t) + 31);
+  if (!raw)
+    return 0;
+  acq_code_spectrum(plan, prn, (fft_cpx_t*)code_spectrum_align(raw));
+
+  void* expected = 0;
+  if (!__atomic_compare_exchange_n(entry, &expected, raw, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    free(raw);
+    raw = expected;
+  }
+  return code_spectrum_align(raw);
+}
+
+/** Spectrum of one code period of samples mixed down to baseband.
+ *
+ * \param plan    Acquisition plan.
+ * \param samples Real IF samples, at least `plan->n_samples`.
+ * \param cf      Carrier Doppler to mix down with, in Hz.
+ * \param out     Output spectrum, `plan->n_fft` values.
+ */
+void acq_signal_spectrum(const acq_plan_t* plan, const s8* samples, float cf,
+                         fft_cpx_t* out)
+{
+  double carr_step = 2*M_PI*(plan->if_freq + cf) / plan->fs;
+
+  for (u32 k = 0; k < plan->n_fft; k++) {
+    u32 i = plan->sample_index[k];
+    double phase = carr_step * i;
+    out[k].re = samples[i] * cos(phase);
+    out[k].im = -samples[i] * sin(phase);
+  }
+
+  fft_forward(&plan->fft, out);
+}
+
+/** Largest Doppler error in Hz accepted by acq_spectrum_shift_bins(). Over
+ * a 1 ms code period the correlation loss is then below 1e-4 dB. */
+#define ACQ_SHIFT_TOL_HZ 1.0
+
+/** Whether the spectrum of one Doppler bin is a rotation of another's.
+ *
+ * The spectra of two Doppler bins a whole number of FFT bins apart, i.e.
+ * multiples of `plan->fs / plan->n_samples`, differ only by a circular
+ * shift. As the FFT points are nearest neighbour samples the carrier phase
+ * of the shifted spectrum is off by at most `2 pi (cf_to - cf_from) / fs`,
+ * which does not affect the correlation power.
+ *
+ * \param plan    Acquisition plan.
+ * \param cf_from Doppler of the spectrum to shift in Hz.
+ * \param cf_to   Doppler wanted in Hz.
+ * \param shift   Output number of FFT bins to shift by, for
+ *                acq_signal_spectrum_shift().
+ * \return true if `cf_to` is within `ACQ_SHIFT_TOL_HZ` of a whole number of
+ *         FFT bins from `cf_from`, false otherwise.
+ */
+bool acq_spectrum_shift_bins(const acq_plan_t* plan, float cf_from,
+                             float cf_to, s32* shift)
+{
+  double bin_hz = plan->fs / plan->n_samples;
+  double d = (double)cf_to - cf_from;
+  double m = round(d / bin_hz);
+
+  if (fabs(d - m*bin_hz) > ACQ_SHIFT_TOL_HZ || fabs(m) >= plan->n_fft)
+    return false;
+  *shift = (s32)m;
+  return true;
+}
+
+/** Spectrum of a Doppler bin a whole number of FFT bins from another.
+ *
+ * Equivalent to acq_signal_spectrum() at `shift` FFT bins above the Doppler
+ * `signal` was computed for, see acq_spectrum_shift_bins(), for the cost of
+ * a copy rather than a forward FFT.
+ *
+ * \param plan   Acquisition plan.
+ * \param signal Signal spectrum from acq_signal_spectrum().
+ * \param shift  Number of FFT bins to shift by, may be negative.
+ * \param out    Output spectrum, `plan->n_fft` values. Must not overlap
+ *               `signal`.
+ */
+void acq_signal_spectrum_shift(const acq_plan_t* plan,
+                               const fft_cpx_t* signal, s32 shift,
+                               fft_cpx_t* out)
+{
+  u32 n = plan->n_fft;
+  u32 m = (u32)(((s64)shift % (s64)n + n) % n);
+
+  /* Mixing down by m more bins moves bin k + m to bin k. */
+  memcpy(out, &signal[m], (n - m) * sizeof(fft_cpx_t));
+  memcpy(&out[n - m], signal, m * sizeof(fft_cpx_t));
+}
+
+/** Correlation power at every code phase of one Doppler bin.
+ *
+ * \param plan   Acquisition plan.
+ * \param signal Signal spectrum from acq_signal_spectrum().
+ * \param code   Code spectrum from acq_code_spectrum().
+ * \param work   Scratch space, `plan->n_fft` values. May be `signal`.
+ * \param power  Output correlation power, `plan->n_fft` values. Index `i`
+ *               corresponds to the code phase given by acq_index_to_cp().
+ */
+void acq_correlate(const acq_plan_t* plan, const fft_cpx_t* signal,
+                   const fft_cpx_t* code, fft_cpx_t* work, float* power)
+{
+  for (u32 k = 0; k < plan->n_fft; k++) {
+    float re = signal[k].re*code[k].re - signal[k].im*code[k].im;
+    float im = signal[k].re*code[k].im + signal[k].im*code[k].re;
+    work[k].re = re;
+    work[k].im = im;
+  }
+
+  fft_inverse(&plan->fft, work);
+
+  for (u32 k = 0; k < plan->n_fft; k++)
+    power[k] = work[k].re*work[k].re + work[k].im*work[k].im;
+}
+
+/** Search all code phases and a range of Doppler bins for one PRN.
+ *
+ * \param plan         Acquisition plan.
+ * \param samples      Real IF samples, at least `plan->n_samples`.
+ * \param prn          PRN number.
+ * \param cf_min       Lowest Doppler to search in Hz.
+ * \param cf_max       Highest Doppler to search in Hz.
+ * \param cf_bin_width Doppler bin spacing in Hz.
+ * \param grid         Output correlation power of the whole search grid, as
+ *                     `acq_n_bins()` rows of `plan->n_fft` code phases. May
+ *                     be NULL.
+ * \param result       Output location of the correlation peak.
+ * \return 0 on success, -1 on a malloc() failure.
+ */
+s8 acq_search(const acq_plan_t* plan, const s8* samples, u8 prn,
+              float cf_min, float cf_max, float cf_bin_width,
+              float* grid, acq_result_t* result)
+{
+  u32 n = plan->n_fft;
+  const fft_cpx_t* code = acq_code_spectrum_cached(plan, prn);
+  fft_cpx_t* signal = malloc(n * sizeof(fft_cpx_t));
+  fft_cpx_t* work = malloc(n * sizeof(fft_cpx_t));
+  float* power = malloc(n * sizeof(float));
+
+  u32 n_bins = acq_n_bins(cf_min, cf_max, cf_bin_width);
+  u8* done = calloc(n_bins, 1);
+
+  if (code && signal && work && power && done) {
+    float best = -1;
+    double sum = 0;
+
+    /* Compute one spectrum for each set of bins a whole number of FFT bins
+     * apart and shift it for the others. */
+    for (u32 b0 = 0; b0 < n_bins; b0++) {
+      if (done[b0])
+        continue;
+      float cf0 = cf_min + b0*cf_bin_width;
+      acq_signal_spectrum(plan, samples, cf0, signal);
+
+      for (u32 b = b0; b < n_bins; b++) {
+        float cf = cf_min + b*cf_bin_width;
+        s32 shift;
+        if (done[b] || !acq_spectrum_shift_bins(plan, cf0, cf, &shift))
+          continue;
+        done[b] = 1;
+        acq_signal_spectrum_shift(plan, signal, shift, work);
+        acq_correlate(plan, work, code, work, power);
+
+        for (u32 k = 0; k < n; k++) {
+          sum += power[k];
+          if (power[k] > best) {
+            best = power[k];
+            result->cp = acq_index_to_cp(plan, k);
+            result->cf = cf;
+          }
+        }
+        if (grid)
+          memcpy(&grid[b*n], power, n * sizeof(float));
+      }
+    }
+
+    result->snr = best / (sum / ((double)n_bins * n));
+  }
+
+  s8 ret = (code && signal && work && power && done) ? 0 : -1;
+  free(signal);
+  free(work);
+  free(power);
+  free(done);
+  return ret;
+}
+
+/* Carrier Doppler of a satellite seen from `ref` and its sensitivity to an
+ * error in `ref`, in Hz and Hz/m. */
+static void almanac_doppler(const almanac_t* alm, double t, s16 week,
+                            const double ref[3], double* el, double* cf,
+                            double* dcf_dpos)
+{
+  double pos[3], vel[3], los[3], az;
+
+  calc_sat_state_almanac(alm, t, week, pos, vel);
+  wgsecef2azel(pos, ref, &az, el);
+
+  vector_subtract(3, pos, ref, los);
+  double range = vector_norm(3, los);
+  double range_rate = vector_dot(3, los, vel) / range;
+
+  /* A receding satellite has a negative Doppler. Note this is the opposite
+   * sign to calc_sat_doppler_almanac(). */
+  *cf = -GPS_L1_HZ * range_rate / GPS_C;
+
+  /* Moving `ref` only changes the range rate through the direction of the
+   * line of sight, by the velocity across it over the range per metre. */
+  double v_sq = vector_dot(3, vel, vel);
+  double v_across = sqrt(MAX(v_sq - range_rate*range_rate, 0));
+  *dcf_dpos = GPS_L1_HZ * v_across / (GPS_C * range);
+}
+
+/** Predict the visible satellites and their Doppler search windows.
+ *
+ * Uses the almanac and an approximate receiver position and time to narrow
+ * the acquisition search space for a warm start. A satellite is a candidate
+ * if it is valid, healthy and above `elev_mask` at any time within
+ * `t_unc` of `t`, with the mask lowered by the elevation error `pos_unc`
+ * could cause. Its Doppler window covers the predicted Doppler over the
+ * same times, widened by the effect of `pos_unc` and by `cf_unc`, which
+ * should cover the receiver clock drift and velocity.
+ *
+ * Candidates are returned highest elevation first.
+ *
+ * \param alm       Almanacs, one per satellite.
+ * \param n_alm     Number of almanacs.
+ * \param t         Approximate GPS time of week in seconds.
+ * \param week      GPS week number modulo 1024 or -1, as for
+ *                  calc_sat_state_almanac().
+ * \param ref       Approximate receiver position in ECEF coordinates, in
+ *                  meters.
+ * \param pos_unc   Receiver position uncertainty in meters.
+ * \param t_unc     Time uncertainty in seconds.
+ * \param cf_unc    Additional Doppler uncertainty in Hz.
+ * \param elev_mask Elevation mask in radians.
+ * \param cands     Output candidates, must have space for `n_alm` entries.
+ * \return Number of candidates.
+ */
+u8 acq_almanac_candidates(const almanac_t alm[], u8 n_alm, double t,
+                          s16 week, const double ref[3], double pos_unc,
+                          double t_unc, float cf_unc, float elev_mask,
+                          acq_candidate_t cands[])
+{
+  /* Elevation changes by about one radian per earth radius moved. */
+  double mask = elev_mask - pos_unc / WGS84_A;
+  u8 n = 0;
+
+  for (u8 i = 0; i < n_alm; i++) {
+    if (!alm[i].valid || !alm[i].healthy)
+      continue;
+
+    double el, cf, dcf_dpos;
+    almanac_doppler(&alm[i], t, week, ref, &el, &cf, &dcf_dpos);
+    double el_max = el, cf_lo = cf, cf_hi = cf;
+
+    /* Doppler changes by less than 1 Hz/s, so is close enough to monotonic
+     * over the time uncertainty to only check its ends. */
+    for (s8 side = -1; t_unc > 0 && side <= 1; side += 2) {
+      double el_t, cf_t, dcf_t;
+      almanac_doppler(&alm[i], t + side*t_unc, week, ref,
+                      &el_t, &cf_t, &dcf_t);
+      el_max = MAX(el_max, el_t);
+      cf_lo = MIN(cf_lo, cf_t);
+      cf_hi = MAX(cf_hi, cf_t);
+      dcf_dpos = MAX(dcf_dpos, dcf_t);
+    }
+    if (el_max < mask)
+      continue;
+
+    double margin = dcf_dpos * pos_unc + cf_unc;
+    acq_candidate_t c = {
+      .prn = alm[i].prn,
+      .el = el,
+      .cf = cf,
+      .cf_min = cf_lo - margin,
+      .cf_max = cf_hi + margin,
+    };
+
+    /* Insertion sort by elevation. */
+    u8 j = n++;
+    for (; j > 0 && cands[j-1].el < c.el; j--)
+      cands[j] = cands[j-1];
+    cands[j] = c;
+  }
+
+  return n;
+}
+
+/** \} */
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq_sched.h"
+
+/** \defgroup acq_sched Acquisition Scheduler
+ * Multi-threaded acquisition of many PRNs over many Doppler bins.
+ *
+ * The search is split into one work unit per PRN and Doppler bin and run on
+ * a pool of worker threads. Each worker starts with an equal contiguous
+ * share of the units and when it runs out steals half of the remaining
+ * units of another worker, so the load stays balanced even when some PRNs
+ * stop early.
+ *
+ * Only available when the library is built with pthreads.
+ * \{ */
+
+#define QUEUE_PACK(b, e) (((u64)(b) << 32) | (e))
+#define QUEUE_BEGIN(r) ((u32)((r) >> 32))
+#define QUEUE_END(r) ((u32)(r))
+/** Returned by the queue functions when there is no work left. */
+#define NO_UNIT 0xFFFFFFFF
+
+/* Take the next unit from the front of a worker's own queue. */
+static u32 queue_pop(acq_pool_queue_t* q)
+{
+  u64 r = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+  while (QUEUE_BEGIN(r) < QUEUE_END(r)) {
+    if (__atomic_compare_exchange_n(&q->range, &r,
+                                    QUEUE_PACK(QUEUE_BEGIN(r) + 1,
+                                               QUEUE_END(r)),
+                                    false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE))
+      return QUEUE_BEGIN(r);
+  }
+  return NO_UNIT;
+}
+
+/* Steal the back half of another worker's queue, returning its first unit
+ * and moving the rest into the thief's own (empty) queue. */
+static u32 queue_steal(acq_pool_t* pool, u8 thief)
+{
+  for (u8 k = 1; k < pool->n_threads; k++) {
+    acq_pool_queue_t* victim = &pool->queues[(thief + k) % pool->n_threads];
+    u64 r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    while (QUEUE_BEGIN(r) < QUEUE_END(r)) {
+      u32 b = QUEUE_BEGIN(r), e = QUEUE_END(r);
+      u32 mid = b + (e - b) / 2;
+      if (__atomic_compare_exchange_n(&victim->range, &r, QUEUE_PACK(b, mid),
+                                      false, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&pool->queues[thief].range, QUEUE_PACK(mid + 1, e),
+                         __ATOMIC_RELEASE);
+        return mid;
+      }
+    }
+  }
+  return NO_UNIT;
+}
+
+static void* pool_worker(void* arg)
+{
+  acq_pool_t* pool = arg;
+  u8 id = 0;
+  u32 generation = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (!pthread_equal(pool->threads[id], pthread_self()))
+    id++;
+
+  while (1) {
+    while (pool->generation == generation && !pool->quit)
+      pthread_cond_wait(&pool->start, &pool->lock);
+    if (pool->quit)
+      break;
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    u32 unit;
+    while ((unit = queue_pop(&pool->queues[id])) != NO_UNIT ||
+           (unit = queue_steal(pool, id)) != NO_UNIT)
+      pool->fn(pool->ctx, unit, id);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->n_busy == 0)
+      pthread_cond_signal(&pool->done);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+/** Start a pool of worker threads.
+ *
+ * Remember to stop the threads with acq_pool_destroy().
+ *
+ * \param pool      Pool to initialise.
+ * \param n_threads Number of worker threads, from 1 to
+ *                  `ACQ_POOL_MAX_THREADS`.
+ * \return 0 on success, -1 if `n_threads` is out of range or the threads
+ *         could not be created.
+ */
+s8 acq_pool_init(acq_pool_t* pool, u8 n_threads)
+{
+  if (n_threads == 0 || n_threads > ACQ_POOL_MAX_THREADS)
+    return -1;
+
+  memset(pool, 0, sizeof(*pool));
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->start, 0);
+  pthread_cond_init(&pool->done, 0);
+
+  /* Hold the lock so workers can find their index once all are created. */
+  pthread_mutex_lock(&pool->lock);
+  for (u8 i = 0; i < n_threads; i++) {
+    if (pthread_create(&pool->threads[i], 0, pool_worker, pool)) {
+      pthread_mutex_unlock(&pool->lock);
+      acq_pool_destroy(pool);
+      return -1;
+    }
+    pool->n_threads++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+/** Stop the worker threads of a pool.
+ *
+ * \param pool Pool to destroy.
+ */
+void acq_pool_destroy(acq_pool_t* pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (u8 i = 0; i < pool->n_threads; i++)
+    pthread_join(pool->threads[i], 0);
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  pool->n_threads = 0;
+}
+
+/** Run a parallel loop on a worker pool.
+ *
+ * Calls `fn(ctx, unit, worker)` once for every unit from 0 to `n_units - 1`
+ * and waits for all calls to return. `worker` is the index of the calling
+ * worker thread and may be used to index per thread scratch space. Only one
+ * loop may run on a pool at a time.
+ *
+ * \param pool    Worker pool.
+ * \param n_units Number of work units.
+ * \param fn      Loop body.
+ * \param ctx     Context passed to `fn`.
+ */
+void acq_pool_run(acq_pool_t* pool, u32 n_units,
+                  void (*fn)(void* ctx, u32 unit, u8 worker), void* ctx)
+{
+  pthread_mutex_lock(&pool->lock);
+
+  pool->fn = fn;
+  pool->ctx = ctx;
+  for (u8 i = 0; i < pool->n_threads; i++) {
+    u32 b = (u64)n_units * i / pool->n_threads;
+    u32 e = (u64)n_units * (i + 1) / pool->n_threads;
+    __atomic_store_n(&pool->queues[i].range, QUEUE_PACK(b, e),
+                     __ATOMIC_RELAXED);
+  }
+
+  pool->n_busy = pool->n_threads;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  while (pool->n_busy)
+    pthread_cond_wait(&pool->done, &pool->lock);
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/** Best correlation found by one worker for one PRN. */
+typedef struct {
+  float peak;
+  float cp;
+  float cf;
+  double sum;
+  u32 n_cells;
+} search_acc_t;
+
+/** Shared state of acq_search_prns() and acq_search_candidates(). */
+typedef struct {
+  const acq_plan_t* plan;
+  const s8* samples;
+  u8 n_prns;
+  const u8* prns;
+  float cf_min;
+  float cf_bin_width;
+  u32 n_bins;            /* Bins of the grid covering all PRNs. */
+  const u32* bin_first;  /* First bin of each PRN, or NULL for all bins. */
+  const u32* bin_count;  /* Number of bins of each PRN. */
+  u32* unit_first;       /* First second pass unit of each PRN. */
+  u8* bin_used;          /* Whether any PRN searches each bin. */
+  u32* bin_base;         /* Bin whose spectrum each bin's is shifted from. */
+  s32* bin_shift;        /* Shift from the base bin in FFT bins. */
+  float early_stop_snr;
+  fft_cpx_t* signal;     /* n_bins spectra, only base bins are computed. */
+  const fft_cpx_t** code;  /* n_prns cached spectra. */
+  fft_cpx_t* work;       /* One per worker. */
+  float* power;          /* One per worker. */
+  u8* prn_done;          /* Early stop flag of each PRN. */
+  search_acc_t* acc;     /* n_prns per worker. */
+} search_ctx_t;
+
+/* First pass, the signal spectra shared between PRNs and the code spectra,
+ * which are only computed if not already in the plan's cache. */
+static void search_spectra(void* arg, u32 unit, u8 worker)
+{
+  (void)worker;
+  search_ctx_t* c = arg;
+
+  if (unit >= c->n_bins)
+    c->code[unit - c->n_bins] =
+      acq_code_spectrum_cached(c->plan, c->prns[unit - c->n_bins]);
+  else if (c->bin_used[unit] && c->bin_base[unit] == unit)
+    acq_signal_spectrum(c->plan, c->samples,
+                        c->cf_min + unit*c->cf_bin_width,
+                        &c->signal[unit*c->plan->n_fft]);
+}
+
+/* Second pass, one PRN and Doppler bin. */
+static void search_unit(void* arg, u32 unit, u8 worker)
+{
+  search_ctx_t* c = arg;
+  u32 n = c->plan->n_fft;
+  u32 p = 0;
+  while (p + 1 < c->n_prns && c->unit_first[p + 1] <= unit)
+    p++;
+  u32 b = unit - c->unit_first[p];
+  if (c->bin_first)
+    b += c->bin_first[p];
+
+  if (__atomic_load_n(&c->prn_done[p], __ATOMIC_RELAXED))
+    return;
+
+  float* power = &c->power[worker*n];
+  fft_cpx_t* work = &c->work[worker*n];
+  acq_signal_spectrum_shift(c->plan, &c->signal[c->bin_base[b]*n],
+                            c->bin_shift[b], work);
+  acq_correlate(c->plan, work, c->code[p], work, power);
+
+  search_acc_t* acc = &c->acc[worker*c->n_prns + p];
+  float peak = -1;
+  u32 peak_k = 0;
+  double sum = 0;
+  for (u32 k = 0; k < n; k++) {
+    sum += power[k];
+    if (power[k] > peak) {
+      peak = power[k];
+      peak_k = k;
+    }
+  }
+  acc->sum += sum;
+  acc->n_cells += n;
+  if (peak > acc->peak) {
+    acc->peak = peak;
+    acc->cp = acq_index_to_cp(c->plan, peak_k);
+    acc->cf = c->cf_min + b*c->cf_bin_width;
+  }
+
+  if (c->early_stop_snr > 0 && peak > c->early_stop_snr * sum / n)
+    __atomic_store_n(&c->prn_done[p], 1, __ATOMIC_RELAXED);
+}
+
+/* Run a search set up in `c` and write the merged results. */
+static s8 search_run(acq_pool_t* pool, search_ctx_t* c,
+                     acq_result_t results[])
+{
+  u32 n = c->plan->n_fft;
+  u8 n_prns = c->n_prns;
+  u8 n_threads = pool->n_threads;
+
+  c->signal = malloc((size_t)c->n_bins * n * sizeof(fft_cpx_t));
+  c->code = malloc(n_prns * sizeof(fft_cpx_t*));
+  c->work = malloc((size_t)n_threads * n * sizeof(fft_cpx_t));
+  c->power = malloc((size_t)n_threads * n * sizeof(float));
+  c->prn_done = calloc(n_prns, 1);
+  c->acc = calloc((size_t)n_threads * n_prns, sizeof(search_acc_t));
+  c->unit_first = malloc(n_prns * sizeof(u32));
+  c->bin_used = calloc(c->n_bins, 1);
+  c->bin_base = malloc(c->n_bins * sizeof(u32));
+  c->bin_shift = malloc(c->n_bins * sizeof(s32));
+
+  bool ok = c->signal && c->code && c->work && c->power && c->prn_done &&
+            c->acc && c->unit_first && c->bin_used && c->bin_base &&
+            c->bin_shift;
+  u32 n_units = 0;
+  for (u8 p = 0; ok && p < n_prns; p++) {
+    u32 first = c->bin_first ? c->bin_first[p] : 0;
+    u32 count = c->bin_first ? c->bin_count[p] : c->n_bins;
+    memset(&c->bin_used[first], 1, count);
+    c->unit_first[p] = n_units;
+    n_units += count;
+  }
+
+  /* Only the first used bin of each set of bins a whole number of FFT bins
+   * apart needs a forward FFT, the others are shifts of it. */
+  for (u32 b = 0; ok && b < c->n_bins; b++) {
+    float cf = c->cf_min + b*c->cf_bin_width;
+    c->bin_base[b] = b;
+    c->bin_shift[b] = 0;
+    for (u32 b0 = 0; c->bin_used[b] && b0 < b; b0++) {
+      if (c->bin_used[b0] && c->bin_base[b0] == b0 &&
+          acq_spectrum_shift_bins(c->plan, c->cf_min + b0*c->cf_bin_width,
+                                  cf, &c->bin_shift[b])) {
+        c->bin_base[b] = b0;
+        break;
+      }
+    }
+  }
+
+  if (ok) {
+    acq_pool_run(pool, c->n_bins + n_prns, search_spectra, c);
+    for (u8 p = 0; p < n_prns; p++)
+      ok = ok && c->code[p];
+  }
+
+  s8 ret = -1;
+  if (ok) {
+    acq_pool_run(pool, n_units, search_unit, c);
+
+    /* Merge the results of the workers. */
+    for (u8 p = 0; p < n_prns; p++) {
+      search_acc_t best = {-1, 0, 0, 0, 0};
+      for (u8 w = 0; w < n_threads; w++) {
+        search_acc_t* a = &c->acc[w*n_prns + p];
+        best.sum += a->sum;
+        best.n_cells += a->n_cells;
+        if (a->n_cells && a->peak > best.peak) {
+          best.peak = a->peak;
+          best.cp = a->cp;
+          best.cf = a->cf;
+        }
+      }
+      results[p].cp = best.cp;
+      results[p].cf = best.cf;
+      results[p].snr = best.peak / (best.sum / best.n_cells);
+    }
+    ret = 0;
+  }
+
+  free(c->signal);
+  free((void*)c->code);
+  free(c->work);
+  free(c->power);
+  free(c->prn_done);
+  free(c->acc);
+  free(c->unit_first);
+  free(c->bin_used);
+  free(c->bin_base);
+  free(c->bin_shift);
+  return ret;
+}
+
+/** Search many PRNs over a range of Doppler bins in parallel.
+ *
+ * Equivalent to calling acq_search() for each PRN, but the work is spread
+ * over a worker pool and the spectrum of the samples in each Doppler bin is
+ * computed once and shared by all PRNs, and the code spectra come from the
+ * plan's cache, so each PRN and bin costs a single inverse FFT. Bins a
+ * whole number of FFT bins apart share one forward FFT, see
+ * acq_spectrum_shift_bins().
+ *
+ * If `early_stop_snr` is positive, the search of a PRN stops as soon as the
+ * peak of any one Doppler bin exceeds `early_stop_snr` times the mean power
+ * of that bin. The result is then the best peak of the bins searched so
+ * far, which may be any bin within the main lobe of the correlation peak,
+ * i.e. up to 1 kHz from the true Doppler for a 1 ms code period, and its
+ * `snr` is computed over those bins only.
+ *
+ * \param pool           Worker pool.
+ * \param plan           Acquisition plan.
+ * \param samples        Real IF samples, at least `plan->n_samples`.
+ * \param n_prns         Number of PRNs to search.
+ * \param prns           PRN numbers.
+ * \param cf_min         Lowest Doppler to search in Hz.
+ * \param cf_max         Highest Doppler to search in Hz.
+ * \param cf_bin_width   Doppler bin spacing in Hz.
+ * \param early_stop_snr Per bin peak to mean power ratio to stop searching a
+ *                       PRN at, or zero to always search all bins.
+ * \param results        Output results, one per PRN.
+ * \return 0 on success, -1 on a malloc() failure.
+ */
+s8 acq_search_prns(acq_pool_t* pool, const acq_plan_t* plan,
+                   const s8* samples, u8 n_prns, const u8 prns[],
+                   float cf_min, float cf_max, float cf_bin_width,
+                   float early_stop_snr, acq_result_t results[])
+{
+  search_ctx_t c;
+
+  memset(&c, 0, sizeof(c));
+  c.plan = plan;
+  c.samples = samples;
+  c.n_prns = n_prns;
+  c.prns = prns;
+  c.cf_min = cf_min;
+  c.cf_bin_width = cf_bin_width;
+  c.n_bins = acq_n_bins(cf_min, cf_max, cf_bin_width);
+  c.early_stop_snr = early_stop_snr;
+
+  return search_run(pool, &c, results);
+}
+
+/** Search candidate satellites, each over its own Doppler window.
+ *
+ * As acq_search_prns(), but each PRN is only searched over the Doppler bins
+ * covering its window, e.g. as predicted by acq_almanac_candidates(). The
+ * bins of all candidates lie on one grid of spacing `cf_bin_width` so that
+ * the signal spectrum of a bin is still shared by all candidates searching
+ * it, and only the bins searched by at least one candidate are computed.
+ *
+ * \param pool           Worker pool.
+ * \param plan           Acquisition plan.
+ * \param samples        Real IF samples, at least `plan->n_samples`.
+ * \param n_cands        Number of candidates.
+ * \param cands          Candidate PRNs and Doppler windows.
+ * \param cf_bin_width   Doppler bin spacing in Hz.
+ * \param early_stop_snr Per bin peak to mean power ratio to stop searching a
+ *                       PRN at, or zero to always search all bins.
+ * \param results        Output results, one per candidate.
+ * \return 0 on success, -1 on a malloc() failure.
+ */
+s8 acq_search_candidates(acq_pool_t* pool, const acq_plan_t* plan,
+                         const s8* samples, u8 n_cands,
+                         const acq_candidate_t cands[], float cf_bin_width,
+                         float early_stop_snr, acq_result_t results[])
+{
+  if (n_cands == 0)
+    return 0;
+
+  float cf_min = cands[0].cf_min;
+  float cf_max = cands[0].cf_max;
+  for (u8 i = 1; i < n_cands; i++) {
+    cf_min = MIN(cf_min, cands[i].cf_min);
+    cf_max = MAX(cf_max, cands[i].cf_max);
+  }
+
+  u8 prns[n_cands];
+  u32 bin_first[n_cands], bin_count[n_cands];
+  for (u8 i = 0; i < n_cands; i++) {
+    prns[i] = cands[i].prn;
+    bin_first[i] = (u32)floor((cands[i].cf_min - cf_min) / cf_bin_width);
+    bin_count[i] = (u32)ceil((cands[i].cf_max - cf_min) / cf_bin_width)
+                   - bin_first[i] + 1;
+  }
+
+  search_ctx_t c;
+  memset(&c, 0, sizeof(c));
+  c.plan = plan;
+  c.samples = samples;
+  c.n_prns = n_cands;
+  c.prns = prns;
+  c.cf_min = cf_min;
+  c.cf_bin_width = cf_bin_width;
+  c.n_bins = (u32)ceil((cf_max - cf_min) / cf_bin_width) + 1;
+  c.bin_first = bin_first;
+  c.bin_count = bin_count;
+  c.early_stop_snr = early_stop_snr;
+
+  return search_run(pool, &c, results);
+}
+
+/** \} */
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq_weak.h"
+#include "constants.h"
+
+/** \defgroup acq_weak Weak Signal Acquisition
+ * Acquisition with long coherent and non-coherent integration.
+ *
+ * The correlation of every code period is computed with the FFT method of
+ * \ref acq, rotated to a common carrier phase and shifted to cancel the code
+ * Doppler, then summed coherently over blocks of `coh_len` periods. The
+ * power of the blocks is summed non-coherently.
+ *
+ * A navigation data bit transition inside a coherent block cancels part of
+ * its signal, so the blocks are formed at several alignments to the
+ * samples at once, the per period correlations being shared between them.
+ * The alignment with the highest peak is taken as the best estimate of the
+ * bit edge.
+ *
+ * Use acq_weak_cost() to trade sensitivity against compute when choosing
+ * the integration parameters.
+ * \{ */
+
+/* Check a search configuration is valid. */
+static s8 weak_config_check(const acq_weak_config_t* cfg)
+{
+  if (cfg->coh_len == 0 || ACQ_WEAK_BIT_LEN % cfg->coh_len != 0 ||
+      cfg->n_edges == 0 || cfg->n_edges > cfg->coh_len ||
+      cfg->n_noncoh == 0 || cfg->cf_bin_width <= 0)
+    return -1;
+  return 0;
+}
+
+/* First period of the blocks of bit edge alignment `e`. */
+static u32 weak_edge_offset(const acq_weak_config_t* cfg, u8 e)
+{
+  return (u32)e * cfg->coh_len / cfg->n_edges;
+}
+
+/** Estimate the cost and sensitivity of a weak signal search.
+ *
+ * The cost counts the FFTs of acq_search_weak() and the per point work of
+ * forming the blocks. The sensitivity is a rough estimate for budgeting
+ * only: the non-coherent gain uses the usual squaring loss approximation
+ *
+ * \f[
+ *   L_{sq} = 10 \log_{10} \frac{1 + \sqrt{1 + 9.2 K / D}}
+ *                              {1 + \sqrt{1 + 9.2 / D}}
+ * \f]
+ *
+ * for \f$K\f$ blocks and a detection SNR \f$D\f$ of `ACQ_WEAK_DETECT_SNR`,
+ * and the loss is that of a signal half a bin from the nearest Doppler bin
+ * and as far as possible from the nearest bit edge alignment tried, with
+ * random data bits.
+ *
+ * \param plan Acquisition plan.
+ * \param cfg  Search configuration.
+ * \param cost Output cost and sensitivity.
+ * \return 0 on success, -1 if the configuration is invalid.
+ */
+s8 acq_weak_cost(const acq_plan_t* plan, const acq_weak_config_t* cfg,
+                 acq_weak_cost_t* cost)
+{
+  if (weak_config_check(cfg))
+    return -1;
+
+  double n = plan->n_fft;
+  double period = plan->n_samples / plan->fs;
+  double t_coh = cfg->coh_len * period;
+  double K = cfg->n_noncoh;
+
+  cost->n_periods = cfg->coh_len * cfg->n_noncoh
+                    + weak_edge_offset(cfg, cfg->n_edges - 1);
+  cost->n_bins = acq_n_bins(cfg->cf_min, cfg->cf_max, cfg->cf_bin_width);
+  cost->n_ffts = 2 * cost->n_bins * cost->n_periods;
+
+  /* Per period: code product and carrier rotation, then one complex add
+   * per alignment. Per block: one power per alignment. */
+  double per_period = 12*n + 2*n*cfg->n_edges;
+  double per_block = 3*n;
+  cost->flops = cost->n_ffts * 5 * n * log2(n)
+                + (double)cost->n_bins * (cost->n_periods * per_period
+                                          + K * cfg->n_edges * per_block);
+
+  double D = ACQ_WEAK_DETECT_SNR;
+  cost->coh_gain = 10*log10(cfg->coh_len);
+  cost->noncoh_gain = 10*log10(K)
+                      - 10*log10((1 + sqrt(1 + 9.2*K/D))
+                                 / (1 + sqrt(1 + 9.2/D)));
+
+  /* A block straddling a transition by m periods keeps 1 - 2m/coh_len of
+   * its amplitude. Blocks containing an edge change bit half the time. */
+  double m = floor(cfg->coh_len / cfg->n_edges / 2.0);
+  double frac_edge = (double)cfg->coh_len / ACQ_WEAK_BIT_LEN;
+  double amp = 1 - 2*m / cfg->coh_len;
+  double edge_gain = 1 - frac_edge/2 + frac_edge/2 * amp*amp;
+
+  double x = M_PI * cfg->cf_bin_width/2 * t_coh;
+  double sinc = x > 0 ? sin(x) / x : 1;
+  cost->loss = -10*log10(edge_gain) - 20*log10(sinc);
+
+  cost->cn0_min = 10*log10(D) - 10*log10(t_coh) - cost->noncoh_gain
+                  + cost->loss;
+  return 0;
+}
+
+/* Complex correlation of one period of one Doppler bin, in place. */
+static void weak_correlate(const acq_plan_t* plan, fft_cpx_t* signal,
+                           const fft_cpx_t* code)
+{
+  for (u32 k = 0; k < plan->n_fft; k++) {
+    float re = signal[k].re*code[k].re - signal[k].im*code[k].im;
+    float im = signal[k].re*code[k].im + signal[k].im*code[k].re;
+    signal[k].re = re;
+    signal[k].im = im;
+  }
+
+  fft_inverse(&plan->fft, signal);
+}
+
+/** Search for a weak signal using long integrations.
+ *
+ * For each Doppler bin, correlates `n_periods` code periods (see
+ * acq_weak_cost()) and combines them into `n_noncoh` coherent blocks of
+ * `coh_len` periods at each of the `n_edges` bit edge alignments. The
+ * result is the highest peak of the non-coherent sums over all alignments.
+ *
+ * The Doppler bin spacing should be no more than about half the inverse of
+ * the coherent block length, i.e. 25 Hz for 20 period blocks.
+ *
+ * \param plan      Acquisition plan.
+ * \param samples   Real IF samples.
+ * \param n_samples Number of samples available, at least `n_periods` times
+ *                  `plan->n_samples`.
+ * \param prn       PRN number.
+ * \param cfg       Search configuration.
+ * \param result    Output location of the correlation peak. Its `snr` is
+ *                  over the mean of the search grid of the best alignment.
+ * \param bit_edge  Output first period of the coherent blocks of the best
+ *                  alignment, i.e. the period a bit edge is closest to
+ *                  the start of, modulo `coh_len`. May be NULL.
+ * \return 0 on success, -1 if the configuration is invalid, there are too
+ *         few samples, or on a malloc() failure.
+ */
+s8 acq_search_weak(const acq_plan_t* plan, const s8* samples,
+                   u32 n_samples, u8 prn, const acq_weak_config_t* cfg,
+                   acq_result_t* result, u8* bit_edge)
+{
+  /* weak_config_check() bounds `n_edges` by `coh_len` <= ACQ_WEAK_BIT_LEN. */
+  acq_weak_cost_t cost;
+  if (acq_weak_cost(plan, cfg, &cost) ||
+      (u64)cost.n_periods * plan->n_samples > n_samples)
+    return -1;
+
+  u32 n = plan->n_fft;
+  u8 n_edges = cfg->n_edges;
+  u32 coh_len = cfg->coh_len;
+  const fft_cpx_t* code = acq_code_spectrum_cached(plan, prn);
+  fft_cpx_t* corr = malloc(n * sizeof(fft_cpx_t));
+  fft_cpx_t* aligned = malloc(n * sizeof(fft_cpx_t));
+  fft_cpx_t* acc = malloc((size_t)n_edges * n * sizeof(fft_cpx_t));
+  float* nc = malloc((size_t)n_edges * n * sizeof(float));
+  if (!code || !corr || !aligned || !acc || !nc) {
+    free(corr);
+    free(aligned);
+    free(acc);
+    free(nc);
+    return -1;
+  }
+
+  float peak[ACQ_WEAK_BIT_LEN];
+  double sum[ACQ_WEAK_BIT_LEN] = {0};
+  acq_result_t best[ACQ_WEAK_BIT_LEN];
+  memset(best, 0, sizeof(best));
+  for (u8 e = 0; e < ACQ_WEAK_BIT_LEN; e++)
+    peak[e] = -1;
+
+  for (u32 b = 0; b < cost.n_bins; b++) {
+    float cf = cfg->cf_min + b*cfg->cf_bin_width;
+    double carr_step = 2*M_PI*(plan->if_freq + cf) / plan->fs;
+    /* Code phase gained each period relative to the nominal period. */
+    double code_drift = plan->n_samples * GPS_CA_CHIPPING_RATE
+                        * (1 + cf / GPS_L1_HZ) / plan->fs - 1023;
+
+    memset(nc, 0, (size_t)n_edges * n * sizeof(float));
+
+    /* Unlike acq_search() the spectra are not shared between bins a whole
+     * number of FFT bins apart with acq_signal_spectrum_shift(): each bin
+     * needs a spectrum per period, so sharing them would mean keeping the
+     * accumulators of every bin of a set at once, `n_edges` times the size
+     * of the samples for each bin, to save at most half the FFTs. */
+    for (u32 p = 0; p < cost.n_periods; p++) {
+      acq_signal_spectrum(plan, &samples[(u64)p * plan->n_samples], cf, corr);
+      weak_correlate(plan, corr, code);
+
+      /* The spectrum was mixed with a carrier starting at zero phase at the
+       * start of the period, rotate it onto a carrier continuous from the
+       * first sample and shift out the code phase gained since. */
+      double theta = fmod(carr_step * p * plan->n_samples, 2*M_PI);
+      float rot_re = cos(theta), rot_im = -sin(theta);
+      u32 shift = (u32)(((s64)lround(p * code_drift * n / 1023) % (s64)n
+                         + n) % n);
+      for (u32 k = 0; k < n; k++) {
+        const fft_cpx_t* z = &corr[k < shift ? k + n - shift : k - shift];
+        aligned[k].re = z->re*rot_re - z->im*rot_im;
+        aligned[k].im = z->re*rot_im + z->im*rot_re;
+      }
+
+      for (u8 e = 0; e < n_edges; e++) {
+        u32 offset = weak_edge_offset(cfg, e);
+        if (p < offset || p >= offset + coh_len*cfg->n_noncoh)
+          continue;
+        u32 j = (p - offset) % coh_len;
+        fft_cpx_t* a = &acc[(size_t)e * n];
+        if (j == 0) {
+          memcpy(a, aligned, n * sizeof(fft_cpx_t));
+        } else {
+          for (u32 k = 0; k < n; k++) {
+            a[k].re += aligned[k].re;
+            a[k].im += aligned[k].im;
+          }
+        }
+        if (j == coh_len - 1) {
+          float* c = &nc[(size_t)e * n];
+          for (u32 k = 0; k < n; k++)
+            c[k] += a[k].re*a[k].re + a[k].im*a[k].im;
+        }
+      }
+    }
+
+    for (u8 e = 0; e < n_edges; e++) {
+      const float* c = &nc[(size_t)e * n];
+      for (u32 k = 0; k < n; k++) {
+        sum[e] += c[k];
+        if (c[k] > peak[e]) {
+          peak[e] = c[k];
+          best[e].cp = acq_index_to_cp(plan, k);
+          best[e].cf = cf;
+        }
+      }
+    }
+  }
+
+  u8 e_best = 0;
+  for (u8 e = 1; e < n_edges; e++)
+    if (peak[e] > peak[e_best])
+      e_best = e;
+
+  *result = best[e_best];
+  result->snr = peak[e_best] / (sum[e_best] / ((double)cost.n_bins * n));
+  if (bit_edge)
+    *bit_edge = weak_edge_offset(cfg, e_best);
+
+  free(corr);
+  free(aligned);
+  free(acc);
+  free(nc);
+  return 0;
+}
+
+/** \} */
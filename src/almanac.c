@@ -16,6 +16,7 @@
 #include "linear_algebra.h"
 #include "coord_system.h"
 #include "almanac.h"
+#include "bits.h"
 
 /** \defgroup almanac Almanac
  * Functions and calculations related to the GPS almanac.
@@ -176,5 +177,79 @@ double calc_sat_doppler_almanac(const almanac_t* alm, double t, s16 week,
   return GPS_L1_HZ * radial_velocity / GPS_C;
 }
 
+/** Decode the almanac of one satellite from a page of subframe 4 or 5.
+ *
+ * The almanac pages don't hold the almanac week number, so the week is
+ * taken as that closest to the time the page was received, which is within
+ * a few days of the time of applicability.
+ *
+ * References:
+ *   -# IS-GPS-200D Section 20.3.3.5.1.2 and Table 20-VI
+ *
+ * \param words Words 3 to 10 of a subframe 4 or 5 with correct parity, the
+ *              data bits inverted where necessary, as for decode_ephemeris().
+ * \param t     Approximate GPS time the page was received.
+ * \param alm   Almanac output, for the satellite given by the page's SV ID.
+ * \return 0 if an almanac was decoded, -1 if the words hold a different
+ *         page.
+ */
+s8 decode_almanac(const u32 words[8], gps_time_t t, almanac_t *alm)
+{
+  /* SV ID: Word 3, bits 3-8 */
+  u8 sv_id = words[3-3] >> (30-8) & 0x3F;
+  if (sv_id < 1 || sv_id > 32)
+    return -1;
+  alm->prn = sv_id - 1;
+
+  /* e: Word 3, bits 9-24 */
+  alm->ecc = (words[3-3] >> (30-24) & 0xFFFF) * pow(2, -21);
+
+  /* t_oa: Word 4, bits 1-8 */
+  alm->toa = (words[4-3] >> (30-8) & 0xFF) * 4096;
+
+  /* delta_i: Word 4, bits 9-24, relative to 0.3 semicircles */
+  alm->inc = (0.3 + getbits_navword(words[4-3], 24, 16) * pow(2, -19))
+             * GPS_PI;
+
+  /* Omega_dot: Word 5, bits 1-16 */
+  alm->rora = getbits_navword(words[5-3], 16, 16) * pow(2, -38) * GPS_PI;
+
+  /* SV health: Word 5, bits 17-24 */
+  alm->healthy = !(words[5-3] >> (30-24) & 0xFF);
+
+  /* sqrt(A): Word 6, bits 1-24 */
+  double sqrta = (words[6-3] >> (30-24) & 0xFFFFFF) * pow(2, -11);
+  alm->a = sqrta * sqrta;
+
+  /* Omega_0: Word 7, bits 1-24 */
+  alm->raaw = getbits_navword(words[7-3], 24, 24) * pow(2, -23) * GPS_PI;
+
+  /* omega: Word 8, bits 1-24 */
+  alm->argp = getbits_navword(words[8-3], 24, 24) * pow(2, -23) * GPS_PI;
+
+  /* M_0: Word 9, bits 1-24 */
+  alm->ma = getbits_navword(words[9-3], 24, 24) * pow(2, -23) * GPS_PI;
+
+  /* a_f0: Word 10, bits 1-8 (MSBs) and bits 20-22 (LSBs) */
+  u32 af0 = (words[10-3] >> (30-8) & 0xFF) << 3
+            | (words[10-3] >> (30-22) & 0x7);
+  alm->af0 = getbits_navword(af0 << 6, 24, 11) * pow(2, -20);
+
+  /* a_f1: Word 10, bits 9-19 */
+  alm->af1 = getbits_navword(words[10-3], 19, 11) * pow(2, -38);
+
+  /* Week of the time of applicability. */
+  s32 week = t.wn;
+  double dt = alm->toa - t.tow;
+  if (dt > 302400)
+    week--;
+  else if (dt < -302400)
+    week++;
+  alm->week = (week + 1024) % 1024;
+
+  alm->valid = 1;
+  return 0;
+}
+
 /** \} */
 
@@ -78,6 +78,23 @@ s32 getbits(const u8 *buff, u32 pos, u8 len)
     return (bits ^ m) - m;
 }
 
+/** Get bit field from a GPS navigation message word as a signed integer.
+ * Unpacks the `len` bits ending at data bit `last` of a 30 bit word held in
+ * the low bits of `word`, bit 1 being the most significant, as numbered in
+ * IS-GPS-200. Maximum bit field length is 24 bits, i.e. `len <= last <= 24`.
+ *
+ * \param word Navigation message word, parity bits in bits 0-5.
+ * \param last Position in the word of the last bit of the bit field.
+ * \param len  Length of bit field in bits.
+ * \return Bit field as a sign extended value.
+ */
+s32 getbits_navword(u32 word, u8 last, u8 len)
+{
+  u32 x = word >> (30 - last) & ((1u << len) - 1);
+  s32 m = 1u << (len - 1);
+  return (x ^ m) - m;
+}
+
 /** Set bit field in buffer from an unsigned integer.
  * Packs `len` bits into bit position `pos` from the start of the buffer.
  * Maximum bit field length is 32 bits, i.e. `len <= 32`.
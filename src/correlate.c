@@ -11,45 +11,76 @@
  */
 
 #include <math.h>
-
-#ifdef __SSSE3__
-#include <tmmintrin.h>
-#endif
+#include <string.h>
 
 #include "correlate.h"
+#include "prns.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* The SIMD kernels are compiled with per-function target attributes so that
+ * they are all present in the binary regardless of the flags chosen by
+ * OptimizeForArchitecture(), the fastest one is then picked at run time. */
+#define CORRELATE_X86
+#include <immintrin.h>
+#endif
 
 /** \defgroup corr Correlation
  * Correlators used for tracking.
  * \{ */
 
-#ifndef __SSSE3__
+/** Correlator kernel, accumulates the E, P and L correlations of `n` samples
+ * into `corr` as [I_E, Q_E, I_P, Q_P, I_L, Q_L]. */
+typedef void (*corr_kernel_t)(const s8* samples, u32 n, const s8* code,
+                              double code_phase, double code_step,
+                              double carr_phase, double carr_step,
+                              double corr[6]);
 
-void track_correlate(s8* samples, s8* code,
-                     double* init_code_phase, double code_step, double* init_carr_phase, double carr_step,
-                     double* I_E, double* Q_E, double* I_P, double* Q_P, double* I_L, double* Q_L, u32* num_samples)
+/** Carrier rotator carried between kernel calls, so that consecutive runs
+ * of samples continue the same phasor rather than starting a new one. */
+typedef struct {
+  double s;  /**< Sine of the carrier phase of the next sample. */
+  double c;  /**< Cosine of the carrier phase of the next sample. */
+  double ds; /**< Sine of the carrier phase step. */
+  double dc; /**< Cosine of the carrier phase step. */
+} corr_carr_t;
+
+static void corr_carr_init(corr_carr_t *carr, double carr_phase,
+                           double carr_step)
 {
-  double code_phase = *init_code_phase;
-  double carr_phase = *init_carr_phase;
+  carr->s = sin(carr_phase);
+  carr->c = cos(carr_phase);
+  carr->ds = sin(carr_step);
+  carr->dc = cos(carr_step);
+}
 
-  double carr_sin = sin(carr_phase);
-  double carr_cos = cos(carr_phase);
-  double sin_delta = sin(carr_step);
-  double cos_delta = cos(carr_step);
+/* Set the phasor from a single precision kernel, renormalising it so that
+ * rounding errors don't build up in the amplitude over many runs. */
+static inline void corr_carr_set(corr_carr_t *carr, double s, double c)
+{
+  double i_mag = 1.0 / sqrt(s*s + c*c);
+  carr->s = s * i_mag;
+  carr->c = c * i_mag;
+}
 
-  *I_E = *Q_E = *I_P = *Q_P = *I_L = *Q_L = 0;
+/** Resumable correlator kernel, as ::corr_kernel_t but continuing the
+ * carrier from `carr`, which is advanced past the samples correlated. */
+typedef void (*corr_run_kernel_t)(const s8* samples, u32 n, const s8* code,
+                                  double code_phase, double code_step,
+                                  corr_carr_t* carr, double corr[6]);
+
+static void corr_c_run(const s8* samples, u32 n, const s8* code,
+                       double code_phase, double code_step,
+                       corr_carr_t* carr, double corr[6])
+{
+  double carr_sin = carr->s;
+  double carr_cos = carr->c;
+  double sin_delta = carr->ds;
+  double cos_delta = carr->dc;
 
   double code_E, code_P, code_L;
   double baseband_Q, baseband_I;
 
-  *num_samples = (int)ceil((1023.0 - code_phase) / code_step);
-
-  for (u32 i=0; i<*num_samples; i++) {
-    /*code_E = get_chip(code, (int)ceil(code_phase-0.5));*/
-    /*code_P = get_chip(code, (int)ceil(code_phase));*/
-    /*code_L = get_chip(code, (int)ceil(code_phase+0.5));*/
-    /*code_E = code[(int)ceil(code_phase-0.5)];*/
-    /*code_P = code[(int)ceil(code_phase)];*/
-    /*code_L = code[(int)ceil(code_phase+0.5)];*/
+  for (u32 i=0; i<n; i++) {
     code_E = code[(int)(code_phase+0.5)];
     code_P = code[(int)(code_phase+1.0)];
     code_L = code[(int)(code_phase+1.5)];
@@ -63,34 +94,262 @@ void track_correlate(s8* samples, s8* code,
     carr_sin = carr_sin_ * i_mag;
     carr_cos = carr_cos_ * i_mag;
 
-    *I_E += code_E * baseband_I;
-    *Q_E += code_E * baseband_Q;
-    *I_P += code_P * baseband_I;
-    *Q_P += code_P * baseband_Q;
-    *I_L += code_L * baseband_I;
-    *Q_L += code_L * baseband_Q;
+    corr[0] += code_E * baseband_I;
+    corr[1] += code_E * baseband_Q;
+    corr[2] += code_P * baseband_I;
+    corr[3] += code_P * baseband_Q;
+    corr[4] += code_L * baseband_I;
+    corr[5] += code_L * baseband_Q;
+
+    code_phase += code_step;
+  }
+
+  carr->s = carr_sin;
+  carr->c = carr_cos;
+}
+
+static void corr_c(const s8* samples, u32 n, const s8* code,
+                   double code_phase, double code_step,
+                   double carr_phase, double carr_step,
+                   double corr[6])
+{
+  corr_carr_t carr;
+  corr_carr_init(&carr, carr_phase, carr_step);
+  corr_c_run(samples, n, code, code_phase, code_step, &carr, corr);
+}
+
+/** Replica correlator kernel, as ::corr_kernel_t but with the code chips of
+ * every sample precomputed in the E, P and L replicas. */
+typedef void (*corr_replica_kernel_t)(const s8* samples, u32 n,
+                                      const s8* E, const s8* P, const s8* L,
+                                      double carr_phase, double carr_step,
+                                      double corr[6]);
+
+static void corr_replica_c(const s8* samples, u32 n,
+                           const s8* E, const s8* P, const s8* L,
+                           double carr_phase, double carr_step,
+                           double corr[6])
+{
+  double carr_sin = sin(carr_phase);
+  double carr_cos = cos(carr_phase);
+  double sin_delta = sin(carr_step);
+  double cos_delta = cos(carr_step);
+
+  for (u32 i=0; i<n; i++) {
+    double baseband_Q = carr_cos * samples[i];
+    double baseband_I = carr_sin * samples[i];
+
+    double carr_sin_ = carr_sin*cos_delta + carr_cos*sin_delta;
+    double carr_cos_ = carr_cos*cos_delta - carr_sin*sin_delta;
+    double i_mag = (3.0 - carr_sin_*carr_sin_ - carr_cos_*carr_cos_) / 2.0;
+    carr_sin = carr_sin_ * i_mag;
+    carr_cos = carr_cos_ * i_mag;
+
+    corr[0] += E[i] * baseband_I;
+    corr[1] += E[i] * baseband_Q;
+    corr[2] += P[i] * baseband_I;
+    corr[3] += P[i] * baseband_Q;
+    corr[4] += L[i] * baseband_I;
+    corr[5] += L[i] * baseband_Q;
+  }
+}
+
+/** Integer correlator kernel, as ::corr_kernel_t but with fixed point code
+ * and carrier NCOs, see track_correlate_int(). */
+typedef void (*corr_int_kernel_t)(const s8* samples, u32 n, const s8* code,
+                                  u64 code_phase, u64 code_step,
+                                  u32 carr_phase, u32 carr_step,
+                                  s32 corr[6]);
+
+/* Carrier lookup tables indexed by the top 4 bits of the carrier phase, each
+ * entry is the value at the centre of its phase bin scaled by
+ * CORR_INT_CARR_AMP. 16 entries so that they fit in one SSE register. */
+static const s8 corr_int_sin[16] __attribute__((aligned(16))) = {
+   12,  36,  53,  63,  63,  53,  36,  12,
+  -12, -36, -53, -63, -63, -53, -36, -12,
+};
+static const s8 corr_int_cos[16] __attribute__((aligned(16))) = {
+   63,  53,  36,  12, -12, -36, -53, -63,
+  -63, -53, -36, -12,  12,  36,  53,  63,
+};
+
+/* Half a chip in the Q32.32 code phase. */
+#define CORR_INT_HALF_CHIP ((u64)1 << 31)
+
+static void corr_int_c(const s8* samples, u32 n, const s8* code,
+                       u64 code_phase, u64 code_step,
+                       u32 carr_phase, u32 carr_step,
+                       s32 corr[6])
+{
+  for (u32 i=0; i<n; i++) {
+    s32 baseband_I = samples[i] * corr_int_sin[carr_phase >> 28];
+    s32 baseband_Q = samples[i] * corr_int_cos[carr_phase >> 28];
+
+    s8 E = code[(code_phase + CORR_INT_HALF_CHIP) >> 32];
+    s8 P = code[(code_phase + 2*CORR_INT_HALF_CHIP) >> 32];
+    s8 L = code[(code_phase + 3*CORR_INT_HALF_CHIP) >> 32];
+
+    corr[0] += E * baseband_I;
+    corr[1] += E * baseband_Q;
+    corr[2] += P * baseband_I;
+    corr[3] += P * baseband_Q;
+    corr[4] += L * baseband_I;
+    corr[5] += L * baseband_Q;
 
     code_phase += code_step;
     carr_phase += carr_step;
   }
-  *init_code_phase = code_phase - 1023;
-  *init_carr_phase = fmod(carr_phase, 2*M_PI);
 }
 
-#else
+/** Multi-tap correlator kernel, accumulates the correlations of `n_taps`
+ * taps into `corr` as [I_0, Q_0, I_1, Q_1, ...]. The code is unwrapped as
+ * described for track_correlate_taps() and `offsets` are tap offsets in
+ * chips reduced to [0, 1023). */
+typedef void (*corr_taps_kernel_t)(const s8* samples, u32 n, const s8* code,
+                                   double code_phase, double code_step,
+                                   double carr_phase, double carr_step,
+                                   u8 n_taps, const double offsets[],
+                                   double corr[]);
 
-void track_correlate(s8* samples, s8* code,
-                     double* init_code_phase, double code_step, double* init_carr_phase, double carr_step,
-                     double* I_E, double* Q_E, double* I_P, double* Q_P, double* I_L, double* Q_L, u32* num_samples)
+static void corr_taps_c(const s8* samples, u32 n, const s8* code,
+                        double code_phase, double code_step,
+                        double carr_phase, double carr_step,
+                        u8 n_taps, const double offsets[],
+                        double corr[])
 {
-  double code_phase = *init_code_phase;
+  double carr_sin = sin(carr_phase);
+  double carr_cos = cos(carr_phase);
+  double sin_delta = sin(carr_step);
+  double cos_delta = cos(carr_step);
+
+  for (u32 i=0; i<n; i++) {
+    double baseband_Q = carr_cos * samples[i];
+    double baseband_I = carr_sin * samples[i];
+
+    double carr_sin_ = carr_sin*cos_delta + carr_cos*sin_delta;
+    double carr_cos_ = carr_cos*cos_delta - carr_sin*sin_delta;
+    double i_mag = (3.0 - carr_sin_*carr_sin_ - carr_cos_*carr_cos_) / 2.0;
+    carr_sin = carr_sin_ * i_mag;
+    carr_cos = carr_cos_ * i_mag;
+
+    for (u8 k=0; k<n_taps; k++) {
+      s8 chip = code[(int)(code_phase + offsets[k])];
+      corr[2*k] += chip * baseband_I;
+      corr[2*k+1] += chip * baseband_Q;
+    }
+
+    code_phase += code_step;
+  }
+}
+
+static void corr_iq_c(const s8* samples, u32 n, const s8* code,
+                      double code_phase, double code_step,
+                      double carr_phase, double carr_step,
+                      double corr[6])
+{
+  double carr_sin = sin(carr_phase);
+  double carr_cos = cos(carr_phase);
+  double sin_delta = sin(carr_step);
+  double cos_delta = cos(carr_step);
+
+  for (u32 i=0; i<n; i++) {
+    /* Multiply by the conjugate of the local carrier. */
+    double s_I = samples[2*i];
+    double s_Q = samples[2*i+1];
+    double baseband_I = s_I*carr_cos + s_Q*carr_sin;
+    double baseband_Q = s_Q*carr_cos - s_I*carr_sin;
+
+    double carr_sin_ = carr_sin*cos_delta + carr_cos*sin_delta;
+    double carr_cos_ = carr_cos*cos_delta - carr_sin*sin_delta;
+    double i_mag = (3.0 - carr_sin_*carr_sin_ - carr_cos_*carr_cos_) / 2.0;
+    carr_sin = carr_sin_ * i_mag;
+    carr_cos = carr_cos_ * i_mag;
 
-  float carr_sin = sin(*init_carr_phase);
-  float carr_cos = cos(*init_carr_phase);
-  float sin_delta = sin(carr_step);
-  float cos_delta = cos(carr_step);
+    s8 E = code[(int)(code_phase+0.5)];
+    s8 P = code[(int)(code_phase+1.0)];
+    s8 L = code[(int)(code_phase+1.5)];
 
-  *num_samples = (int)ceil((1023.0 - code_phase) / code_step);
+    corr[0] += E * baseband_I;
+    corr[1] += E * baseband_Q;
+    corr[2] += P * baseband_I;
+    corr[3] += P * baseband_Q;
+    corr[4] += L * baseband_I;
+    corr[5] += L * baseband_Q;
+
+    code_phase += code_step;
+  }
+}
+
+/** Packed correlator kernel, as ::corr_kernel_t but reading `n` 1 or 2-bit
+ * samples starting at sample `first` of a packed buffer. */
+typedef void (*corr_packed_kernel_t)(const u8* packed, sample_fmt_t fmt,
+                                     u32 first, u32 n, const s8* code,
+                                     double code_phase, double code_step,
+                                     double carr_phase, double carr_step,
+                                     double corr[6]);
+
+/* Unpack the samples with samples_unpack() in chunks small enough to stay in
+ * the L1 cache and correlate each chunk with `kernel` as soon as it is
+ * unpacked, for the kernels that can't decode the packed samples
+ * themselves. */
+static void corr_packed_chunked(corr_kernel_t kernel,
+                                const u8* packed, sample_fmt_t fmt,
+                                u32 first, u32 n, const s8* code,
+                                double code_phase, double code_step,
+                                double carr_phase, double carr_step,
+                                double corr[6])
+{
+  s8 chunk[CORR_PACKED_CHUNK_LEN] __attribute__((aligned(32)));
+
+  for (u32 start=0; start<n; start+=CORR_PACKED_CHUNK_LEN) {
+    u32 m = MIN(CORR_PACKED_CHUNK_LEN, n - start);
+    samples_unpack(packed, fmt, first + start, m, chunk);
+    kernel(chunk, m, code,
+           code_phase + start*code_step, code_step,
+           carr_phase + start*carr_step, carr_step, corr);
+  }
+}
+
+static void corr_packed_c(const u8* packed, sample_fmt_t fmt,
+                          u32 first, u32 n, const s8* code,
+                          double code_phase, double code_step,
+                          double carr_phase, double carr_step,
+                          double corr[6])
+{
+  corr_packed_chunked(corr_c, packed, fmt, first, n, code,
+                      code_phase, code_step, carr_phase, carr_step, corr);
+}
+
+#ifdef CORRELATE_X86
+
+/** Number of leading samples of a block for which the wide kernels may use
+ * 32-bit gathers from the code array.
+ *
+ * A gather at tap index `k` reads `code[k..k+3]`. The largest index the
+ * correlator is ever allowed to touch is 1024 (the late tap just before the
+ * code rollover), so the gathers are only used while every late tap index is
+ * at most 1021. The remaining samples are handed to the scalar kernel.
+ */
+static u32 corr_gather_safe_len(u32 n, double code_phase, double code_step)
+{
+  /* Late tap index is (int)(code_phase + 1.5) <= 1021 while
+   * code_phase < 1020.5, keep a little margin for rounding. */
+  double limit = 1020.0 - code_phase;
+  if (limit <= 0)
+    return 0;
+  double n_safe = floor(limit / code_step);
+  return (n_safe < n) ? (u32)n_safe : n;
+}
+
+__attribute__((target("ssse3")))
+static void corr_ssse3_run(const s8* samples, u32 n, const s8* code,
+                           double code_phase, double code_step,
+                           corr_carr_t* carr, double corr[6])
+{
+  float carr_sin = carr->s;
+  float carr_cos = carr->c;
+  float sin_delta = carr->ds;
+  float cos_delta = carr->dc;
 
   __m128 IE_QE_IP_QP;
   __m128 CE_CE_CP_CP;
@@ -106,7 +365,7 @@ void track_correlate(s8* samples, s8* code,
   S_C_S_C = _mm_set_ps(carr_sin, carr_cos, carr_sin, carr_cos);
   dC_dS_dS_dC = _mm_set_ps(cos_delta, sin_delta, sin_delta, cos_delta);
 
-  for (u32 i=0; i<*num_samples; i++) {
+  for (u32 i=0; i<n; i++) {
     CE_CE_CP_CP = _mm_set_ps(code[(int)(code_phase+0.5)],
                              code[(int)(code_phase+0.5)],
                              code[(int)(code_phase+1.0)],
@@ -137,23 +396,1544 @@ void track_correlate(s8* samples, s8* code,
 
     code_phase += code_step;
   }
-  *init_code_phase = code_phase - 1023;
-  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
 
   float res[8];
   _mm_storeu_ps(res, IE_QE_IP_QP);
   _mm_storeu_ps(res+4, IL_QL_X_X);
 
-  *I_E = res[3];
-  *Q_E = res[2];
-  *I_P = res[1];
-  *Q_P = res[0];
-  *I_L = res[7];
-  *Q_L = res[6];
+  corr[0] += res[3];
+  corr[1] += res[2];
+  corr[2] += res[1];
+  corr[3] += res[0];
+  corr[4] += res[7];
+  corr[5] += res[6];
+
+  corr_carr_set(carr, _mm_cvtss_f32(_mm_shuffle_ps(S_C_S_C, S_C_S_C, 1)),
+                _mm_cvtss_f32(S_C_S_C));
 }
 
-#endif /* !__SSSE3__ */
+__attribute__((target("ssse3")))
+static void corr_ssse3(const s8* samples, u32 n, const s8* code,
+                       double code_phase, double code_step,
+                       double carr_phase, double carr_step,
+                       double corr[6])
+{
+  corr_carr_t carr;
+  corr_carr_init(&carr, carr_phase, carr_step);
+  corr_ssse3_run(samples, n, code, code_phase, code_step, &carr, corr);
+}
 
-/** \} */
+static void corr_packed_ssse3(const u8* packed, sample_fmt_t fmt,
+                              u32 first, u32 n, const s8* code,
+                              double code_phase, double code_step,
+                              double carr_phase, double carr_step,
+                              double corr[6])
+{
+  corr_packed_chunked(corr_ssse3, packed, fmt, first, n, code,
+                      code_phase, code_step, carr_phase, carr_step, corr);
+}
+
+/* Sign extend the low 8 bytes of `x` to 16 bits. */
+#define CORR_INT_SEXT_LO(x) _mm_srai_epi16(_mm_unpacklo_epi8((x), (x)), 8)
+#define CORR_INT_SEXT_HI(x) _mm_srai_epi16(_mm_unpackhi_epi8((x), (x)), 8)
+
+__attribute__((target("ssse3")))
+static s32 corr_int_hsum(__m128i x)
+{
+  x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+  x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(x);
+}
+
+/* Processes 8 samples per iteration in 16-bit lanes. The carrier values are
+ * looked up with pshufb and the chips of all three taps with a second pshufb
+ * into a 16 chip window of the code starting at the early tap of the first
+ * sample. The products are accumulated into 32-bit lanes with pmaddwd. The
+ * result is bit exact with corr_int_c(), which handles the samples near the
+ * end of the code where the window would overrun the code array. */
+__attribute__((target("ssse3")))
+static void corr_int_ssse3(const s8* samples, u32 n, const s8* code,
+                           u64 code_phase, u64 code_step,
+                           u32 carr_phase, u32 carr_step,
+                           s32 corr[6])
+{
+  u32 i = 0;
+
+  /* With less than one chip per sample the late tap of the 8th sample is
+   * within 9 chips of the early tap of the first. */
+  if (code_step < 2*CORR_INT_HALF_CHIP) {
+    const __m128i lut_sin = _mm_load_si128((const __m128i *)corr_int_sin);
+    const __m128i lut_cos = _mm_load_si128((const __m128i *)corr_int_cos);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i code_lanes = _mm_set_epi64x(code_step, 0);
+    const __m128i code_step2 = _mm_set1_epi64x(2*code_step);
+    const __m128i carr_step8 = _mm_set1_epi32(8*carr_step);
+    __m128i carr_lo = _mm_setr_epi32(carr_phase, carr_phase + carr_step,
+                                     carr_phase + 2*carr_step,
+                                     carr_phase + 3*carr_step);
+    __m128i carr_hi = _mm_add_epi32(carr_lo, _mm_set1_epi32(4*carr_step));
+
+    __m128i IE = _mm_setzero_si128(), QE = _mm_setzero_si128();
+    __m128i IP = _mm_setzero_si128(), QP = _mm_setzero_si128();
+    __m128i IL = _mm_setzero_si128(), QL = _mm_setzero_si128();
+
+    for (; i + 8 <= n; i += 8) {
+      u64 base = (code_phase + CORR_INT_HALF_CHIP) >> 32;
+      if (base > CA_CODE_UNPACKED_LEN - 16)
+        break;
+
+      /* Phase of each sample relative to the early tap of the first sample,
+       * in half chips. The tap offsets into the window are then
+       * E = h/2, P = (h+1)/2 and L = E+1. */
+      __m128i r01 = _mm_add_epi64(
+        _mm_set1_epi64x(code_phase + CORR_INT_HALF_CHIP - (base << 32)),
+        code_lanes);
+      __m128i r23 = _mm_add_epi64(r01, code_step2);
+      __m128i r45 = _mm_add_epi64(r23, code_step2);
+      __m128i r67 = _mm_add_epi64(r45, code_step2);
+      __m128 h03 = _mm_shuffle_ps(
+        _mm_castsi128_ps(_mm_srli_epi64(r01, 31)),
+        _mm_castsi128_ps(_mm_srli_epi64(r23, 31)), _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 h47 = _mm_shuffle_ps(
+        _mm_castsi128_ps(_mm_srli_epi64(r45, 31)),
+        _mm_castsi128_ps(_mm_srli_epi64(r67, 31)), _MM_SHUFFLE(2, 0, 2, 0));
+      __m128i h = _mm_packs_epi32(_mm_castps_si128(h03),
+                                  _mm_castps_si128(h47));
+      __m128i oE = _mm_srli_epi16(h, 1);
+      __m128i oP = _mm_srli_epi16(_mm_add_epi16(h, one), 1);
+      __m128i oL = _mm_add_epi16(oE, one);
+
+      __m128i window = _mm_loadu_si128((const __m128i *)&code[base]);
+      __m128i EP = _mm_shuffle_epi8(window, _mm_packus_epi16(oE, oP));
+      __m128i LL = _mm_shuffle_epi8(window, _mm_packus_epi16(oL, oL));
+      __m128i cE = CORR_INT_SEXT_LO(EP);
+      __m128i cP = CORR_INT_SEXT_HI(EP);
+      __m128i cL = CORR_INT_SEXT_LO(LL);
+
+      /* Carrier lookup from the top 4 bits of the phase. */
+      __m128i idx = _mm_packs_epi32(_mm_srli_epi32(carr_lo, 28),
+                                    _mm_srli_epi32(carr_hi, 28));
+      idx = _mm_packus_epi16(idx, idx);
+      __m128i S = CORR_INT_SEXT_LO(_mm_shuffle_epi8(lut_sin, idx));
+      __m128i C = CORR_INT_SEXT_LO(_mm_shuffle_epi8(lut_cos, idx));
+
+      __m128i x = _mm_loadl_epi64((const __m128i *)&samples[i]);
+      x = CORR_INT_SEXT_LO(x);
+      __m128i BI = _mm_mullo_epi16(x, S);
+      __m128i BQ = _mm_mullo_epi16(x, C);
+
+      IE = _mm_add_epi32(IE, _mm_madd_epi16(BI, cE));
+      QE = _mm_add_epi32(QE, _mm_madd_epi16(BQ, cE));
+      IP = _mm_add_epi32(IP, _mm_madd_epi16(BI, cP));
+      QP = _mm_add_epi32(QP, _mm_madd_epi16(BQ, cP));
+      IL = _mm_add_epi32(IL, _mm_madd_epi16(BI, cL));
+      QL = _mm_add_epi32(QL, _mm_madd_epi16(BQ, cL));
+
+      carr_lo = _mm_add_epi32(carr_lo, carr_step8);
+      carr_hi = _mm_add_epi32(carr_hi, carr_step8);
+      code_phase += 8*code_step;
+      carr_phase += 8*carr_step;
+    }
+
+    corr[0] += corr_int_hsum(IE);
+    corr[1] += corr_int_hsum(QE);
+    corr[2] += corr_int_hsum(IP);
+    corr[3] += corr_int_hsum(QP);
+    corr[4] += corr_int_hsum(IL);
+    corr[5] += corr_int_hsum(QL);
+  }
+
+  corr_int_c(&samples[i], n - i, code, code_phase, code_step,
+             carr_phase, carr_step, corr);
+}
+
+/** Carrier NCO of the AVX2 kernels, holding one phasor per lane. */
+typedef struct {
+  __m256 S;  /**< Carrier sine for each lane. */
+  __m256 C;  /**< Carrier cosine for each lane. */
+  __m256 dS; /**< Sine of the 8 sample rotation. */
+  __m256 dC; /**< Cosine of the 8 sample rotation. */
+} corr_avx2_nco_t;
+
+/* Start the lanes on the carrier phases of the next 8 samples, found by
+ * rotating the phasor in double precision rather than with trigonometric
+ * functions. */
+__attribute__((target("avx2")))
+static inline void corr_avx2_nco_init(corr_avx2_nco_t *nco,
+                                      const corr_carr_t *carr)
+{
+  float s0[8], c0[8];
+  double s = carr->s, c = carr->c;
+  for (u8 k=0; k<8; k++) {
+    s0[k] = s;
+    c0[k] = c;
+    double s_ = s*carr->dc + c*carr->ds;
+    c = c*carr->dc - s*carr->ds;
+    s = s_;
+  }
+  /* The phasor is now rotated by 8 steps, rotate its conjugate back to the
+   * start to get the 8 step rotation. */
+  double dS = s*carr->c - c*carr->s;
+  double dC = c*carr->c + s*carr->s;
+  nco->S = _mm256_loadu_ps(s0);
+  nco->C = _mm256_loadu_ps(c0);
+  nco->dS = _mm256_set1_ps(dS);
+  nco->dC = _mm256_set1_ps(dC);
+}
+
+/* Advance all lanes by 8 carrier steps and renormalise the phasors. */
+__attribute__((target("avx2")))
+static inline void corr_avx2_nco_step(corr_avx2_nco_t *nco)
+{
+  __m256 S_ = _mm256_add_ps(_mm256_mul_ps(nco->S, nco->dC),
+                            _mm256_mul_ps(nco->C, nco->dS));
+  __m256 C_ = _mm256_sub_ps(_mm256_mul_ps(nco->C, nco->dC),
+                            _mm256_mul_ps(nco->S, nco->dS));
+  __m256 mag2 = _mm256_add_ps(_mm256_mul_ps(S_, S_), _mm256_mul_ps(C_, C_));
+  __m256 i_mag = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(3.0f), mag2),
+                               _mm256_set1_ps(0.5f));
+  nco->S = _mm256_mul_ps(S_, i_mag);
+  nco->C = _mm256_mul_ps(C_, i_mag);
+}
+
+/* Load 8 s8 values and convert them to float. */
+__attribute__((target("avx2")))
+static inline __m256 corr_avx2_load_s8(const s8* p)
+{
+  __m128i x = _mm_loadl_epi64((const __m128i *)p);
+  return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 corr_avx2_taps(const s8* code, __m256d p_lo, __m256d p_hi)
+{
+  /* Truncate the code phases of all 8 lanes to chip indices and fetch the
+   * chips with a single gather, keeping only the addressed byte. */
+  __m128i i_lo = _mm256_cvttpd_epi32(p_lo);
+  __m128i i_hi = _mm256_cvttpd_epi32(p_hi);
+  __m256i idx = _mm256_inserti128_si256(_mm256_castsi128_si256(i_lo), i_hi, 1);
+  __m256i chips = _mm256_i32gather_epi32((const int *)code, idx, 1);
+  chips = _mm256_srai_epi32(_mm256_slli_epi32(chips, 24), 24);
+  return _mm256_cvtepi32_ps(chips);
+}
+
+__attribute__((target("avx2")))
+static float corr_avx2_hsum(__m256 x)
+{
+  __m128 a = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+  a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+  return _mm_cvtss_f32(a);
+}
+
+/** State of the AVX2 correlator, 8 consecutive samples per lane set. */
+typedef struct {
+  corr_avx2_nco_t nco;
+  __m256d lane_lo; /**< Code phase offsets of lanes 0-3. */
+  __m256d lane_hi; /**< Code phase offsets of lanes 4-7. */
+  __m256 IE, QE, IP, QP, IL, QL;
+} corr_avx2_state_t;
+
+__attribute__((target("avx2")))
+static inline void corr_avx2_init(corr_avx2_state_t *st, double code_step,
+                                  const corr_carr_t *carr)
+{
+  corr_avx2_nco_init(&st->nco, carr);
+  st->lane_lo = _mm256_setr_pd(0, code_step, 2*code_step, 3*code_step);
+  st->lane_hi = _mm256_setr_pd(4*code_step, 5*code_step,
+                               6*code_step, 7*code_step);
+  st->IE = st->QE = st->IP = st->QP = st->IL = st->QL = _mm256_setzero_ps();
+}
+
+/* Correlate the 8 samples `x`, the first of which is at `code_phase`. */
+__attribute__((target("avx2")))
+static inline void corr_avx2_block(corr_avx2_state_t *st, const s8* code,
+                                   double code_phase, __m256 x)
+{
+  __m256d tap_half = _mm256_set1_pd(0.5);
+
+  /* Early tap code phases of the 8 lanes. */
+  __m256d base = _mm256_set1_pd(code_phase + 0.5);
+  __m256d p_lo = _mm256_add_pd(base, st->lane_lo);
+  __m256d p_hi = _mm256_add_pd(base, st->lane_hi);
+  __m256 cE = corr_avx2_taps(code, p_lo, p_hi);
+  p_lo = _mm256_add_pd(p_lo, tap_half);
+  p_hi = _mm256_add_pd(p_hi, tap_half);
+  __m256 cP = corr_avx2_taps(code, p_lo, p_hi);
+  p_lo = _mm256_add_pd(p_lo, tap_half);
+  p_hi = _mm256_add_pd(p_hi, tap_half);
+  __m256 cL = corr_avx2_taps(code, p_lo, p_hi);
+
+  /* Mix the samples down to baseband. */
+  __m256 BI = _mm256_mul_ps(x, st->nco.S);
+  __m256 BQ = _mm256_mul_ps(x, st->nco.C);
+  corr_avx2_nco_step(&st->nco);
+
+  st->IE = _mm256_add_ps(st->IE, _mm256_mul_ps(cE, BI));
+  st->QE = _mm256_add_ps(st->QE, _mm256_mul_ps(cE, BQ));
+  st->IP = _mm256_add_ps(st->IP, _mm256_mul_ps(cP, BI));
+  st->QP = _mm256_add_ps(st->QP, _mm256_mul_ps(cP, BQ));
+  st->IL = _mm256_add_ps(st->IL, _mm256_mul_ps(cL, BI));
+  st->QL = _mm256_add_ps(st->QL, _mm256_mul_ps(cL, BQ));
+}
+
+/* Add the lanes to `corr` and, if given, carry the carrier of lane 0, which
+ * is that of the next sample, back to `carr`. */
+__attribute__((target("avx2")))
+static inline void corr_avx2_finish(const corr_avx2_state_t *st,
+                                    double corr[6], corr_carr_t *carr)
+{
+  if (carr)
+    corr_carr_set(carr, _mm256_cvtss_f32(st->nco.S),
+                  _mm256_cvtss_f32(st->nco.C));
+  corr[0] += corr_avx2_hsum(st->IE);
+  corr[1] += corr_avx2_hsum(st->QE);
+  corr[2] += corr_avx2_hsum(st->IP);
+  corr[3] += corr_avx2_hsum(st->QP);
+  corr[4] += corr_avx2_hsum(st->IL);
+  corr[5] += corr_avx2_hsum(st->QL);
+}
+
+__attribute__((target("avx2")))
+static void corr_avx2_run(const s8* samples, u32 n, const s8* code,
+                          double code_phase, double code_step,
+                          corr_carr_t* carr, double corr[6])
+{
+  u32 n_vec = corr_gather_safe_len(n, code_phase, code_step) & ~7u;
+
+  if (n_vec) {
+    corr_avx2_state_t st;
+    corr_avx2_init(&st, code_step, carr);
+    for (u32 i=0; i<n_vec; i+=8)
+      corr_avx2_block(&st, code, code_phase + i*code_step,
+                      corr_avx2_load_s8(&samples[i]));
+    corr_avx2_finish(&st, corr, carr);
+  }
+
+  if (n_vec < n)
+    corr_c_run(&samples[n_vec], n - n_vec, code,
+               code_phase + n_vec*code_step, code_step, carr, corr);
+}
+
+__attribute__((target("avx2")))
+static void corr_avx2(const s8* samples, u32 n, const s8* code,
+                      double code_phase, double code_step,
+                      double carr_phase, double carr_step,
+                      double corr[6])
+{
+  corr_carr_t carr;
+  corr_carr_init(&carr, carr_phase, carr_step);
+  corr_avx2_run(samples, n, code, code_phase, code_step, &carr, corr);
+}
+
+/* As corr_avx2() but decoding the packed samples in the kernel. Every 8
+ * samples take one byte in 1-bit format or two bytes in 2-bit format, each
+ * lane shifts its own sample down from those bytes and looks its value up
+ * with a permute, so the samples are never written out unpacked. */
+__attribute__((target("avx2")))
+static void corr_packed_avx2(const u8* packed, sample_fmt_t fmt,
+                             u32 first, u32 n, const s8* code,
+                             double code_phase, double code_step,
+                             double carr_phase, double carr_step,
+                             double corr[6])
+{
+  u8 bits = sample_fmt_bits(fmt);
+  u32 per_byte = 8 / bits;
+
+  /* Leading samples up to a byte boundary. */
+  u32 lead = MIN(n, (per_byte - first % per_byte) % per_byte);
+  if (lead) {
+    corr_packed_c(packed, fmt, first, lead, code, code_phase, code_step,
+                  carr_phase, carr_step, corr);
+    first += lead;
+    n -= lead;
+    code_phase += lead * code_step;
+    carr_phase += lead * carr_step;
+  }
+
+  u32 n_vec = corr_gather_safe_len(n, code_phase, code_step) & ~7u;
+
+  if (n_vec) {
+    __m256i shift, mask;
+    __m256 values;
+    if (fmt == SAMPLE_FMT_1BIT) {
+      shift = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+      mask = _mm256_set1_epi32(1);
+      values = _mm256_setr_ps(1, -1, 0, 0, 0, 0, 0, 0);
+    } else {
+      shift = _mm256_setr_epi32(14, 12, 10, 8, 6, 4, 2, 0);
+      mask = _mm256_set1_epi32(3);
+      values = _mm256_setr_ps(1, 3, -1, -3, 0, 0, 0, 0);
+    }
+
+    corr_carr_t carr;
+    corr_carr_init(&carr, carr_phase, carr_step);
+    corr_avx2_state_t st;
+    corr_avx2_init(&st, code_step, &carr);
+    const u8 *p = &packed[first / per_byte];
+    for (u32 i=0; i<n_vec; i+=8, p+=bits) {
+      u32 w = (bits == 1) ? p[0] : ((u32)p[0] << 8) | p[1];
+      __m256i v = _mm256_and_si256(
+                    _mm256_srlv_epi32(_mm256_set1_epi32(w), shift), mask);
+      corr_avx2_block(&st, code, code_phase + i*code_step,
+                      _mm256_permutevar8x32_ps(values, v));
+    }
+    corr_avx2_finish(&st, corr, 0);
+  }
+
+  if (n_vec < n)
+    corr_packed_c(packed, fmt, first + n_vec, n - n_vec, code,
+                  code_phase + n_vec*code_step, code_step,
+                  carr_phase + n_vec*carr_step, carr_step, corr);
+}
+
+__attribute__((target("avx2")))
+static void corr_replica_avx2(const s8* samples, u32 n,
+                              const s8* E, const s8* P, const s8* L,
+                              double carr_phase, double carr_step,
+                              double corr[6])
+{
+  u32 n_vec = n & ~7u;
+
+  if (n_vec) {
+    corr_carr_t carr;
+    corr_carr_init(&carr, carr_phase, carr_step);
+    corr_avx2_nco_t nco;
+    corr_avx2_nco_init(&nco, &carr);
+
+    __m256 IE = _mm256_setzero_ps(), QE = _mm256_setzero_ps();
+    __m256 IP = _mm256_setzero_ps(), QP = _mm256_setzero_ps();
+    __m256 IL = _mm256_setzero_ps(), QL = _mm256_setzero_ps();
+
+    for (u32 i=0; i<n_vec; i+=8) {
+      __m256 cE = corr_avx2_load_s8(&E[i]);
+      __m256 cP = corr_avx2_load_s8(&P[i]);
+      __m256 cL = corr_avx2_load_s8(&L[i]);
+
+      __m256 x = corr_avx2_load_s8(&samples[i]);
+      __m256 BI = _mm256_mul_ps(x, nco.S);
+      __m256 BQ = _mm256_mul_ps(x, nco.C);
+      corr_avx2_nco_step(&nco);
+
+      IE = _mm256_add_ps(IE, _mm256_mul_ps(cE, BI));
+      QE = _mm256_add_ps(QE, _mm256_mul_ps(cE, BQ));
+      IP = _mm256_add_ps(IP, _mm256_mul_ps(cP, BI));
+      QP = _mm256_add_ps(QP, _mm256_mul_ps(cP, BQ));
+      IL = _mm256_add_ps(IL, _mm256_mul_ps(cL, BI));
+      QL = _mm256_add_ps(QL, _mm256_mul_ps(cL, BQ));
+    }
+
+    corr[0] += corr_avx2_hsum(IE);
+    corr[1] += corr_avx2_hsum(QE);
+    corr[2] += corr_avx2_hsum(IP);
+    corr[3] += corr_avx2_hsum(QP);
+    corr[4] += corr_avx2_hsum(IL);
+    corr[5] += corr_avx2_hsum(QL);
+  }
+
+  if (n_vec < n)
+    corr_replica_c(&samples[n_vec], n - n_vec,
+                   &E[n_vec], &P[n_vec], &L[n_vec],
+                   carr_phase + n_vec*carr_step, carr_step, corr);
+}
+
+/* As corr_avx2() for interleaved complex samples, 8 complex samples per
+ * iteration. The I and Q bytes are split with a single pshufb. */
+__attribute__((target("avx2")))
+static void corr_iq_avx2(const s8* samples, u32 n, const s8* code,
+                         double code_phase, double code_step,
+                         double carr_phase, double carr_step,
+                         double corr[6])
+{
+  u32 n_vec = corr_gather_safe_len(n, code_phase, code_step) & ~7u;
+
+  if (n_vec) {
+    corr_carr_t carr;
+    corr_carr_init(&carr, carr_phase, carr_step);
+    corr_avx2_nco_t nco;
+    corr_avx2_nco_init(&nco, &carr);
+
+    const __m128i deinterleave = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                               1, 3, 5, 7, 9, 11, 13, 15);
+    __m256d lane_lo = _mm256_setr_pd(0, code_step, 2*code_step, 3*code_step);
+    __m256d lane_hi = _mm256_setr_pd(4*code_step, 5*code_step,
+                                     6*code_step, 7*code_step);
+    __m256d tap_half = _mm256_set1_pd(0.5);
+
+    __m256 IE = _mm256_setzero_ps(), QE = _mm256_setzero_ps();
+    __m256 IP = _mm256_setzero_ps(), QP = _mm256_setzero_ps();
+    __m256 IL = _mm256_setzero_ps(), QL = _mm256_setzero_ps();
+
+    for (u32 i=0; i<n_vec; i+=8) {
+      __m256d base = _mm256_set1_pd(code_phase + i*code_step + 0.5);
+      __m256d p_lo = _mm256_add_pd(base, lane_lo);
+      __m256d p_hi = _mm256_add_pd(base, lane_hi);
+      __m256 cE = corr_avx2_taps(code, p_lo, p_hi);
+      p_lo = _mm256_add_pd(p_lo, tap_half);
+      p_hi = _mm256_add_pd(p_hi, tap_half);
+      __m256 cP = corr_avx2_taps(code, p_lo, p_hi);
+      p_lo = _mm256_add_pd(p_lo, tap_half);
+      p_hi = _mm256_add_pd(p_hi, tap_half);
+      __m256 cL = corr_avx2_taps(code, p_lo, p_hi);
+
+      __m128i x = _mm_shuffle_epi8(
+        _mm_loadu_si128((const __m128i *)&samples[2*i]), deinterleave);
+      __m256 xI = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x));
+      __m256 xQ = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+                    _mm_unpackhi_epi64(x, x)));
+
+      /* Multiply by the conjugate of the local carrier. */
+      __m256 BI = _mm256_add_ps(_mm256_mul_ps(xI, nco.C),
+                                _mm256_mul_ps(xQ, nco.S));
+      __m256 BQ = _mm256_sub_ps(_mm256_mul_ps(xQ, nco.C),
+                                _mm256_mul_ps(xI, nco.S));
+      corr_avx2_nco_step(&nco);
+
+      IE = _mm256_add_ps(IE, _mm256_mul_ps(cE, BI));
+      QE = _mm256_add_ps(QE, _mm256_mul_ps(cE, BQ));
+      IP = _mm256_add_ps(IP, _mm256_mul_ps(cP, BI));
+      QP = _mm256_add_ps(QP, _mm256_mul_ps(cP, BQ));
+      IL = _mm256_add_ps(IL, _mm256_mul_ps(cL, BI));
+      QL = _mm256_add_ps(QL, _mm256_mul_ps(cL, BQ));
+    }
+
+    corr[0] += corr_avx2_hsum(IE);
+    corr[1] += corr_avx2_hsum(QE);
+    corr[2] += corr_avx2_hsum(IP);
+    corr[3] += corr_avx2_hsum(QP);
+    corr[4] += corr_avx2_hsum(IL);
+    corr[5] += corr_avx2_hsum(QL);
+  }
+
+  if (n_vec < n)
+    corr_iq_c(&samples[2*n_vec], n - n_vec, code,
+              code_phase + n_vec*code_step, code_step,
+              carr_phase + n_vec*carr_step, carr_step, corr);
+}
+
+/** Number of samples mixed down to baseband at once by corr_taps_avx2()
+ * before sweeping the taps over them. */
+#define CORR_TAPS_CHUNK_LEN 256
+
+/* Mixes a chunk of samples down to baseband once and stores it, then sweeps
+ * each tap over the chunk with only the chip gather and two multiply-adds
+ * per 8 samples, so the cost per tap matches that of corr_avx2(). */
+__attribute__((target("avx2")))
+static void corr_taps_avx2(const s8* samples, u32 n, const s8* code,
+                           double code_phase, double code_step,
+                           double carr_phase, double carr_step,
+                           u8 n_taps, const double offsets[],
+                           double corr[])
+{
+  float BI[CORR_TAPS_CHUNK_LEN] __attribute__((aligned(32)));
+  float BQ[CORR_TAPS_CHUNK_LEN] __attribute__((aligned(32)));
+  u32 n_vec = n & ~7u;
+
+  if (n_vec) {
+    corr_carr_t carr;
+    corr_carr_init(&carr, carr_phase, carr_step);
+    corr_avx2_nco_t nco;
+    corr_avx2_nco_init(&nco, &carr);
+
+    __m256d lane_lo = _mm256_setr_pd(0, code_step, 2*code_step, 3*code_step);
+    __m256d lane_hi = _mm256_setr_pd(4*code_step, 5*code_step,
+                                     6*code_step, 7*code_step);
+
+    for (u32 start=0; start<n_vec; start+=CORR_TAPS_CHUNK_LEN) {
+      u32 len = MIN(CORR_TAPS_CHUNK_LEN, n_vec - start);
+
+      for (u32 i=0; i<len; i+=8) {
+        __m256 x = corr_avx2_load_s8(&samples[start + i]);
+        _mm256_store_ps(&BI[i], _mm256_mul_ps(x, nco.S));
+        _mm256_store_ps(&BQ[i], _mm256_mul_ps(x, nco.C));
+        corr_avx2_nco_step(&nco);
+      }
+
+      for (u8 k=0; k<n_taps; k++) {
+        double phase = code_phase + start*code_step + offsets[k];
+        __m256 I = _mm256_setzero_ps(), Q = _mm256_setzero_ps();
+
+        for (u32 i=0; i<len; i+=8) {
+          __m256d base = _mm256_set1_pd(phase + i*code_step);
+          __m256 c = corr_avx2_taps(code, _mm256_add_pd(base, lane_lo),
+                                    _mm256_add_pd(base, lane_hi));
+          I = _mm256_add_ps(I, _mm256_mul_ps(c, _mm256_load_ps(&BI[i])));
+          Q = _mm256_add_ps(Q, _mm256_mul_ps(c, _mm256_load_ps(&BQ[i])));
+        }
+
+        corr[2*k] += corr_avx2_hsum(I);
+        corr[2*k+1] += corr_avx2_hsum(Q);
+      }
+    }
+  }
+
+  if (n_vec < n)
+    corr_taps_c(&samples[n_vec], n - n_vec, code,
+                code_phase + n_vec*code_step, code_step,
+                carr_phase + n_vec*carr_step, carr_step,
+                n_taps, offsets, corr);
+}
+
+/** Carrier NCO of the AVX-512 kernels, holding one phasor per lane. */
+typedef struct {
+  __m512 S;  /**< Carrier sine for each lane. */
+  __m512 C;  /**< Carrier cosine for each lane. */
+  __m512 dS; /**< Sine of the 16 sample rotation. */
+  __m512 dC; /**< Cosine of the 16 sample rotation. */
+} corr_avx512_nco_t;
+
+/* As corr_avx2_nco_init() for 16 lanes. */
+__attribute__((target("avx512f")))
+static inline void corr_avx512_nco_init(corr_avx512_nco_t *nco,
+                                        const corr_carr_t *carr)
+{
+  float s0[16], c0[16];
+  double s = carr->s, c = carr->c;
+  for (u8 k=0; k<16; k++) {
+    s0[k] = s;
+    c0[k] = c;
+    double s_ = s*carr->dc + c*carr->ds;
+    c = c*carr->dc - s*carr->ds;
+    s = s_;
+  }
+  double dS = s*carr->c - c*carr->s;
+  double dC = c*carr->c + s*carr->s;
+  nco->S = _mm512_loadu_ps(s0);
+  nco->C = _mm512_loadu_ps(c0);
+  nco->dS = _mm512_set1_ps(dS);
+  nco->dC = _mm512_set1_ps(dC);
+}
+
+/* Advance all lanes by 16 carrier steps and renormalise the phasors. */
+__attribute__((target("avx512f")))
+static inline void corr_avx512_nco_step(corr_avx512_nco_t *nco)
+{
+  __m512 S_ = _mm512_add_ps(_mm512_mul_ps(nco->S, nco->dC),
+                            _mm512_mul_ps(nco->C, nco->dS));
+  __m512 C_ = _mm512_sub_ps(_mm512_mul_ps(nco->C, nco->dC),
+                            _mm512_mul_ps(nco->S, nco->dS));
+  __m512 mag2 = _mm512_add_ps(_mm512_mul_ps(S_, S_), _mm512_mul_ps(C_, C_));
+  __m512 i_mag = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(3.0f), mag2),
+                               _mm512_set1_ps(0.5f));
+  nco->S = _mm512_mul_ps(S_, i_mag);
+  nco->C = _mm512_mul_ps(C_, i_mag);
+}
+
+/* Load 16 s8 values and convert them to float. */
+__attribute__((target("avx512f")))
+static inline __m512 corr_avx512_load_s8(const s8* p)
+{
+  __m128i x = _mm_loadu_si128((const __m128i *)p);
+  return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(x));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 corr_avx512_taps(const s8* code, __m512d p_lo, __m512d p_hi)
+{
+  __m256i i_lo = _mm512_cvttpd_epi32(p_lo);
+  __m256i i_hi = _mm512_cvttpd_epi32(p_hi);
+  __m512i idx = _mm512_inserti64x4(_mm512_castsi256_si512(i_lo), i_hi, 1);
+  __m512i chips = _mm512_i32gather_epi32(idx, (const int *)code, 1);
+  chips = _mm512_srai_epi32(_mm512_slli_epi32(chips, 24), 24);
+  return _mm512_cvtepi32_ps(chips);
+}
+
+__attribute__((target("avx512f")))
+static void corr_avx512_run(const s8* samples, u32 n, const s8* code,
+                            double code_phase, double code_step,
+                            corr_carr_t* carr, double corr[6])
+{
+  u32 n_vec = corr_gather_safe_len(n, code_phase, code_step) & ~15u;
+
+  if (n_vec) {
+    corr_avx512_nco_t nco;
+    corr_avx512_nco_init(&nco, carr);
+
+    double lane[16];
+    for (u8 k=0; k<16; k++)
+      lane[k] = k*code_step;
+    __m512d lane_lo = _mm512_loadu_pd(lane);
+    __m512d lane_hi = _mm512_loadu_pd(lane + 8);
+    __m512d tap_half = _mm512_set1_pd(0.5);
+
+    __m512 IE = _mm512_setzero_ps(), QE = _mm512_setzero_ps();
+    __m512 IP = _mm512_setzero_ps(), QP = _mm512_setzero_ps();
+    __m512 IL = _mm512_setzero_ps(), QL = _mm512_setzero_ps();
+
+    for (u32 i=0; i<n_vec; i+=16) {
+      __m512d base = _mm512_set1_pd(code_phase + i*code_step + 0.5);
+      __m512d p_lo = _mm512_add_pd(base, lane_lo);
+      __m512d p_hi = _mm512_add_pd(base, lane_hi);
+      __m512 cE = corr_avx512_taps(code, p_lo, p_hi);
+      p_lo = _mm512_add_pd(p_lo, tap_half);
+      p_hi = _mm512_add_pd(p_hi, tap_half);
+      __m512 cP = corr_avx512_taps(code, p_lo, p_hi);
+      p_lo = _mm512_add_pd(p_lo, tap_half);
+      p_hi = _mm512_add_pd(p_hi, tap_half);
+      __m512 cL = corr_avx512_taps(code, p_lo, p_hi);
+
+      __m512 x = corr_avx512_load_s8(&samples[i]);
+      __m512 BI = _mm512_mul_ps(x, nco.S);
+      __m512 BQ = _mm512_mul_ps(x, nco.C);
+      corr_avx512_nco_step(&nco);
+
+      IE = _mm512_add_ps(IE, _mm512_mul_ps(cE, BI));
+      QE = _mm512_add_ps(QE, _mm512_mul_ps(cE, BQ));
+      IP = _mm512_add_ps(IP, _mm512_mul_ps(cP, BI));
+      QP = _mm512_add_ps(QP, _mm512_mul_ps(cP, BQ));
+      IL = _mm512_add_ps(IL, _mm512_mul_ps(cL, BI));
+      QL = _mm512_add_ps(QL, _mm512_mul_ps(cL, BQ));
+    }
+
+    corr[0] += _mm512_reduce_add_ps(IE);
+    corr[1] += _mm512_reduce_add_ps(QE);
+    corr[2] += _mm512_reduce_add_ps(IP);
+    corr[3] += _mm512_reduce_add_ps(QP);
+    corr[4] += _mm512_reduce_add_ps(IL);
+    corr[5] += _mm512_reduce_add_ps(QL);
+
+    corr_carr_set(carr, _mm512_cvtss_f32(nco.S), _mm512_cvtss_f32(nco.C));
+  }
+
+  if (n_vec < n)
+    corr_c_run(&samples[n_vec], n - n_vec, code,
+               code_phase + n_vec*code_step, code_step, carr, corr);
+}
+
+__attribute__((target("avx512f")))
+static void corr_avx512(const s8* samples, u32 n, const s8* code,
+                        double code_phase, double code_step,
+                        double carr_phase, double carr_step,
+                        double corr[6])
+{
+  corr_carr_t carr;
+  corr_carr_init(&carr, carr_phase, carr_step);
+  corr_avx512_run(samples, n, code, code_phase, code_step, &carr, corr);
+}
+
+__attribute__((target("avx512f")))
+static void corr_replica_avx512(const s8* samples, u32 n,
+                                const s8* E, const s8* P, const s8* L,
+                                double carr_phase, double carr_step,
+                                double corr[6])
+{
+  u32 n_vec = n & ~15u;
+
+  if (n_vec) {
+    corr_carr_t carr;
+    corr_carr_init(&carr, carr_phase, carr_step);
+    corr_avx512_nco_t nco;
+    corr_avx512_nco_init(&nco, &carr);
+
+    __m512 IE = _mm512_setzero_ps(), QE = _mm512_setzero_ps();
+    __m512 IP = _mm512_setzero_ps(), QP = _mm512_setzero_ps();
+    __m512 IL = _mm512_setzero_ps(), QL = _mm512_setzero_ps();
+
+    for (u32 i=0; i<n_vec; i+=16) {
+      /* Replicas are 32 byte aligned so these are aligned loads. */
+      __m512 cE = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(
+                    _mm_load_si128((const __m128i *)&E[i])));
+      __m512 cP = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(
+                    _mm_load_si128((const __m128i *)&P[i])));
+      __m512 cL = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(
+                    _mm_load_si128((const __m128i *)&L[i])));
+
+      __m512 x = corr_avx512_load_s8(&samples[i]);
+      __m512 BI = _mm512_mul_ps(x, nco.S);
+      __m512 BQ = _mm512_mul_ps(x, nco.C);
+      corr_avx512_nco_step(&nco);
+
+      IE = _mm512_add_ps(IE, _mm512_mul_ps(cE, BI));
+      QE = _mm512_add_ps(QE, _mm512_mul_ps(cE, BQ));
+      IP = _mm512_add_ps(IP, _mm512_mul_ps(cP, BI));
+      QP = _mm512_add_ps(QP, _mm512_mul_ps(cP, BQ));
+      IL = _mm512_add_ps(IL, _mm512_mul_ps(cL, BI));
+      QL = _mm512_add_ps(QL, _mm512_mul_ps(cL, BQ));
+    }
+
+    corr[0] += _mm512_reduce_add_ps(IE);
+    corr[1] += _mm512_reduce_add_ps(QE);
+    corr[2] += _mm512_reduce_add_ps(IP);
+    corr[3] += _mm512_reduce_add_ps(QP);
+    corr[4] += _mm512_reduce_add_ps(IL);
+    corr[5] += _mm512_reduce_add_ps(QL);
+  }
+
+  if (n_vec < n)
+    corr_replica_c(&samples[n_vec], n - n_vec,
+                   &E[n_vec], &P[n_vec], &L[n_vec],
+                   carr_phase + n_vec*carr_step, carr_step, corr);
+}
+
+#endif /* CORRELATE_X86 */
+
+/** Kernels of one correlator implementation. Instruction sets without a
+ * kernel of their own use the best one they support. */
+typedef struct {
+  corr_impl_t impl;
+  corr_kernel_t corr;
+  corr_replica_kernel_t replica;
+  corr_int_kernel_t integer;
+  corr_taps_kernel_t taps;
+  corr_kernel_t iq;
+  corr_packed_kernel_t packed;
+  corr_run_kernel_t run;
+} corr_kernels_t;
+
+static const corr_kernels_t corr_kernels_c = {
+  CORR_IMPL_C, corr_c, corr_replica_c, corr_int_c, corr_taps_c, corr_iq_c,
+  corr_packed_c, corr_c_run
+};
+
+#ifdef CORRELATE_X86
+static const corr_kernels_t corr_kernels_ssse3 = {
+  CORR_IMPL_SSSE3, corr_ssse3, corr_replica_c, corr_int_ssse3, corr_taps_c,
+  corr_iq_c, corr_packed_ssse3, corr_ssse3_run
+};
+
+static const corr_kernels_t corr_kernels_avx2 = {
+  CORR_IMPL_AVX2, corr_avx2, corr_replica_avx2, corr_int_ssse3,
+  corr_taps_avx2, corr_iq_avx2, corr_packed_avx2, corr_avx2_run
+};
+
+static const corr_kernels_t corr_kernels_avx512 = {
+  CORR_IMPL_AVX512, corr_avx512, corr_replica_avx512, corr_int_ssse3,
+  corr_taps_avx2, corr_iq_avx2, corr_packed_avx2, corr_avx512_run
+};
+#endif
+
+/* Selected kernels, NULL until the first correlation or
+ * track_correlate_set_impl(). The correlators are called from several
+ * threads at once, e.g. by the acquisition pool and the tracking engine,
+ * so the pointer is only ever accessed atomically. */
+static const corr_kernels_t *corr_selected = 0;
+
+static bool corr_impl_supported(corr_impl_t impl)
+{
+  /* The CPU features are detected by a constructor in libgcc, so
+   * __builtin_cpu_init() isn't needed and, as it writes the feature flags
+   * again, isn't safe to call here. */
+  switch (impl) {
+  case CORR_IMPL_C:
+    return true;
+#ifdef CORRELATE_X86
+  case CORR_IMPL_SSSE3:
+    return __builtin_cpu_supports("ssse3");
+  case CORR_IMPL_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case CORR_IMPL_AVX512:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+static const corr_kernels_t* corr_impl_kernels(corr_impl_t impl)
+{
+  switch (impl) {
+#ifdef CORRELATE_X86
+  case CORR_IMPL_SSSE3:
+    return &corr_kernels_ssse3;
+  case CORR_IMPL_AVX2:
+    return &corr_kernels_avx2;
+  case CORR_IMPL_AVX512:
+    return &corr_kernels_avx512;
+#endif
+  default:
+    return &corr_kernels_c;
+  }
+}
+
+/** Fastest implementation supported by the CPU. */
+static corr_impl_t corr_impl_detect(void)
+{
+  corr_impl_t impl = CORR_IMPL_C;
+  for (corr_impl_t i = CORR_IMPL_C; i <= CORR_IMPL_AVX512; i++)
+    if (corr_impl_supported(i))
+      impl = i;
+  return impl;
+}
+
+/** Kernels to use, detecting the fastest ones on first use. If several
+ * threads get here first they all detect the same kernels, and a selection
+ * made meanwhile with track_correlate_set_impl() is kept. */
+static const corr_kernels_t* corr_kernels(void)
+{
+  const corr_kernels_t *k = __atomic_load_n(&corr_selected, __ATOMIC_ACQUIRE);
+  if (k)
+    return k;
+
+  const corr_kernels_t *expected = 0;
+  k = corr_impl_kernels(corr_impl_detect());
+  if (!__atomic_compare_exchange_n(&corr_selected, &expected, k, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    k = expected;
+  return k;
+}
+
+/** Number of samples from `code_phase` up to the next code rollover. */
+static u32 corr_period_len(double code_phase, double code_step)
+{
+  return (int)ceil((1023.0 - code_phase) / code_step);
+}
+
+/** Select the correlator implementation used by track_correlate().
+ *
+ * By default the fastest implementation supported by the host CPU is chosen
+ * on the first call to track_correlate(). This function can be used to force
+ * a particular implementation, e.g. for testing or benchmarking.
+ *
+ * \param impl Implementation to use, or `CORR_IMPL_AUTO` to detect the best
+ *             one supported by the CPU.
+ * \return 0 on success, -1 if `impl` is not supported on this host (in which
+ *         case the current selection is left unchanged).
+ */
+s8 track_correlate_set_impl(corr_impl_t impl)
+{
+  if (impl == CORR_IMPL_AUTO)
+    impl = corr_impl_detect();
+  else if (!corr_impl_supported(impl))
+    return -1;
+
+  __atomic_store_n(&corr_selected, corr_impl_kernels(impl), __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Get the correlator implementation used by track_correlate().
+ *
+ * \return The selected implementation, resolving `CORR_IMPL_AUTO` to the one
+ *         detected for the host CPU.
+ */
+corr_impl_t track_correlate_get_impl(void)
+{
+  return corr_kernels()->impl;
+}
+
+/** Correlate one code period of samples against the Early, Prompt and Late
+ * replicas of a spreading code.
+ *
+ * The samples are mixed down to baseband with a local carrier and correlated
+ * from `init_code_phase` up to the next code rollover. On return the code and
+ * carrier phases are advanced to the first sample after the rollover.
+ *
+ * The code array holds one chip per element with one chip of padding at each
+ * end, i.e. `code[0]` is chip 1022, `code[1..1023]` are chips 0 to 1022 and
+ * `code[1024]` is chip 0.
+ *
+ * The implementation is chosen at run time, see track_correlate_set_impl().
+ *
+ * \param samples         Real IF samples.
+ * \param code            Spreading code, 1025 chips as described above.
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation output.
+ * \param Q_E             Early quadrature correlation output.
+ * \param I_P             Prompt in-phase correlation output.
+ * \param Q_P             Prompt quadrature correlation output.
+ * \param I_L             Late in-phase correlation output.
+ * \param Q_L             Late quadrature correlation output.
+ * \param num_samples     Number of samples correlated output.
+ */
+void track_correlate(s8* samples, s8* code,
+                     double* init_code_phase, double code_step, double* init_carr_phase, double carr_step,
+                     double* I_E, double* Q_E, double* I_P, double* Q_P, double* I_L, double* Q_L, u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  double corr[6] = {0, 0, 0, 0, 0, 0};
+
+  *num_samples = corr_period_len(*init_code_phase, code_step);
+
+  k->corr(samples, *num_samples, code, *init_code_phase, code_step,
+          *init_carr_phase, carr_step, corr);
+
+  *init_code_phase += *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+
+  *I_E = corr[0];
+  *Q_E = corr[1];
+  *I_P = corr[2];
+  *Q_P = corr[3];
+  *I_L = corr[4];
+  *Q_L = corr[5];
+}
+
+/** Correlate one code period against a precomputed code replica.
+ *
+ * Equivalent to track_correlate() but the Early, Prompt and Late chips are
+ * read from a replica obtained with code_replica_get() for the same
+ * `init_code_phase` and `code_step`, which avoids the per sample chip index
+ * computation. See \ref replica for the accuracy of cached replicas.
+ *
+ * \param samples         Real IF samples.
+ * \param replica         Code replica for this code period.
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation output.
+ * \param Q_E             Early quadrature correlation output.
+ * \param I_P             Prompt in-phase correlation output.
+ * \param Q_P             Prompt quadrature correlation output.
+ * \param I_L             Late in-phase correlation output.
+ * \param Q_L             Late quadrature correlation output.
+ * \param num_samples     Number of samples correlated output.
+ * \return 0 on success, -1 if the replica is shorter than the code period, in
+ *         which case nothing is updated.
+ */
+s8 track_correlate_replica(const s8* samples, const code_replica_t* replica,
+                           double* init_code_phase, double code_step,
+                           double* init_carr_phase, double carr_step,
+                           double* I_E, double* Q_E,
+                           double* I_P, double* Q_P,
+                           double* I_L, double* Q_L,
+                           u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  double corr[6] = {0, 0, 0, 0, 0, 0};
+
+  u32 n = corr_period_len(*init_code_phase, code_step);
+  if (replica->len < n)
+    return -1;
+  *num_samples = n;
+
+  k->replica(samples, *num_samples,
+             replica->E, replica->P, replica->L,
+             *init_carr_phase, carr_step, corr);
+
+  *init_code_phase += *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+
+  *I_E = corr[0];
+  *Q_E = corr[1];
+  *I_P = corr[2];
+  *Q_P = corr[3];
+  *I_L = corr[4];
+  *Q_L = corr[5];
+
+  return 0;
+}
+
+/** Correlate one code period of samples using integer arithmetic only.
+ *
+ * Integer counterpart of track_correlate(), with the code and carrier
+ * phases held in fixed point phase accumulators as in a hardware
+ * correlator:
+ *
+ *  - The code phase is in chips, Q32.32 (`CORR_INT_CODE_ONE` is one chip).
+ *    A 64-bit accumulator is used rather than a 32-bit one so that the phase
+ *    resolution is fine enough to correlate a full code period without a
+ *    noticeable drift.
+ *  - The carrier phase is in cycles, Q0.32 (`CORR_INT_CARR_CYCLE` is one
+ *    cycle), and wraps naturally.
+ *
+ * The local carrier is taken from a 16 entry lookup table with amplitude
+ * `CORR_INT_CARR_AMP`, so the correlations are approximately
+ * `CORR_INT_CARR_AMP` times those of track_correlate(). The outputs are
+ * identical for every implementation selected with
+ * track_correlate_set_impl(). The accumulators cannot overflow for periods
+ * of up to 2^18 samples.
+ *
+ * \param samples         Real IF samples.
+ * \param code            Spreading code, padded as for track_correlate().
+ * \param init_code_phase Code phase of the first sample, Q32.32 chips,
+ *                        updated.
+ * \param code_step       Code phase increment per sample, Q32.32 chips.
+ * \param init_carr_phase Carrier phase of the first sample, Q0.32 cycles,
+ *                        updated.
+ * \param carr_step       Carrier phase increment per sample, Q0.32 cycles.
+ * \param I_E             Early in-phase correlation output.
+ * \param Q_E             Early quadrature correlation output.
+ * \param I_P             Prompt in-phase correlation output.
+ * \param Q_P             Prompt quadrature correlation output.
+ * \param I_L             Late in-phase correlation output.
+ * \param Q_L             Late quadrature correlation output.
+ * \param num_samples     Number of samples correlated output.
+ */
+void track_correlate_int(const s8* samples, const s8* code,
+                         u64* init_code_phase, u64 code_step,
+                         u32* init_carr_phase, u32 carr_step,
+                         s32* I_E, s32* Q_E,
+                         s32* I_P, s32* Q_P,
+                         s32* I_L, s32* Q_L,
+                         u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  s32 corr[6] = {0, 0, 0, 0, 0, 0};
+  u64 period = 1023 * CORR_INT_CODE_ONE;
 
+  *num_samples = (period - *init_code_phase + code_step - 1) / code_step;
+
+  k->integer(samples, *num_samples, code, *init_code_phase, code_step,
+             *init_carr_phase, carr_step, corr);
+
+  *init_code_phase += *num_samples * code_step - period;
+  *init_carr_phase += *num_samples * carr_step;
+
+  *I_E = corr[0];
+  *Q_E = corr[1];
+  *I_P = corr[2];
+  *Q_P = corr[3];
+  *I_L = corr[4];
+  *Q_L = corr[5];
+}
+
+/** Correlate one code period of samples against any number of code taps.
+ *
+ * Generalisation of track_correlate() to `n_taps` taps at arbitrary code
+ * offsets, all computed in the same pass over the samples. Tap `k` uses the
+ * chip at code phase `code_phase + offsets[k]`, wrapped modulo the code
+ * length, so offsets of -0.5, 0 and 0.5 chips give the Early, Prompt and Late
+ * correlations of track_correlate(). Offsets may be any value, including
+ * whole code periods.
+ *
+ * Internally the code is unwrapped to two periods so that no tap ever needs
+ * an explicit wrap, at the cost of a 2 KB copy per call.
+ *
+ * \param samples         Real IF samples.
+ * \param code            Spreading code, padded as for track_correlate().
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param n_taps          Number of taps, at most `CORR_MAX_TAPS`.
+ * \param offsets         Code offset of each tap relative to the prompt tap,
+ *                        in chips.
+ * \param I               In-phase correlation of each tap output.
+ * \param Q               Quadrature correlation of each tap output.
+ * \param num_samples     Number of samples correlated output.
+ * \return 0 on success, -1 if `n_taps` is too large.
+ */
+s8 track_correlate_taps(const s8* samples, const s8* code,
+                        double* init_code_phase, double code_step,
+                        double* init_carr_phase, double carr_step,
+                        u8 n_taps, const double offsets[],
+                        double I[], double Q[], u32* num_samples)
+{
+  if (n_taps > CORR_MAX_TAPS)
+    return -1;
+
+  const corr_kernels_t *k = corr_kernels();
+
+  /* Two code periods, plus enough to keep the 32-bit gathers of the last
+   * chip within the buffer. */
+  s8 unwrapped[2*1023 + 8];
+  memcpy(&unwrapped[0], &code[1], 1023);
+  memcpy(&unwrapped[1023], &code[1], 1023);
+  memcpy(&unwrapped[2*1023], &code[1], 8);
+
+  double offs[CORR_MAX_TAPS];
+  for (u8 t=0; t<n_taps; t++) {
+    offs[t] = fmod(offsets[t], 1023);
+    if (offs[t] < 0)
+      offs[t] += 1023;
+  }
+
+  double corr[2*CORR_MAX_TAPS];
+  memset(corr, 0, sizeof(corr));
+
+  *num_samples = corr_period_len(*init_code_phase, code_step);
+
+  k->taps(samples, *num_samples, unwrapped,
+          *init_code_phase, code_step, *init_carr_phase, carr_step,
+          n_taps, offs, corr);
+
+  *init_code_phase += *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+
+  for (u8 t=0; t<n_taps; t++) {
+    I[t] = corr[2*t];
+    Q[t] = corr[2*t+1];
+  }
+
+  return 0;
+}
+
+/** Correlate several consecutive code periods in one call.
+ *
+ * Equivalent to calling track_correlate() repeatedly, but the carrier
+ * rotator and code phase are carried across the code rollovers, with the
+ * accumulators only split at each rollover, rather than being set up again
+ * from the phases for every period. The correlations can be summed for long
+ * coherent integrations. Correlation
+ * stops after `max_periods` periods, or earlier if the next whole period
+ * would need more than `max_samples` samples in total.
+ *
+ * \param samples         Real IF samples.
+ * \param max_samples     Number of samples available in `samples`.
+ * \param code            Spreading code, padded as for track_correlate().
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param max_periods     Maximum number of code periods to correlate.
+ * \param corr_periods    Correlations of each period output, as
+ *                        [I_E, Q_E, I_P, Q_P, I_L, Q_L]. May be NULL,
+ *                        otherwise must have room for `max_periods` periods.
+ * \param corr_sum        Sum of the correlations of all periods output, as
+ *                        [I_E, Q_E, I_P, Q_P, I_L, Q_L]. May be NULL.
+ * \param num_samples     Total number of samples correlated output.
+ * \return Number of code periods correlated.
+ */
+u32 track_correlate_periods(const s8* samples, u32 max_samples,
+                            const s8* code,
+                            double* init_code_phase, double code_step,
+                            double* init_carr_phase, double carr_step,
+                            u32 max_periods, double corr_periods[][6],
+                            double corr_sum[6], u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  double code_phase = *init_code_phase;
+  u32 start = 0;
+  u32 p;
+
+  corr_carr_t carr;
+  corr_carr_init(&carr, *init_carr_phase, carr_step);
+
+  if (corr_sum)
+    memset(corr_sum, 0, 6 * sizeof(double));
+
+  for (p=0; p<max_periods; p++) {
+    u32 n = corr_period_len(code_phase, code_step);
+    if (start + n > max_samples)
+      break;
+
+    double corr[6] = {0, 0, 0, 0, 0, 0};
+    k->run(&samples[start], n, code, code_phase, code_step, &carr, corr);
+
+    for (u8 i=0; i<6; i++) {
+      if (corr_periods)
+        corr_periods[p][i] = corr[i];
+      if (corr_sum)
+        corr_sum[i] += corr[i];
+    }
+
+    code_phase += n * code_step - 1023;
+    start += n;
+  }
+
+  *init_code_phase = code_phase;
+  *init_carr_phase = fmod(*init_carr_phase + start*carr_step, 2*M_PI);
+  *num_samples = start;
+
+  return p;
+}
+
+/** Correlate one code period of complex baseband samples.
+ *
+ * As track_correlate() but for interleaved complex samples
+ * `[I_0, Q_0, I_1, Q_1, ...]`. The carrier is wiped off by multiplying each
+ * sample by the conjugate of the local carrier `exp(j * carr_phase)`, so a
+ * signal with the same phase as the local carrier gives a positive prompt
+ * in-phase correlation. As there is no IF, `carr_step` corresponds to the
+ * Doppler alone.
+ *
+ * \param samples         Interleaved complex samples, `2 * num_samples`
+ *                        bytes.
+ * \param code            Spreading code, padded as for track_correlate().
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation output.
+ * \param Q_E             Early quadrature correlation output.
+ * \param I_P             Prompt in-phase correlation output.
+ * \param Q_P             Prompt quadrature correlation output.
+ * \param I_L             Late in-phase correlation output.
+ * \param Q_L             Late quadrature correlation output.
+ * \param num_samples     Number of complex samples correlated output.
+ */
+void track_correlate_iq(const s8* samples, const s8* code,
+                        double* init_code_phase, double code_step,
+                        double* init_carr_phase, double carr_step,
+                        double* I_E, double* Q_E,
+                        double* I_P, double* Q_P,
+                        double* I_L, double* Q_L,
+                        u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  double corr[6] = {0, 0, 0, 0, 0, 0};
+
+  *num_samples = corr_period_len(*init_code_phase, code_step);
+
+  k->iq(samples, *num_samples, code, *init_code_phase, code_step,
+        *init_carr_phase, carr_step, corr);
+
+  *init_code_phase += *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+
+  *I_E = corr[0];
+  *Q_E = corr[1];
+  *I_P = corr[2];
+  *Q_P = corr[3];
+  *I_L = corr[4];
+  *Q_L = corr[5];
+}
+
+/** Correlate one code period of packed front-end samples.
+ *
+ * As track_correlate() but reading the samples directly from a packed
+ * capture buffer, so the whole buffer is never expanded in memory. The AVX2
+ * and AVX-512 implementations decode the 1 and 2-bit samples inside the
+ * correlator kernel. The others unpack them with samples_unpack() in chunks
+ * of `CORR_PACKED_CHUNK_LEN` into a buffer on the stack that stays in the L1
+ * cache and correlate each chunk as soon as it is unpacked.
+ *
+ * \param samples         Packed sample buffer.
+ * \param sample_offset   Index of the first sample to correlate in `samples`,
+ *                        need not be on a byte boundary.
+ * \param fmt             Format of `samples`.
+ * \param code            Spreading code, padded as for track_correlate().
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation output.
+ * \param Q_E             Early quadrature correlation output.
+ * \param I_P             Prompt in-phase correlation output.
+ * \param Q_P             Prompt quadrature correlation output.
+ * \param I_L             Late in-phase correlation output.
+ * \param Q_L             Late quadrature correlation output.
+ * \param num_samples     Number of samples correlated output.
+ */
+void track_correlate_packed(const u8* samples, u32 sample_offset,
+                            sample_fmt_t fmt, const s8* code,
+                            double* init_code_phase, double code_step,
+                            double* init_carr_phase, double carr_step,
+                            double* I_E, double* Q_E,
+                            double* I_P, double* Q_P,
+                            double* I_L, double* Q_L,
+                            u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  double corr[6] = {0, 0, 0, 0, 0, 0};
+
+  *num_samples = corr_period_len(*init_code_phase, code_step);
+
+  if (fmt == SAMPLE_FMT_S8) {
+    /* Nothing to unpack, correlate in place. */
+    k->corr((const s8*)&samples[sample_offset], *num_samples, code,
+            *init_code_phase, code_step, *init_carr_phase, carr_step,
+            corr);
+  } else {
+    k->packed(samples, fmt, sample_offset, *num_samples, code,
+              *init_code_phase, code_step, *init_carr_phase, carr_step,
+              corr);
+  }
+
+  *init_code_phase += *num_samples * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + *num_samples*carr_step, 2*M_PI);
+
+  *I_E = corr[0];
+  *Q_E = corr[1];
+  *I_P = corr[2];
+  *Q_P = corr[3];
+  *I_L = corr[4];
+  *Q_L = corr[5];
+}
+
+/** Correlate samples `start` to `start + n` of a run of samples split into
+ * two segments, as returned by sample_ring_segments(). The phases are those
+ * of sample `start`. */
+static void corr_segments(corr_kernel_t kernel,
+                          const s8* seg0, u32 n0, const s8* seg1,
+                          u32 start, u32 n, const s8* code,
+                          double code_phase, double code_step,
+                          double carr_phase, double carr_step,
+                          double corr[6])
+{
+  if (start < n0) {
+    u32 m = MIN(n, n0 - start);
+    kernel(&seg0[start], m, code, code_phase, code_step,
+           carr_phase, carr_step, corr);
+    start += m;
+    n -= m;
+    code_phase += m * code_step;
+    carr_phase += m * carr_step;
+  }
+  if (n)
+    kernel(&seg1[start - n0], n, code, code_phase, code_step,
+           carr_phase, carr_step, corr);
+}
+
+/** Correlate one code period of samples read from a ring buffer.
+ *
+ * As track_correlate() but reading the samples in place from a ring buffer,
+ * splitting the correlation at the end of the ring storage rather than
+ * copying the samples into a contiguous buffer. Each channel can keep its
+ * own read cursor into the same ring.
+ *
+ * \param ring            Sample ring buffer.
+ * \param pos             Index in the ring of the first sample to correlate,
+ *                        advanced past the samples correlated.
+ * \param code            Spreading code, padded as for track_correlate().
+ * \param init_code_phase Code phase of the first sample in chips, updated.
+ * \param code_step       Code phase increment per sample in chips.
+ * \param init_carr_phase Carrier phase of the first sample in radians, updated.
+ * \param carr_step       Carrier phase increment per sample in radians.
+ * \param I_E             Early in-phase correlation output.
+ * \param Q_E             Early quadrature correlation output.
+ * \param I_P             Prompt in-phase correlation output.
+ * \param Q_P             Prompt quadrature correlation output.
+ * \param I_L             Late in-phase correlation output.
+ * \param Q_L             Late quadrature correlation output.
+ * \param num_samples     Number of samples correlated output.
+ * \return 0 on success, -1 if the ring does not (or no longer) hold the whole
+ *         code period, in which case nothing is updated.
+ */
+s8 track_correlate_ring(const sample_ring_t* ring, u64* pos, const s8* code,
+                        double* init_code_phase, double code_step,
+                        double* init_carr_phase, double carr_step,
+                        double* I_E, double* Q_E,
+                        double* I_P, double* Q_P,
+                        double* I_L, double* Q_L,
+                        u32* num_samples)
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  const s8 *seg0, *seg1;
+  u32 n0;
+  u32 n = corr_period_len(*init_code_phase, code_step);
+  if (sample_ring_segments(ring, *pos, n, &seg0, &n0, &seg1))
+    return -1;
+
+  double corr[6] = {0, 0, 0, 0, 0, 0};
+  corr_segments(k->corr, seg0, n0, seg1, 0, n, code,
+                *init_code_phase, code_step, *init_carr_phase, carr_step, corr);
+
+  /* The producer may have written over the samples while correlating. */
+  if (sample_ring_overwritten(ring, *pos))
+    return -1;
+
+  *pos += n;
+  *num_samples = n;
+  *init_code_phase += n * code_step - 1023;
+  *init_carr_phase = fmod(*init_carr_phase + n*carr_step, 2*M_PI);
+
+  *I_E = corr[0];
+  *Q_E = corr[1];
+  *I_P = corr[2];
+  *Q_P = corr[3];
+  *I_L = corr[4];
+  *Q_L = corr[5];
+
+  return 0;
+}
+
+/** Work out the period length of every channel for corr_multi(), returning
+ * the longest. */
+static u32 corr_multi_len(u8 n_channels, corr_channel_t chans[])
+{
+  u32 n_max = 0;
+  for (u8 i=0; i<n_channels; i++) {
+    corr_channel_t *c = &chans[i];
+    c->num_samples = corr_period_len(c->code_phase, c->code_step);
+    for (u8 j=0; j<6; j++)
+      c->corr[j] = 0;
+    n_max = MAX(n_max, c->num_samples);
+  }
+  return n_max;
+}
+
+/** Sweep the samples in L1 sized chunks over all channels, see
+ * track_correlate_multi(). The samples are split into two segments as for
+ * corr_segments(). */
+static void corr_multi(corr_kernel_t kernel,
+                       const s8* seg0, u32 n0, const s8* seg1,
+                       u8 n_channels, corr_channel_t chans[])
+{
+  u32 n_max = 0;
+  for (u8 i=0; i<n_channels; i++)
+    n_max = MAX(n_max, chans[i].num_samples);
+
+  for (u32 start=0; start<n_max; start+=CORR_MULTI_CHUNK_LEN) {
+    for (u8 i=0; i<n_channels; i++) {
+      corr_channel_t *c = &chans[i];
+      if (start >= c->num_samples)
+        continue;
+      u32 n = MIN(CORR_MULTI_CHUNK_LEN, c->num_samples - start);
+      corr_segments(kernel, seg0, n0, seg1, start, n, c->code,
+                    c->code_phase + start*c->code_step, c->code_step,
+                    c->carr_phase + start*c->carr_step, c->carr_step,
+                    c->corr);
+    }
+  }
+
+  for (u8 i=0; i<n_channels; i++) {
+    corr_channel_t *c = &chans[i];
+    c->code_phase += c->num_samples * c->code_step - 1023;
+    c->carr_phase = fmod(c->carr_phase + c->num_samples*c->carr_step, 2*M_PI);
+  }
+}
+
+/** Correlate one code period for several channels in a single pass over a
+ * shared block of samples.
+ *
+ * This gives the same results as calling track_correlate() once per channel
+ * on the same `samples` pointer, but the samples are swept in chunks of
+ * `CORR_MULTI_CHUNK_LEN` that are correlated against every channel while they
+ * are still in the L1 cache, so the sample buffer is only read from memory
+ * once regardless of the number of channels.
+ *
+ * For each channel the correlations and `num_samples` are written to the
+ * channel struct and its code and carrier phases are advanced past the code
+ * rollover, exactly as for track_correlate(). The `samples` buffer must hold
+ * at least as many samples as the longest channel period.
+ *
+ * \param samples    Real IF samples, shared by all channels.
+ * \param n_channels Number of channels in `chans`.
+ * \param chans      Array of channel states.
+ */
+void track_correlate_multi(const s8* samples, u8 n_channels,
+                           corr_channel_t chans[])
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  u32 n_max = corr_multi_len(n_channels, chans);
+  corr_multi(k->corr, samples, n_max, 0, n_channels, chans);
+}
+
+/** Correlate one code period for several channels reading from a ring
+ * buffer.
+ *
+ * As track_correlate_multi(), with all channels starting at sample `pos` of
+ * the ring.
+ *
+ * \param ring       Sample ring buffer.
+ * \param pos        Index in the ring of the first sample to correlate.
+ * \param n_channels Number of channels in `chans`.
+ * \param chans      Array of channel states.
+ * \return 0 on success, -1 if the ring does not (or no longer) hold the
+ *         samples for the longest channel period, in which case the channel
+ *         states are not valid.
+ */
+s8 track_correlate_multi_ring(const sample_ring_t* ring, u64 pos,
+                              u8 n_channels, corr_channel_t chans[])
+{
+  const corr_kernels_t *k = corr_kernels();
+
+  const s8 *seg0, *seg1;
+  u32 n0;
+  u32 n_max = corr_multi_len(n_channels, chans);
+  if (sample_ring_segments(ring, pos, n_max, &seg0, &n0, &seg1))
+    return -1;
+
+  corr_multi(k->corr, seg0, n0, seg1, n_channels, chans);
+
+  /* The producer may have written over the samples while correlating. */
+  if (sample_ring_overwritten(ring, pos))
+    return -1;
+
+  return 0;
+}
+
+/** \} */
 
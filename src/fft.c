@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "fft.h"
+
+/** \defgroup fft FFT
+ * Radix-2 complex fast Fourier transforms.
+ *
+ * The transforms are in place, iterative decimation in time. The twiddle
+ * factors of each stage are stored contiguously so that the butterfly loops
+ * have unit stride and can be vectorised by the compiler.
+ * \{ */
+
+/** Initialise an FFT plan.
+ *
+ * Remember to free the plan with fft_plan_destroy().
+ *
+ * \param plan Plan to initialise.
+ * \param n    Transform length, must be a power of two.
+ * \return 0 on success, -1 if `n` is not a power of two or on a malloc()
+ *         failure.
+ */
+s8 fft_plan_init(fft_plan_t* plan, u32 n)
+{
+  plan->n = n;
+  plan->twiddle = 0;
+  plan->bitrev = 0;
+
+  if (n < 2 || (n & (n - 1)))
+    return -1;
+
+  plan->twiddle = malloc((n - 1) * sizeof(fft_cpx_t));
+  plan->bitrev = malloc(n * sizeof(u32));
+  if (!plan->twiddle || !plan->bitrev) {
+    fft_plan_destroy(plan);
+    return -1;
+  }
+
+  /* The stage combining blocks of `half` uses twiddles
+   * exp(-2 pi i j / (2 half)) for j < half, stored from index half - 1. */
+  for (u32 half = 1; half < n; half *= 2) {
+    for (u32 j = 0; j < half; j++) {
+      double a = -M_PI * j / half;
+      plan->twiddle[half - 1 + j].re = cos(a);
+      plan->twiddle[half - 1 + j].im = sin(a);
+    }
+  }
+
+  u32 bits = 0;
+  while ((1u << bits) < n)
+    bits++;
+  for (u32 i = 0; i < n; i++) {
+    u32 r = 0;
+    for (u32 b = 0; b < bits; b++)
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    plan->bitrev[i] = r;
+  }
+
+  return 0;
+}
+
+/** Free the tables held by an FFT plan.
+ *
+ * \param plan Plan to destroy.
+ */
+void fft_plan_destroy(fft_plan_t* plan)
+{
+  free(plan->twiddle);
+  free(plan->bitrev);
+  plan->twiddle = 0;
+  plan->bitrev = 0;
+}
+
+/** Forward FFT, in place.
+ *
+ * Computes \f$ X_k = \sum_n x_n e^{-2 \pi i k n / N} \f$.
+ *
+ * \param plan Plan for the transform length.
+ * \param x    Data to transform, `plan->n` values.
+ */
+void fft_forward(const fft_plan_t* plan, fft_cpx_t* x)
+{
+  u32 n = plan->n;
+
+  for (u32 i = 0; i < n; i++) {
+    u32 j = plan->bitrev[i];
+    if (j > i) {
+      fft_cpx_t t = x[i];
+      x[i] = x[j];
+      x[j] = t;
+    }
+  }
+
+  for (u32 half = 1; half < n; half *= 2) {
+    const fft_cpx_t* w = &plan->twiddle[half - 1];
+    for (u32 k = 0; k < n; k += 2*half) {
+      fft_cpx_t* a = &x[k];
+      fft_cpx_t* b = &x[k + half];
+      for (u32 j = 0; j < half; j++) {
+        float re = b[j].re*w[j].re - b[j].im*w[j].im;
+        float im = b[j].re*w[j].im + b[j].im*w[j].re;
+        b[j].re = a[j].re - re;
+        b[j].im = a[j].im - im;
+        a[j].re += re;
+        a[j].im += im;
+      }
+    }
+  }
+}
+
+/** Inverse FFT, in place.
+ *
+ * Computes \f$ x_n = \sum_k X_k e^{2 \pi i k n / N} \f$, note that the
+ * result is not scaled by \f$ 1/N \f$.
+ *
+ * \param plan Plan for the transform length.
+ * \param x    Data to transform, `plan->n` values.
+ */
+void fft_inverse(const fft_plan_t* plan, fft_cpx_t* x)
+{
+  for (u32 i = 0; i < plan->n; i++)
+    x[i].im = -x[i].im;
+  fft_forward(plan, x);
+  for (u32 i = 0; i < plan->n; i++)
+    x[i].im = -x[i].im;
+}
+
+/** \} */
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+
+#include "bits.h"
+#include "ionosphere.h"
+
+/** \defgroup ionosphere Ionosphere and UTC
+ * Ionospheric model and UTC parameters broadcast in the navigation message.
+ * \{ */
+
+/** Decode the ionospheric and UTC parameters from subframe 4 page 18.
+ *
+ * References:
+ *   -# IS-GPS-200D Section 20.3.3.5.1.6 and 20.3.3.5.1.7
+ *
+ * \param words Words 3 to 10 of a subframe 4 with correct parity, the data
+ *              bits inverted where necessary, as for decode_ephemeris().
+ * \param iono  Ionospheric model parameters output.
+ * \param utc   UTC parameters output.
+ * \return 0 if the parameters were decoded, -1 if the words hold a different
+ *         page.
+ */
+s8 decode_iono_utc(const u32 words[8], ionosphere_t *iono, utc_params_t *utc)
+{
+  /* SV ID: Word 3, bits 3-8 */
+  if ((words[3-3] >> (30-8) & 0x3F) != 56)
+    return -1;
+
+  /* alpha_0 to alpha_3: Word 3, bits 9-24 and word 4, bits 1-16 */
+  iono->a0 = getbits_navword(words[3-3], 16, 8) * pow(2, -30);
+  iono->a1 = getbits_navword(words[3-3], 24, 8) * pow(2, -27);
+  iono->a2 = getbits_navword(words[4-3], 8, 8) * pow(2, -24);
+  iono->a3 = getbits_navword(words[4-3], 16, 8) * pow(2, -24);
+
+  /* beta_0 to beta_3: Word 4, bits 17-24 and word 5, bits 1-24 */
+  iono->b0 = getbits_navword(words[4-3], 24, 8) * pow(2, 11);
+  iono->b1 = getbits_navword(words[5-3], 8, 8) * pow(2, 14);
+  iono->b2 = getbits_navword(words[5-3], 16, 8) * pow(2, 16);
+  iono->b3 = getbits_navword(words[5-3], 24, 8) * pow(2, 16);
+  iono->valid = 1;
+
+  /* A_1: Word 6, bits 1-24 */
+  utc->a1 = getbits_navword(words[6-3], 24, 24) * pow(2, -50);
+
+  /* A_0: Word 7, bits 1-24 and word 8, bits 1-8 */
+  s32 a0 = (s32)((words[7-3] >> (30-24) & 0xFFFFFF) << 8
+                 | (words[8-3] >> (30-8) & 0xFF));
+  utc->a0 = a0 * pow(2, -30);
+
+  /* t_ot: Word 8, bits 9-16 */
+  utc->tot = (words[8-3] >> (30-16) & 0xFF) * 4096;
+  /* WN_t: Word 8, bits 17-24 */
+  utc->wnt = words[8-3] >> (30-24) & 0xFF;
+
+  /* Delta t_LS: Word 9, bits 1-8 */
+  utc->dt_ls = getbits_navword(words[9-3], 8, 8);
+  /* WN_LSF: Word 9, bits 9-16 */
+  utc->wn_lsf = words[9-3] >> (30-16) & 0xFF;
+  /* DN: Word 9, bits 17-24 */
+  utc->dn = words[9-3] >> (30-24) & 0xFF;
+  /* Delta t_LSF: Word 10, bits 1-8 */
+  utc->dt_lsf = getbits_navword(words[10-3], 8, 8);
+  utc->valid = 1;
+
+  return 0;
+}
+
+/** \} */
@@ -17,7 +17,6 @@
 
 #include "logging.h"
 #include "constants.h"
-#include "bits.h"
 #include "nav_msg.h"
 
 /* Approx number of nav bit edges needed to accept bit sync for a
@@ -52,7 +51,7 @@ static u32 extract_word(nav_msg_t *n, u16 bit_index, u8 n_bits, u8 invert)
   }
 
   /* Wrap if necessary. */
-  if (bit_index > NAV_MSG_SUBFRAME_BITS_LEN*32)
+  if (bit_index >= NAV_MSG_SUBFRAME_BITS_LEN*32)
     bit_index -= NAV_MSG_SUBFRAME_BITS_LEN*32;
 
   u8 bix_hi = bit_index >> 5;
@@ -72,12 +71,57 @@ static u32 extract_word(nav_msg_t *n, u16 bit_index, u8 n_bits, u8 invert)
   return word >> (32 - n_bits);
 }
 
-/* TODO: Bit synchronization that can operate with multi-ms integration times
-   e.g. http://www.thinkmind.org/download.php?articleid=spacomm_2013_2_30_30070
+/* Bit phase the histogram `hist` settles on, or `BITSYNC_UNSYNCED` if it
+ * is not clear yet. `prev_corr` holds the last 20 correlations. Entries are
+ * `stride` apart so that the histograms of a batch can be checked in place. */
+static s8 bit_sync_phase(const u32 hist[], const s32 prev_corr[], u32 stride)
+{
+  /* Histogram is valid.  Find the two highest values. */
+  u32 max = 0, next_best = 0;
+  u32 max_prev_corr = 0;
+  u8 max_i = 0;
+  for (u8 i = 0; i < 20; i++) {
+    u32 v = hist[i * stride];
+    if (v > max) {
+      next_best = max;
+      max = v;
+      max_i = i;
+    } else if (v > next_best) {
+      next_best = v;
+    }
+    /* Also find the highest value from the last 20 correlations.
+       We'll use this to normalize the threshold score. */
+    v = abs(prev_corr[i * stride]);
+    if (v > max_prev_corr)
+      max_prev_corr = v;
+  }
+  /* Form score from difference between the best and the second-best */
+  if (max - next_best > BITSYNC_THRES * 2 * max_prev_corr)
+    return max_i;
+  return BITSYNC_UNSYNCED;
+}
+
+/* Decide on bit sync once the histogram holds a full pass of bit phases,
+ * i.e. after the correlation ending at bit phase 20 - ms. */
+static void bit_sync_decide(nav_msg_t *n)
+{
+  /* We are synchronized if the histogram has a clear peak. */
+  n->bit_phase_ref = bit_sync_phase(n->bitsync_histogram,
+                                    n->bitsync_prev_corr, 1);
+  /* TODO: Subtract necessary older prev_corrs from bit_integrate to
+     ensure it will be correct for the upcoming first dump */
+}
+
+/* Bit synchronization for integration times of `ms` milliseconds, where `ms`
+ * divides 20 and the integrations are aligned to multiples of `ms` ms of bit
+ * phase (true from nav_msg_init() as long as `ms` is not changed before bit
+ * sync). Only the histogram bins at those phases are filled, and each
+ * correlation already spans `ms` bit phases, so the histogram peak and the
+ * threshold scale in the same way as with 1 ms integrations.
  */
-static void update_bit_sync(nav_msg_t *n, s32 corr_prompt_real)
+static void update_bit_sync(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
 {
-  /* On 20th call:
+  /* On 20th call (for ms = 1):
      bit_phase = 0
      bitsync_count = 20
      bit_integrate holds sum of first 20 correlations
@@ -105,80 +149,28 @@ ____bit_integrate is sum of these after 20th call__________
         then max_i = bit_phase_ref = 0.
   */
 
-  /* Maintain a rolling sum of the 20 most recent correlations in
+  /* Maintain a rolling sum of the 20 ms of most recent correlations in
      bit_integrate */
   n->bit_integrate -= n->bitsync_prev_corr[n->bit_phase];
   n->bitsync_prev_corr[n->bit_phase] = corr_prompt_real;
   if (n->bitsync_count < 20) {
-    n->bitsync_count++;
+    n->bitsync_count += ms;
     return;  /* That rolling accumulator is not valid yet */
   }
 
   /* Add the accumulator to the histogram for the relevant phase */
   n->bitsync_histogram[(n->bit_phase) % 20] += abs(n->bit_integrate);
 
-  if (n->bit_phase == 20 - 1) {
-    /* Histogram is valid.  Find the two highest values. */
-    u32 max = 0, next_best = 0;
-    u32 max_prev_corr = 0;
-    u8 max_i = 0;
-    for (u8 i = 0; i < 20; i++) {
-      u32 v = n->bitsync_histogram[i];
-      if (v > max) {
-        next_best = max;
-        max = v;
-        max_i = i;
-      } else if (v > next_best) {
-        next_best = v;
-      }
-      /* Also find the highest value from the last 20 correlations.
-         We'll use this to normalize the threshold score. */
-      v = abs(n->bitsync_prev_corr[i]);
-      if (v > max_prev_corr)
-        max_prev_corr = v;
-    }
-    /* Form score from difference between the best and the second-best */
-    if (max - next_best > BITSYNC_THRES * 2 * max_prev_corr) {
-      /* We are synchronized! */
-      n->bit_phase_ref = max_i;
-      /* TODO: Subtract necessary older prev_corrs from bit_integrate to
-         ensure it will be correct for the upcoming first dump */
-    }
-  }
+  if (n->bit_phase == 20 - ms)
+    bit_sync_decide(n);
 }
 
-/** Navigation message decoding update.
- * Called once per tracking loop update. Performs the necessary steps to
- * recover the nav bit clock, store the nav bits and decode them.
- *
- * Also extracts and returns the GPS time of week each time a new subframe is
- * received.
- *
- * \param n Nav message decode state struct
- * \param corr_prompt_real In-phase prompt correlation from tracking loop
- * \param ms Number of milliseconds integration performed in the correlation
- *
- * \return The GPS time of week in milliseconds of the current code phase
- *         rollover, or `TOW_INVALID` (-1) if unknown
- */
-s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
+/* Store a nav bit dumped at a bit boundary and look for the preamble.
+ * Returns as for nav_msg_update(). */
+static s32 nav_msg_dump_bit(nav_msg_t *n)
 {
   s32 TOW_ms = TOW_INVALID;
 
-  n->bit_phase += ms;
-  n->bit_phase %= 20;
-  n->bit_integrate += corr_prompt_real;
-  /* Do we have bit phase lock yet? (Do we know which of the 20 possible PRN
-   * offsets corresponds to the nav bit edges?) */
-  if (n->bit_phase_ref == BITSYNC_UNSYNCED)
-    update_bit_sync(n, corr_prompt_real);
-
-  if (n->bit_phase != n->bit_phase_ref) {
-    /* Either we don't have bit phase lock, or this particular
-       integration is not aligned to a nav bit boundary. */
-    return TOW_INVALID;
-  }
-
   /* Dump the nav bit, i.e. determine the sign of the correlation over the
    * nav bit period. */
   bool bit_val = n->bit_integrate > 0;
@@ -270,58 +262,495 @@ s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
   return TOW_ms;
 }
 
-/* Tests the parity of a L1 C/A NAV message word.
- * Inverts the data bits if necessary, and checks the parity.
- * Expects a word where MSB = D29*, bit 30 = D30*, bit 29 = D1, ... LSB = D30.
+/** Navigation message decoding update.
+ * Called once per tracking loop update. Performs the necessary steps to
+ * recover the nav bit clock, store the nav bits and decode them.
  *
- * \note This function may modify the value of `word`.
+ * Also extracts and returns the GPS time of week each time a new subframe is
+ * received.
  *
- * References:
- *   -# ICD-GPS-200E Table 20-XIV
+ * Integrations of more than 1 ms are supported as long as `ms` divides 20
+ * and is not changed before bit sync has been achieved.
+ *
+ * \param n Nav message decode state struct
+ * \param corr_prompt_real In-phase prompt correlation from tracking loop
+ * \param ms Number of milliseconds integration performed in the correlation
+ *
+ * \return The GPS time of week in milliseconds of the current code phase
+ *         rollover, or `TOW_INVALID` (-1) if unknown
+ */
+s32 nav_msg_update(nav_msg_t *n, s32 corr_prompt_real, u8 ms)
+{
+  n->bit_phase += ms;
+  n->bit_phase %= 20;
+  n->bit_integrate += corr_prompt_real;
+  /* Do we have bit phase lock yet? (Do we know which of the 20 possible PRN
+   * offsets corresponds to the nav bit edges?) */
+  if (n->bit_phase_ref == BITSYNC_UNSYNCED)
+    update_bit_sync(n, corr_prompt_real, ms);
+
+  if (n->bit_phase != n->bit_phase_ref) {
+    /* Either we don't have bit phase lock, or this particular
+       integration is not aligned to a nav bit boundary. */
+    return TOW_INVALID;
+  }
+
+  return nav_msg_dump_bit(n);
+}
+
+/* Bit sync over correlations `stride` apart, stopping early if sync is
+ * achieved. Works through one pass over the bit phases at a time so that the
+ * rolling sums and histogram updates are straight line loops without the
+ * per-correlation phase wrapping and branching of update_bit_sync().
+ * Returns the number of correlations consumed. */
+static u32 bit_sync_block(nav_msg_t *n, u32 n_corr, const s32 corr[],
+                          u32 stride, u8 ms)
+{
+  u32 i = 0;
+
+  /* Fill the rolling window before the histogram can be accumulated. */
+  while (i < n_corr && n->bitsync_count < 20) {
+    n->bit_phase = (n->bit_phase + ms) % 20;
+    n->bit_integrate += corr[i * stride];
+    update_bit_sync(n, corr[i * stride], ms);
+    i++;
+  }
+
+  while (i < n_corr && n->bit_phase_ref == BITSYNC_UNSYNCED) {
+    u32 phase = (n->bit_phase + ms) % 20;
+    /* Correlations up to the end of this pass over the bit phases. */
+    u32 len = MIN(n_corr - i, (20 - phase + ms - 1) / ms);
+    s32 roll[20];
+
+    /* Change in the rolling sum as each correlation enters and the one
+     * 20 ms older leaves. */
+    for (u32 j = 0; j < len; j++) {
+      s32 c = corr[(i + j) * stride];
+      roll[j] = c - n->bitsync_prev_corr[phase + j * ms];
+      n->bitsync_prev_corr[phase + j * ms] = c;
+    }
+    s32 acc = n->bit_integrate;
+    for (u32 j = 0; j < len; j++) {
+      acc += roll[j];
+      roll[j] = acc;
+    }
+    for (u32 j = 0; j < len; j++)
+      n->bitsync_histogram[phase + j * ms] += abs(roll[j]);
+
+    n->bit_integrate = acc;
+    n->bit_phase = phase + (len - 1) * ms;
+    i += len;
+
+    if (n->bit_phase == 20 - ms)
+      bit_sync_decide(n);
+  }
+
+  return i;
+}
+
+static s32 nav_msg_update_strided(nav_msg_t *n, u32 n_corr, const s32 corr[],
+                                  u32 stride, u8 ms)
+{
+  s32 TOW_ms = TOW_INVALID;
+  s32 err = TOW_INVALID;
+  u32 TOW_i = 0;
+  u32 i = 0;
+
+  while (i < n_corr) {
+    bool edge;
+    if (n->bit_phase_ref == BITSYNC_UNSYNCED) {
+      i += bit_sync_block(n, n_corr - i, &corr[i * stride], stride, ms);
+      /* The correlation completing bit sync may also end a nav bit. */
+      edge = n->bit_phase == n->bit_phase_ref;
+    } else {
+      /* Integrate up to the correlation ending on the next bit boundary.
+       * If the integrations are not aligned to the bit phase that boundary
+       * is never reached, as in nav_msg_update(). */
+      u32 to_edge = (n->bit_phase_ref + 20 - n->bit_phase) % 20;
+      u32 n_edge = to_edge % ms ? n_corr - i + 1
+                                : (to_edge ? to_edge : 20) / ms;
+      u32 len = MIN(n_corr - i, n_edge);
+      s32 sum = 0;
+      for (u32 j = 0; j < len; j++)
+        sum += corr[(i + j) * stride];
+      n->bit_integrate += sum;
+      n->bit_phase = (n->bit_phase + len * ms) % 20;
+      i += len;
+      edge = len == n_edge;
+    }
+
+    if (edge) {
+      s32 ret = nav_msg_dump_bit(n);
+      if (ret >= 0) {
+        TOW_ms = ret;
+        TOW_i = i;
+      } else if (ret != TOW_INVALID) {
+        err = ret;
+      }
+    }
+  }
+
+  if (TOW_ms >= 0)
+    return (TOW_ms + (n_corr - TOW_i) * ms) % (7*24*60*60*1000);
+  return err;
+}
+
+/** Navigation message decoding update over a block of correlations.
+ * Equivalent to calling nav_msg_update() on each correlation of the block in
+ * turn, but bit sync and the integration of nav bits are done over runs of
+ * correlations, only dropping into the bit decoding at nav bit boundaries.
  *
- * \param word Pointer to word to check. Note, if D30* is set then the data
- *             bits in this word will be inverted in place.
- * \return 0 if the parity is correct,
- *         otherwise returns the number of the first incorrect parity bit.
+ * Subframes must still be processed with process_subframe() before the
+ * subframe buffer overruns, so blocks should be kept well under 5 s long.
+ *
+ * \param n Nav message decode state struct
+ * \param n_corr Number of correlations in the block
+ * \param corr_prompt_real In-phase prompt correlations from tracking loop,
+ *                         oldest first
+ * \param ms Number of milliseconds integration performed in each correlation
+ *
+ * \return The GPS time of week in milliseconds of the code phase rollover at
+ *         the end of the block if a new subframe was received during the
+ *         block, otherwise the last error nav_msg_update() would have
+ *         returned or `TOW_INVALID` (-1)
  */
-static u8 nav_parity(u32 *word)
+s32 nav_msg_update_block(nav_msg_t *n, u32 n_corr,
+                         const s32 corr_prompt_real[], u8 ms)
+{
+  return nav_msg_update_strided(n, n_corr, corr_prompt_real, 1, ms);
+}
+
+/* Number of channels of a batch whose bit sync is run together. */
+#define NAV_BATCH_LANES 32
+
+/* Bit sync of the channels `ch` of a batch together. The channels must all
+ * be unsynced, past filling their rolling window and at the same bit phase.
+ * Their rolling sums, last correlations and histograms are copied out
+ * channel-minor so that updating every channel for one correlation is a
+ * straight line loop. Runs up to the end of the first pass over the bit
+ * phases after which any of the channels is synced, as the synced channels
+ * then go their own way. Returns the number of correlations consumed. */
+static u32 bit_sync_batch(nav_msg_t *n[], u8 n_lanes, const u8 ch[],
+                          u32 n_corr, const s32 corr[], u32 stride, u8 ms)
 {
-  if (*word & 1<<30) { /* Inspect D30* */
-    *word ^= 0x3FFFFFC0; /* D30* = 1, invert all the data bits! */
+  s32 integrate[NAV_BATCH_LANES];
+  s32 prev_corr[20][NAV_BATCH_LANES];
+  u32 histogram[20][NAV_BATCH_LANES];
+  s32 c[NAV_BATCH_LANES];
+
+  for (u8 k = 0; k < n_lanes; k++) {
+    integrate[k] = n[ch[k]]->bit_integrate;
+    for (u8 p = 0; p < 20; p++) {
+      prev_corr[p][k] = n[ch[k]]->bitsync_prev_corr[p];
+      histogram[p][k] = n[ch[k]]->bitsync_histogram[p];
+    }
   }
 
-  /* Check D25 */
-  if (parity(*word & 0xBB1F34A0 /* 0b10111011000111110011010010100000 */)) {
-    return 25;
+  u8 phase = n[ch[0]]->bit_phase;
+  bool synced = false;
+  u32 i = 0;
+  while (i < n_corr && !synced) {
+    phase = (phase + ms) % 20;
+    for (u8 k = 0; k < n_lanes; k++)
+      c[k] = corr[i * stride + ch[k]];
+    /* As update_bit_sync() for each channel. */
+    for (u8 k = 0; k < n_lanes; k++) {
+      integrate[k] += c[k] - prev_corr[phase][k];
+      prev_corr[phase][k] = c[k];
+      histogram[phase][k] += abs(integrate[k]);
+    }
+    i++;
+
+    if (phase == 20 - ms) {
+      for (u8 k = 0; k < n_lanes; k++) {
+        n[ch[k]]->bit_phase_ref = bit_sync_phase(&histogram[0][k],
+                                                 &prev_corr[0][k],
+                                                 NAV_BATCH_LANES);
+        if (n[ch[k]]->bit_phase_ref != BITSYNC_UNSYNCED)
+          synced = true;
+      }
+    }
   }
-  /* Check D26 */
-  if (parity(*word & 0x5D8F9A50 /* 0b01011101100011111001101001010000 */)) {
-    return 26;
+
+  for (u8 k = 0; k < n_lanes; k++) {
+    n[ch[k]]->bit_phase = phase;
+    n[ch[k]]->bit_integrate = integrate[k];
+    for (u8 p = 0; p < 20; p++) {
+      n[ch[k]]->bitsync_prev_corr[p] = prev_corr[p][k];
+      n[ch[k]]->bitsync_histogram[p] = histogram[p][k];
+    }
   }
-  /* Check D27 */
-  if (parity(*word & 0xAEC7CD08 /* 0b10101110110001111100110100001000 */)) {
-    return 27;
+
+  return i;
+}
+
+/** Navigation message decoding update for a batch of channels.
+ * Equivalent to running nav_msg_update_block() for each channel over
+ * correlations laid out as produced by a tracking bank, one array across
+ * all channels per integration.
+ *
+ * Channels still looking for bit sync at the same bit phase, e.g. those
+ * started together, run the rolling sums and histogram updates of bit sync
+ * across channels, `NAV_BATCH_LANES` at a time, which vectorises. The rest
+ * of the work, and channels with bit sync, are done one channel at a time.
+ *
+ * \param n_channels Number of channels in the batch
+ * \param n Nav message decode state structs, one per channel
+ * \param n_corr Number of correlations per channel
+ * \param corr_prompt_real In-phase prompt correlations, the `i`th
+ *                         correlation of channel `ch` at
+ *                         `corr_prompt_real[i * n_channels + ch]`
+ * \param ms Number of milliseconds integration performed in each correlation
+ * \param TOW_ms Output of the nav_msg_update_block() return value for each
+ *               channel
+ */
+void nav_msg_update_batch(u8 n_channels, nav_msg_t *n[], u32 n_corr,
+                          const s32 corr_prompt_real[], u8 ms, s32 TOW_ms[])
+{
+  /* Correlations of each channel already consumed by bit_sync_batch(), and
+   * what the nav bit ending on the last of them returned. */
+  u32 start[UINT8_MAX];
+  s32 edge[UINT8_MAX];
+  /* Channels yet to go through bit_sync_batch(). */
+  bool pending[UINT8_MAX];
+
+  for (u8 ch = 0; ch < n_channels; ch++) {
+    start[ch] = 0;
+    edge[ch] = TOW_INVALID;
+    pending[ch] = n[ch]->bit_phase_ref == BITSYNC_UNSYNCED &&
+                  n[ch]->bitsync_count >= 20;
   }
-  /* Check D28 */
-  if (parity(*word & 0x5763E684 /* 0b01010111011000111110011010000100 */)) {
-    return 28;
+
+  for (u8 ch = 0; ch < n_channels; ch++) {
+    if (!pending[ch])
+      continue;
+
+    /* Gather the pending channels at the same bit phase. */
+    u8 lanes[NAV_BATCH_LANES] = {ch};
+    u8 n_lanes = 1;
+    pending[ch] = false;
+    for (u8 c = ch + 1; c < n_channels && n_lanes < NAV_BATCH_LANES; c++) {
+      if (pending[c] && n[c]->bit_phase == n[ch]->bit_phase) {
+        pending[c] = false;
+        lanes[n_lanes++] = c;
+      }
+    }
+
+    u32 len = bit_sync_batch(n, n_lanes, lanes, n_corr, corr_prompt_real,
+                             n_channels, ms);
+    for (u8 k = 0; k < n_lanes; k++) {
+      nav_msg_t *nk = n[lanes[k]];
+      start[lanes[k]] = len;
+      /* The correlation completing bit sync may also end a nav bit. */
+      if (nk->bit_phase_ref != BITSYNC_UNSYNCED &&
+          nk->bit_phase == nk->bit_phase_ref)
+        edge[lanes[k]] = nav_msg_dump_bit(nk);
+    }
   }
-  /* Check D29 */
-  if (parity(*word & 0x6BB1F342 /* 0b01101011101100011111001101000010 */)) {
-    return 29;
+
+  for (u8 ch = 0; ch < n_channels; ch++) {
+    u32 rest = n_corr - start[ch];
+    s32 ret = TOW_INVALID;
+    if (rest)
+      ret = nav_msg_update_strided(n[ch], rest,
+                                   &corr_prompt_real[start[ch] * n_channels
+                                                     + ch],
+                                   n_channels, ms);
+    /* Combine with the nav bit ending bit sync, as
+     * nav_msg_update_strided() does within a channel. */
+    if (ret < 0 && edge[ch] >= 0)
+      ret = (edge[ch] + rest * ms) % (7*24*60*60*1000);
+    else if (ret == TOW_INVALID)
+      ret = edge[ch];
+    TOW_ms[ch] = ret;
   }
-  /* Check D30 */
-  if (parity(*word & 0x8B7A89C1 /* 0b10001011011110101000100111000001 */)) {
-    return 30;
+}
+
+/* Parity check bits of each byte of a L1 C/A NAV message word.
+ * Parity is linear, so the check of a word is the XOR of the entries for
+ * its four bytes. Bit 5 of an entry is the check of D25 (parity over mask
+ * 0xBB1F34A0) down to bit 0 for D30 (mask 0x8B7A89C1), see
+ * ICD-GPS-200E Table 20-XIV. */
+static const u8 parity_table[4][256] = {
+  {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23,
+    0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B,
+    0x3C, 0x3D, 0x3E, 0x3F, 0x13, 0x12, 0x11, 0x10, 0x17, 0x16, 0x15, 0x14,
+    0x1B, 0x1A, 0x19, 0x18, 0x1F, 0x1E, 0x1D, 0x1C, 0x03, 0x02, 0x01, 0x00,
+    0x07, 0x06, 0x05, 0x04, 0x0B, 0x0A, 0x09, 0x08, 0x0F, 0x0E, 0x0D, 0x0C,
+    0x33, 0x32, 0x31, 0x30, 0x37, 0x36, 0x35, 0x34, 0x3B, 0x3A, 0x39, 0x38,
+    0x3F, 0x3E, 0x3D, 0x3C, 0x23, 0x22, 0x21, 0x20, 0x27, 0x26, 0x25, 0x24,
+    0x2B, 0x2A, 0x29, 0x28, 0x2F, 0x2E, 0x2D, 0x2C, 0x25, 0x24, 0x27, 0x26,
+    0x21, 0x20, 0x23, 0x22, 0x2D, 0x2C, 0x2F, 0x2E, 0x29, 0x28, 0x2B, 0x2A,
+    0x35, 0x34, 0x37, 0x36, 0x31, 0x30, 0x33, 0x32, 0x3D, 0x3C, 0x3F, 0x3E,
+    0x39, 0x38, 0x3B, 0x3A, 0x05, 0x04, 0x07, 0x06, 0x01, 0x00, 0x03, 0x02,
+    0x0D, 0x0C, 0x0F, 0x0E, 0x09, 0x08, 0x0B, 0x0A, 0x15, 0x14, 0x17, 0x16,
+    0x11, 0x10, 0x13, 0x12, 0x1D, 0x1C, 0x1F, 0x1E, 0x19, 0x18, 0x1B, 0x1A,
+    0x36, 0x37, 0x34, 0x35, 0x32, 0x33, 0x30, 0x31, 0x3E, 0x3F, 0x3C, 0x3D,
+    0x3A, 0x3B, 0x38, 0x39, 0x26, 0x27, 0x24, 0x25, 0x22, 0x23, 0x20, 0x21,
+    0x2E, 0x2F, 0x2C, 0x2D, 0x2A, 0x2B, 0x28, 0x29, 0x16, 0x17, 0x14, 0x15,
+    0x12, 0x13, 0x10, 0x11, 0x1E, 0x1F, 0x1C, 0x1D, 0x1A, 0x1B, 0x18, 0x19,
+    0x06, 0x07, 0x04, 0x05, 0x02, 0x03, 0x00, 0x01, 0x0E, 0x0F, 0x0C, 0x0D,
+    0x0A, 0x0B, 0x08, 0x09
+  },
+  {
+    0x00, 0x0B, 0x16, 0x1D, 0x2C, 0x27, 0x3A, 0x31, 0x19, 0x12, 0x0F, 0x04,
+    0x35, 0x3E, 0x23, 0x28, 0x32, 0x39, 0x24, 0x2F, 0x1E, 0x15, 0x08, 0x03,
+    0x2B, 0x20, 0x3D, 0x36, 0x07, 0x0C, 0x11, 0x1A, 0x26, 0x2D, 0x30, 0x3B,
+    0x0A, 0x01, 0x1C, 0x17, 0x3F, 0x34, 0x29, 0x22, 0x13, 0x18, 0x05, 0x0E,
+    0x14, 0x1F, 0x02, 0x09, 0x38, 0x33, 0x2E, 0x25, 0x0D, 0x06, 0x1B, 0x10,
+    0x21, 0x2A, 0x37, 0x3C, 0x0E, 0x05, 0x18, 0x13, 0x22, 0x29, 0x34, 0x3F,
+    0x17, 0x1C, 0x01, 0x0A, 0x3B, 0x30, 0x2D, 0x26, 0x3C, 0x37, 0x2A, 0x21,
+    0x10, 0x1B, 0x06, 0x0D, 0x25, 0x2E, 0x33, 0x38, 0x09, 0x02, 0x1F, 0x14,
+    0x28, 0x23, 0x3E, 0x35, 0x04, 0x0F, 0x12, 0x19, 0x31, 0x3A, 0x27, 0x2C,
+    0x1D, 0x16, 0x0B, 0x00, 0x1A, 0x11, 0x0C, 0x07, 0x36, 0x3D, 0x20, 0x2B,
+    0x03, 0x08, 0x15, 0x1E, 0x2F, 0x24, 0x39, 0x32, 0x1F, 0x14, 0x09, 0x02,
+    0x33, 0x38, 0x25, 0x2E, 0x06, 0x0D, 0x10, 0x1B, 0x2A, 0x21, 0x3C, 0x37,
+    0x2D, 0x26, 0x3B, 0x30, 0x01, 0x0A, 0x17, 0x1C, 0x34, 0x3F, 0x22, 0x29,
+    0x18, 0x13, 0x0E, 0x05, 0x39, 0x32, 0x2F, 0x24, 0x15, 0x1E, 0x03, 0x08,
+    0x20, 0x2B, 0x36, 0x3D, 0x0C, 0x07, 0x1A, 0x11, 0x0B, 0x00, 0x1D, 0x16,
+    0x27, 0x2C, 0x31, 0x3A, 0x12, 0x19, 0x04, 0x0F, 0x3E, 0x35, 0x28, 0x23,
+    0x11, 0x1A, 0x07, 0x0C, 0x3D, 0x36, 0x2B, 0x20, 0x08, 0x03, 0x1E, 0x15,
+    0x24, 0x2F, 0x32, 0x39, 0x23, 0x28, 0x35, 0x3E, 0x0F, 0x04, 0x19, 0x12,
+    0x3A, 0x31, 0x2C, 0x27, 0x16, 0x1D, 0x00, 0x0B, 0x37, 0x3C, 0x21, 0x2A,
+    0x1B, 0x10, 0x0D, 0x06, 0x2E, 0x25, 0x38, 0x33, 0x02, 0x09, 0x14, 0x1F,
+    0x05, 0x0E, 0x13, 0x18, 0x29, 0x22, 0x3F, 0x34, 0x1C, 0x17, 0x0A, 0x01,
+    0x30, 0x3B, 0x26, 0x2D
+  },
+  {
+    0x00, 0x3E, 0x3D, 0x03, 0x38, 0x06, 0x05, 0x3B, 0x31, 0x0F, 0x0C, 0x32,
+    0x09, 0x37, 0x34, 0x0A, 0x23, 0x1D, 0x1E, 0x20, 0x1B, 0x25, 0x26, 0x18,
+    0x12, 0x2C, 0x2F, 0x11, 0x2A, 0x14, 0x17, 0x29, 0x07, 0x39, 0x3A, 0x04,
+    0x3F, 0x01, 0x02, 0x3C, 0x36, 0x08, 0x0B, 0x35, 0x0E, 0x30, 0x33, 0x0D,
+    0x24, 0x1A, 0x19, 0x27, 0x1C, 0x22, 0x21, 0x1F, 0x15, 0x2B, 0x28, 0x16,
+    0x2D, 0x13, 0x10, 0x2E, 0x0D, 0x33, 0x30, 0x0E, 0x35, 0x0B, 0x08, 0x36,
+    0x3C, 0x02, 0x01, 0x3F, 0x04, 0x3A, 0x39, 0x07, 0x2E, 0x10, 0x13, 0x2D,
+    0x16, 0x28, 0x2B, 0x15, 0x1F, 0x21, 0x22, 0x1C, 0x27, 0x19, 0x1A, 0x24,
+    0x0A, 0x34, 0x37, 0x09, 0x32, 0x0C, 0x0F, 0x31, 0x3B, 0x05, 0x06, 0x38,
+    0x03, 0x3D, 0x3E, 0x00, 0x29, 0x17, 0x14, 0x2A, 0x11, 0x2F, 0x2C, 0x12,
+    0x18, 0x26, 0x25, 0x1B, 0x20, 0x1E, 0x1D, 0x23, 0x1A, 0x24, 0x27, 0x19,
+    0x22, 0x1C, 0x1F, 0x21, 0x2B, 0x15, 0x16, 0x28, 0x13, 0x2D, 0x2E, 0x10,
+    0x39, 0x07, 0x04, 0x3A, 0x01, 0x3F, 0x3C, 0x02, 0x08, 0x36, 0x35, 0x0B,
+    0x30, 0x0E, 0x0D, 0x33, 0x1D, 0x23, 0x20, 0x1E, 0x25, 0x1B, 0x18, 0x26,
+    0x2C, 0x12, 0x11, 0x2F, 0x14, 0x2A, 0x29, 0x17, 0x3E, 0x00, 0x03, 0x3D,
+    0x06, 0x38, 0x3B, 0x05, 0x0F, 0x31, 0x32, 0x0C, 0x37, 0x09, 0x0A, 0x34,
+    0x17, 0x29, 0x2A, 0x14, 0x2F, 0x11, 0x12, 0x2C, 0x26, 0x18, 0x1B, 0x25,
+    0x1E, 0x20, 0x23, 0x1D, 0x34, 0x0A, 0x09, 0x37, 0x0C, 0x32, 0x31, 0x0F,
+    0x05, 0x3B, 0x38, 0x06, 0x3D, 0x03, 0x00, 0x3E, 0x10, 0x2E, 0x2D, 0x13,
+    0x28, 0x16, 0x15, 0x2B, 0x21, 0x1F, 0x1C, 0x22, 0x19, 0x27, 0x24, 0x1A,
+    0x33, 0x0D, 0x0E, 0x30, 0x0B, 0x35, 0x36, 0x08, 0x02, 0x3C, 0x3F, 0x01,
+    0x3A, 0x04, 0x07, 0x39
+  },
+  {
+    0x00, 0x37, 0x2F, 0x18, 0x1C, 0x2B, 0x33, 0x04, 0x3B, 0x0C, 0x14, 0x23,
+    0x27, 0x10, 0x08, 0x3F, 0x34, 0x03, 0x1B, 0x2C, 0x28, 0x1F, 0x07, 0x30,
+    0x0F, 0x38, 0x20, 0x17, 0x13, 0x24, 0x3C, 0x0B, 0x2A, 0x1D, 0x05, 0x32,
+    0x36, 0x01, 0x19, 0x2E, 0x11, 0x26, 0x3E, 0x09, 0x0D, 0x3A, 0x22, 0x15,
+    0x1E, 0x29, 0x31, 0x06, 0x02, 0x35, 0x2D, 0x1A, 0x25, 0x12, 0x0A, 0x3D,
+    0x39, 0x0E, 0x16, 0x21, 0x16, 0x21, 0x39, 0x0E, 0x0A, 0x3D, 0x25, 0x12,
+    0x2D, 0x1A, 0x02, 0x35, 0x31, 0x06, 0x1E, 0x29, 0x22, 0x15, 0x0D, 0x3A,
+    0x3E, 0x09, 0x11, 0x26, 0x19, 0x2E, 0x36, 0x01, 0x05, 0x32, 0x2A, 0x1D,
+    0x3C, 0x0B, 0x13, 0x24, 0x20, 0x17, 0x0F, 0x38, 0x07, 0x30, 0x28, 0x1F,
+    0x1B, 0x2C, 0x34, 0x03, 0x08, 0x3F, 0x27, 0x10, 0x14, 0x23, 0x3B, 0x0C,
+    0x33, 0x04, 0x1C, 0x2B, 0x2F, 0x18, 0x00, 0x37, 0x29, 0x1E, 0x06, 0x31,
+    0x35, 0x02, 0x1A, 0x2D, 0x12, 0x25, 0x3D, 0x0A, 0x0E, 0x39, 0x21, 0x16,
+    0x1D, 0x2A, 0x32, 0x05, 0x01, 0x36, 0x2E, 0x19, 0x26, 0x11, 0x09, 0x3E,
+    0x3A, 0x0D, 0x15, 0x22, 0x03, 0x34, 0x2C, 0x1B, 0x1F, 0x28, 0x30, 0x07,
+    0x38, 0x0F, 0x17, 0x20, 0x24, 0x13, 0x0B, 0x3C, 0x37, 0x00, 0x18, 0x2F,
+    0x2B, 0x1C, 0x04, 0x33, 0x0C, 0x3B, 0x23, 0x14, 0x10, 0x27, 0x3F, 0x08,
+    0x3F, 0x08, 0x10, 0x27, 0x23, 0x14, 0x0C, 0x3B, 0x04, 0x33, 0x2B, 0x1C,
+    0x18, 0x2F, 0x37, 0x00, 0x0B, 0x3C, 0x24, 0x13, 0x17, 0x20, 0x38, 0x0F,
+    0x30, 0x07, 0x1F, 0x28, 0x2C, 0x1B, 0x03, 0x34, 0x15, 0x22, 0x3A, 0x0D,
+    0x09, 0x3E, 0x26, 0x11, 0x2E, 0x19, 0x01, 0x36, 0x32, 0x05, 0x1D, 0x2A,
+    0x21, 0x16, 0x0E, 0x39, 0x3D, 0x0A, 0x12, 0x25, 0x1A, 0x2D, 0x35, 0x02,
+    0x06, 0x31, 0x29, 0x1E
   }
+};
 
-  return 0;
+/* Tests the parity of a L1 C/A NAV message word.
+ * Expects a word where MSB = D29*, bit 30 = D30*, bit 29 = D1, ... LSB = D30
+ * with the data bits already inverted if D30* is set.
+ *
+ * \return 0 if the parity is correct, otherwise a bit set for each failing
+ *         parity bit, D25 in bit 5 ... D30 in bit 0.
+ */
+static u8 parity_syndrome(u32 word)
+{
+  return parity_table[0][word & 0xFF] ^ parity_table[1][word >> 8 & 0xFF] ^
+         parity_table[2][word >> 16 & 0xFF] ^ parity_table[3][word >> 24];
+}
+
+/* Tests the parity of a sequence of L1 C/A NAV message words.
+ * Inverts the data bits if necessary, and checks the parity. Every word is
+ * checked, with no branches per word, so a whole subframe is checked in one
+ * pass.
+ *
+ * References:
+ *   -# ICD-GPS-200E Table 20-XIV
+ *
+ * \param n_words Number of words.
+ * \param words Words to check, each with MSB = D29*, bit 30 = D30* (of the
+ *              previous word), bit 29 = D1, ... LSB = D30. Note, if D30* is
+ *              set then the data bits in the word will be inverted in place.
+ * \return 0 if the parity of all words is correct,
+ *         otherwise the index plus one of the first incorrect word.
+ */
+static u8 nav_parity_words(u8 n_words, u32 words[])
+{
+  u8 bad = 0;
+  for (u8 i = n_words; i > 0; i--) {
+    /* D30* = 1, invert all the data bits! */
+    words[i-1] ^= -(words[i-1] >> 30 & 1) & 0x3FFFFFC0;
+    if (parity_syndrome(words[i-1]))
+      bad = i;
+  }
+  return bad;
+}
+
+/** Check the parity of the ten words of a subframe.
+ * Converts the words of a subframe as transmitted into the form used by
+ * decode_ephemeris(), checking the parity of all of them in one pass.
+ *
+ * \param prev Last word transmitted before the subframe, only D29 and D30 in
+ *             the two least significant bits are used.
+ * \param raw Words of the subframe as transmitted, with D1 in bit 29 to D30
+ *            in the least significant bit.
+ * \param words Output words with D29* and D30* of the previous word in the
+ *              two most significant bits, and the data bits inverted if D30*
+ *              is set. Words 3 to 10 of subframes 1 to 3 can be passed to
+ *              decode_ephemeris() as they are.
+ * \return 0 if the parity of all words is correct, otherwise the number
+ *         (1-10) of the first word with incorrect parity.
+ */
+u8 nav_subframe_parity(u32 prev, const u32 raw[10], u32 words[10])
+{
+  for (u8 i = 0; i < 10; i++) {
+    words[i] = (prev & 3) << 30 | (raw[i] & 0x3FFFFFFF);
+    prev = raw[i];
+  }
+  return nav_parity_words(10, words);
 }
 
 bool subframe_ready(nav_msg_t *n) {
   return (n->subframe_start_index != 0);
 }
 
+/** Check and decode the subframe last found by nav_msg_update().
+ * Subframes 1 to 3 are collected in turn and decoded into an ephemeris once
+ * all three have been received. Pages of subframes 4 and 5 are kept for
+ * process_page().
+ *
+ * \param n Nav message decode state struct
+ * \param e Ephemeris output, only written when 1 is returned
+ *
+ * \return 1 if an ephemeris was decoded, 2 if a page of subframe 4 or 5 was
+ *         kept for process_page(), 0 if there is nothing new yet, -1 if `e`
+ *         is NULL, -2 on a parity error in the HOW or -3 on a parity error
+ *         in words 3 to 10
+ */
 s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
   // Check parity and parse out the ephemeris from the most recently received subframe
 
@@ -352,29 +781,48 @@ s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
     n->overrun = false;
   }
 
-  /* Extract word 2, and the last two parity bits of word 1 */
-  u32 sf_word2 = extract_word(n, 28, 32, 0);
-  if (nav_parity(&sf_word2)) {
+  /* Extract words 2 to 10, each with the last two parity bits of the word
+   * before, and check them all at once. */
+  u32 words[9];
+  for (u8 w = 0; w < 9; w++)
+    words[w] = extract_word(n, 30*(w+1) - 2, 32, 0);
+  u8 bad_word = nav_parity_words(9, words);
+
+  if (bad_word == 1) {
     log_info("PRN %02d subframe parity mismatch (word 2)", e->prn+1);
     n->subframe_start_index = 0;  // Mark the subframe as processed
     n->next_subframe_id = 1;      // Make sure we start again next time
     return -2;
   }
 
-  u8 sf_id = sf_word2 >> 8 & 0x07;    // Which of 5 possible subframes is it?
+  u8 sf_id = words[0] >> 8 & 0x07;    // Which of 5 possible subframes is it?
+
+  if (sf_id == 4 || sf_id == 5) {
+    // Almanac, ionosphere and UTC pages, kept for process_page()
+    n->next_subframe_id = 1;      // Make sure we start again next time
+    n->subframe_start_index = 0;  // Mark the subframe as processed
+    if (bad_word) {
+      log_info("PRN %02d subframe parity mismatch (word %d)", e->prn+1,
+               bad_word+1);
+      return -3;
+    }
+    memcpy(n->page_words, &words[1], sizeof(n->page_words));
+    n->page_tow = words[0] >> 13 & 0x1FFFF;
+    n->page_ready = true;
+    return 2;
+  }
 
   if (sf_id <= 3 && sf_id == n->next_subframe_id) {  // Is it the one that we want next?
 
-    for (int w = 0; w < 8; w++) {   // For words 3..10
-      n->frame_words[sf_id-1][w] = extract_word(n, 30*(w+2) - 2, 32, 0);    // Get the bits
-      // MSBs are D29* and D30*.  LSBs are D1...D30
-      if (nav_parity(&n->frame_words[sf_id-1][w])) {  // Check parity and invert bits if D30*
-        log_info("PRN %02d subframe parity mismatch (word %d)", e->prn+1, w+3);
-        n->next_subframe_id = 1;      // Make sure we start again next time
-        n->subframe_start_index = 0;  // Mark the subframe as processed
-        return -3;
-      }
+    if (bad_word) {
+      log_info("PRN %02d subframe parity mismatch (word %d)", e->prn+1,
+               bad_word+1);
+      n->next_subframe_id = 1;      // Make sure we start again next time
+      n->subframe_start_index = 0;  // Mark the subframe as processed
+      return -3;
     }
+    // Words 3..10, MSBs are D29* and D30*.  LSBs are D1...D30
+    memcpy(n->frame_words[sf_id-1], &words[1], sizeof(n->frame_words[0]));
     n->subframe_start_index = 0;  // Mark the subframe as processed
     n->next_subframe_id++;
 
@@ -397,3 +845,40 @@ s8 process_subframe(nav_msg_t *n, ephemeris_t *e) {
 
 }
 
+/** Decode the page of subframe 4 or 5 last kept by process_subframe().
+ * Almanac pages fill in the almanac of the satellite they describe, and page
+ * 18 of subframe 4 the ionospheric and UTC parameters. Other pages (health,
+ * reserved and special messages) are ignored.
+ *
+ * \param n Nav message decode state struct
+ * \param week GPS week number at about the time the page was received, used
+ *             to resolve the almanac week
+ * \param alm Almanacs of all satellites, indexed by PRN
+ * \param iono Ionospheric model parameters output
+ * \param utc UTC parameters output
+ *
+ * \return 1 if an almanac was decoded, 2 if the ionospheric and UTC
+ *         parameters were decoded, 0 for any other page, or -1 if there is
+ *         no new page
+ */
+s8 process_page(nav_msg_t *n, u16 week, almanac_t alm[],
+                ionosphere_t *iono, utc_params_t *utc)
+{
+  if (!n->page_ready)
+    return -1;
+  n->page_ready = false;
+
+  almanac_t a;
+  /* The HOW TOW count gives the start of the next subframe. */
+  gps_time_t t = {n->page_tow * 6.0, week};
+  if (!decode_almanac(n->page_words, t, &a)) {
+    alm[a.prn] = a;
+    return 1;
+  }
+
+  if (!decode_iono_utc(n->page_words, iono, utc))
+    return 2;
+
+  return 0;
+}
+
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "nav_replay.h"
+
+/** \defgroup nav_replay Nav Data Replay
+ * Offline decoding of recorded navigation data.
+ *
+ * Recorded nav bits or prompt correlations of many satellites are decoded in
+ * bulk into ephemerides, each distinct ephemeris being passed to a callback
+ * once however many times it was broadcast.
+ *
+ * Nav bits are searched directly for subframes, checking the parity of all
+ * ten words of a candidate at once and then stepping a whole subframe at a
+ * time while the subframes keep coming, so a recording of weeks of bits is
+ * decoded at close to the speed it can be read. Correlations go through bit
+ * sync and the nav message decoder in blocks, as in a receiver.
+ *
+ * Recordings can be passed in pieces of any size, e.g. as read from a file,
+ * or all at once from a memory mapped file.
+ * \{ */
+
+#define TOW_COUNT_WEEK (7*24*60*10)
+
+/* Read up to 32 bits at a bit position of a buffer, most significant bit
+ * first, from the 40 bits starting at the byte holding the first. */
+static u32 read_bits(const u8 *buff, u32 pos, u8 len)
+{
+  const u8 *b = &buff[pos / 8];
+  u64 v = (u64)b[0] << 32 | (u64)b[1] << 24 | (u64)b[2] << 16 |
+          (u64)b[3] << 8 | b[4];
+  return v >> (40 - pos % 8 - len) & (((u64)1 << len) - 1);
+}
+
+/** Initialise a nav data replay.
+ *
+ * \param r        Replay to initialise.
+ * \param callback Function called with each new ephemeris, or NULL.
+ * \param context  Context passed to `callback`.
+ */
+void nav_replay_init(nav_replay_t *r, nav_replay_callback_t callback,
+                     void *context)
+{
+  memset(r, 0, sizeof(*r));
+  for (u8 prn = 0; prn < NAV_REPLAY_MAX_SATS; prn++)
+    nav_msg_init(&r->sats[prn].nav);
+  r->callback = callback;
+  r->context = context;
+}
+
+static void replay_ephemeris(nav_replay_t *r, u8 prn, u32 frame_words[3][8],
+                             ephemeris_t *e)
+{
+  nav_replay_sat_t *s = &r->sats[prn];
+
+  /* The 8 LSBs of the IODC of subframe 1 and the IODE of subframes 2 and 3
+   * only differ if the subframes straddle a new upload. */
+  u8 iodc = frame_words[0][8-3] >> (30-8) & 0xFF;
+  u8 iode = frame_words[1][3-3] >> (30-8) & 0xFF;
+  if (iodc != e->iode || iode != e->iode) {
+    r->stats.n_iode_mismatch++;
+    return;
+  }
+
+  r->stats.n_ephemerides++;
+  e->prn = prn;
+  if (s->have_eph && ephemeris_equal(e, &s->eph))
+    return;
+
+  s->eph = *e;
+  s->have_eph = true;
+  r->stats.n_unique++;
+  if (r->callback)
+    r->callback(e, r->context);
+}
+
+/* Collect subframes 1 to 3 of consecutive subframes with correct parity. */
+static void replay_subframe(nav_replay_t *r, u8 prn, const u32 words[10])
+{
+  nav_replay_sat_t *s = &r->sats[prn];
+  u32 tow = words[1] >> (30-17) & 0x1FFFF;
+  u8 sf_id = words[1] >> (30-22) & 0x07;
+
+  r->stats.n_subframes++;
+
+  if (sf_id == 1 ||
+      (sf_id >= 2 && sf_id <= 3 &&
+       s->have_subframes == (1 << (sf_id-1)) - 1 &&
+       tow == (s->last_tow + 1) % TOW_COUNT_WEEK)) {
+    memcpy(s->frame_words[sf_id-1], &words[2], sizeof(s->frame_words[0]));
+    s->have_subframes = (1 << sf_id) - 1;
+    s->last_tow = tow;
+  } else {
+    s->have_subframes = 0;
+  }
+
+  if (s->have_subframes == 7) {
+    ephemeris_t e;
+    s->have_subframes = 0;
+    decode_ephemeris(s->frame_words, &e);
+    replay_ephemeris(r, prn, s->frame_words, &e);
+  }
+}
+
+/* Search the buffered bits for subframes, leaving `pos` at the first bit
+ * that can't yet be the start of a whole subframe. */
+static void search_subframes(nav_replay_t *r, u8 prn)
+{
+  nav_replay_sat_t *s = &r->sats[prn];
+
+  while (s->pos + 300 <= s->n_bits) {
+    u8 preamble = read_bits(s->buff, s->pos, 8);
+    if (preamble == 0x8B || preamble == 0x74) {
+      /* An inverted preamble means all the bits are inverted by the half
+       * cycle ambiguity of the carrier phase. */
+      u32 inv = preamble == 0x74 ? 0x3FFFFFFF : 0;
+      u32 raw[10], words[10];
+      for (u8 i = 0; i < 10; i++)
+        raw[i] = read_bits(s->buff, s->pos + 30*i, 30) ^ inv;
+      /* The word before the TLM, word 10, always ends with D29 = D30 = 0. */
+      if (!nav_subframe_parity(0, raw, words)) {
+        replay_subframe(r, prn, words);
+        s->pos += 300;
+        continue;
+      }
+    }
+    s->pos++;
+  }
+}
+
+static void append_bits(nav_replay_sat_t *s, const u8 *bits, u32 offset,
+                        u32 n_bits)
+{
+  if (!(s->n_bits % 8) && !(offset % 8)) {
+    memcpy(&s->buff[s->n_bits / 8], &bits[offset / 8], (n_bits + 7) / 8);
+  } else {
+    for (u32 i = 0; i < n_bits; i++) {
+      u32 src = offset + i, dst = s->n_bits + i;
+      u8 mask = 0x80 >> dst % 8;
+      if (bits[src / 8] >> (7 - src % 8) & 1)
+        s->buff[dst / 8] |= mask;
+      else
+        s->buff[dst / 8] &= ~mask;
+    }
+  }
+  s->n_bits += n_bits;
+}
+
+/** Replay recorded nav bits of a satellite.
+ * Bits can be passed in pieces of any length, each continuing from the end
+ * of the last.
+ *
+ * \param r      Replay.
+ * \param prn    PRN of the satellite, 0-31.
+ * \param bits   Nav bits, most significant bit of the first byte first.
+ * \param n_bits Number of bits.
+ * \return 0 on success, -1 if `prn` is out of range.
+ */
+s8 nav_replay_bits(nav_replay_t *r, u8 prn, const u8 *bits, u32 n_bits)
+{
+  if (prn >= NAV_REPLAY_MAX_SATS)
+    return -1;
+
+  clock_t start = clock();
+  nav_replay_sat_t *s = &r->sats[prn];
+
+  for (u32 i = 0; i < n_bits; ) {
+    u32 n = MIN(n_bits - i, NAV_REPLAY_BUFF_BITS - s->n_bits);
+    append_bits(s, bits, i, n);
+    i += n;
+
+    search_subframes(r, prn);
+
+    /* Drop the bits that have been searched. */
+    u32 drop = s->pos / 8;
+    memmove(s->buff, &s->buff[drop], (s->n_bits + 7) / 8 - drop);
+    s->pos -= 8 * drop;
+    s->n_bits -= 8 * drop;
+  }
+
+  r->stats.n_bits += n_bits;
+  r->stats.time += (double)(clock() - start) / CLOCKS_PER_SEC;
+  return 0;
+}
+
+/** Replay recorded prompt correlations of a number of satellites.
+ * The correlations of all the satellites are passed together, as output by
+ * a tracking bank, and can be passed in pieces of any length, each
+ * continuing from the end of the last.
+ *
+ * \param r      Replay.
+ * \param n_sats Number of satellites.
+ * \param prns   PRN of each satellite, 0-31, all different.
+ * \param n_corr Number of correlations of each satellite.
+ * \param corrs  In-phase prompt correlations, the `i`th correlation of
+ *               satellite `j` at `corrs[i * n_sats + j]`.
+ * \param ms     Integration time of each correlation in ms, a divisor of 20.
+ * \return 0 on success, -1 if a PRN or `ms` is out of range.
+ */
+s8 nav_replay_corrs(nav_replay_t *r, u8 n_sats, const u8 prns[],
+                    u32 n_corr, const s32 corrs[], u8 ms)
+{
+  nav_msg_t *navs[NAV_REPLAY_MAX_SATS];
+  s32 TOW_ms[NAV_REPLAY_MAX_SATS];
+
+  if (n_sats > NAV_REPLAY_MAX_SATS || !ms || 20 % ms)
+    return -1;
+  for (u8 i = 0; i < n_sats; i++) {
+    if (prns[i] >= NAV_REPLAY_MAX_SATS)
+      return -1;
+    navs[i] = &r->sats[prns[i]].nav;
+  }
+
+  clock_t start = clock();
+  u32 block = NAV_REPLAY_CORR_BLOCK_MS / ms;
+
+  for (u32 i = 0; i < n_corr; i += block) {
+    u32 n = MIN(n_corr - i, block);
+    nav_msg_update_batch(n_sats, navs, n, &corrs[i * n_sats], ms, TOW_ms);
+
+    for (u8 j = 0; j < n_sats; j++) {
+      if (!subframe_ready(navs[j]))
+        continue;
+      ephemeris_t e;
+      e.prn = prns[j];
+      s8 ret = process_subframe(navs[j], &e);
+      if (ret >= 0)
+        r->stats.n_subframes++;
+      if (ret == 1)
+        replay_ephemeris(r, prns[j], navs[j]->frame_words, &e);
+    }
+  }
+
+  r->stats.n_corrs += (u64)n_corr * n_sats;
+  r->stats.time += (double)(clock() - start) / CLOCKS_PER_SEC;
+  return 0;
+}
+
+/** Decoding throughput of a replay so far.
+ *
+ * \param r Replay.
+ * \return Subframes found per second of processor time.
+ */
+double nav_replay_throughput(const nav_replay_t *r)
+{
+  if (r->stats.time <= 0)
+    return 0;
+  return r->stats.n_subframes / r->stats.time;
+}
+
+/** \} */
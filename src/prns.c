@@ -42,6 +42,29 @@ inline s8 get_chip(u8* code, u32 chip_num)
   return ((code[byte] >> bit) & 1) ? -1 : 1;
 }
 
+/** Unpacks the C/A code for a given PRN into one chip per byte.
+ *
+ * The chips are written as +/-1 in the padded layout used by the
+ * correlators, i.e. with one chip of padding at each end so that
+ * `code[k+1]` holds chip `k` for `k = -1 .. 1023` (modulo 1023):
+ *
+ * ~~~
+ * code[0] = chip 1022, code[1..1023] = chips 0..1022, code[1024] = chip 0
+ * ~~~
+ *
+ * \param prn  PRN number.
+ * \param code Array of `CA_CODE_UNPACKED_LEN` elements to unpack into.
+ */
+void ca_code_unpack(u8 prn, s8 code[CA_CODE_UNPACKED_LEN])
+{
+  u8* packed = (u8*)ca_code(prn);
+
+  for (u32 i = 0; i < 1023; i++)
+    code[i+1] = get_chip(packed, i);
+  code[0] = code[1023];
+  code[1024] = code[1];
+}
+
 /** \} */
 
 /* {
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <string.h>
+
+#include "queue.h"
+
+/** \defgroup queue Lock-free Queues
+ * Bounded lock-free queues for passing messages between threads.
+ *
+ * Both queues hold a power of two number of fixed size elements in storage
+ * supplied by the caller and never block: a push to a full queue or a pop
+ * from an empty one returns -1 straight away, leaving the caller to decide
+ * whether to retry, yield or drop the element. Elements are copied in and
+ * out, so they should be kept small.
+ *
+ * ::spsc_queue_t connects exactly one producer thread to one consumer
+ * thread. ::mpsc_queue_t allows any number of producer threads and
+ * preserves the order of the elements pushed by each of them.
+ * \{ */
+
+static bool is_pow2(u32 n)
+{
+  return n && !(n & (n - 1));
+}
+
+/** Initialise a single producer, single consumer queue.
+ *
+ * \param q         Queue to initialise.
+ * \param buff      Storage for `n_elems` elements of `elem_size` bytes.
+ * \param elem_size Size of an element in bytes.
+ * \param n_elems   Capacity of the queue, a power of two.
+ * \return 0 on success, -1 if `n_elems` is not a power of two.
+ */
+s8 spsc_queue_init(spsc_queue_t* q, void* buff, u32 elem_size, u32 n_elems)
+{
+  if (!is_pow2(n_elems))
+    return -1;
+
+  memset(q, 0, sizeof(*q));
+  q->buff = buff;
+  q->elem_size = elem_size;
+  q->mask = n_elems - 1;
+  return 0;
+}
+
+/** Push an element onto a single producer, single consumer queue.
+ * Must only be called from the producer thread.
+ *
+ * \param q    Queue.
+ * \param elem Element to copy into the queue.
+ * \return 0 on success, -1 if the queue is full.
+ */
+s8 spsc_queue_push(spsc_queue_t* q, const void* elem)
+{
+  u32 tail = q->tail;
+
+  if (tail - q->head_cache > q->mask) {
+    q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (tail - q->head_cache > q->mask)
+      return -1;
+  }
+
+  memcpy(&q->buff[(tail & q->mask) * q->elem_size], elem, q->elem_size);
+  __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Pop the oldest element from a single producer, single consumer queue.
+ * Must only be called from the consumer thread.
+ *
+ * \param q    Queue.
+ * \param elem Element output.
+ * \return 0 on success, -1 if the queue is empty.
+ */
+s8 spsc_queue_pop(spsc_queue_t* q, void* elem)
+{
+  u32 head = q->head;
+
+  if (head == q->tail_cache) {
+    q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    if (head == q->tail_cache)
+      return -1;
+  }
+
+  memcpy(elem, &q->buff[(head & q->mask) * q->elem_size], q->elem_size);
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Number of elements in a single producer, single consumer queue.
+ * Only exact when called from the producer or consumer thread while the
+ * other side is idle.
+ *
+ * \param q Queue.
+ * \return Number of elements waiting to be popped.
+ */
+u32 spsc_queue_count(const spsc_queue_t* q)
+{
+  return __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)
+         - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+}
+
+static u32* mpsc_slot_seq(const mpsc_queue_t* q, u32 i)
+{
+  return (u32*)&q->buff[(i & q->mask) * q->slot_size];
+}
+
+/** Initialise a multiple producer, single consumer queue.
+ *
+ * \param q         Queue to initialise.
+ * \param buff      Storage for `n_elems` slots of
+ *                  `MPSC_QUEUE_SLOT_SIZE(elem_size)` bytes, 8 byte aligned.
+ * \param elem_size Size of an element in bytes.
+ * \param n_elems   Capacity of the queue, a power of two.
+ * \return 0 on success, -1 if `n_elems` is not a power of two.
+ */
+s8 mpsc_queue_init(mpsc_queue_t* q, void* buff, u32 elem_size, u32 n_elems)
+{
+  if (!is_pow2(n_elems))
+    return -1;
+
+  memset(q, 0, sizeof(*q));
+  q->buff = buff;
+  q->elem_size = elem_size;
+  q->slot_size = MPSC_QUEUE_SLOT_SIZE(elem_size);
+  q->mask = n_elems - 1;
+
+  /* A slot is free for the push of index `i` when its sequence is `i`, and
+   * holds an element for the pop of index `i` when its sequence is
+   * `i + 1`. */
+  for (u32 i = 0; i < n_elems; i++)
+    *mpsc_slot_seq(q, i) = i;
+  return 0;
+}
+
+/** Push an element onto a multiple producer, single consumer queue.
+ * May be called from any number of threads.
+ *
+ * \param q    Queue.
+ * \param elem Element to copy into the queue.
+ * \return 0 on success, -1 if the queue is full.
+ */
+s8 mpsc_queue_push(mpsc_queue_t* q, const void* elem)
+{
+  u32 tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  u32* seq;
+
+  while (1) {
+    seq = mpsc_slot_seq(q, tail);
+    s32 diff = (s32)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - tail);
+    if (diff == 0) {
+      /* Slot is free, try to claim it. On failure `tail` is reloaded. */
+      if (__atomic_compare_exchange_n(&q->tail, &tail, tail + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      /* Slot still holds the element pushed a lap ago. */
+      return -1;
+    } else {
+      /* Another producer claimed the slot first. */
+      tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy(seq + 2, elem, q->elem_size);
+  __atomic_store_n(seq, tail + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Pop the oldest element from a multiple producer, single consumer queue.
+ * Must only be called from the consumer thread.
+ *
+ * Elements are popped in the order their slots were claimed, so a push
+ * that has claimed a slot but not finished copying holds back the
+ * elements behind it until it completes.
+ *
+ * \param q    Queue.
+ * \param elem Element output.
+ * \return 0 on success, -1 if the queue is empty.
+ */
+s8 mpsc_queue_pop(mpsc_queue_t* q, void* elem)
+{
+  u32 head = q->head;
+  u32* seq = mpsc_slot_seq(q, head);
+
+  if (__atomic_load_n(seq, __ATOMIC_ACQUIRE) != head + 1)
+    return -1;
+
+  memcpy(elem, seq + 2, q->elem_size);
+  /* Free the slot for the push one lap ahead. */
+  __atomic_store_n(seq, head + q->mask + 1, __ATOMIC_RELEASE);
+  q->head = head + 1;
+  return 0;
+}
+
+/** \} */
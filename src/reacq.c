@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "correlate.h"
+#include "reacq.h"
+#include "replica.h"
+
+/** \defgroup reacq Reacquisition
+ * Fast reacquisition of a satellite after a short loss of lock.
+ *
+ * After a short outage the code phase and carrier frequency of a channel are
+ * still known to within a few chips and a few hundred Hz. Instead of a full
+ * acquisition over all 1023 chips and the whole Doppler range, the last
+ * measurement is propagated over the outage with reacq_predict() and only a
+ * small window around the prediction is searched with reacq_search(). For a
+ * one second outage this is typically 5 code taps in 3 Doppler bins, against
+ * around 80000 cells for a full search.
+ *
+ * The result can then be loaded straight back into the tracking loop with
+ * reacq_tl_restore(), or used to initialise a new loop with aided_tl_init().
+ * \{ */
+
+/** Predict the code phase and carrier frequency of a channel after an
+ * outage.
+ *
+ * Propagates the last measurement of the channel, assuming a constant rate
+ * of change of the carrier frequency. The code phase rate follows the
+ * carrier frequency as it would with carrier aiding.
+ *
+ * \param meas           Last measurement before the outage.
+ * \param carr_freq_rate Rate of change of the carrier frequency in Hz/s, or
+ *                       zero if unknown.
+ * \param t              Receiver time to predict at in seconds.
+ * \param code_phase     Predicted code phase in chips output, in [0, 1023).
+ * \param carr_freq      Predicted carrier frequency in Hz output.
+ */
+void reacq_predict(const channel_measurement_t* meas, double carr_freq_rate,
+                   double t, double* code_phase, double* carr_freq)
+{
+  double dt = t - meas->receiver_time;
+  double code_rate_rate = carr_freq_rate * GPS_CA_CHIPPING_RATE / GPS_L1_HZ;
+
+  *carr_freq = meas->carrier_freq + carr_freq_rate * dt;
+
+  double cp = meas->code_phase_chips + meas->code_phase_rate * dt
+              + 0.5 * code_rate_rate * dt * dt;
+  cp = fmod(cp, 1023);
+  if (cp < 0)
+    cp += 1023;
+  *code_phase = cp;
+}
+
+/** Size of the search window needed after an outage.
+ *
+ * The carrier frequency error grows with the unknown rate of change of the
+ * frequency, and the code phase error with the integral of the frequency
+ * error, scaled to the chipping rate. Half a chip is added to the code
+ * window to cover the tracking error before the outage.
+ *
+ * \param dt            Outage duration in seconds.
+ * \param carr_freq_unc Carrier frequency uncertainty before the outage in Hz.
+ * \param carr_rate_unc Carrier frequency rate uncertainty in Hz/s.
+ * \param code_width    Code window half width in chips output.
+ * \param carr_width    Doppler window half width in Hz output.
+ */
+void reacq_window(double dt, double carr_freq_unc, double carr_rate_unc,
+                  double* code_width, double* carr_width)
+{
+  dt = fabs(dt);
+  *carr_width = carr_freq_unc + carr_rate_unc * dt;
+  *code_width = (carr_freq_unc * dt + 0.5 * carr_rate_unc * dt * dt)
+                * GPS_CA_CHIPPING_RATE / GPS_L1_HZ + 0.5;
+}
+
+/* Correlate `n_periods` whole code periods starting at `samples` for one
+ * Doppler bin and group of taps, summing the power of each tap. */
+static void reacq_cell(const s8* samples, const s8* code, double code_phase,
+                       double code_step, double carr_step, u8 n_periods,
+                       u8 n_taps, const double offsets[], double power[])
+{
+  double carr_phase = 0;
+  double I[CORR_MAX_TAPS], Q[CORR_MAX_TAPS];
+  u32 n;
+
+  for (u8 p = 0; p < n_periods; p++) {
+    track_correlate_taps(samples, code, &code_phase, code_step,
+                         &carr_phase, carr_step, n_taps, offsets, I, Q, &n);
+    samples += n;
+    for (u8 k = 0; k < n_taps; k++)
+      power[k] += I[k]*I[k] + Q[k]*Q[k];
+  }
+}
+
+/* Carrier frequency error of the prompt tap from the phase change between
+ * periods, tolerant of data bit transitions. */
+static double reacq_freq_error(const s8* samples, const s8* code,
+                               double code_phase, double offset,
+                               double code_step, double carr_step, double fs,
+                               u8 n_periods)
+{
+  double carr_phase = 0;
+  double I, Q, prev_I = 0, prev_Q = 0;
+  double dot = 0, cross = 0;
+  u32 n, n_total = 0;
+
+  for (u8 p = 0; p < n_periods; p++) {
+    track_correlate_taps(samples, code, &code_phase, code_step,
+                         &carr_phase, carr_step, 1, &offset, &I, &Q, &n);
+    samples += n;
+    n_total += n;
+    if (p > 0) {
+      double d = I*prev_I + Q*prev_Q;
+      double c = prev_I*Q - I*prev_Q;
+      dot += fabs(d);
+      cross += d < 0 ? -c : c;
+    }
+    prev_I = I;
+    prev_Q = Q;
+  }
+
+  double period = n_total / (n_periods * fs);
+  return atan2(cross, dot) / (2 * M_PI * period);
+}
+
+/** Search a small code phase and Doppler window around a prediction.
+ *
+ * Correlates `n_periods` code periods against taps spaced
+ * `REACQ_TAP_SPACING` chips apart covering the code window, in Doppler
+ * bins covering the carrier window, summing the power of the periods
+ * non-coherently. The search starts at the first predicted code rollover
+ * so that every period is correlated whole.
+ *
+ * The code phase of the best cell is refined by interpolating between its
+ * neighbouring taps and, if `n_periods` is at least two, the Doppler by
+ * the carrier phase change between periods. The refinement is only
+ * unambiguous for residual Doppler errors below 250 Hz, so
+ * `carr_bin_width` should be at most 500 Hz.
+ *
+ * \param samples        Real IF samples, the first at the time of the
+ *                       prediction.
+ * \param n_samples      Number of samples available, at least
+ *                       `n_periods + 1` code periods.
+ * \param fs             Sample rate in Hz.
+ * \param if_freq        Intermediate frequency in Hz.
+ * \param prn            PRN number.
+ * \param code_phase     Predicted code phase of the first sample in chips.
+ * \param carr_freq      Predicted carrier Doppler in Hz.
+ * \param code_width     Code window half width in chips.
+ * \param carr_width     Doppler window half width in Hz.
+ * \param carr_bin_width Doppler bin spacing in Hz.
+ * \param n_periods      Number of code periods to integrate.
+ * \param result         Search result output.
+ * \return 0 on success, -1 if there are too few samples, `n_periods` is
+ *         zero or on a malloc() failure.
+ */
+s8 reacq_search(const s8* samples, u32 n_samples, double fs, double if_freq,
+                u8 prn, double code_phase, double carr_freq,
+                double code_width, double carr_width, double carr_bin_width,
+                u8 n_periods, reacq_result_t* result)
+{
+  const s8* code = ca_code_unpacked(prn);
+
+  u32 half_bins = (u32)ceil(carr_width / carr_bin_width);
+  u32 n_bins = 2*half_bins + 1;
+  u32 half_taps = (u32)ceil(code_width / REACQ_TAP_SPACING);
+  u32 n_taps = 2*half_taps + 1;
+
+  /* Skip to the first predicted code rollover. */
+  double step_pred = GPS_CA_CHIPPING_RATE * (1 + carr_freq / GPS_L1_HZ) / fs;
+  u32 skip = (u32)ceil((1023 - code_phase) / step_pred);
+  double start_phase = code_phase + skip*step_pred - 1023;
+
+  double cf_min = carr_freq - half_bins*carr_bin_width;
+  double step_min = GPS_CA_CHIPPING_RATE * (1 + cf_min / GPS_L1_HZ) / fs;
+  u64 needed = skip + (u64)n_periods * ((u32)ceil(1023 / step_min) + 1);
+  if (n_periods == 0 || needed > n_samples)
+    return -1;
+
+  double* offsets = malloc(n_taps * sizeof(double));
+  double* power = calloc((size_t)n_bins * n_taps, sizeof(double));
+  if (!offsets || !power) {
+    free(offsets);
+    free(power);
+    return -1;
+  }
+  for (u32 k = 0; k < n_taps; k++)
+    offsets[k] = ((double)k - half_taps) * REACQ_TAP_SPACING;
+
+  u32 best = 0;
+  for (u32 b = 0; b < n_bins; b++) {
+    double cf = cf_min + b*carr_bin_width;
+    double code_step = GPS_CA_CHIPPING_RATE * (1 + cf / GPS_L1_HZ) / fs;
+    double carr_step = 2*M_PI * (if_freq + cf) / fs;
+    for (u32 k = 0; k < n_taps; k += CORR_MAX_TAPS)
+      reacq_cell(&samples[skip], code, start_phase, code_step, carr_step,
+                 n_periods, MIN(n_taps - k, CORR_MAX_TAPS),
+                 &offsets[k], &power[b*n_taps + k]);
+    for (u32 k = 0; k < n_taps; k++)
+      if (power[b*n_taps + k] > power[best])
+        best = b*n_taps + k;
+  }
+
+  u32 best_bin = best / n_taps, best_tap = best % n_taps;
+  double cf = cf_min + best_bin*carr_bin_width;
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + cf / GPS_L1_HZ) / fs;
+
+  /* Interpolate the code offset from the triangular correlation peak. */
+  double offset = offsets[best_tap];
+  if (best_tap > 0 && best_tap < n_taps - 1) {
+    double E = sqrt(power[best - 1]);
+    double L = sqrt(power[best + 1]);
+    if (E + L > 0)
+      offset += (1 - REACQ_TAP_SPACING) * (L - E) / (L + E);
+  }
+
+  if (n_periods >= 2)
+    cf += reacq_freq_error(&samples[skip], code, start_phase, offset,
+                           code_step, 2*M_PI * (if_freq + cf) / fs, fs,
+                           n_periods);
+
+  double cp = fmod(start_phase + offset - skip*code_step + 1023, 1023);
+  if (cp < 0)
+    cp += 1023;
+
+  /* With the local carrier of unit amplitude, the expected noise power of
+   * a cell is the energy of the samples correlated. */
+  double energy = 0;
+  u32 n_used = (u32)(n_periods * 1023 / step_pred);
+  for (u32 i = skip; i < skip + n_used; i++)
+    energy += samples[i]*samples[i];
+
+  result->code_phase = cp;
+  result->carr_freq = cf;
+  result->code_freq = cf * GPS_CA_CHIPPING_RATE / GPS_L1_HZ;
+  result->snr = energy > 0 ? power[best] / energy : 0;
+
+  free(offsets);
+  free(power);
+  return 0;
+}
+
+/** Restore a tracking loop after reacquisition.
+ *
+ * Loads the frequencies found by reacq_search() into a tracking loop that
+ * was running before the outage, keeping its gains and code loop
+ * integrator, and clears the discriminator history so the first update
+ * after the outage does not use correlations from before it. This avoids
+ * retuning the loop as a call to aided_tl_init() would.
+ *
+ * \param s The tracking loop state struct.
+ * \param r Reacquisition result.
+ */
+void reacq_tl_restore(aided_tl_state_t* s, const reacq_result_t* r)
+{
+  s->carr_freq = r->carr_freq;
+  s->carr_filt.y = r->carr_freq;
+  s->carr_filt.prev_error = 0;
+  s->prev_I = 1.0f;
+  s->prev_Q = 0.0f;
+
+  s->code_filt.prev_error = 0;
+  if (s->carr_to_code) {
+    s->code_freq = s->code_filt.y + s->carr_freq / s->carr_to_code;
+  } else {
+    s->code_filt.y = r->code_freq;
+    s->code_freq = r->code_freq;
+  }
+}
+
+/** \} */
+
@@ -0,0 +1,757 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* For pthread_setaffinity_np(). */
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "correlate.h"
+#include "replica.h"
+#include "receiver.h"
+
+/** \defgroup receiver Software Receiver
+ * Pipelined software receiver, from samples to position fixes.
+ *
+ * A ::receiver_t connects the correlators, tracking loops, navigation
+ * message decoder, calc_navigation_measurement() and calc_PVT() as a
+ * pipeline of stages, each running on its own thread pinned to a core
+ * where the platform allows it:
+ *
+ * -# Ingest, on the caller's thread: receiver_ingest() writes samples into
+ *    a ::sample_ring_t and timestamps each block.
+ * -# Correlation, on one or more threads: channel `i` is correlated by
+ *    thread `i % n_corr_threads`, one code period at a time.
+ * -# Loop closure: discriminators, loop filters, lock detector and
+ *    \f$ C / N_0 \f$ estimator. The new NCO frequencies are sent back to
+ *    the correlation thread, which holds the channel's next period until
+ *    they arrive so the loops behave as if run in line. Throughput comes
+ *    from the other channels filling the pipeline meanwhile.
+ * -# Navigation message decoding: bit sync, time of week and ephemerides.
+ * -# Measurement: every `epoch_period` seconds of receiver time, once all
+ *    active channels have tracked past the epoch, the locked channels with
+ *    a time of week and an ephemeris are turned into navigation
+ *    measurements at the epoch.
+ * -# PVT: calc_PVT(), with the time from ingesting the epoch's sample to
+ *    the solution reported as the fix latency.
+ *
+ * Stages exchange messages over bounded lock-free queues: an
+ * ::mpsc_queue_t from the correlation threads to loop closure, and
+ * ::spsc_queue_t elsewhere. A stage drains its queues and then sleeps until
+ * a producer bumps its ticket, so idle stages do not spin. A stage whose
+ * output queue is full yields until the next stage catches up, and
+ * receiver_ingest() refuses samples that would overwrite ones not yet
+ * correlated, so back-pressure propagates up to the caller.
+ *
+ * Only available when the library is built with pthreads.
+ * \{ */
+
+/** Milliseconds in a GPS week. */
+#define WEEK_MS (7*24*3600*1000)
+
+/* Monotonic clock time in seconds. */
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static bool quitting(receiver_t* r)
+{
+  return __atomic_load_n(&r->quit, __ATOMIC_ACQUIRE);
+}
+
+static void stage_init(receiver_stage_t* s)
+{
+  pthread_mutex_init(&s->lock, 0);
+  pthread_cond_init(&s->cond, 0);
+  s->ticket = 0;
+  s->sleeping = false;
+}
+
+static void stage_destroy(receiver_stage_t* s)
+{
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->lock);
+}
+
+/* Tell a stage there is new work. Only takes the stage's lock if it is
+ * asleep. */
+static void stage_wake(receiver_stage_t* s)
+{
+  __atomic_add_fetch(&s->ticket, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&s->sleeping, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+/* Sleep until the ticket of a stage moves on from `seen`, read before the
+ * stage last looked for work. Setting `sleeping` before checking the
+ * ticket, while stage_wake() bumps the ticket before checking `sleeping`,
+ * means one of the two always sees the other. */
+static void stage_wait(receiver_t* r, receiver_stage_t* s, u32 seen)
+{
+  pthread_mutex_lock(&s->lock);
+  __atomic_store_n(&s->sleeping, true, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&s->ticket, __ATOMIC_SEQ_CST) == seen &&
+         !quitting(r))
+    pthread_cond_wait(&s->cond, &s->lock);
+  __atomic_store_n(&s->sleeping, false, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* Push onto a full queue, yielding until the consumer makes room. The
+ * message is dropped if the receiver is being destroyed. */
+static void spsc_push_wait(receiver_t* r, spsc_queue_t* q, const void* msg,
+                           receiver_stage_t* to)
+{
+  while (spsc_queue_push(q, msg) && !quitting(r)) {
+    stage_wake(to);
+    sched_yield();
+  }
+  stage_wake(to);
+}
+
+static void mpsc_push_wait(receiver_t* r, mpsc_queue_t* q, const void* msg,
+                           receiver_stage_t* to)
+{
+  while (mpsc_queue_push(q, msg) && !quitting(r)) {
+    stage_wake(to);
+    sched_yield();
+  }
+  stage_wake(to);
+}
+
+/* Correlate the next code period of a channel, if its NCO update has
+ * arrived and the samples are in the ring. Called with the channel's
+ * correlation thread lock held. */
+static bool corr_step(receiver_t* r, u8 channel)
+{
+  receiver_channel_t* c = &r->channels[channel];
+  receiver_corr_state_t* s = &r->corr[channel];
+
+  if (!c->active)
+    return false;
+
+  if (s->gen != c->gen) {
+    /* Channel has been (re)started. */
+    s->gen = c->gen;
+    s->first = true;
+    s->waiting = false;
+    s->prn = c->prn;
+    s->code = ca_code_unpacked(c->prn);
+    s->pos = c->start_pos;
+    s->code_phase = c->code_phase;
+    s->carr_phase = 0;
+    s->carr_freq = c->carr_freq;
+    s->code_freq = c->carr_freq * GPS_CA_CHIPPING_RATE / GPS_L1_HZ;
+  }
+
+  if (s->waiting)
+    return false;
+
+  double code_step = (GPS_CA_CHIPPING_RATE + s->code_freq) / r->fs;
+  double carr_step = 2*M_PI * (r->if_freq + s->carr_freq) / r->fs;
+  double I_E, Q_E, I_P, Q_P, I_L, Q_L;
+  u64 pos = s->pos;
+  u32 n;
+
+  if (track_correlate_ring(&r->ring, &pos, s->code,
+                           &s->code_phase, code_step,
+                           &s->carr_phase, carr_step,
+                           &I_E, &Q_E, &I_P, &Q_P, &I_L, &Q_L, &n)) {
+    if (sample_ring_overwritten(&r->ring, pos)) {
+      c->overrun = true;
+      __atomic_store_n(&c->active, false, __ATOMIC_RELEASE);
+    }
+    return false;
+  }
+  s->pos = pos;
+  __atomic_store_n(&c->pos, pos, __ATOMIC_RELEASE);
+
+  receiver_corr_msg_t m = {
+    .channel = channel,
+    .gen = s->gen,
+    .prn = s->prn,
+    .first = s->first,
+    .n_samples = n,
+    .pos = pos,
+    .code_phase = s->code_phase,
+    .code_freq = s->code_freq,
+    .carr_freq = s->carr_freq,
+    .cs = {{I_E, Q_E}, {I_P, Q_P}, {I_L, Q_L}},
+  };
+  mpsc_push_wait(r, &r->corr_q, &m, &r->loop_stage);
+
+  s->first = false;
+  s->waiting = true;
+  return true;
+}
+
+static bool corr_work(receiver_t* r, u8 id)
+{
+  bool progress = false;
+  receiver_nco_msg_t nco;
+
+  while (!spsc_queue_pop(&r->nco_q[id], &nco)) {
+    receiver_corr_state_t* s = &r->corr[nco.channel];
+    if (nco.gen == s->gen && s->waiting) {
+      s->code_freq = nco.code_freq;
+      s->carr_freq = nco.carr_freq;
+      s->waiting = false;
+    }
+    progress = true;
+  }
+
+  pthread_mutex_lock(&r->corr_lock[id]);
+  for (u8 i = id; i < r->n_channels; i += r->n_corr_threads)
+    if (corr_step(r, i))
+      progress = true;
+  pthread_mutex_unlock(&r->corr_lock[id]);
+
+  return progress;
+}
+
+/* Close the tracking loops of a channel on one period of correlations. */
+static void loop_update(receiver_t* r, receiver_corr_msg_t* m)
+{
+  const track_engine_params_t* p = &r->params;
+  receiver_loop_state_t* s = &r->loop[m->channel];
+
+  if (m->first) {
+    s->gen = m->gen;
+    aided_tl_init(&s->tl, 1e3, m->code_freq,
+                  p->code_bw, p->code_zeta, p->code_k,
+                  GPS_L1_HZ / GPS_CA_CHIPPING_RATE,
+                  m->carr_freq,
+                  p->carr_bw, p->carr_zeta, p->carr_k, p->carr_fll_gain);
+    lock_detect_init(&s->ld, p->lock_k1, p->lock_k2, p->lock_lp, p->lock_lo);
+    cn0_est_init(&s->cn0_est, 1e3, p->cn0_init, p->cn0_cutoff, 1e3);
+    s->cn0 = p->cn0_init;
+    s->carr_cycles = 0;
+    s->lock_counter++;
+  } else if (m->gen != s->gen) {
+    return;
+  }
+
+  s->carr_cycles += m->n_samples * m->carr_freq / r->fs;
+
+  double I_P = m->cs[1].I, Q_P = m->cs[1].Q;
+  aided_tl_update(&s->tl, m->cs);
+
+  bool was_locked = s->ld.outo;
+  lock_detect_update(&s->ld, I_P, Q_P, 1e-3);
+  if (was_locked && !s->ld.outo)
+    s->lock_counter++;
+
+  s->cn0 = cn0_est(&s->cn0_est, I_P, Q_P);
+
+  u8 id = m->channel % r->n_corr_threads;
+  receiver_nco_msg_t nco = {
+    .channel = m->channel,
+    .gen = m->gen,
+    .code_freq = s->tl.code_freq,
+    .carr_freq = s->tl.carr_freq,
+  };
+  spsc_push_wait(r, &r->nco_q[id], &nco, &r->corr_stage[id]);
+
+  receiver_track_msg_t t = {
+    .channel = m->channel,
+    .gen = m->gen,
+    .first = m->first,
+    .locked = s->ld.outp,
+    .I_P = (s32)I_P,
+    .pos = m->pos,
+    .meas = {
+      .prn = m->prn,
+      .code_phase_chips = m->code_phase,
+      .code_phase_rate = GPS_CA_CHIPPING_RATE + s->tl.code_freq,
+      .carrier_phase = s->carr_cycles,
+      .carrier_freq = s->tl.carr_freq,
+      .time_of_week_ms = TOW_INVALID,
+      .receiver_time = m->pos / r->fs,
+      .snr = s->cn0,
+      .lock_counter = s->lock_counter,
+    },
+  };
+  spsc_push_wait(r, &r->track_q, &t, &r->nav_stage);
+}
+
+static bool loop_work(receiver_t* r, u8 id)
+{
+  (void)id;
+  bool progress = false;
+  receiver_corr_msg_t m;
+
+  while (!mpsc_queue_pop(&r->corr_q, &m)) {
+    loop_update(r, &m);
+    progress = true;
+  }
+  return progress;
+}
+
+/* Decode the navigation message of a channel and fill in the time of week
+ * of its tracking state. */
+static void nav_update(receiver_t* r, receiver_track_msg_t* m)
+{
+  receiver_nav_state_t* s = &r->nav[m->channel];
+
+  if (m->first) {
+    s->gen = m->gen;
+    nav_msg_init(&s->nav);
+    s->TOW_ms = TOW_INVALID;
+  } else if (m->gen != s->gen) {
+    return;
+  }
+
+  s32 TOW_ms = nav_msg_update(&s->nav, m->I_P, 1);
+  if (s->TOW_ms != TOW_INVALID)
+    s->TOW_ms = (s->TOW_ms + 1) % WEEK_MS;
+  if (TOW_ms >= 0)
+    s->TOW_ms = TOW_ms;
+
+  if (subframe_ready(&s->nav)) {
+    s->eph.prn = m->meas.prn;
+    if (process_subframe(&s->nav, &s->eph) == 1) {
+      s->eph.prn = m->meas.prn;
+      mpsc_push_wait(r, &r->eph_q, &s->eph, &r->meas_stage);
+    }
+  }
+
+  m->meas.time_of_week_ms = s->TOW_ms;
+  spsc_push_wait(r, &r->meas_q, m, &r->meas_stage);
+}
+
+static bool nav_work(receiver_t* r, u8 id)
+{
+  (void)id;
+  bool progress = false;
+  receiver_track_msg_t m;
+
+  while (!spsc_queue_pop(&r->track_q, &m)) {
+    nav_update(r, &m);
+    progress = true;
+  }
+  return progress;
+}
+
+/* Form the next measurement epoch, once its sample has been ingested and
+ * every active channel has tracked past it. The last state of each channel
+ * is propagated back to the epoch by calc_navigation_measurement(). */
+static bool meas_epoch(receiver_t* r)
+{
+  double t = r->epoch_count * r->epoch_period;
+  u64 epoch_pos = (u64)ceil(t * r->fs);
+
+  while (!r->have_block || r->block.end <= epoch_pos) {
+    r->have_block = !spsc_queue_pop(&r->block_q, &r->block);
+    if (!r->have_block)
+      return false;
+  }
+
+  channel_measurement_t meas[RECEIVER_MAX_CHANNELS];
+  u8 n = 0;
+  for (u8 i = 0; i < r->n_channels; i++) {
+    receiver_channel_t* c = &r->channels[i];
+    if (!__atomic_load_n(&c->active, __ATOMIC_ACQUIRE))
+      continue;
+
+    const receiver_track_msg_t* m = &r->last[i];
+    if (m->gen != __atomic_load_n(&c->gen, __ATOMIC_ACQUIRE) ||
+        m->pos < epoch_pos)
+      return false;
+
+    if (m->locked && (s32)m->meas.time_of_week_ms != TOW_INVALID &&
+        r->ephemerides[m->meas.prn].valid &&
+        r->ephemerides[m->meas.prn].healthy)
+      meas[n++] = m->meas;
+  }
+
+  if (n >= 4) {
+    receiver_epoch_t* e = &r->epoch;
+    calc_navigation_measurement(n, meas, e->nav_meas, t, r->ephemerides);
+    e->n = n;
+    e->receiver_time = t;
+    e->t_ingest = r->block.t;
+    spsc_push_wait(r, &r->epoch_q, e, &r->pvt_stage);
+  }
+
+  r->epoch_count++;
+  return true;
+}
+
+static bool meas_work(receiver_t* r, u8 id)
+{
+  (void)id;
+  bool progress = false;
+  ephemeris_t e;
+  receiver_track_msg_t m;
+
+  while (!mpsc_queue_pop(&r->eph_q, &e)) {
+    if (e.prn < 32)
+      r->ephemerides[e.prn] = e;
+    progress = true;
+  }
+
+  while (!spsc_queue_pop(&r->meas_q, &m)) {
+    r->last[m.channel] = m;
+    progress = true;
+  }
+
+  while (meas_epoch(r))
+    progress = true;
+
+  return progress;
+}
+
+static bool pvt_work(receiver_t* r, u8 id)
+{
+  (void)id;
+  bool progress = false;
+  receiver_epoch_t* e = &r->pvt_epoch;
+  receiver_fix_t fix;
+
+  while (!spsc_queue_pop(&r->epoch_q, e)) {
+    progress = true;
+    if (calc_PVT(e->n, e->nav_meas, false, &fix.soln, &fix.dops) < 0)
+      continue;
+    fix.receiver_time = e->receiver_time;
+    fix.latency = now() - e->t_ingest;
+    if (spsc_queue_push(&r->fix_q, &fix))
+      __atomic_add_fetch(&r->fixes_dropped, 1, __ATOMIC_RELAXED);
+  }
+  return progress;
+}
+
+/* Pin the calling thread to a core. */
+static void thread_pin(u8 id)
+{
+#ifdef __linux__
+  long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_cpus < 1)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(id % n_cpus, &set);
+  /* Not being able to pin is not fatal. */
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)id;
+#endif
+}
+
+/* Run a stage until the receiver is destroyed. */
+static void stage_run(receiver_t* r, receiver_stage_t* s,
+                      bool (*work)(receiver_t* r, u8 id), u8 id)
+{
+  while (!quitting(r)) {
+    u32 seen = __atomic_load_n(&s->ticket, __ATOMIC_SEQ_CST);
+    if (!work(r, id))
+      stage_wait(r, s, seen);
+  }
+}
+
+static void* receiver_thread(void* arg)
+{
+  receiver_t* r = arg;
+  u8 id = 0;
+
+  pthread_mutex_lock(&r->start_lock);
+  while (!pthread_equal(r->threads[id], pthread_self()))
+    id++;
+  pthread_mutex_unlock(&r->start_lock);
+
+  thread_pin(id);
+
+  if (id < r->n_corr_threads) {
+    stage_run(r, &r->corr_stage[id], corr_work, id);
+    return 0;
+  }
+
+  switch (id - r->n_corr_threads) {
+  case 0:
+    stage_run(r, &r->loop_stage, loop_work, 0);
+    break;
+  case 1:
+    stage_run(r, &r->nav_stage, nav_work, 0);
+    break;
+  case 2:
+    stage_run(r, &r->meas_stage, meas_work, 0);
+    break;
+  default:
+    stage_run(r, &r->pvt_stage, pvt_work, 0);
+    break;
+  }
+  return 0;
+}
+
+/** Start a software receiver.
+ *
+ * All channels are initially idle, start them with
+ * receiver_start_channel(). Remember to stop the receiver with
+ * receiver_destroy().
+ *
+ * \param r              Receiver to initialise.
+ * \param ring_buff      Storage for the sample ring buffer.
+ * \param ring_size      Number of samples in `ring_buff`.
+ * \param fs             Sampling frequency in Hz.
+ * \param if_freq        Intermediate frequency in Hz.
+ * \param n_channels     Number of channels, up to `RECEIVER_MAX_CHANNELS`.
+ * \param n_corr_threads Number of correlation threads, from 1 to
+ *                       `RECEIVER_MAX_CORR_THREADS`.
+ * \param params         Loop parameters, or NULL for
+ *                       track_engine_default_params().
+ * \param epoch_period   Time between measurement epochs in seconds.
+ * \return 0 on success, -1 if an argument is out of range or the threads
+ *         could not be created.
+ */
+s8 receiver_init(receiver_t* r, s8* ring_buff, u32 ring_size,
+                 double fs, double if_freq, u8 n_channels,
+                 u8 n_corr_threads, const track_engine_params_t* params,
+                 double epoch_period)
+{
+  if (n_channels > RECEIVER_MAX_CHANNELS || n_corr_threads == 0 ||
+      n_corr_threads > RECEIVER_MAX_CORR_THREADS || epoch_period <= 0)
+    return -1;
+
+  memset(r, 0, sizeof(*r));
+  sample_ring_init(&r->ring, ring_buff, ring_size);
+  r->fs = fs;
+  r->if_freq = if_freq;
+  r->epoch_period = epoch_period;
+  r->n_channels = n_channels;
+  r->n_corr_threads = n_corr_threads;
+  if (params)
+    r->params = *params;
+  else
+    track_engine_default_params(&r->params);
+
+  mpsc_queue_init(&r->corr_q, r->corr_q_buff, sizeof(receiver_corr_msg_t),
+                  RECEIVER_QUEUE_LEN);
+  for (u8 i = 0; i < RECEIVER_MAX_CORR_THREADS; i++)
+    spsc_queue_init(&r->nco_q[i], r->nco_q_buff[i],
+                    sizeof(receiver_nco_msg_t), RECEIVER_MAX_CHANNELS);
+  spsc_queue_init(&r->track_q, r->track_q_buff,
+                  sizeof(receiver_track_msg_t), RECEIVER_QUEUE_LEN);
+  spsc_queue_init(&r->meas_q, r->meas_q_buff,
+                  sizeof(receiver_track_msg_t), RECEIVER_QUEUE_LEN);
+  mpsc_queue_init(&r->eph_q, r->eph_q_buff, sizeof(ephemeris_t),
+                  RECEIVER_EPH_QUEUE_LEN);
+  spsc_queue_init(&r->block_q, r->block_q_buff, sizeof(receiver_block_t),
+                  RECEIVER_BLOCK_QUEUE_LEN);
+  spsc_queue_init(&r->epoch_q, r->epoch_q_buff, sizeof(receiver_epoch_t),
+                  RECEIVER_EPOCH_QUEUE_LEN);
+  spsc_queue_init(&r->fix_q, r->fix_q_buff, sizeof(receiver_fix_t),
+                  RECEIVER_FIX_QUEUE_LEN);
+
+  for (u8 i = 0; i < RECEIVER_MAX_CORR_THREADS; i++) {
+    pthread_mutex_init(&r->corr_lock[i], 0);
+    stage_init(&r->corr_stage[i]);
+  }
+  stage_init(&r->loop_stage);
+  stage_init(&r->nav_stage);
+  stage_init(&r->meas_stage);
+  stage_init(&r->pvt_stage);
+  pthread_mutex_init(&r->start_lock, 0);
+
+  /* Hold the lock so threads can find their index once all are created. */
+  pthread_mutex_lock(&r->start_lock);
+  for (u8 i = 0; i < n_corr_threads + RECEIVER_N_STAGE_THREADS; i++) {
+    if (pthread_create(&r->threads[i], 0, receiver_thread, r)) {
+      pthread_mutex_unlock(&r->start_lock);
+      receiver_destroy(r);
+      return -1;
+    }
+    r->n_threads++;
+  }
+  pthread_mutex_unlock(&r->start_lock);
+
+  return 0;
+}
+
+/** Stop the threads of a software receiver.
+ *
+ * \param r Receiver to destroy.
+ */
+void receiver_destroy(receiver_t* r)
+{
+  receiver_stage_t* stages[RECEIVER_MAX_CORR_THREADS + 4];
+  u8 n_stages = 0;
+  for (u8 i = 0; i < RECEIVER_MAX_CORR_THREADS; i++)
+    stages[n_stages++] = &r->corr_stage[i];
+  stages[n_stages++] = &r->loop_stage;
+  stages[n_stages++] = &r->nav_stage;
+  stages[n_stages++] = &r->meas_stage;
+  stages[n_stages++] = &r->pvt_stage;
+
+  __atomic_store_n(&r->quit, true, __ATOMIC_SEQ_CST);
+  for (u8 i = 0; i < n_stages; i++) {
+    pthread_mutex_lock(&stages[i]->lock);
+    pthread_cond_broadcast(&stages[i]->cond);
+    pthread_mutex_unlock(&stages[i]->lock);
+  }
+
+  for (u8 i = 0; i < r->n_threads; i++)
+    pthread_join(r->threads[i], 0);
+  r->n_threads = 0;
+
+  for (u8 i = 0; i < n_stages; i++)
+    stage_destroy(stages[i]);
+  for (u8 i = 0; i < RECEIVER_MAX_CORR_THREADS; i++)
+    pthread_mutex_destroy(&r->corr_lock[i]);
+  pthread_mutex_destroy(&r->start_lock);
+}
+
+/** Start tracking a satellite on a channel, e.g. after acquisition.
+ *
+ * The code frequency is initialised from the carrier frequency, assuming
+ * the Doppler shifts of the code and carrier are coherent. Any satellite
+ * previously tracked on the channel is dropped.
+ *
+ * \param r          Receiver.
+ * \param channel    Channel index.
+ * \param prn        Satellite PRN.
+ * \param pos        Ring index of the first sample to track.
+ * \param code_phase Code phase of that sample in chips, in [0, 1023).
+ * \param carr_freq  Carrier Doppler in Hz.
+ * \return 0 on success, -1 if `channel` or `prn` is out of range.
+ */
+s8 receiver_start_channel(receiver_t* r, u8 channel, u8 prn, u64 pos,
+                          double code_phase, double carr_freq)
+{
+  if (channel >= r->n_channels || prn >= 32)
+    return -1;
+
+  u8 id = channel % r->n_corr_threads;
+  receiver_channel_t* c = &r->channels[channel];
+
+  pthread_mutex_lock(&r->corr_lock[id]);
+  c->prn = prn;
+  c->start_pos = pos;
+  c->code_phase = code_phase;
+  c->carr_freq = carr_freq;
+  c->overrun = false;
+  __atomic_store_n(&c->pos, pos, __ATOMIC_RELEASE);
+  __atomic_store_n(&c->gen, c->gen + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&c->active, true, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&r->corr_lock[id]);
+
+  stage_wake(&r->corr_stage[id]);
+  return 0;
+}
+
+/** Stop tracking on a channel.
+ *
+ * Returns once the channel's correlation thread is no longer using it. The
+ * channel no longer holds back measurement epochs.
+ *
+ * \param r       Receiver.
+ * \param channel Channel index.
+ */
+void receiver_stop_channel(receiver_t* r, u8 channel)
+{
+  if (channel >= r->n_channels)
+    return;
+
+  u8 id = channel % r->n_corr_threads;
+  pthread_mutex_lock(&r->corr_lock[id]);
+  __atomic_store_n(&r->channels[channel].active, false, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&r->corr_lock[id]);
+
+  stage_wake(&r->meas_stage);
+}
+
+/** Provide an ephemeris, e.g. from assistance data, without waiting for it
+ * to be decoded from the navigation message. Replaces the ephemeris held
+ * for the same PRN.
+ *
+ * \param r Receiver.
+ * \param e Ephemeris, `e->prn` selects the satellite.
+ * \return 0 on success, -1 if the ephemeris queue is full.
+ */
+s8 receiver_set_ephemeris(receiver_t* r, const ephemeris_t* e)
+{
+  if (mpsc_queue_push(&r->eph_q, e))
+    return -1;
+  stage_wake(&r->meas_stage);
+  return 0;
+}
+
+/* Ring index of the oldest sample still needed by an active channel. */
+static u64 receiver_tail(receiver_t* r)
+{
+  u64 tail = sample_ring_head(&r->ring);
+  for (u8 i = 0; i < r->n_channels; i++) {
+    receiver_channel_t* c = &r->channels[i];
+    if (__atomic_load_n(&c->active, __ATOMIC_ACQUIRE))
+      tail = MIN(tail, __atomic_load_n(&c->pos, __ATOMIC_ACQUIRE));
+  }
+  return tail;
+}
+
+/** Feed samples to a software receiver.
+ *
+ * The samples are refused, rather than overwriting samples the channels
+ * furthest behind have not correlated yet, in which case the caller should
+ * retry once the receiver has caught up.
+ *
+ * \param r       Receiver.
+ * \param samples Samples, one per byte.
+ * \param n       Number of samples.
+ * \return 0 on success, -1 if there is no room for the samples.
+ */
+s8 receiver_ingest(receiver_t* r, const s8* samples, u32 n)
+{
+  u64 head = sample_ring_head(&r->ring);
+
+  if (n > r->ring.size || head + n > receiver_tail(r) + r->ring.size)
+    return -1;
+  /* Only this thread pushes blocks, so a queue that is not full now
+   * cannot fill up before the push below. */
+  if (spsc_queue_count(&r->block_q) >= RECEIVER_BLOCK_QUEUE_LEN)
+    return -1;
+
+  receiver_block_t b = {head + n, now()};
+  sample_ring_write(&r->ring, samples, n);
+  spsc_queue_push(&r->block_q, &b);
+
+  for (u8 i = 0; i < r->n_corr_threads; i++)
+    stage_wake(&r->corr_stage[i]);
+  stage_wake(&r->meas_stage);
+  return 0;
+}
+
+/** Get the oldest position fix not yet read.
+ *
+ * Fixes are produced for each measurement epoch with at least four locked
+ * channels that have decoded the time of week and have an ephemeris. If
+ * fixes are not read they are dropped once `RECEIVER_FIX_QUEUE_LEN` are
+ * waiting, counted in `fixes_dropped`.
+ *
+ * \param r   Receiver.
+ * \param fix Fix output.
+ * \return 0 on success, -1 if no fix is waiting.
+ */
+s8 receiver_get_fix(receiver_t* r, receiver_fix_t* fix)
+{
+  return spsc_queue_pop(&r->fix_q, fix);
+}
+
+/** \} */
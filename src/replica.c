@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "prns.h"
+#include "replica.h"
+
+/** \defgroup replica Code Replicas
+ * Precomputed spreading code replicas for the correlators.
+ *
+ * Two levels of caching are provided. ca_code_unpacked() returns the C/A
+ * codes unpacked to one chip per byte, as required by track_correlate(). A
+ * ::code_replica_cache_t additionally keeps code replicas resampled to the
+ * sample rate for use with track_correlate_replica().
+ *
+ * Cached replicas are keyed by PRN, quantised code phase increment per sample
+ * (see `CODE_REPLICA_STEP_RES`) and quantised initial code phase (see
+ * `CODE_REPLICA_PHASE_STEPS`). In the worst case the chip boundaries of a
+ * replica are offset from those of the exact code phase by
+ *
+ * ~~~
+ * code_step / (2 * CODE_REPLICA_PHASE_STEPS) + len * CODE_REPLICA_STEP_RES / 2
+ * ~~~
+ *
+ * chips, i.e. less than 0.01 chips for a 1 ms period at 16.368 MHz.
+ *
+ * \{ */
+
+/** Row stride of the unpacked code table, keeping each row 32 byte aligned. */
+#define CA_CODE_UNPACKED_STRIDE 1056
+
+static s8 ca_codes_unpacked[32][CA_CODE_UNPACKED_STRIDE]
+  __attribute__((aligned(32)));
+static u8 ca_codes_unpacked_valid[32];
+
+/** Returns the C/A code for a given PRN unpacked to one chip per byte.
+ *
+ * The codes are unpacked with ca_code_unpack() on first use and kept in a
+ * static table, each code is 32 byte aligned. It is safe to call this
+ * function concurrently from several threads.
+ *
+ * \param prn PRN number.
+ * \return Pointer to `CA_CODE_UNPACKED_LEN` chips in the layout expected by
+ *         track_correlate().
+ */
+const s8* ca_code_unpacked(u8 prn)
+{
+  if (!__atomic_load_n(&ca_codes_unpacked_valid[prn], __ATOMIC_ACQUIRE)) {
+    /* Racing threads write identical data so no further locking needed. */
+    ca_code_unpack(prn, ca_codes_unpacked[prn]);
+    __atomic_store_n(&ca_codes_unpacked_valid[prn], 1, __ATOMIC_RELEASE);
+  }
+  return ca_codes_unpacked[prn];
+}
+
+/* Round a replica length up to keep all replicas 32 byte aligned. */
+static u32 replica_stride(u32 max_len)
+{
+  return (max_len + 31) & ~31u;
+}
+
+/** Initialise a code replica cache.
+ *
+ * Allocates space for `n_slots` replicas of up to `max_len` samples each.
+ * Every slot holds Early, Prompt and Late replicas so the total storage used
+ * is about `3 * n_slots * max_len` bytes. `max_len` should be at least one
+ * more than the number of samples in a code period.
+ *
+ * Remember to free the cache with code_replica_cache_destroy().
+ *
+ * \param c       Cache to initialise.
+ * \param n_slots Number of replicas to cache.
+ * \param max_len Maximum replica length in samples.
+ * \return 0 on success, -1 on a malloc() failure.
+ */
+s8 code_replica_cache_init(code_replica_cache_t* c, u16 n_slots, u32 max_len)
+{
+  memset(c, 0, sizeof(*c));
+
+  u32 stride = replica_stride(max_len);
+  c->slots = calloc(n_slots, sizeof(code_replica_t));
+  c->buff = malloc((size_t)3 * n_slots * stride + 31);
+  if (!c->slots || !c->buff) {
+    free(c->slots);
+    free(c->buff);
+    c->slots = 0;
+    c->buff = 0;
+    return -1;
+  }
+
+  s8* aligned = (s8*)(((uintptr_t)c->buff + 31) & ~(uintptr_t)31);
+  for (u16 i = 0; i < n_slots; i++) {
+    c->slots[i].E = aligned + (size_t)(3*i + 0) * stride;
+    c->slots[i].P = aligned + (size_t)(3*i + 1) * stride;
+    c->slots[i].L = aligned + (size_t)(3*i + 2) * stride;
+  }
+
+  c->n_slots = n_slots;
+  c->max_len = max_len;
+  return 0;
+}
+
+/** Free the storage held by a code replica cache.
+ *
+ * \param c Cache to destroy.
+ */
+void code_replica_cache_destroy(code_replica_cache_t* c)
+{
+  free(c->slots);
+  free(c->buff);
+  memset(c, 0, sizeof(*c));
+}
+
+/* Chip `k` of an unpacked code for any integer k, wrapping modulo 1023. */
+static s8 replica_chip(const s8* code, s32 k)
+{
+  k %= 1023;
+  if (k < 0)
+    k += 1023;
+  return code[k + 1];
+}
+
+static void replica_generate(code_replica_t* r, const s8* code,
+                             double code_phase, double code_step)
+{
+  for (u32 i = 0; i < r->len; i++) {
+    double x = code_phase + i*code_step;
+    r->E[i] = replica_chip(code, (s32)floor(x - 0.5));
+    r->P[i] = replica_chip(code, (s32)floor(x));
+    r->L[i] = replica_chip(code, (s32)floor(x + 0.5));
+  }
+}
+
+/** Look up or generate the replica for one code period.
+ *
+ * Returns the cached replica matching the PRN and the quantised code phase
+ * and increment. On a miss the least recently used slot is regenerated.
+ *
+ * The returned pointer is valid until the next call to code_replica_get() on
+ * the same cache.
+ *
+ * \param c          Cache to use.
+ * \param prn        PRN number.
+ * \param code_phase Code phase of the first sample in chips, in [0, 1023).
+ * \param code_step  Code phase increment per sample in chips.
+ * \return Pointer to the replica, or NULL if the code period does not fit in
+ *         `max_len` samples or the cache has no slots.
+ */
+const code_replica_t* code_replica_get(code_replica_cache_t* c, u8 prn,
+                                       double code_phase, double code_step)
+{
+  s32 step_key = (s32)lround(code_step / CODE_REPLICA_STEP_RES);
+  if (step_key <= 0 || code_phase < 0 || !c->n_slots)
+    return 0;
+  double step_q = step_key * CODE_REPLICA_STEP_RES;
+  u32 phase_key = (u32)floor(code_phase / step_q * CODE_REPLICA_PHASE_STEPS);
+
+  c->tick++;
+
+  code_replica_t* lru = &c->slots[0];
+  for (u16 i = 0; i < c->n_slots; i++) {
+    code_replica_t* r = &c->slots[i];
+    if (r->len && r->prn == prn && r->step_key == step_key &&
+        r->phase_key == phase_key) {
+      r->last_used = c->tick;
+      c->hits++;
+      return r;
+    }
+    if (r->last_used < lru->last_used)
+      lru = r;
+  }
+
+  /* Generate at the centre of the quantisation bin, with one extra sample to
+   * cover the period length of any phase and increment in the bin. */
+  double phase_q = (phase_key + 0.5) * step_q / CODE_REPLICA_PHASE_STEPS;
+  u32 len = (u32)ceil((1023.0 - phase_q) / step_q) + 1;
+  if (len > c->max_len)
+    return 0;
+
+  lru->prn = prn;
+  lru->step_key = step_key;
+  lru->phase_key = phase_key;
+  lru->len = len;
+  lru->last_used = c->tick;
+  replica_generate(lru, ca_code_unpacked(prn), phase_q, step_q);
+  c->misses++;
+
+  return lru;
+}
+
+/** \} */
+
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "resample.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* As for the correlators the SIMD dot products are compiled with per-function
+ * target attributes and picked at run time. */
+#define RESAMPLE_X86
+#include <immintrin.h>
+#endif
+
+/** \defgroup resample Resampling
+ * Conversion of a sample stream to a different sample rate.
+ *
+ * The resampler is a polyphase FIR filter with `RESAMPLE_PHASES` branches.
+ * For each output sample the branch closest to the fractional input position
+ * is chosen, giving a timing error of at most 1/(2 * `RESAMPLE_PHASES`)
+ * input samples. The prototype filter is a Blackman windowed sinc low pass
+ * with its cutoff at 0.45 times the lower of the two sample rates.
+ *
+ * When decimating, input above the output Nyquist frequency folds back
+ * into the output band. The filter length therefore grows with the
+ * decimation ratio, `RESAMPLE_TAPS_PER_RATIO` taps per unit of `fs_in /
+ * fs_out`, which keeps the transition band at a fixed fraction of the output
+ * rate. Input from 0.55 times the output rate up, which would alias into the
+ * passband, is attenuated by about 50 dB. Input between 0.5 and 0.55 times
+ * the output rate only aliases into the transition band above 0.45 times the
+ * output rate. The cost per input sample stays at about
+ * `RESAMPLE_TAPS_PER_RATIO` multiply-adds whatever the ratio.
+ *
+ * The taps are held as Q14 `s16` so that each output is an `s16` dot
+ * product, using `pmaddwd` with SSE2 or AVX2 when the CPU has them.
+ * \{ */
+
+/* Windowed sinc prototype filter of `n_taps` taps at offset `x` input
+ * samples from its centre, with cutoff `fc` in cycles per input sample. */
+static double resample_prototype(double x, double fc, u32 n_taps)
+{
+  double half = n_taps / 2.0;
+  if (fabs(x) >= half)
+    return 0;
+  double w = 0.42 + 0.5*cos(M_PI*x/half) + 0.08*cos(2*M_PI*x/half);
+  double sinc = (x == 0) ? 2*fc : sin(2*M_PI*fc*x) / (M_PI*x);
+  return w * sinc;
+}
+
+/** Initialise a resampler.
+ *
+ * \param r         Resampler to initialise.
+ * \param fs_in     Input sample rate.
+ * \param fs_out    Output sample rate, at most `RESAMPLE_MAX_RATIO` times
+ *                  lower than `fs_in`.
+ * \param gain_log2 The output is scaled by `2^gain_log2`, e.g. to make use
+ *                  of the `s8` range when decimating few bit samples. At
+ *                  most 13.
+ * \return 0 on success, -1 if the rates or gain are out of range.
+ */
+s8 resampler_init(resampler_t* r, double fs_in, double fs_out, u8 gain_log2)
+{
+  if (fs_in <= 0 || fs_out <= 0 || fs_in / fs_out > RESAMPLE_MAX_RATIO ||
+      gain_log2 > 13)
+    return -1;
+
+  memset(r, 0, sizeof(*r));
+
+  double ratio = MAX(1.0, fs_in / fs_out);
+  u32 n_taps = (u32)ceil(RESAMPLE_TAPS_PER_RATIO * ratio);
+  n_taps = MIN(RESAMPLE_MAX_TAPS, (n_taps + 7) & ~7u);
+
+  double fc = 0.45 / ratio;
+  for (u32 p = 0; p < RESAMPLE_PHASES; p++) {
+    /* Branch p interpolates at a fraction f past the centre tap. */
+    double f = (p + 0.5) / RESAMPLE_PHASES;
+    double h[RESAMPLE_MAX_TAPS];
+    double sum = 0;
+    for (u32 k = 0; k < n_taps; k++) {
+      h[k] = resample_prototype(n_taps/2 - 1 + f - k, fc, n_taps);
+      sum += h[k];
+    }
+    /* Normalise every branch to unity gain at DC. */
+    for (u32 k = 0; k < n_taps; k++)
+      r->taps[p][k] = (s16)lround(h[k] / sum * (1 << 14));
+  }
+
+  r->n_taps = n_taps;
+  r->delay = n_taps/2 - 1;
+  r->step = (u64)llround(fs_in / fs_out * 4294967296.0);
+  r->shift = 14 - gain_log2;
+  return 0;
+}
+
+/** Maximum number of output samples produced by one call to
+ * resampler_process().
+ *
+ * \param r    Resampler.
+ * \param n_in Number of input samples passed to resampler_process().
+ * \return Required size of the output buffer.
+ */
+u32 resampler_max_out(const resampler_t* r, u32 n_in)
+{
+  return (u32)((((u64)n_in + r->n_taps) << 32) / r->step) + 1;
+}
+
+static s8 resample_saturate(s32 x, u8 shift)
+{
+  x = (x + (1 << (shift - 1))) >> shift;
+  return (s8)MAX(-127, MIN(127, x));
+}
+
+/** Dot product of `n` samples and taps, `n` a multiple of 8. */
+typedef s32 (*resample_dot_t)(const s16* x, const s16* h, u32 n);
+
+static s32 resample_dot_c(const s16* x, const s16* h, u32 n)
+{
+  s32 acc = 0;
+  for (u32 k = 0; k < n; k++)
+    acc += x[k] * h[k];
+  return acc;
+}
+
+#ifdef RESAMPLE_X86
+
+__attribute__((target("sse2")))
+static s32 resample_hsum_sse2(__m128i a)
+{
+  a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+  a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(a);
+}
+
+__attribute__((target("sse2")))
+static s32 resample_dot_sse2(const s16* x, const s16* h, u32 n)
+{
+  __m128i acc = _mm_setzero_si128();
+  for (u32 k = 0; k < n; k += 8)
+    acc = _mm_add_epi32(acc,
+                        _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&x[k]),
+                                       _mm_load_si128((const __m128i *)&h[k])));
+  return resample_hsum_sse2(acc);
+}
+
+__attribute__((target("avx2")))
+static s32 resample_dot_avx2(const s16* x, const s16* h, u32 n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  u32 k = 0;
+  for (; k + 16 <= n; k += 16)
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+            _mm256_loadu_si256((const __m256i *)&x[k]),
+            _mm256_loadu_si256((const __m256i *)&h[k])));
+  __m128i a = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                            _mm256_extracti128_si256(acc, 1));
+  if (k < n)
+    a = _mm_add_epi32(a,
+                      _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&x[k]),
+                                     _mm_load_si128((const __m128i *)&h[k])));
+  return resample_hsum_sse2(a);
+}
+
+#endif /* RESAMPLE_X86 */
+
+/* Fastest dot product supported by the CPU. The CPU features are detected
+ * by a constructor in libgcc, so this only reads them. */
+static resample_dot_t resample_dot_select(void)
+{
+#ifdef RESAMPLE_X86
+  if (__builtin_cpu_supports("avx2"))
+    return resample_dot_avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return resample_dot_sse2;
+#endif
+  return resample_dot_c;
+}
+
+/** Resample a block of samples.
+ *
+ * The input is consumed in chunks of `RESAMPLE_CHUNK_LEN` samples and the
+ * filter state is kept between calls, so a stream can be passed in blocks of
+ * any size and the output is the same as if it had been passed in one go.
+ * The output lags the input by `r->delay` input samples.
+ *
+ * \param r    Resampler.
+ * \param in   Input samples.
+ * \param n_in Number of input samples.
+ * \param out  Output samples, must have room for resampler_max_out()
+ *             samples.
+ * \return Number of output samples written.
+ */
+u32 resampler_process(resampler_t* r, const s8* in, u32 n_in, s8* out)
+{
+  resample_dot_t dot = resample_dot_select();
+  u32 n_taps = r->n_taps;
+  u32 n_out = 0;
+
+  while (n_in) {
+    u32 n = MIN(n_in, RESAMPLE_CHUNK_LEN + n_taps - 1 - r->n_buff);
+    for (u32 i = 0; i < n; i++)
+      r->buff[r->n_buff + i] = in[i];
+    r->n_buff += n;
+    in += n;
+    n_in -= n;
+
+    while ((r->t >> 32) + n_taps <= r->n_buff) {
+      u32 idx = r->t >> 32;
+      u32 phase = (u32)r->t >> (32 - RESAMPLE_PHASE_BITS);
+      out[n_out++] = resample_saturate(dot(&r->buff[idx], r->taps[phase],
+                                           n_taps),
+                                       r->shift);
+      r->t += r->step;
+    }
+
+    /* Keep the samples still needed by the next output. */
+    u32 keep_from = MIN(r->t >> 32, r->n_buff);
+    memmove(r->buff, &r->buff[keep_from],
+            (r->n_buff - keep_from) * sizeof(s16));
+    r->n_buff -= keep_from;
+    r->t -= (u64)keep_from << 32;
+  }
+
+  return n_out;
+}
+
+/** \} */
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <string.h>
+
+#include "samples.h"
+
+/** \defgroup samples Samples
+ * Handling of raw front-end sample streams.
+ * \{ */
+
+/* Values of a 2-bit sign/magnitude sample. */
+static const s8 sample_2bit_values[4] = {1, 3, -1, -3};
+
+/* Expansion of every possible packed byte to its samples, built on first
+ * use. */
+static s8 sample_1bit_lut[256][8];
+static s8 sample_2bit_lut[256][4];
+static u8 sample_luts_valid;
+
+static void sample_luts_init(void)
+{
+  if (__atomic_load_n(&sample_luts_valid, __ATOMIC_ACQUIRE))
+    return;
+
+  /* Racing threads write identical data so no further locking needed. */
+  for (u32 b = 0; b < 256; b++) {
+    for (u8 k = 0; k < 8; k++)
+      sample_1bit_lut[b][k] = (b >> (7 - k)) & 1 ? -1 : 1;
+    for (u8 k = 0; k < 4; k++)
+      sample_2bit_lut[b][k] = sample_2bit_values[(b >> (6 - 2*k)) & 3];
+  }
+
+  __atomic_store_n(&sample_luts_valid, 1, __ATOMIC_RELEASE);
+}
+
+/** Number of bits per sample of a sample format.
+ *
+ * \param fmt Sample format.
+ * \return Bits per sample.
+ */
+u8 sample_fmt_bits(sample_fmt_t fmt)
+{
+  switch (fmt) {
+  case SAMPLE_FMT_1BIT:
+    return 1;
+  case SAMPLE_FMT_2BIT:
+    return 2;
+  default:
+    return 8;
+  }
+}
+
+/* Sample `i` of a packed buffer. */
+static s8 sample_get(const u8* packed, sample_fmt_t fmt, u32 i)
+{
+  switch (fmt) {
+  case SAMPLE_FMT_1BIT:
+    return sample_1bit_lut[packed[i / 8]][i % 8];
+  case SAMPLE_FMT_2BIT:
+    return sample_2bit_lut[packed[i / 4]][i % 4];
+  default:
+    return ((const s8*)packed)[i];
+  }
+}
+
+/** Unpack a run of samples to one `s8` per sample.
+ *
+ * Whole bytes are expanded with a lookup table, one table entry per packed
+ * byte, so unpacking costs one load and one store per 4 or 8 samples. The
+ * correlators use this to unpack short chunks that stay in the L1 cache
+ * rather than whole buffers.
+ *
+ * \param packed Packed sample buffer.
+ * \param fmt    Format of `packed`.
+ * \param first  Index of the first sample to unpack.
+ * \param n      Number of samples to unpack.
+ * \param out    Output buffer of length `n`.
+ */
+void samples_unpack(const u8* packed, sample_fmt_t fmt, u32 first, u32 n,
+                    s8* out)
+{
+  if (fmt == SAMPLE_FMT_S8) {
+    memcpy(out, &packed[first], n);
+    return;
+  }
+
+  sample_luts_init();
+
+  u32 per_byte = 8 / sample_fmt_bits(fmt);
+  u32 i = 0;
+
+  /* Leading samples up to a byte boundary. */
+  for (; i < n && (first + i) % per_byte; i++)
+    out[i] = sample_get(packed, fmt, first + i);
+
+  const u8* p = &packed[(first + i) / per_byte];
+  if (fmt == SAMPLE_FMT_1BIT) {
+    for (; i + 8 <= n; i += 8)
+      memcpy(&out[i], sample_1bit_lut[*p++], 8);
+  } else {
+    for (; i + 4 <= n; i += 4)
+      memcpy(&out[i], sample_2bit_lut[*p++], 4);
+  }
+
+  for (; i < n; i++)
+    out[i] = sample_get(packed, fmt, first + i);
+}
+
+/** Initialise a sample ring buffer.
+ *
+ * \param ring Ring buffer to initialise.
+ * \param buff Storage for `size` samples, owned by the caller.
+ * \param size Number of samples the ring can hold.
+ */
+void sample_ring_init(sample_ring_t* ring, s8* buff, u32 size)
+{
+  ring->buff = buff;
+  ring->size = size;
+  ring->write_count = 0;
+  ring->reserve_count = 0;
+}
+
+/** Write samples into a ring buffer.
+ *
+ * Copies the samples in after the last ones written and publishes them to
+ * the readers. Only one thread may write to a ring.
+ *
+ * \param ring    Ring buffer.
+ * \param samples Samples to write.
+ * \param n       Number of samples, at most the size of the ring.
+ */
+void sample_ring_write(sample_ring_t* ring, const s8* samples, u32 n)
+{
+  u32 start = ring->write_count % ring->size;
+  u32 n0 = MIN(n, ring->size - start);
+
+  sample_ring_reserve(ring, n);
+  memcpy(&ring->buff[start], samples, n0);
+  memcpy(ring->buff, &samples[n0], n - n0);
+  sample_ring_commit(ring, n);
+}
+
+/** Announce that samples are about to be written into a ring buffer's
+ * storage directly.
+ *
+ * The producer writes over the oldest samples in place, so readers still
+ * working on them must be able to tell, see sample_ring_overwritten(). A
+ * producer that fills `ring->buff` itself should call this with the number
+ * of samples it is going to write before touching the storage, and
+ * sample_ring_commit() once they are written.
+ *
+ * \param ring Ring buffer.
+ * \param n    Number of samples about to be written.
+ */
+void sample_ring_reserve(sample_ring_t* ring, u32 n)
+{
+  __atomic_store_n(&ring->reserve_count, ring->write_count + n,
+                   __ATOMIC_RELAXED);
+  /* Keep the count ahead of the stores of the samples themselves, pairs
+   * with the fence in sample_ring_overwritten(). */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/** Publish samples written into a ring buffer's storage directly.
+ *
+ * For producers such as DMA engines that fill `ring->buff` themselves, this
+ * marks the next `n` samples after the last ones published as valid. The
+ * write should have been announced with sample_ring_reserve() first.
+ *
+ * \param ring Ring buffer.
+ * \param n    Number of samples written.
+ */
+void sample_ring_commit(sample_ring_t* ring, u32 n)
+{
+  u64 head = ring->write_count + n;
+  if (ring->reserve_count < head)
+    __atomic_store_n(&ring->reserve_count, head, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring->write_count, head, __ATOMIC_RELEASE);
+}
+
+/** Index of the next sample to be written to a ring buffer, i.e. samples up
+ * to but not including this index may be read.
+ *
+ * \param ring Ring buffer.
+ * \return Total number of samples written.
+ */
+u64 sample_ring_head(const sample_ring_t* ring)
+{
+  return __atomic_load_n(&ring->write_count, __ATOMIC_ACQUIRE);
+}
+
+/** Check whether samples read from a ring buffer may have been written over.
+ *
+ * Readers access the samples in place, so the producer may write over them
+ * while they are being read. Call this after reading: samples from `pos` on
+ * that were read before the call are intact if it returns false. Writes that
+ * are still in progress count as overwrites, as announced by
+ * sample_ring_reserve().
+ *
+ * \param ring Ring buffer.
+ * \param pos  Index of the first sample read.
+ * \return True if any sample from `pos` on may have been overwritten.
+ */
+bool sample_ring_overwritten(const sample_ring_t* ring, u64 pos)
+{
+  /* Pairs with the fence in sample_ring_reserve(), if any of the samples
+   * read was written over then the reservation for it is seen here. */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  u64 reserved = __atomic_load_n(&ring->reserve_count, __ATOMIC_RELAXED);
+  return reserved - pos > ring->size;
+}
+
+/** Get the location of a run of samples in a ring buffer.
+ *
+ * The run is returned as up to two contiguous segments, the second one
+ * starting at the beginning of the ring storage if the run wraps around.
+ * The samples stay valid until the producer writes over them, which should
+ * be checked with sample_ring_overwritten() after reading them.
+ *
+ * \param ring Ring buffer.
+ * \param pos  Index of the first sample of the run.
+ * \param n    Number of samples in the run.
+ * \param seg0 First segment output.
+ * \param n0   Number of samples in the first segment output, the second
+ *             segment holds the remaining `n - n0`.
+ * \param seg1 Second segment output.
+ * \return 0 on success, -1 if the run has not been written yet or has
+ *         already been overwritten.
+ */
+s8 sample_ring_segments(const sample_ring_t* ring, u64 pos, u32 n,
+                        const s8** seg0, u32* n0, const s8** seg1)
+{
+  if (pos + n > sample_ring_head(ring) || sample_ring_overwritten(ring, pos))
+    return -1;
+
+  u32 start = pos % ring->size;
+  *n0 = MIN(n, ring->size - start);
+  *seg0 = &ring->buff[start];
+  *seg1 = ring->buff;
+  return 0;
+}
+
+/** \} */
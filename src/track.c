@@ -665,6 +665,8 @@ void cn0_est_init(cn0_est_state_t *s, float bw, float cn0_0,
   s->I_prev_abs = -1.f;
   s->Q_prev_abs = -1.f;
   s->nsr = powf(10.f, 0.1f*(s->log_bw - cn0_0));
+  /* Start the filter in steady state at `cn0_0`. */
+  s->xn = s->b * s->nsr;
 }
 
 /** Estimate the Carrier-to-Noise Density, \f$ C / N_0 \f$ of a tracked signal.
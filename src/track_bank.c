@@ -0,0 +1,1344 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "track_bank.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* As in correlate.c, the SIMD updates are compiled with per-function target
+ * attributes and the widest one supported is picked at run time. */
+#define TRACK_BANK_X86
+#include <immintrin.h>
+#endif
+
+/** \defgroup track_bank Tracking Bank
+ * Tracking loops of many channels updated together.
+ *
+ * A ::track_bank_t holds the state of an aided tracking loop, a lock
+ * detector and a \f$ C / N_0 \f$ estimator for every channel, one array per
+ * field. track_bank_update() then runs the discriminators, loop filters, lock
+ * detectors and estimators of 4, 8 or 16 channels at a time with SSE2, AVX2
+ * or AVX-512, whichever is the widest the CPU supports, see
+ * track_bank_set_impl().
+ *
+ * The loops behave as aided_tl_update(), lock_detect_update() and cn0_est()
+ * except that the arctangents of the Costas and frequency discriminators use
+ * the polynomial approximation of track_bank_atan() and the \f$ C / N_0 \f$
+ * estimate uses track_bank_log10(). The simple tracking loop is the special
+ * case of an aided loop with no FLL aiding and no carrier aiding of the code
+ * loop, i.e. `aiding_igain` and `carr_to_code` both zero.
+ * \{ */
+
+/* Minimax polynomial for atan(x) on [0, 1], odd powers only. */
+#define ATAN_C1  0.99997726f
+#define ATAN_C3 -0.33262347f
+#define ATAN_C5  0.19354346f
+#define ATAN_C7 -0.11643287f
+#define ATAN_C9  0.05265332f
+#define ATAN_C11 -0.01172120f
+
+static float atan_poly(float z)
+{
+  float z2 = z*z;
+  return z * (ATAN_C1 + z2*(ATAN_C3 + z2*(ATAN_C5 + z2*(ATAN_C7
+              + z2*(ATAN_C9 + z2*ATAN_C11)))));
+}
+
+/** Polynomial approximation of the arctangent.
+ *
+ * Reduces the argument to [0, 1] and evaluates an 11th order minimax
+ * polynomial, for a maximum absolute error of about 2e-6 radians, i.e.
+ * 3e-7 cycles in the output of the Costas discriminator. This is the
+ * arctangent used by track_bank_update().
+ *
+ * \param x Argument, may be infinite.
+ * \return \f$ \tan^{-1} x \f$ in radians.
+ */
+float track_bank_atan(float x)
+{
+  float ax = fabsf(x);
+  float r = ax > 1 ? (float)M_PI_2 - atan_poly(1 / ax) : atan_poly(ax);
+  return copysignf(r, x);
+}
+
+/* Series for ln(m) = 2 atanh(t), t = (m - 1) / (m + 1), |t| < 0.172. */
+#define LOG_C3 (1.f/3)
+#define LOG_C5 (1.f/5)
+#define LOG_C7 (1.f/7)
+
+/* log10(2) split so that the product with the exponent is exact. */
+#define LOG10_2_HI 0.301025390625f
+#define LOG10_2_LO 4.6050389811952137e-6f
+
+/** Fast approximation of the base 10 logarithm.
+ *
+ * Splits the argument into a power of two and a mantissa in
+ * \f$ [\sqrt{1/2}, \sqrt{2}) \f$ and evaluates a 7th order series for the
+ * logarithm of the mantissa. The absolute error is below 5e-8 for
+ * arguments in [1/2, 2] and otherwise within the rounding of the result,
+ * below 2e-6 over the whole range of positive floats as for log10f(). This
+ * is the logarithm used by track_bank_cn0_update().
+ *
+ * \param x Argument.
+ * \return \f$ \log_{10} x \f$, `-INFINITY` for zero, `INFINITY` for
+ *         infinity and NaN for negative or NaN arguments.
+ */
+float track_bank_log10(float x)
+{
+  if (!(x > 0))
+    return x == 0 ? -INFINITY : NAN;
+  if (isinf(x))
+    return x;
+
+  float e = 0;
+  if (x < FLT_MIN) {
+    /* Denormal, normalise it first. */
+    x *= 8388608.f;
+    e = -23;
+  }
+
+  u32 bits;
+  memcpy(&bits, &x, sizeof(bits));
+  e += (s32)(bits >> 23) - 127;
+  bits = (bits & 0x007FFFFF) | 0x3F800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  if (m > (float)M_SQRT2) {
+    m *= 0.5f;
+    e += 1;
+  }
+
+  float t = (m - 1) / (m + 1);
+  float t2 = t*t;
+  float ln_m = 2*t * (1 + t2*(LOG_C3 + t2*(LOG_C5 + t2*LOG_C7)));
+  return e*LOG10_2_HI + (e*LOG10_2_LO + ln_m*(float)M_LOG10E);
+}
+
+/* Round a channel count up to a whole number of lanes. */
+static u32 bank_capacity(u32 n_channels)
+{
+  return (n_channels + TRACK_BANK_LANES - 1) & ~(TRACK_BANK_LANES - 1);
+}
+
+/** Number of float arrays in a ::track_bank_t. */
+#define BANK_N_FLOAT 32
+
+/** Allocate a tracking bank.
+ *
+ * All channels are initially zero, they should be set up with
+ * track_bank_set() before the first update. Remember to free the bank with
+ * track_bank_destroy().
+ *
+ * \param b          Bank to initialise.
+ * \param n_channels Number of channels.
+ * \return 0 on success, -1 on a malloc() failure.
+ */
+s8 track_bank_init(track_bank_t* b, u32 n_channels)
+{
+  memset(b, 0, sizeof(*b));
+
+  u32 cap = bank_capacity(n_channels);
+  size_t size = (size_t)BANK_N_FLOAT * cap * sizeof(float)
+                + 4 * cap * sizeof(u16) + 2 * cap;
+  b->buff = calloc(size + 63, 1);
+  if (!b->buff)
+    return -1;
+
+  float* f = (float*)(((uintptr_t)b->buff + 63) & ~(uintptr_t)63);
+  float** arrays[BANK_N_FLOAT] = {
+    &b->carr_freq, &b->carr_b0, &b->carr_b1, &b->carr_aiding_igain,
+    &b->carr_prev_error, &b->code_freq, &b->code_b0, &b->code_b1,
+    &b->code_prev_error, &b->code_y, &b->prev_I, &b->prev_Q,
+    &b->carr_to_code,
+    &b->lock_k1i, &b->lock_k1q, &b->lock_yi, &b->lock_yq, &b->lock_k2,
+    &b->cn0_log_bw, &b->cn0_b, &b->cn0_a, &b->cn0_I_prev_abs,
+    &b->cn0_Q_prev_abs, &b->cn0_nsr, &b->cn0_xn, &b->cn0,
+    &b->I_E, &b->Q_E, &b->I_P, &b->Q_P, &b->I_L, &b->Q_L,
+  };
+  for (u32 k = 0; k < BANK_N_FLOAT; k++)
+    *arrays[k] = &f[k * cap];
+
+  u16* h = (u16*)&f[BANK_N_FLOAT * cap];
+  b->lock_lo = &h[0];
+  b->lock_lp = &h[cap];
+  b->lock_pcount1 = &h[2*cap];
+  b->lock_pcount2 = &h[3*cap];
+  b->lock_outo = (u8*)&h[4*cap];
+  b->lock_outp = &b->lock_outo[cap];
+
+  /* Keep the unused lanes free of divisions by zero. */
+  for (u32 i = n_channels; i < cap; i++) {
+    b->I_E[i] = b->I_P[i] = b->I_L[i] = 1;
+    b->prev_I[i] = 1;
+    b->lock_k2[i] = 1;
+    b->cn0_nsr[i] = 1;
+  }
+
+  b->n_channels = n_channels;
+  b->capacity = cap;
+  return 0;
+}
+
+/** Free the storage held by a tracking bank.
+ *
+ * \param b Bank to destroy.
+ */
+void track_bank_destroy(track_bank_t* b)
+{
+  free(b->buff);
+  memset(b, 0, sizeof(*b));
+}
+
+/** Load the state of one channel of a tracking bank.
+ *
+ * \param b   Tracking bank.
+ * \param i   Channel index.
+ * \param tl  Tracking loop state, e.g. from aided_tl_init().
+ * \param ld  Lock detector state, e.g. from lock_detect_init(). May be NULL
+ *            to leave the lock detector unchanged.
+ * \param cn0 \f$ C / N_0 \f$ estimator state, e.g. from cn0_est_init(). May
+ *            be NULL to leave the estimator unchanged.
+ */
+void track_bank_set(track_bank_t* b, u32 i, const aided_tl_state_t* tl,
+                    const lock_detect_t* ld, const cn0_est_state_t* cn0)
+{
+  b->carr_freq[i] = tl->carr_filt.y;
+  b->carr_b0[i] = tl->carr_filt.b0;
+  b->carr_b1[i] = tl->carr_filt.b1;
+  b->carr_aiding_igain[i] = tl->carr_filt.aiding_igain;
+  b->carr_prev_error[i] = tl->carr_filt.prev_error;
+  b->code_freq[i] = tl->code_freq;
+  b->code_b0[i] = tl->code_filt.b0;
+  b->code_b1[i] = tl->code_filt.b1;
+  b->code_prev_error[i] = tl->code_filt.prev_error;
+  b->code_y[i] = tl->code_filt.y;
+  b->prev_I[i] = tl->prev_I;
+  b->prev_Q[i] = tl->prev_Q;
+  b->carr_to_code[i] = tl->carr_to_code;
+
+  if (ld) {
+    b->lock_k1i[i] = ld->lpfi.k1;
+    b->lock_k1q[i] = ld->lpfq.k1;
+    b->lock_yi[i] = ld->lpfi.y;
+    b->lock_yq[i] = ld->lpfq.y;
+    b->lock_k2[i] = ld->k2;
+    b->lock_lo[i] = ld->lo;
+    b->lock_lp[i] = ld->lp;
+    b->lock_pcount1[i] = ld->pcount1;
+    b->lock_pcount2[i] = ld->pcount2;
+    b->lock_outo[i] = ld->outo;
+    b->lock_outp[i] = ld->outp;
+  }
+
+  if (cn0) {
+    b->cn0_log_bw[i] = cn0->log_bw;
+    b->cn0_b[i] = cn0->b;
+    b->cn0_a[i] = cn0->a;
+    b->cn0_I_prev_abs[i] = cn0->I_prev_abs;
+    b->cn0_Q_prev_abs[i] = cn0->Q_prev_abs;
+    b->cn0_nsr[i] = cn0->nsr;
+    b->cn0_xn[i] = cn0->xn;
+  }
+}
+
+/** Read back the state of one channel of a tracking bank.
+ *
+ * \param b   Tracking bank.
+ * \param i   Channel index.
+ * \param tl  Tracking loop state output. May be NULL.
+ * \param ld  Lock detector state output. May be NULL.
+ * \param cn0 \f$ C / N_0 \f$ estimator state output. May be NULL.
+ */
+void track_bank_get(const track_bank_t* b, u32 i, aided_tl_state_t* tl,
+                    lock_detect_t* ld, cn0_est_state_t* cn0)
+{
+  if (tl) {
+    tl->carr_freq = b->carr_freq[i];
+    tl->carr_filt.y = b->carr_freq[i];
+    tl->carr_filt.b0 = b->carr_b0[i];
+    tl->carr_filt.b1 = b->carr_b1[i];
+    tl->carr_filt.aiding_igain = b->carr_aiding_igain[i];
+    tl->carr_filt.prev_error = b->carr_prev_error[i];
+    tl->code_freq = b->code_freq[i];
+    tl->code_filt.b0 = b->code_b0[i];
+    tl->code_filt.b1 = b->code_b1[i];
+    tl->code_filt.prev_error = b->code_prev_error[i];
+    tl->code_filt.y = b->code_y[i];
+    tl->prev_I = b->prev_I[i];
+    tl->prev_Q = b->prev_Q[i];
+    tl->carr_to_code = b->carr_to_code[i];
+  }
+
+  if (ld) {
+    ld->lpfi.k1 = b->lock_k1i[i];
+    ld->lpfq.k1 = b->lock_k1q[i];
+    ld->lpfi.y = b->lock_yi[i];
+    ld->lpfq.y = b->lock_yq[i];
+    ld->k2 = b->lock_k2[i];
+    ld->lo = b->lock_lo[i];
+    ld->lp = b->lock_lp[i];
+    ld->pcount1 = b->lock_pcount1[i];
+    ld->pcount2 = b->lock_pcount2[i];
+    ld->outo = b->lock_outo[i];
+    ld->outp = b->lock_outp[i];
+  }
+
+  if (cn0) {
+    cn0->log_bw = b->cn0_log_bw[i];
+    cn0->b = b->cn0_b[i];
+    cn0->a = b->cn0_a[i];
+    cn0->I_prev_abs = b->cn0_I_prev_abs[i];
+    cn0->Q_prev_abs = b->cn0_Q_prev_abs[i];
+    cn0->nsr = b->cn0_nsr[i];
+    cn0->xn = b->cn0_xn[i];
+  }
+}
+
+/* Tracking loop update of one channel, as aided_tl_update(). */
+static void bank_loop_update(track_bank_t* b, u32 i)
+{
+  float I = b->I_P[i], Q = b->Q_P[i];
+
+  /* Costas discriminator. */
+  float carr_error = I == 0 ? 0 : track_bank_atan(Q / I)
+                                  * (float)(1/(2*M_PI));
+
+  /* Frequency discriminator, atan2() with a non-negative dot product. */
+  float freq_error = 0;
+  if (b->carr_aiding_igain[i] != 0) {
+    float dot = fabsf(I * b->prev_I[i]) + fabsf(Q * b->prev_Q[i]);
+    float cross = b->prev_I[i] * Q - I * b->prev_Q[i];
+    if (dot != 0 || cross != 0)
+      freq_error = track_bank_atan(cross / dot) * (float)(1/M_PI);
+    b->prev_I[i] = I;
+    b->prev_Q[i] = Q;
+  }
+
+  b->carr_freq[i] += (b->carr_b0[i] * carr_error)
+                     + (b->carr_b1[i] * b->carr_prev_error[i])
+                     + b->carr_aiding_igain[i] * freq_error;
+  b->carr_prev_error[i] = carr_error;
+
+  /* DLL discriminator. */
+  float early = sqrtf(b->I_E[i]*b->I_E[i] + b->Q_E[i]*b->Q_E[i]);
+  float late = sqrtf(b->I_L[i]*b->I_L[i] + b->Q_L[i]*b->Q_L[i]);
+  float code_error = -(0.5f * (early - late) / (early + late));
+
+  b->code_y[i] += (b->code_b0[i] * code_error)
+                  + (b->code_b1[i] * b->code_prev_error[i]);
+  b->code_prev_error[i] = code_error;
+  b->code_freq[i] = b->code_y[i];
+  if (b->carr_to_code[i])
+    b->code_freq[i] += b->carr_freq[i] / b->carr_to_code[i];
+}
+
+/* Lock detector update of one channel, as lock_detect_update(). */
+static void bank_lock_update(track_bank_t* b, u32 i, float DT)
+{
+  b->lock_yi[i] += b->lock_k1i[i] * (fabsf(b->I_P[i]) / DT - b->lock_yi[i]);
+  b->lock_yq[i] += b->lock_k1q[i] * (fabsf(b->Q_P[i]) / DT - b->lock_yq[i]);
+
+  if (b->lock_yi[i] / b->lock_k2[i] > b->lock_yq[i]) {
+    b->lock_outo[i] = true;
+    b->lock_pcount2[i] = 0;
+    if (b->lock_pcount1[i] > b->lock_lp[i])
+      b->lock_outp[i] = true;
+    else
+      b->lock_pcount1[i]++;
+  } else {
+    b->lock_outp[i] = false;
+    b->lock_pcount1[i] = 0;
+    if (b->lock_pcount2[i] > b->lock_lo[i])
+      b->lock_outo[i] = false;
+    else
+      b->lock_pcount2[i]++;
+  }
+}
+
+/* C/N0 estimator update of one channel, as cn0_est(). */
+static void bank_cn0_update(track_bank_t* b, u32 i)
+{
+  float I = b->I_P[i], Q = b->Q_P[i];
+
+  if (b->cn0_I_prev_abs[i] >= 0.f) {
+    float P_n = fabsf(Q) - b->cn0_Q_prev_abs[i];
+    P_n = P_n*P_n;
+    float P_s = 0.5f*(I*I + b->cn0_I_prev_abs[i]*b->cn0_I_prev_abs[i]);
+
+    float tmp = b->cn0_b[i] * P_n / P_s;
+    b->cn0_nsr[i] = tmp + b->cn0_xn[i] - b->cn0_a[i] * b->cn0_nsr[i];
+    b->cn0_xn[i] = tmp;
+  }
+  b->cn0_I_prev_abs[i] = fabsf(I);
+  b->cn0_Q_prev_abs[i] = fabsf(Q);
+
+  b->cn0[i] = b->cn0_log_bw[i] - 10.f*track_bank_log10(b->cn0_nsr[i]);
+}
+
+#ifdef TRACK_BANK_X86
+
+/* Four lane atan_poly(). */
+__attribute__((target("sse2")))
+static __m128 atan_poly_ps(__m128 z)
+{
+  __m128 z2 = _mm_mul_ps(z, z);
+  __m128 p = _mm_set1_ps(ATAN_C11);
+  p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C9));
+  p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C7));
+  p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C5));
+  p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C3));
+  p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C1));
+  return _mm_mul_ps(p, z);
+}
+
+/* Four lane track_bank_atan(). */
+__attribute__((target("sse2")))
+static __m128 atan_ps(__m128 x)
+{
+  __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 one = _mm_set1_ps(1);
+  __m128 ax = _mm_andnot_ps(sign, x);
+  __m128 big = _mm_cmpgt_ps(ax, one);
+  __m128 z = _mm_or_ps(_mm_and_ps(big, _mm_div_ps(one, ax)),
+                       _mm_andnot_ps(big, ax));
+  __m128 p = atan_poly_ps(z);
+  __m128 r = _mm_or_ps(_mm_and_ps(big, _mm_sub_ps(_mm_set1_ps(M_PI_2), p)),
+                       _mm_andnot_ps(big, p));
+  return _mm_or_ps(r, _mm_and_ps(sign, x));
+}
+
+/* Select a where mask is set, else b. */
+__attribute__((target("sse2")))
+static __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/* Tracking loop update of channels i to i + 3, as aided_tl_update(). */
+__attribute__((target("sse2")))
+static void bank_loop_update_sse(track_bank_t* b, u32 i)
+{
+  __m128 zero = _mm_setzero_ps();
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 I = _mm_load_ps(&b->I_P[i]);
+  __m128 Q = _mm_load_ps(&b->Q_P[i]);
+
+  /* Costas discriminator. */
+  __m128 carr_error = _mm_mul_ps(atan_ps(_mm_div_ps(Q, I)),
+                                 _mm_set1_ps(1/(2*M_PI)));
+  carr_error = _mm_andnot_ps(_mm_cmpeq_ps(I, zero), carr_error);
+
+  /* Frequency discriminator. */
+  __m128 aid = _mm_load_ps(&b->carr_aiding_igain[i]);
+  __m128 use_fll = _mm_cmpneq_ps(aid, zero);
+  __m128 prev_I = _mm_load_ps(&b->prev_I[i]);
+  __m128 prev_Q = _mm_load_ps(&b->prev_Q[i]);
+  __m128 dot = _mm_add_ps(_mm_and_ps(abs_mask, _mm_mul_ps(I, prev_I)),
+                          _mm_and_ps(abs_mask, _mm_mul_ps(Q, prev_Q)));
+  __m128 cross = _mm_sub_ps(_mm_mul_ps(prev_I, Q), _mm_mul_ps(I, prev_Q));
+  __m128 freq_error = _mm_mul_ps(atan_ps(_mm_div_ps(cross, dot)),
+                                 _mm_set1_ps(1/M_PI));
+  __m128 both_zero = _mm_and_ps(_mm_cmpeq_ps(dot, zero),
+                                _mm_cmpeq_ps(cross, zero));
+  freq_error = _mm_and_ps(_mm_andnot_ps(both_zero, use_fll), freq_error);
+  _mm_store_ps(&b->prev_I[i], select_ps(use_fll, I, prev_I));
+  _mm_store_ps(&b->prev_Q[i], select_ps(use_fll, Q, prev_Q));
+
+  /* Carrier loop filter. */
+  __m128 carr_prev = _mm_load_ps(&b->carr_prev_error[i]);
+  __m128 carr = _mm_add_ps(
+    _mm_add_ps(_mm_mul_ps(_mm_load_ps(&b->carr_b0[i]), carr_error),
+               _mm_mul_ps(_mm_load_ps(&b->carr_b1[i]), carr_prev)),
+    _mm_mul_ps(aid, freq_error));
+  carr = _mm_add_ps(_mm_load_ps(&b->carr_freq[i]), carr);
+  _mm_store_ps(&b->carr_freq[i], carr);
+  _mm_store_ps(&b->carr_prev_error[i], carr_error);
+
+  /* DLL discriminator. */
+  __m128 IE = _mm_load_ps(&b->I_E[i]), QE = _mm_load_ps(&b->Q_E[i]);
+  __m128 IL = _mm_load_ps(&b->I_L[i]), QL = _mm_load_ps(&b->Q_L[i]);
+  __m128 early = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(IE, IE),
+                                        _mm_mul_ps(QE, QE)));
+  __m128 late = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(IL, IL),
+                                       _mm_mul_ps(QL, QL)));
+  __m128 code_error = _mm_div_ps(
+    _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(early, late)),
+    _mm_add_ps(early, late));
+  code_error = _mm_xor_ps(code_error, _mm_set1_ps(-0.0f));
+
+  /* Code loop filter, with optional carrier aiding. */
+  __m128 code_prev = _mm_load_ps(&b->code_prev_error[i]);
+  __m128 code = _mm_add_ps(
+    _mm_mul_ps(_mm_load_ps(&b->code_b0[i]), code_error),
+    _mm_mul_ps(_mm_load_ps(&b->code_b1[i]), code_prev));
+  code = _mm_add_ps(_mm_load_ps(&b->code_y[i]), code);
+  _mm_store_ps(&b->code_y[i], code);
+  _mm_store_ps(&b->code_prev_error[i], code_error);
+
+  __m128 c2c = _mm_load_ps(&b->carr_to_code[i]);
+  __m128 aiding = _mm_andnot_ps(_mm_cmpeq_ps(c2c, zero),
+                                _mm_div_ps(carr, c2c));
+  _mm_store_ps(&b->code_freq[i], _mm_add_ps(code, aiding));
+}
+
+/* Load four u8 flags widened to the low four u16 lanes. */
+__attribute__((target("sse2")))
+static __m128i load_flags(const u8* p)
+{
+  s32 x;
+  memcpy(&x, p, sizeof(x));
+  return _mm_unpacklo_epi8(_mm_cvtsi32_si128(x), _mm_setzero_si128());
+}
+
+/* Store the low four u16 lanes as u8 flags. */
+__attribute__((target("sse2")))
+static void store_flags(u8* p, __m128i x)
+{
+  s32 y = _mm_cvtsi128_si32(_mm_packus_epi16(x, x));
+  memcpy(p, &y, sizeof(y));
+}
+
+/* Unsigned a > b of the u16 lanes. */
+__attribute__((target("sse2")))
+static __m128i cmpgt_epu16(__m128i a, __m128i b)
+{
+  __m128i flip = _mm_set1_epi16((s16)0x8000);
+  return _mm_cmpgt_epi16(_mm_xor_si128(a, flip), _mm_xor_si128(b, flip));
+}
+
+/* Lock detector update of channels i to i + 3, as lock_detect_update(). */
+__attribute__((target("sse2")))
+static void bank_lock_update_sse(track_bank_t* b, u32 i, float DT)
+{
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 DT4 = _mm_set1_ps(DT);
+  __m128 I = _mm_and_ps(abs_mask, _mm_load_ps(&b->I_P[i]));
+  __m128 Q = _mm_and_ps(abs_mask, _mm_load_ps(&b->Q_P[i]));
+
+  __m128 yi = _mm_load_ps(&b->lock_yi[i]);
+  __m128 yq = _mm_load_ps(&b->lock_yq[i]);
+  yi = _mm_add_ps(yi, _mm_mul_ps(_mm_load_ps(&b->lock_k1i[i]),
+                                 _mm_sub_ps(_mm_div_ps(I, DT4), yi)));
+  yq = _mm_add_ps(yq, _mm_mul_ps(_mm_load_ps(&b->lock_k1q[i]),
+                                 _mm_sub_ps(_mm_div_ps(Q, DT4), yq)));
+  _mm_store_ps(&b->lock_yi[i], yi);
+  _mm_store_ps(&b->lock_yq[i], yq);
+
+  __m128i locked = _mm_castps_si128(
+    _mm_cmpgt_ps(_mm_div_ps(yi, _mm_load_ps(&b->lock_k2[i])), yq));
+  locked = _mm_packs_epi32(locked, locked);
+
+  __m128i one = _mm_set1_epi16(1);
+  __m128i pc1 = _mm_loadl_epi64((__m128i*)&b->lock_pcount1[i]);
+  __m128i pc2 = _mm_loadl_epi64((__m128i*)&b->lock_pcount2[i]);
+  __m128i gt1 = cmpgt_epu16(pc1,
+                            _mm_loadl_epi64((__m128i*)&b->lock_lp[i]));
+  __m128i gt2 = cmpgt_epu16(pc2,
+                            _mm_loadl_epi64((__m128i*)&b->lock_lo[i]));
+  __m128i outp = load_flags(&b->lock_outp[i]);
+  __m128i outo = load_flags(&b->lock_outo[i]);
+
+  /* Locked: count up to the pessimistic threshold then raise outp, raise
+   * outo and reset the optimistic counter. Otherwise the converse. */
+  pc1 = _mm_and_si128(locked, _mm_add_epi16(pc1, _mm_andnot_si128(gt1, one)));
+  pc2 = _mm_andnot_si128(locked,
+                         _mm_add_epi16(pc2, _mm_andnot_si128(gt2, one)));
+  outp = _mm_and_si128(locked, _mm_or_si128(outp, _mm_and_si128(gt1, one)));
+  outo = _mm_or_si128(_mm_and_si128(locked, one),
+                      _mm_andnot_si128(locked, _mm_andnot_si128(gt2, outo)));
+
+  _mm_storel_epi64((__m128i*)&b->lock_pcount1[i], pc1);
+  _mm_storel_epi64((__m128i*)&b->lock_pcount2[i], pc2);
+  store_flags(&b->lock_outp[i], outp);
+  store_flags(&b->lock_outo[i], outo);
+}
+
+/* Four lane track_bank_log10(). */
+__attribute__((target("sse2")))
+static __m128 log10_ps(__m128 x)
+{
+  __m128 zero = _mm_setzero_ps();
+  __m128 inf = _mm_set1_ps(INFINITY);
+
+  /* Normalise denormals. */
+  __m128 tiny = _mm_cmplt_ps(x, _mm_set1_ps(FLT_MIN));
+  x = select_ps(tiny, _mm_mul_ps(x, _mm_set1_ps(8388608.f)), x);
+
+  __m128i bits = _mm_castps_si128(x);
+  __m128i ei = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+  __m128 m = _mm_castsi128_ps(
+    _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+                 _mm_set1_epi32(0x3F800000)));
+  __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(M_SQRT2));
+  m = select_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f)), m);
+  ei = _mm_sub_epi32(ei, _mm_castps_si128(big));
+  __m128 e = _mm_sub_ps(_mm_cvtepi32_ps(ei),
+                        _mm_and_ps(tiny, _mm_set1_ps(23)));
+
+  __m128 one = _mm_set1_ps(1);
+  __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+  __m128 t2 = _mm_mul_ps(t, t);
+  __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(LOG_C7), t2),
+                        _mm_set1_ps(LOG_C5));
+  p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(LOG_C3));
+  p = _mm_add_ps(_mm_mul_ps(p, t2), one);
+  __m128 ln_m = _mm_mul_ps(_mm_add_ps(t, t), p);
+  __m128 r = _mm_add_ps(_mm_mul_ps(e, _mm_set1_ps(LOG10_2_LO)),
+                        _mm_mul_ps(ln_m, _mm_set1_ps(M_LOG10E)));
+  r = _mm_add_ps(_mm_mul_ps(e, _mm_set1_ps(LOG10_2_HI)), r);
+
+  /* Special cases. */
+  r = select_ps(_mm_cmpeq_ps(x, zero), _mm_set1_ps(-INFINITY), r);
+  r = select_ps(_mm_cmpeq_ps(x, inf), inf, r);
+  return select_ps(_mm_cmpnge_ps(x, zero), _mm_set1_ps(NAN), r);
+}
+
+/* C/N0 estimator update of channels i to i + 3, as cn0_est(). */
+__attribute__((target("sse2")))
+static void bank_cn0_update_sse(track_bank_t* b, u32 i)
+{
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 I = _mm_load_ps(&b->I_P[i]);
+  __m128 Q_abs = _mm_and_ps(abs_mask, _mm_load_ps(&b->Q_P[i]));
+  __m128 I_prev_abs = _mm_load_ps(&b->cn0_I_prev_abs[i]);
+  __m128 first = _mm_cmplt_ps(I_prev_abs, _mm_setzero_ps());
+
+  __m128 P_n = _mm_sub_ps(Q_abs, _mm_load_ps(&b->cn0_Q_prev_abs[i]));
+  P_n = _mm_mul_ps(P_n, P_n);
+  __m128 P_s = _mm_mul_ps(_mm_set1_ps(0.5f),
+                          _mm_add_ps(_mm_mul_ps(I, I),
+                                     _mm_mul_ps(I_prev_abs, I_prev_abs)));
+
+  __m128 tmp = _mm_div_ps(_mm_mul_ps(_mm_load_ps(&b->cn0_b[i]), P_n), P_s);
+  __m128 xn = _mm_load_ps(&b->cn0_xn[i]);
+  __m128 nsr = _mm_load_ps(&b->cn0_nsr[i]);
+  __m128 nsr_new = _mm_sub_ps(_mm_add_ps(tmp, xn),
+                              _mm_mul_ps(_mm_load_ps(&b->cn0_a[i]), nsr));
+  nsr = select_ps(first, nsr, nsr_new);
+  _mm_store_ps(&b->cn0_nsr[i], nsr);
+  _mm_store_ps(&b->cn0_xn[i], select_ps(first, xn, tmp));
+  _mm_store_ps(&b->cn0_I_prev_abs[i], _mm_and_ps(abs_mask, I));
+  _mm_store_ps(&b->cn0_Q_prev_abs[i], Q_abs);
+
+  _mm_store_ps(&b->cn0[i],
+               _mm_sub_ps(_mm_load_ps(&b->cn0_log_bw[i]),
+                          _mm_mul_ps(_mm_set1_ps(10.f), log10_ps(nsr))));
+}
+
+/* Eight lane atan_poly(). */
+__attribute__((target("avx2")))
+static __m256 atan_poly_avx2(__m256 z)
+{
+  __m256 z2 = _mm256_mul_ps(z, z);
+  __m256 p = _mm256_set1_ps(ATAN_C11);
+  p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(ATAN_C9));
+  p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(ATAN_C7));
+  p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(ATAN_C5));
+  p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(ATAN_C3));
+  p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(ATAN_C1));
+  return _mm256_mul_ps(p, z);
+}
+
+/* Eight lane track_bank_atan(). */
+__attribute__((target("avx2")))
+static __m256 atan_avx2(__m256 x)
+{
+  __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 one = _mm256_set1_ps(1);
+  __m256 ax = _mm256_andnot_ps(sign, x);
+  __m256 big = _mm256_cmp_ps(ax, one, _CMP_GT_OS);
+  __m256 z = _mm256_blendv_ps(ax, _mm256_div_ps(one, ax), big);
+  __m256 p = atan_poly_avx2(z);
+  __m256 r = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(M_PI_2), p),
+                              big);
+  return _mm256_or_ps(r, _mm256_and_ps(sign, x));
+}
+
+/* Select a where mask is set, else b. */
+__attribute__((target("avx2")))
+static __m256 select_avx2(__m256 mask, __m256 a, __m256 b)
+{
+  return _mm256_blendv_ps(b, a, mask);
+}
+
+/* Tracking loop update of channels i to i + 7, as aided_tl_update(). */
+__attribute__((target("avx2")))
+static void bank_loop_update_avx2(track_bank_t* b, u32 i)
+{
+  __m256 zero = _mm256_setzero_ps();
+  __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 I = _mm256_load_ps(&b->I_P[i]);
+  __m256 Q = _mm256_load_ps(&b->Q_P[i]);
+
+  /* Costas discriminator. */
+  __m256 carr_error = _mm256_mul_ps(atan_avx2(_mm256_div_ps(Q, I)),
+                                    _mm256_set1_ps(1/(2*M_PI)));
+  carr_error = _mm256_andnot_ps(_mm256_cmp_ps(I, zero, _CMP_EQ_OQ),
+                                carr_error);
+
+  /* Frequency discriminator, only for channels with FLL aiding. */
+  __m256 aid = _mm256_load_ps(&b->carr_aiding_igain[i]);
+  __m256 use_fll = _mm256_cmp_ps(aid, zero, _CMP_NEQ_UQ);
+  __m256 prev_I = _mm256_load_ps(&b->prev_I[i]);
+  __m256 prev_Q = _mm256_load_ps(&b->prev_Q[i]);
+  __m256 dot = _mm256_add_ps(
+    _mm256_and_ps(abs_mask, _mm256_mul_ps(I, prev_I)),
+    _mm256_and_ps(abs_mask, _mm256_mul_ps(Q, prev_Q)));
+  __m256 cross = _mm256_sub_ps(_mm256_mul_ps(prev_I, Q),
+                               _mm256_mul_ps(I, prev_Q));
+  __m256 freq_error = _mm256_mul_ps(atan_avx2(_mm256_div_ps(cross, dot)),
+                                    _mm256_set1_ps(1/M_PI));
+  __m256 both_zero = _mm256_and_ps(_mm256_cmp_ps(dot, zero, _CMP_EQ_OQ),
+                                   _mm256_cmp_ps(cross, zero, _CMP_EQ_OQ));
+  freq_error = _mm256_and_ps(_mm256_andnot_ps(both_zero, use_fll),
+                             freq_error);
+  _mm256_store_ps(&b->prev_I[i], select_avx2(use_fll, I, prev_I));
+  _mm256_store_ps(&b->prev_Q[i], select_avx2(use_fll, Q, prev_Q));
+
+  /* Carrier loop filter. */
+  __m256 carr_prev = _mm256_load_ps(&b->carr_prev_error[i]);
+  __m256 carr = _mm256_add_ps(
+    _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(&b->carr_b0[i]), carr_error),
+                  _mm256_mul_ps(_mm256_load_ps(&b->carr_b1[i]), carr_prev)),
+    _mm256_mul_ps(aid, freq_error));
+  carr = _mm256_add_ps(_mm256_load_ps(&b->carr_freq[i]), carr);
+  _mm256_store_ps(&b->carr_freq[i], carr);
+  _mm256_store_ps(&b->carr_prev_error[i], carr_error);
+
+  /* DLL discriminator. */
+  __m256 IE = _mm256_load_ps(&b->I_E[i]), QE = _mm256_load_ps(&b->Q_E[i]);
+  __m256 IL = _mm256_load_ps(&b->I_L[i]), QL = _mm256_load_ps(&b->Q_L[i]);
+  __m256 early = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(IE, IE),
+                                              _mm256_mul_ps(QE, QE)));
+  __m256 late = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(IL, IL),
+                                             _mm256_mul_ps(QL, QL)));
+  __m256 code_error = _mm256_div_ps(
+    _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(early, late)),
+    _mm256_add_ps(early, late));
+  code_error = _mm256_xor_ps(code_error, _mm256_set1_ps(-0.0f));
+
+  /* Code loop filter and carrier aiding. */
+  __m256 code_prev = _mm256_load_ps(&b->code_prev_error[i]);
+  __m256 code = _mm256_add_ps(
+    _mm256_mul_ps(_mm256_load_ps(&b->code_b0[i]), code_error),
+    _mm256_mul_ps(_mm256_load_ps(&b->code_b1[i]), code_prev));
+  code = _mm256_add_ps(_mm256_load_ps(&b->code_y[i]), code);
+  _mm256_store_ps(&b->code_y[i], code);
+  _mm256_store_ps(&b->code_prev_error[i], code_error);
+
+  __m256 c2c = _mm256_load_ps(&b->carr_to_code[i]);
+  __m256 aiding = _mm256_andnot_ps(_mm256_cmp_ps(c2c, zero, _CMP_EQ_OQ),
+                                   _mm256_div_ps(carr, c2c));
+  _mm256_store_ps(&b->code_freq[i], _mm256_add_ps(code, aiding));
+}
+
+/* Load eight u16 values widened to u32 lanes. */
+__attribute__((target("avx2")))
+static __m256i load_u16_avx2(const u16* p)
+{
+  return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+}
+
+/* Store the low halves of eight u32 lanes as u16 values. */
+__attribute__((target("avx2")))
+static void store_u16_avx2(u16* p, __m256i x)
+{
+  x = _mm256_and_si256(x, _mm256_set1_epi32(0xFFFF));
+  _mm_storeu_si128((__m128i*)p,
+                   _mm_packus_epi32(_mm256_castsi256_si128(x),
+                                    _mm256_extracti128_si256(x, 1)));
+}
+
+/* Load eight u8 flags widened to u32 lanes. */
+__attribute__((target("avx2")))
+static __m256i load_flags_avx2(const u8* p)
+{
+  return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+}
+
+/* Store eight u32 lanes holding 0 or 1 as u8 flags. */
+__attribute__((target("avx2")))
+static void store_flags_avx2(u8* p, __m256i x)
+{
+  __m128i h = _mm_packus_epi32(_mm256_castsi256_si128(x),
+                               _mm256_extracti128_si256(x, 1));
+  _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(h, h));
+}
+
+/* Lock detector update of channels i to i + 7, as lock_detect_update(). */
+__attribute__((target("avx2")))
+static void bank_lock_update_avx2(track_bank_t* b, u32 i, float DT)
+{
+  __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 DT8 = _mm256_set1_ps(DT);
+  __m256 I = _mm256_and_ps(abs_mask, _mm256_load_ps(&b->I_P[i]));
+  __m256 Q = _mm256_and_ps(abs_mask, _mm256_load_ps(&b->Q_P[i]));
+
+  __m256 yi = _mm256_load_ps(&b->lock_yi[i]);
+  __m256 yq = _mm256_load_ps(&b->lock_yq[i]);
+  yi = _mm256_add_ps(yi, _mm256_mul_ps(_mm256_load_ps(&b->lock_k1i[i]),
+                                       _mm256_sub_ps(_mm256_div_ps(I, DT8),
+                                                     yi)));
+  yq = _mm256_add_ps(yq, _mm256_mul_ps(_mm256_load_ps(&b->lock_k1q[i]),
+                                       _mm256_sub_ps(_mm256_div_ps(Q, DT8),
+                                                     yq)));
+  _mm256_store_ps(&b->lock_yi[i], yi);
+  _mm256_store_ps(&b->lock_yq[i], yq);
+
+  __m256i locked = _mm256_castps_si256(
+    _mm256_cmp_ps(_mm256_div_ps(yi, _mm256_load_ps(&b->lock_k2[i])), yq,
+                  _CMP_GT_OS));
+
+  /* The counters are widened to 32 bits, so signed compares will do. */
+  __m256i one = _mm256_set1_epi32(1);
+  __m256i pc1 = load_u16_avx2(&b->lock_pcount1[i]);
+  __m256i pc2 = load_u16_avx2(&b->lock_pcount2[i]);
+  __m256i gt1 = _mm256_cmpgt_epi32(pc1, load_u16_avx2(&b->lock_lp[i]));
+  __m256i gt2 = _mm256_cmpgt_epi32(pc2, load_u16_avx2(&b->lock_lo[i]));
+  __m256i outp = load_flags_avx2(&b->lock_outp[i]);
+  __m256i outo = load_flags_avx2(&b->lock_outo[i]);
+
+  /* As bank_lock_update_sse(). */
+  pc1 = _mm256_and_si256(locked,
+                         _mm256_add_epi32(pc1, _mm256_andnot_si256(gt1, one)));
+  pc2 = _mm256_andnot_si256(locked,
+                            _mm256_add_epi32(pc2,
+                                             _mm256_andnot_si256(gt2, one)));
+  outp = _mm256_and_si256(locked,
+                          _mm256_or_si256(outp, _mm256_and_si256(gt1, one)));
+  outo = _mm256_or_si256(_mm256_and_si256(locked, one),
+                         _mm256_andnot_si256(locked,
+                                             _mm256_andnot_si256(gt2, outo)));
+
+  store_u16_avx2(&b->lock_pcount1[i], pc1);
+  store_u16_avx2(&b->lock_pcount2[i], pc2);
+  store_flags_avx2(&b->lock_outp[i], outp);
+  store_flags_avx2(&b->lock_outo[i], outo);
+}
+
+/* Eight lane track_bank_log10(). */
+__attribute__((target("avx2")))
+static __m256 log10_avx2(__m256 x)
+{
+  __m256 zero = _mm256_setzero_ps();
+  __m256 inf = _mm256_set1_ps(INFINITY);
+
+  /* Normalise denormals. */
+  __m256 tiny = _mm256_cmp_ps(x, _mm256_set1_ps(FLT_MIN), _CMP_LT_OS);
+  x = select_avx2(tiny, _mm256_mul_ps(x, _mm256_set1_ps(8388608.f)), x);
+
+  __m256i bits = _mm256_castps_si256(x);
+  __m256i ei = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                _mm256_set1_epi32(127));
+  __m256 m = _mm256_castsi256_ps(
+    _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                    _mm256_set1_epi32(0x3F800000)));
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(M_SQRT2), _CMP_GT_OS);
+  m = select_avx2(big, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), m);
+  ei = _mm256_sub_epi32(ei, _mm256_castps_si256(big));
+  __m256 e = _mm256_sub_ps(_mm256_cvtepi32_ps(ei),
+                           _mm256_and_ps(tiny, _mm256_set1_ps(23)));
+
+  __m256 one = _mm256_set1_ps(1);
+  __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+  __m256 t2 = _mm256_mul_ps(t, t);
+  __m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(LOG_C7), t2),
+                           _mm256_set1_ps(LOG_C5));
+  p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(LOG_C3));
+  p = _mm256_add_ps(_mm256_mul_ps(p, t2), one);
+  __m256 ln_m = _mm256_mul_ps(_mm256_add_ps(t, t), p);
+  __m256 r = _mm256_add_ps(_mm256_mul_ps(e, _mm256_set1_ps(LOG10_2_LO)),
+                           _mm256_mul_ps(ln_m, _mm256_set1_ps(M_LOG10E)));
+  r = _mm256_add_ps(_mm256_mul_ps(e, _mm256_set1_ps(LOG10_2_HI)), r);
+
+  /* Special cases. */
+  r = select_avx2(_mm256_cmp_ps(x, zero, _CMP_EQ_OQ),
+                  _mm256_set1_ps(-INFINITY), r);
+  r = select_avx2(_mm256_cmp_ps(x, inf, _CMP_EQ_OQ), inf, r);
+  return select_avx2(_mm256_cmp_ps(x, zero, _CMP_NGE_US),
+                     _mm256_set1_ps(NAN), r);
+}
+
+/* C/N0 estimator update of channels i to i + 7, as cn0_est(). */
+__attribute__((target("avx2")))
+static void bank_cn0_update_avx2(track_bank_t* b, u32 i)
+{
+  __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 I = _mm256_load_ps(&b->I_P[i]);
+  __m256 Q_abs = _mm256_and_ps(abs_mask, _mm256_load_ps(&b->Q_P[i]));
+  __m256 I_prev_abs = _mm256_load_ps(&b->cn0_I_prev_abs[i]);
+  __m256 first = _mm256_cmp_ps(I_prev_abs, _mm256_setzero_ps(), _CMP_LT_OS);
+
+  __m256 P_n = _mm256_sub_ps(Q_abs, _mm256_load_ps(&b->cn0_Q_prev_abs[i]));
+  P_n = _mm256_mul_ps(P_n, P_n);
+  __m256 P_s = _mm256_mul_ps(
+    _mm256_set1_ps(0.5f),
+    _mm256_add_ps(_mm256_mul_ps(I, I), _mm256_mul_ps(I_prev_abs, I_prev_abs)));
+
+  __m256 tmp = _mm256_div_ps(_mm256_mul_ps(_mm256_load_ps(&b->cn0_b[i]), P_n),
+                             P_s);
+  __m256 xn = _mm256_load_ps(&b->cn0_xn[i]);
+  __m256 nsr = _mm256_load_ps(&b->cn0_nsr[i]);
+  __m256 nsr_new = _mm256_sub_ps(_mm256_add_ps(tmp, xn),
+                                 _mm256_mul_ps(_mm256_load_ps(&b->cn0_a[i]),
+                                               nsr));
+  nsr = select_avx2(first, nsr, nsr_new);
+  _mm256_store_ps(&b->cn0_nsr[i], nsr);
+  _mm256_store_ps(&b->cn0_xn[i], select_avx2(first, xn, tmp));
+  _mm256_store_ps(&b->cn0_I_prev_abs[i], _mm256_and_ps(abs_mask, I));
+  _mm256_store_ps(&b->cn0_Q_prev_abs[i], Q_abs);
+
+  _mm256_store_ps(&b->cn0[i],
+                  _mm256_sub_ps(_mm256_load_ps(&b->cn0_log_bw[i]),
+                                _mm256_mul_ps(_mm256_set1_ps(10.f),
+                                              log10_avx2(nsr))));
+}
+
+/* Sixteen lane atan_poly(). */
+__attribute__((target("avx512f")))
+static __m512 atan_poly_avx512(__m512 z)
+{
+  __m512 z2 = _mm512_mul_ps(z, z);
+  __m512 p = _mm512_set1_ps(ATAN_C11);
+  p = _mm512_add_ps(_mm512_mul_ps(p, z2), _mm512_set1_ps(ATAN_C9));
+  p = _mm512_add_ps(_mm512_mul_ps(p, z2), _mm512_set1_ps(ATAN_C7));
+  p = _mm512_add_ps(_mm512_mul_ps(p, z2), _mm512_set1_ps(ATAN_C5));
+  p = _mm512_add_ps(_mm512_mul_ps(p, z2), _mm512_set1_ps(ATAN_C3));
+  p = _mm512_add_ps(_mm512_mul_ps(p, z2), _mm512_set1_ps(ATAN_C1));
+  return _mm512_mul_ps(p, z);
+}
+
+/* Sixteen lane track_bank_atan(). AVX-512F has no float logic operations,
+ * the sign is copied with integer ones. */
+__attribute__((target("avx512f")))
+static __m512 atan_avx512(__m512 x)
+{
+  __m512 one = _mm512_set1_ps(1);
+  __m512 ax = _mm512_abs_ps(x);
+  __mmask16 big = _mm512_cmp_ps_mask(ax, one, _CMP_GT_OS);
+  __m512 z = _mm512_mask_div_ps(ax, big, one, ax);
+  __m512 p = atan_poly_avx512(z);
+  __m512 r = _mm512_mask_sub_ps(p, big, _mm512_set1_ps(M_PI_2), p);
+  __m512i sign = _mm512_and_epi32(_mm512_castps_si512(x),
+                                  _mm512_set1_epi32(0x80000000));
+  return _mm512_castsi512_ps(_mm512_or_epi32(_mm512_castps_si512(r), sign));
+}
+
+/* Tracking loop update of channels i to i + 15, as aided_tl_update(). */
+__attribute__((target("avx512f")))
+static void bank_loop_update_avx512(track_bank_t* b, u32 i)
+{
+  __m512 zero = _mm512_setzero_ps();
+  __m512 I = _mm512_load_ps(&b->I_P[i]);
+  __m512 Q = _mm512_load_ps(&b->Q_P[i]);
+
+  /* Costas discriminator. */
+  __m512 carr_error = _mm512_maskz_mul_ps(
+    _mm512_cmp_ps_mask(I, zero, _CMP_NEQ_UQ),
+    atan_avx512(_mm512_div_ps(Q, I)), _mm512_set1_ps(1/(2*M_PI)));
+
+  /* Frequency discriminator, only for channels with FLL aiding. */
+  __m512 aid = _mm512_load_ps(&b->carr_aiding_igain[i]);
+  __mmask16 use_fll = _mm512_cmp_ps_mask(aid, zero, _CMP_NEQ_UQ);
+  __m512 prev_I = _mm512_load_ps(&b->prev_I[i]);
+  __m512 prev_Q = _mm512_load_ps(&b->prev_Q[i]);
+  __m512 dot = _mm512_add_ps(_mm512_abs_ps(_mm512_mul_ps(I, prev_I)),
+                             _mm512_abs_ps(_mm512_mul_ps(Q, prev_Q)));
+  __m512 cross = _mm512_sub_ps(_mm512_mul_ps(prev_I, Q),
+                               _mm512_mul_ps(I, prev_Q));
+  __mmask16 both_zero = _mm512_cmp_ps_mask(dot, zero, _CMP_EQ_OQ)
+                        & _mm512_cmp_ps_mask(cross, zero, _CMP_EQ_OQ);
+  __m512 freq_error = _mm512_maskz_mul_ps(
+    use_fll & ~both_zero, atan_avx512(_mm512_div_ps(cross, dot)),
+    _mm512_set1_ps(1/M_PI));
+  _mm512_store_ps(&b->prev_I[i], _mm512_mask_blend_ps(use_fll, prev_I, I));
+  _mm512_store_ps(&b->prev_Q[i], _mm512_mask_blend_ps(use_fll, prev_Q, Q));
+
+  /* Carrier loop filter. */
+  __m512 carr_prev = _mm512_load_ps(&b->carr_prev_error[i]);
+  __m512 carr = _mm512_add_ps(
+    _mm512_add_ps(_mm512_mul_ps(_mm512_load_ps(&b->carr_b0[i]), carr_error),
+                  _mm512_mul_ps(_mm512_load_ps(&b->carr_b1[i]), carr_prev)),
+    _mm512_mul_ps(aid, freq_error));
+  carr = _mm512_add_ps(_mm512_load_ps(&b->carr_freq[i]), carr);
+  _mm512_store_ps(&b->carr_freq[i], carr);
+  _mm512_store_ps(&b->carr_prev_error[i], carr_error);
+
+  /* DLL discriminator. */
+  __m512 IE = _mm512_load_ps(&b->I_E[i]), QE = _mm512_load_ps(&b->Q_E[i]);
+  __m512 IL = _mm512_load_ps(&b->I_L[i]), QL = _mm512_load_ps(&b->Q_L[i]);
+  __m512 early = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(IE, IE),
+                                              _mm512_mul_ps(QE, QE)));
+  __m512 late = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(IL, IL),
+                                             _mm512_mul_ps(QL, QL)));
+  __m512 code_error = _mm512_div_ps(
+    _mm512_mul_ps(_mm512_set1_ps(0.5f), _mm512_sub_ps(early, late)),
+    _mm512_add_ps(early, late));
+  code_error = _mm512_castsi512_ps(
+    _mm512_xor_epi32(_mm512_castps_si512(code_error),
+                     _mm512_set1_epi32(0x80000000)));
+
+  /* Code loop filter and carrier aiding. */
+  __m512 code_prev = _mm512_load_ps(&b->code_prev_error[i]);
+  __m512 code = _mm512_add_ps(
+    _mm512_mul_ps(_mm512_load_ps(&b->code_b0[i]), code_error),
+    _mm512_mul_ps(_mm512_load_ps(&b->code_b1[i]), code_prev));
+  code = _mm512_add_ps(_mm512_load_ps(&b->code_y[i]), code);
+  _mm512_store_ps(&b->code_y[i], code);
+  _mm512_store_ps(&b->code_prev_error[i], code_error);
+
+  __m512 c2c = _mm512_load_ps(&b->carr_to_code[i]);
+  __m512 aiding = _mm512_maskz_div_ps(
+    _mm512_cmp_ps_mask(c2c, zero, _CMP_NEQ_UQ), carr, c2c);
+  _mm512_store_ps(&b->code_freq[i], _mm512_add_ps(code, aiding));
+}
+
+/* Lock detector update of channels i to i + 15, as lock_detect_update(). */
+__attribute__((target("avx512f")))
+static void bank_lock_update_avx512(track_bank_t* b, u32 i, float DT)
+{
+  __m512 DT16 = _mm512_set1_ps(DT);
+  __m512 I = _mm512_abs_ps(_mm512_load_ps(&b->I_P[i]));
+  __m512 Q = _mm512_abs_ps(_mm512_load_ps(&b->Q_P[i]));
+
+  __m512 yi = _mm512_load_ps(&b->lock_yi[i]);
+  __m512 yq = _mm512_load_ps(&b->lock_yq[i]);
+  yi = _mm512_add_ps(yi, _mm512_mul_ps(_mm512_load_ps(&b->lock_k1i[i]),
+                                       _mm512_sub_ps(_mm512_div_ps(I, DT16),
+                                                     yi)));
+  yq = _mm512_add_ps(yq, _mm512_mul_ps(_mm512_load_ps(&b->lock_k1q[i]),
+                                       _mm512_sub_ps(_mm512_div_ps(Q, DT16),
+                                                     yq)));
+  _mm512_store_ps(&b->lock_yi[i], yi);
+  _mm512_store_ps(&b->lock_yq[i], yq);
+
+  __mmask16 locked = _mm512_cmp_ps_mask(
+    _mm512_div_ps(yi, _mm512_load_ps(&b->lock_k2[i])), yq, _CMP_GT_OS);
+
+  /* The counters are widened to 32 bits and the flags kept in masks. */
+  __m512i one = _mm512_set1_epi32(1);
+  __m512i pc1 = _mm512_cvtepu16_epi32(
+    _mm256_loadu_si256((const __m256i*)&b->lock_pcount1[i]));
+  __m512i pc2 = _mm512_cvtepu16_epi32(
+    _mm256_loadu_si256((const __m256i*)&b->lock_pcount2[i]));
+  __mmask16 gt1 = _mm512_cmpgt_epi32_mask(
+    pc1, _mm512_cvtepu16_epi32(
+           _mm256_loadu_si256((const __m256i*)&b->lock_lp[i])));
+  __mmask16 gt2 = _mm512_cmpgt_epi32_mask(
+    pc2, _mm512_cvtepu16_epi32(
+           _mm256_loadu_si256((const __m256i*)&b->lock_lo[i])));
+  __m512i flags = _mm512_cvtepu8_epi32(
+    _mm_loadu_si128((const __m128i*)&b->lock_outp[i]));
+  __mmask16 outp = _mm512_test_epi32_mask(flags, flags);
+  flags = _mm512_cvtepu8_epi32(
+    _mm_loadu_si128((const __m128i*)&b->lock_outo[i]));
+  __mmask16 outo = _mm512_test_epi32_mask(flags, flags);
+
+  /* As bank_lock_update_sse(). */
+  pc1 = _mm512_maskz_add_epi32(locked, pc1,
+                               _mm512_maskz_mov_epi32(~gt1, one));
+  pc2 = _mm512_maskz_add_epi32(~locked, pc2,
+                               _mm512_maskz_mov_epi32(~gt2, one));
+  outp = locked & (outp | gt1);
+  outo = locked | (~gt2 & outo);
+
+  _mm256_storeu_si256((__m256i*)&b->lock_pcount1[i],
+                      _mm512_cvtepi32_epi16(pc1));
+  _mm256_storeu_si256((__m256i*)&b->lock_pcount2[i],
+                      _mm512_cvtepi32_epi16(pc2));
+  _mm_storeu_si128((__m128i*)&b->lock_outp[i],
+                   _mm512_cvtepi32_epi8(_mm512_maskz_mov_epi32(outp, one)));
+  _mm_storeu_si128((__m128i*)&b->lock_outo[i],
+                   _mm512_cvtepi32_epi8(_mm512_maskz_mov_epi32(outo, one)));
+}
+
+/* Sixteen lane track_bank_log10(). */
+__attribute__((target("avx512f")))
+static __m512 log10_avx512(__m512 x)
+{
+  __m512 zero = _mm512_setzero_ps();
+  __m512 inf = _mm512_set1_ps(INFINITY);
+
+  /* Normalise denormals. */
+  __mmask16 tiny = _mm512_cmp_ps_mask(x, _mm512_set1_ps(FLT_MIN), _CMP_LT_OS);
+  x = _mm512_mask_mul_ps(x, tiny, x, _mm512_set1_ps(8388608.f));
+
+  __m512i bits = _mm512_castps_si512(x);
+  __m512i ei = _mm512_sub_epi32(_mm512_srli_epi32(bits, 23),
+                                _mm512_set1_epi32(127));
+  __m512 m = _mm512_castsi512_ps(
+    _mm512_or_epi32(_mm512_and_epi32(bits, _mm512_set1_epi32(0x007FFFFF)),
+                    _mm512_set1_epi32(0x3F800000)));
+  __mmask16 big = _mm512_cmp_ps_mask(m, _mm512_set1_ps(M_SQRT2), _CMP_GT_OS);
+  m = _mm512_mask_mul_ps(m, big, m, _mm512_set1_ps(0.5f));
+  ei = _mm512_mask_add_epi32(ei, big, ei, _mm512_set1_epi32(1));
+  __m512 e = _mm512_cvtepi32_ps(ei);
+  e = _mm512_mask_sub_ps(e, tiny, e, _mm512_set1_ps(23));
+
+  __m512 one = _mm512_set1_ps(1);
+  __m512 t = _mm512_div_ps(_mm512_sub_ps(m, one), _mm512_add_ps(m, one));
+  __m512 t2 = _mm512_mul_ps(t, t);
+  __m512 p = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(LOG_C7), t2),
+                           _mm512_set1_ps(LOG_C5));
+  p = _mm512_add_ps(_mm512_mul_ps(p, t2), _mm512_set1_ps(LOG_C3));
+  p = _mm512_add_ps(_mm512_mul_ps(p, t2), one);
+  __m512 ln_m = _mm512_mul_ps(_mm512_add_ps(t, t), p);
+  __m512 r = _mm512_add_ps(_mm512_mul_ps(e, _mm512_set1_ps(LOG10_2_LO)),
+                           _mm512_mul_ps(ln_m, _mm512_set1_ps(M_LOG10E)));
+  r = _mm512_add_ps(_mm512_mul_ps(e, _mm512_set1_ps(LOG10_2_HI)), r);
+
+  /* Special cases. */
+  r = _mm512_mask_mov_ps(r, _mm512_cmp_ps_mask(x, zero, _CMP_EQ_OQ),
+                         _mm512_set1_ps(-INFINITY));
+  r = _mm512_mask_mov_ps(r, _mm512_cmp_ps_mask(x, inf, _CMP_EQ_OQ), inf);
+  return _mm512_mask_mov_ps(r, _mm512_cmp_ps_mask(x, zero, _CMP_NGE_US),
+                            _mm512_set1_ps(NAN));
+}
+
+/* C/N0 estimator update of channels i to i + 15, as cn0_est(). */
+__attribute__((target("avx512f")))
+static void bank_cn0_update_avx512(track_bank_t* b, u32 i)
+{
+  __m512 I = _mm512_load_ps(&b->I_P[i]);
+  __m512 Q_abs = _mm512_abs_ps(_mm512_load_ps(&b->Q_P[i]));
+  __m512 I_prev_abs = _mm512_load_ps(&b->cn0_I_prev_abs[i]);
+  __mmask16 first = _mm512_cmp_ps_mask(I_prev_abs, _mm512_setzero_ps(),
+                                       _CMP_LT_OS);
+
+  __m512 P_n = _mm512_sub_ps(Q_abs, _mm512_load_ps(&b->cn0_Q_prev_abs[i]));
+  P_n = _mm512_mul_ps(P_n, P_n);
+  __m512 P_s = _mm512_mul_ps(
+    _mm512_set1_ps(0.5f),
+    _mm512_add_ps(_mm512_mul_ps(I, I), _mm512_mul_ps(I_prev_abs, I_prev_abs)));
+
+  __m512 tmp = _mm512_div_ps(_mm512_mul_ps(_mm512_load_ps(&b->cn0_b[i]), P_n),
+                             P_s);
+  __m512 xn = _mm512_load_ps(&b->cn0_xn[i]);
+  __m512 nsr = _mm512_load_ps(&b->cn0_nsr[i]);
+  __m512 nsr_new = _mm512_sub_ps(_mm512_add_ps(tmp, xn),
+                                 _mm512_mul_ps(_mm512_load_ps(&b->cn0_a[i]),
+                                               nsr));
+  nsr = _mm512_mask_blend_ps(first, nsr_new, nsr);
+  _mm512_store_ps(&b->cn0_nsr[i], nsr);
+  _mm512_store_ps(&b->cn0_xn[i], _mm512_mask_blend_ps(first, tmp, xn));
+  _mm512_store_ps(&b->cn0_I_prev_abs[i], _mm512_abs_ps(I));
+  _mm512_store_ps(&b->cn0_Q_prev_abs[i], Q_abs);
+
+  _mm512_store_ps(&b->cn0[i],
+                  _mm512_sub_ps(_mm512_load_ps(&b->cn0_log_bw[i]),
+                                _mm512_mul_ps(_mm512_set1_ps(10.f),
+                                              log10_avx512(nsr))));
+}
+
+#endif /* TRACK_BANK_X86 */
+
+/** Update functions of one implementation, each updating `lanes` channels
+ * from channel `i`. */
+typedef struct {
+  track_bank_impl_t impl;
+  u32 lanes;
+  void (*loop)(track_bank_t* b, u32 i);
+  void (*lock)(track_bank_t* b, u32 i, float DT);
+  void (*cn0)(track_bank_t* b, u32 i);
+} bank_kernels_t;
+
+static const bank_kernels_t bank_kernels_c = {
+  TRACK_BANK_IMPL_C, 1, bank_loop_update, bank_lock_update, bank_cn0_update
+};
+
+#ifdef TRACK_BANK_X86
+static const bank_kernels_t bank_kernels_sse2 = {
+  TRACK_BANK_IMPL_SSE2, 4, bank_loop_update_sse, bank_lock_update_sse,
+  bank_cn0_update_sse
+};
+
+static const bank_kernels_t bank_kernels_avx2 = {
+  TRACK_BANK_IMPL_AVX2, 8, bank_loop_update_avx2, bank_lock_update_avx2,
+  bank_cn0_update_avx2
+};
+
+static const bank_kernels_t bank_kernels_avx512 = {
+  TRACK_BANK_IMPL_AVX512, 16, bank_loop_update_avx512,
+  bank_lock_update_avx512, bank_cn0_update_avx512
+};
+#endif
+
+/* Selected update functions, NULL until the first update or
+ * track_bank_set_impl(). Only ever accessed atomically as banks may be
+ * updated from several threads. */
+static const bank_kernels_t *bank_selected = 0;
+
+static bool bank_impl_supported(track_bank_impl_t impl)
+{
+  /* See corr_impl_supported() on __builtin_cpu_init(). */
+  switch (impl) {
+  case TRACK_BANK_IMPL_C:
+    return true;
+#ifdef TRACK_BANK_X86
+  case TRACK_BANK_IMPL_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case TRACK_BANK_IMPL_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case TRACK_BANK_IMPL_AVX512:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+static const bank_kernels_t* bank_impl_kernels(track_bank_impl_t impl)
+{
+  switch (impl) {
+#ifdef TRACK_BANK_X86
+  case TRACK_BANK_IMPL_SSE2:
+    return &bank_kernels_sse2;
+  case TRACK_BANK_IMPL_AVX2:
+    return &bank_kernels_avx2;
+  case TRACK_BANK_IMPL_AVX512:
+    return &bank_kernels_avx512;
+#endif
+  default:
+    return &bank_kernels_c;
+  }
+}
+
+/** Widest implementation supported by the CPU. */
+static track_bank_impl_t bank_impl_detect(void)
+{
+  track_bank_impl_t impl = TRACK_BANK_IMPL_C;
+  for (track_bank_impl_t i = TRACK_BANK_IMPL_C; i <= TRACK_BANK_IMPL_AVX512;
+       i++)
+    if (bank_impl_supported(i))
+      impl = i;
+  return impl;
+}
+
+/** Update functions to use, detecting the widest ones on first use. */
+static const bank_kernels_t* bank_kernels(void)
+{
+  const bank_kernels_t *k = __atomic_load_n(&bank_selected, __ATOMIC_ACQUIRE);
+  if (k)
+    return k;
+
+  const bank_kernels_t *expected = 0;
+  k = bank_impl_kernels(bank_impl_detect());
+  if (!__atomic_compare_exchange_n(&bank_selected, &expected, k, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    k = expected;
+  return k;
+}
+
+/** Select the implementation used by the tracking bank updates.
+ *
+ * By default the widest implementation supported by the host CPU is chosen
+ * on the first update. This function can be used to force a particular
+ * implementation, e.g. for testing or benchmarking.
+ *
+ * \param impl Implementation to use, or `TRACK_BANK_IMPL_AUTO` to detect the
+ *             widest one supported by the CPU.
+ * \return 0 on success, -1 if `impl` is not supported on this host (in which
+ *         case the current selection is left unchanged).
+ */
+s8 track_bank_set_impl(track_bank_impl_t impl)
+{
+  if (impl == TRACK_BANK_IMPL_AUTO)
+    impl = bank_impl_detect();
+  else if (!bank_impl_supported(impl))
+    return -1;
+
+  __atomic_store_n(&bank_selected, bank_impl_kernels(impl), __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Get the implementation used by the tracking bank updates.
+ *
+ * \return The selected implementation, resolving `TRACK_BANK_IMPL_AUTO` to
+ *         the one detected for the host CPU.
+ */
+track_bank_impl_t track_bank_get_impl(void)
+{
+  return bank_kernels()->impl;
+}
+
+/** Update the lock detectors of all channels of a bank.
+ *
+ * Equivalent to calling lock_detect_update() for every channel with the
+ * prompt correlations in `b->I_P` and `b->Q_P`. The filter arithmetic is
+ * the same so the lock indicators and counters match exactly.
+ *
+ * \param b  Tracking bank.
+ * \param DT Integration time, as for lock_detect_update().
+ */
+void track_bank_lock_update(track_bank_t* b, float DT)
+{
+  const bank_kernels_t *k = bank_kernels();
+  for (u32 i = 0; i < b->n_channels; i += k->lanes)
+    k->lock(b, i, DT);
+}
+
+/** Update the \f$ C / N_0 \f$ estimators of all channels of a bank.
+ *
+ * Equivalent to calling cn0_est() for every channel with the prompt
+ * correlations in `b->I_P` and `b->Q_P`, leaving the estimates in
+ * `b->cn0`. The estimator state matches exactly, the estimates differ only
+ * by the error of track_bank_log10(), about 1e-6 dB for typical signals.
+ *
+ * \param b Tracking bank.
+ */
+void track_bank_cn0_update(track_bank_t* b)
+{
+  const bank_kernels_t *k = bank_kernels();
+  for (u32 i = 0; i < b->n_channels; i += k->lanes)
+    k->cn0(b, i);
+}
+
+/** Update the tracking loops, lock detectors and \f$ C / N_0 \f$
+ * estimators of all channels of a bank.
+ *
+ * Equivalent to calling aided_tl_update(), lock_detect_update() and
+ * cn0_est() for every channel, see \ref track_bank for the differences.
+ * The outputs are left in the bank, e.g. `b->carr_freq[i]`,
+ * `b->code_freq[i]`, `b->lock_outp[i]` and `b->cn0[i]`.
+ *
+ * \param b  Tracking bank.
+ * \param cs Correlations of each channel, as an array [E, P, L] of
+ *           correlation_t structs per channel.
+ * \param DT Integration time, as for lock_detect_update().
+ */
+void track_bank_update(track_bank_t* b, const correlation_t cs[][3],
+                       float DT)
+{
+  u32 n = b->n_channels;
+
+  for (u32 i = 0; i < n; i++) {
+    b->I_E[i] = cs[i][0].I;
+    b->Q_E[i] = cs[i][0].Q;
+    b->I_P[i] = cs[i][1].I;
+    b->Q_P[i] = cs[i][1].Q;
+    b->I_L[i] = cs[i][2].I;
+    b->Q_L[i] = cs[i][2].Q;
+  }
+
+  const bank_kernels_t *k = bank_kernels();
+  for (u32 i = 0; i < n; i += k->lanes)
+    k->loop(b, i);
+
+  track_bank_lock_update(b, DT);
+  track_bank_cn0_update(b);
+}
+
+/** \} */
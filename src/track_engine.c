@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* For pthread_setaffinity_np(). */
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "correlate.h"
+#include "replica.h"
+#include "track_engine.h"
+
+/** \defgroup track_engine Tracking Engine
+ * Multi-threaded tracking of many channels from a sample ring buffer.
+ *
+ * A ::track_engine_t owns a set of tracking channels reading from a
+ * ::sample_ring_t. The channels are partitioned over worker threads, each
+ * pinned to a core where the platform allows it. For every code period
+ * a worker runs the correlator, the discriminators and loop filters of
+ * aided_tl_update(), the lock detector, the \f$ C / N_0 \f$ estimator and
+ * the navigation message decoder of its channels.
+ *
+ * The producer writes samples into the ring and calls track_engine_notify()
+ * to wake the workers, using track_engine_tail() to avoid overwriting
+ * samples that have not been tracked yet. At the end of each code period a
+ * worker publishes a ::channel_measurement_t snapshot of the channel under
+ * a sequence lock, so track_engine_measure() can read consistent
+ * measurements at any time without blocking the workers.
+ *
+ * Only available when the library is built with pthreads.
+ * \{ */
+
+/** Milliseconds in a GPS week. */
+#define WEEK_MS (7*24*3600*1000)
+
+/* Publish the measurement snapshot of a channel. */
+static void channel_publish(const track_engine_t* e, track_engine_channel_t* c)
+{
+  u32 seq = c->snap_seq;
+  __atomic_store_n(&c->snap_seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  c->snap.prn = c->prn;
+  c->snap.code_phase_chips = c->code_phase;
+  c->snap.code_phase_rate = GPS_CA_CHIPPING_RATE + c->tl.code_freq;
+  c->snap.carrier_phase = c->carr_cycles;
+  c->snap.carrier_freq = c->tl.carr_freq;
+  c->snap.time_of_week_ms = c->TOW_ms;
+  c->snap.receiver_time = c->pos / e->fs;
+  c->snap.snr = c->cn0;
+  c->snap.lock_counter = c->lock_counter;
+  c->snap_locked = c->ld.outp;
+
+  __atomic_store_n(&c->snap_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Track one code period of a channel. Returns false if the period is not
+ * in the ring yet, or has been overwritten, in which case the channel is
+ * stopped. */
+static bool channel_step(const track_engine_t* e, track_engine_channel_t* c)
+{
+  double code_step = (GPS_CA_CHIPPING_RATE + c->tl.code_freq) / e->fs;
+  double carr_step = 2*M_PI * (e->if_freq + c->tl.carr_freq) / e->fs;
+  double I_E, Q_E, I_P, Q_P, I_L, Q_L;
+  u64 pos = c->pos;
+  u32 n;
+
+  if (track_correlate_ring(e->ring, &pos, c->code,
+                           &c->code_phase, code_step,
+                           &c->carr_phase, carr_step,
+                           &I_E, &Q_E, &I_P, &Q_P, &I_L, &Q_L, &n)) {
+    if (sample_ring_overwritten(e->ring, pos)) {
+      c->overrun = true;
+      __atomic_store_n(&c->active, false, __ATOMIC_RELEASE);
+    }
+    return false;
+  }
+  c->carr_cycles += n * c->tl.carr_freq / e->fs;
+
+  correlation_t cs[3] = {{I_E, Q_E}, {I_P, Q_P}, {I_L, Q_L}};
+  aided_tl_update(&c->tl, cs);
+
+  bool was_locked = c->ld.outo;
+  lock_detect_update(&c->ld, I_P, Q_P, 1e-3);
+  if (was_locked && !c->ld.outo)
+    c->lock_counter++;
+
+  c->cn0 = cn0_est(&c->cn0_est, I_P, Q_P);
+
+  s32 TOW_ms = nav_msg_update(&c->nav, (s32)I_P, 1);
+  if (c->TOW_ms != TOW_INVALID)
+    c->TOW_ms = (c->TOW_ms + 1) % WEEK_MS;
+  if (TOW_ms >= 0)
+    c->TOW_ms = TOW_ms;
+
+  c->n_periods++;
+  __atomic_store_n(&c->pos, pos, __ATOMIC_RELEASE);
+  channel_publish(e, c);
+  return true;
+}
+
+/* Pin the calling worker to a core. */
+static void worker_pin(u8 id)
+{
+#ifdef __linux__
+  long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_cpus < 1)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(id % n_cpus, &set);
+  /* Not being able to pin is not fatal. */
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)id;
+#endif
+}
+
+static void* engine_worker(void* arg)
+{
+  track_engine_t* e = arg;
+  u8 id = 0;
+  u32 seen = 0;
+
+  pthread_mutex_lock(&e->lock);
+  while (!pthread_equal(e->threads[id], pthread_self()))
+    id++;
+  pthread_mutex_unlock(&e->lock);
+
+  worker_pin(id);
+
+  while (1) {
+    pthread_mutex_lock(&e->lock);
+    while (e->notify_count == seen && !e->quit)
+      pthread_cond_wait(&e->wake, &e->lock);
+    if (e->quit)
+      break;
+    seen = e->notify_count;
+    pthread_mutex_unlock(&e->lock);
+
+    /* Round robin over the channels one period at a time, until none of
+     * them can advance. */
+    bool progress;
+    do {
+      progress = false;
+      pthread_mutex_lock(&e->worker_lock[id]);
+      for (u8 i = id; i < e->n_channels; i += e->n_threads) {
+        track_engine_channel_t* c = &e->channels[i];
+        if (c->active && channel_step(e, c))
+          progress = true;
+      }
+      pthread_mutex_unlock(&e->worker_lock[id]);
+    } while (progress);
+  }
+
+  pthread_mutex_unlock(&e->lock);
+  return 0;
+}
+
+/** Fill in typical tracking parameters for a 1 ms loop update rate.
+ *
+ * \param params Parameters to fill in.
+ */
+void track_engine_default_params(track_engine_params_t* params)
+{
+  params->code_bw = 1;
+  params->code_zeta = 0.7;
+  params->code_k = 1;
+  params->carr_bw = 25;
+  params->carr_zeta = 0.7;
+  params->carr_k = 1;
+  params->carr_fll_gain = 5;
+  params->lock_k1 = 0.0247;
+  params->lock_k2 = 1.5;
+  params->lock_lp = 150;
+  params->lock_lo = 50;
+  params->cn0_init = 40;
+  params->cn0_cutoff = 5;
+}
+
+/** Start a tracking engine.
+ *
+ * All channels are initially idle, start them with
+ * track_engine_start_channel(). Remember to stop the engine with
+ * track_engine_destroy().
+ *
+ * \param e          Engine to initialise.
+ * \param ring       Sample ring buffer to track, one sample per byte.
+ * \param fs         Sampling frequency in Hz.
+ * \param if_freq    Intermediate frequency in Hz.
+ * \param n_channels Number of channels, up to
+ *                   `TRACK_ENGINE_MAX_CHANNELS`.
+ * \param n_threads  Number of worker threads, from 1 to
+ *                   `TRACK_ENGINE_MAX_THREADS`.
+ * \param params     Loop parameters, or NULL for
+ *                   track_engine_default_params().
+ * \return 0 on success, -1 if an argument is out of range or the threads
+ *         could not be created.
+ */
+s8 track_engine_init(track_engine_t* e, const sample_ring_t* ring,
+                     double fs, double if_freq, u8 n_channels,
+                     u8 n_threads, const track_engine_params_t* params)
+{
+  if (n_channels > TRACK_ENGINE_MAX_CHANNELS ||
+      n_threads == 0 || n_threads > TRACK_ENGINE_MAX_THREADS)
+    return -1;
+
+  memset(e, 0, sizeof(*e));
+  e->ring = ring;
+  e->fs = fs;
+  e->if_freq = if_freq;
+  e->n_channels = n_channels;
+  if (params)
+    e->params = *params;
+  else
+    track_engine_default_params(&e->params);
+
+  pthread_mutex_init(&e->lock, 0);
+  pthread_cond_init(&e->wake, 0);
+  for (u8 i = 0; i < TRACK_ENGINE_MAX_THREADS; i++)
+    pthread_mutex_init(&e->worker_lock[i], 0);
+
+  /* Hold the lock so workers can find their index once all are created. */
+  pthread_mutex_lock(&e->lock);
+  for (u8 i = 0; i < n_threads; i++) {
+    if (pthread_create(&e->threads[i], 0, engine_worker, e)) {
+      pthread_mutex_unlock(&e->lock);
+      track_engine_destroy(e);
+      return -1;
+    }
+    e->n_threads++;
+  }
+  pthread_mutex_unlock(&e->lock);
+
+  return 0;
+}
+
+/** Stop the worker threads of a tracking engine.
+ *
+ * \param e Engine to destroy.
+ */
+void track_engine_destroy(track_engine_t* e)
+{
+  pthread_mutex_lock(&e->lock);
+  e->quit = true;
+  pthread_cond_broadcast(&e->wake);
+  pthread_mutex_unlock(&e->lock);
+
+  for (u8 i = 0; i < e->n_threads; i++)
+    pthread_join(e->threads[i], 0);
+
+  for (u8 i = 0; i < TRACK_ENGINE_MAX_THREADS; i++)
+    pthread_mutex_destroy(&e->worker_lock[i]);
+  pthread_cond_destroy(&e->wake);
+  pthread_mutex_destroy(&e->lock);
+  e->n_threads = 0;
+}
+
+/** Start tracking a satellite on a channel, e.g. after acquisition.
+ *
+ * The code frequency is initialised from the carrier frequency, assuming
+ * the Doppler shifts of the code and carrier are coherent. Any satellite
+ * previously tracked on the channel is dropped.
+ *
+ * \param e          Tracking engine.
+ * \param channel    Channel index.
+ * \param prn        Satellite PRN.
+ * \param pos        Ring index of the first sample to track.
+ * \param code_phase Code phase of that sample in chips, in [0, 1023).
+ * \param carr_freq  Carrier Doppler in Hz.
+ * \return 0 on success, -1 if `channel` is out of range.
+ */
+s8 track_engine_start_channel(track_engine_t* e, u8 channel, u8 prn,
+                              u64 pos, double code_phase, double carr_freq)
+{
+  if (channel >= e->n_channels)
+    return -1;
+
+  const track_engine_params_t* p = &e->params;
+  track_engine_channel_t* c = &e->channels[channel];
+  pthread_mutex_t* lock = &e->worker_lock[channel % e->n_threads];
+
+  pthread_mutex_lock(lock);
+  c->overrun = false;
+  c->prn = prn;
+  c->code = ca_code_unpacked(prn);
+  c->pos = pos;
+  c->code_phase = code_phase;
+  c->carr_phase = 0;
+  c->carr_cycles = 0;
+  aided_tl_init(&c->tl, 1e3,
+                carr_freq * GPS_CA_CHIPPING_RATE / GPS_L1_HZ,
+                p->code_bw, p->code_zeta, p->code_k,
+                GPS_L1_HZ / GPS_CA_CHIPPING_RATE,
+                carr_freq,
+                p->carr_bw, p->carr_zeta, p->carr_k, p->carr_fll_gain);
+  lock_detect_init(&c->ld, p->lock_k1, p->lock_k2, p->lock_lp, p->lock_lo);
+  cn0_est_init(&c->cn0_est, 1e3, p->cn0_init, p->cn0_cutoff, 1e3);
+  c->cn0 = p->cn0_init;
+  nav_msg_init(&c->nav);
+  c->TOW_ms = TOW_INVALID;
+  c->lock_counter++;
+  c->n_periods = 0;
+  channel_publish(e, c);
+  __atomic_store_n(&c->active, true, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(lock);
+
+  track_engine_notify(e);
+  return 0;
+}
+
+/** Stop tracking on a channel.
+ *
+ * Returns once the channel's worker is no longer using it.
+ *
+ * \param e       Tracking engine.
+ * \param channel Channel index.
+ */
+void track_engine_stop_channel(track_engine_t* e, u8 channel)
+{
+  if (channel >= e->n_channels)
+    return;
+
+  pthread_mutex_t* lock = &e->worker_lock[channel % e->n_threads];
+  pthread_mutex_lock(lock);
+  __atomic_store_n(&e->channels[channel].active, false, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(lock);
+}
+
+/** Wake the workers of a tracking engine, e.g. after new samples have been
+ * written to the ring.
+ *
+ * \param e Tracking engine.
+ */
+void track_engine_notify(track_engine_t* e)
+{
+  pthread_mutex_lock(&e->lock);
+  e->notify_count++;
+  pthread_cond_broadcast(&e->wake);
+  pthread_mutex_unlock(&e->lock);
+}
+
+/** Ring index of the oldest sample still needed by the engine.
+ *
+ * The producer must not write past this index plus the ring size, or the
+ * channels furthest behind will be stopped with their `overrun` flag set.
+ *
+ * \param e Tracking engine.
+ * \return Smallest next sample index of the active channels, or the ring
+ *         head if no channel is active.
+ */
+u64 track_engine_tail(track_engine_t* e)
+{
+  u64 tail = sample_ring_head(e->ring);
+  for (u8 i = 0; i < e->n_channels; i++) {
+    track_engine_channel_t* c = &e->channels[i];
+    if (__atomic_load_n(&c->active, __ATOMIC_ACQUIRE))
+      tail = MIN(tail, __atomic_load_n(&c->pos, __ATOMIC_ACQUIRE));
+  }
+  return tail;
+}
+
+/** Read the measurements of all locked channels at a common epoch.
+ *
+ * The last snapshot of each channel is read without blocking its worker
+ * and propagated from the end of its last code period to the epoch using
+ * the code phase rate and carrier frequency. Channels are reported once
+ * their pessimistic lock detector is set. `snr` holds the
+ * \f$ C / N_0 \f$ estimate in dBHz and `time_of_week_ms` is `TOW_INVALID`
+ * until the channel has decoded the time of week.
+ *
+ * \param e    Tracking engine.
+ * \param t    Epoch in seconds of receiver time, i.e. ring index divided by
+ *             the sampling frequency.
+ * \param meas Measurements output, room for `e->n_channels`.
+ * \return Number of measurements written to `meas`.
+ */
+u8 track_engine_measure(track_engine_t* e, double t,
+                        channel_measurement_t meas[])
+{
+  u8 n = 0;
+
+  for (u8 i = 0; i < e->n_channels; i++) {
+    track_engine_channel_t* c = &e->channels[i];
+    if (!__atomic_load_n(&c->active, __ATOMIC_ACQUIRE))
+      continue;
+
+    channel_measurement_t m;
+    bool locked;
+    u32 seq0, seq1;
+    do {
+      seq0 = __atomic_load_n(&c->snap_seq, __ATOMIC_ACQUIRE);
+      m = c->snap;
+      locked = c->snap_locked;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      seq1 = __atomic_load_n(&c->snap_seq, __ATOMIC_RELAXED);
+    } while ((seq0 & 1) || seq0 != seq1);
+
+    if (!locked)
+      continue;
+
+    double dt = t - m.receiver_time;
+    double cp = m.code_phase_chips + dt * m.code_phase_rate;
+    s32 periods = (s32)floor(cp / 1023);
+    m.code_phase_chips = cp - periods * 1023.0;
+    if ((s32)m.time_of_week_ms != TOW_INVALID)
+      m.time_of_week_ms = (m.time_of_week_ms + periods + WEEK_MS) % WEEK_MS;
+    m.carrier_phase += dt * m.carrier_freq;
+    m.receiver_time = t;
+    meas[n++] = m;
+  }
+
+  return n;
+}
+
+/** \} */
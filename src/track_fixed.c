@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2015 Swift Navigation Inc.
+ * Contact: Fergus Noble <fergus@swift-nav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "track.h"
+#include "track_fixed.h"
+
+/** \defgroup track_fixed Fixed-point Tracking Loops
+ * Integer versions of the tracking loop filters and discriminators.
+ *
+ * These mirror the functions of \ref track_loop but use only integer
+ * arithmetic in their update steps, so that they run deterministically and
+ * without an FPU. Only the initialisation functions use floating point, to
+ * convert the loop parameters.
+ *
+ * The formats used are:
+ *  - Correlations are integers, ::correlation_q_t.
+ *  - Discriminator outputs are Q15, i.e. the value of the float
+ *    discriminator scaled by \f$ 2^{15} \f$.
+ *  - Loop filter outputs, i.e. code and carrier frequencies, have
+ *    `TRACK_FIXED_FREQ_BITS` fractional bits in an `s32`. They should be
+ *    given relative to the nominal frequencies, e.g. as a Doppler shift.
+ *  - Loop filter gains have `TRACK_FIXED_GAIN_BITS` fractional bits in an
+ *    `s32`.
+ *  - The carrier aiding ratio of the code loop is Q31.
+ *
+ * Products are formed in 64 bits. The loop filters integrate them without
+ * rounding and only round their outputs, so rounding errors don't build up
+ * over the life of a channel. The discriminators are within about one LSB
+ * of their float versions, and the loop filter outputs differ from the float
+ * loops' by about the proportional gain times one discriminator LSB.
+ * \{ */
+
+/* atan(x) / (2 pi) in Q30, from the 9th order polynomial of
+ * Abramowitz & Stegun 4.4.49 with error below 1e-5 radians on [0, 1]. */
+#define ATAN_Q30_C1 170868419
+#define ATAN_Q30_C3 -56445317
+#define ATAN_Q30_C5 30784533
+#define ATAN_Q30_C7 -14548491
+#define ATAN_Q30_C9 3560538
+
+/* Shift from the loop filter accumulators, gain times Q15 error, to the
+ * frequency format. */
+#define LF_ACC_SHIFT (TRACK_FIXED_GAIN_BITS + 15 - TRACK_FIXED_FREQ_BITS)
+
+/* Shift right by n > 0 bits rounding to nearest. */
+static s64 round_shift(s64 x, u8 n)
+{
+  return (x + ((s64)1 << (n - 1))) >> n;
+}
+
+/* Saturate a 64 bit value to 32 bits. */
+static s32 sat_s32(s64 x)
+{
+  if (x > INT32_MAX)
+    return INT32_MAX;
+  if (x < INT32_MIN)
+    return INT32_MIN;
+  return (s32)x;
+}
+
+/* Floor of the square root. */
+static u32 isqrt64(u64 x)
+{
+  u64 r = 0;
+  u64 bit = (u64)1 << 62;
+
+  while (bit > x)
+    bit >>= 2;
+  while (bit) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (u32)r;
+}
+
+/* Four quadrant arctangent in cycles, Q30. */
+static s32 atan2_q30(s64 y, s64 x)
+{
+  if (x == 0 && y == 0)
+    return 0;
+
+  u64 ax = x < 0 ? -(u64)x : (u64)x;
+  u64 ay = y < 0 ? -(u64)y : (u64)y;
+  /* The ratio only needs 33 significant bits. */
+  while ((ax | ay) >> 33) {
+    ax >>= 1;
+    ay >>= 1;
+  }
+
+  bool swap = ay > ax;
+  u64 mn = swap ? ax : ay;
+  u64 mx = swap ? ay : ax;
+  s64 r = (s64)((mn << 30) / mx);
+  s64 r2 = (r * r) >> 30;
+
+  s64 p = ATAN_Q30_C9;
+  p = ((p * r2) >> 30) + ATAN_Q30_C7;
+  p = ((p * r2) >> 30) + ATAN_Q30_C5;
+  p = ((p * r2) >> 30) + ATAN_Q30_C3;
+  p = ((p * r2) >> 30) + ATAN_Q30_C1;
+  s32 a = (s32)((p * r) >> 30);
+
+  if (swap)
+    a = (1 << 28) - a;
+  if (x < 0)
+    a = (1 << 29) - a;
+  return y < 0 ? -a : a;
+}
+
+/** Convert a frequency to the fixed-point format.
+ *
+ * \param x Value to convert.
+ * \return `x` with `TRACK_FIXED_FREQ_BITS` fractional bits, saturated to
+ *         the range of an `s32`.
+ */
+s32 float_to_freq_q(float x)
+{
+  return sat_s32(llround((double)x * TRACK_FIXED_FREQ_ONE));
+}
+
+/** Convert a loop filter gain to the fixed-point format.
+ *
+ * \param x Value to convert.
+ * \return `x` with `TRACK_FIXED_GAIN_BITS` fractional bits, saturated to
+ *         the range of an `s32`.
+ */
+s32 float_to_gain_q(float x)
+{
+  return sat_s32(llround((double)x * TRACK_FIXED_GAIN_ONE));
+}
+
+/** Convert a frequency from the fixed-point format.
+ *
+ * \param x Value with `TRACK_FIXED_FREQ_BITS` fractional bits.
+ * \return `x` as a float.
+ */
+float freq_q_to_float(s32 x)
+{
+  return (float)x / TRACK_FIXED_FREQ_ONE;
+}
+
+/** Fixed-point four quadrant arctangent.
+ *
+ * Evaluates a 9th order polynomial on the ratio of the smaller to the larger
+ * argument magnitude. The result is within one LSB, \f$ 2 \pi / 2^{15} \f$
+ * radians, of the exact value.
+ *
+ * \param y Ordinate.
+ * \param x Abscissa.
+ * \return \f$ \mathrm{atan2}(y, x) / 2 \pi \f$ in Q15, i.e. the angle in
+ *         cycles. Zero if both arguments are zero.
+ */
+s16 atan2_q15(s64 y, s64 x)
+{
+  return (s16)round_shift(atan2_q30(y, x), 15);
+}
+
+/** Calculate fixed-point coefficients for a 2nd order loop filter.
+ *
+ * As calc_loop_gains(), with the coefficients converted by
+ * float_to_gain_q().
+ *
+ * \param bw        The loop noise bandwidth, \f$B_L\f$.
+ * \param zeta      The damping ratio, \f$\zeta\f$.
+ * \param k         The loop gain, \f$k\f$.
+ * \param loop_freq The loop update frequency, \f$1/T\f$.
+ * \param b0        First filter coefficient, \f$b_0\f$.
+ * \param b1        Second filter coefficient, \f$b_1\f$.
+ */
+void calc_loop_gains_q(float bw, float zeta, float k, float loop_freq,
+                       s32 *b0, s32 *b1)
+{
+  float b0f, b1f;
+  calc_loop_gains(bw, zeta, k, loop_freq, &b0f, &b1f);
+  *b0 = float_to_gain_q(b0f);
+  *b1 = float_to_gain_q(b1f);
+}
+
+/** Fixed-point phase discriminator for a Costas loop.
+ *
+ * As costas_discriminator().
+ *
+ * \param I The prompt in-phase correlation, \f$I_k\f$.
+ * \param Q The prompt quadrature correlation, \f$Q_k\f$.
+ * \return The discriminator value in Q15, within \f$ \pm 0.25 \f$ cycles.
+ */
+s16 costas_discriminator_q15(s32 I, s32 Q)
+{
+  if (I == 0)
+    return 0;
+  /* atan(Q / I) is atan2() with I folded into the right half plane. */
+  return atan2_q15(I < 0 ? -(s64)Q : Q, I < 0 ? -(s64)I : I);
+}
+
+/** Fixed-point frequency discriminator for a FLL.
+ *
+ * As frequency_discriminator().
+ *
+ * \param I The prompt in-phase correlation, \f$I_k\f$.
+ * \param Q The prompt quadrature correlation, \f$Q_k\f$.
+ * \param prev_I The prompt in-phase correlation, \f$I_{k-1}\f$.
+ * \param prev_Q The prompt quadrature correlation, \f$Q_{k-1}\f$.
+ * \return The discriminator value in Q15.
+ */
+s16 frequency_discriminator_q15(s32 I, s32 Q, s32 prev_I, s32 prev_Q)
+{
+  s64 ii = (s64)I * prev_I;
+  s64 qq = (s64)Q * prev_Q;
+  /* Halve the products so that their sums can't overflow. */
+  s64 dot = (llabs(ii) >> 1) + (llabs(qq) >> 1);
+  s64 cross = ((s64)prev_I * Q >> 1) - ((s64)I * prev_Q >> 1);
+  /* atan2() / pi is twice the angle in cycles. */
+  return (s16)round_shift(atan2_q30(cross, dot), 14);
+}
+
+/** Fixed-point normalised non-coherent early-minus-late envelope
+ * discriminator.
+ *
+ * As dll_discriminator(), except that zero is returned if both the early
+ * and late correlations are zero. The result is rounded to nearest.
+ *
+ * \param cs An array [E, P, L] of correlation_q_t structs for the Early,
+ *           Prompt and Late correlations.
+ * \return The discriminator value in Q15.
+ */
+s16 dll_discriminator_q15(const correlation_q_t cs[3])
+{
+  u64 early2 = (u64)((s64)cs[0].I*cs[0].I) + (u64)((s64)cs[0].Q*cs[0].Q);
+  u64 late2 = (u64)((s64)cs[2].I*cs[2].I) + (u64)((s64)cs[2].Q*cs[2].Q);
+  if (early2 == 0 && late2 == 0)
+    return 0;
+
+  /* Scale up small correlations so the square roots keep their
+   * fractional bits. */
+  while (((early2 | late2) >> 60) == 0) {
+    early2 <<= 2;
+    late2 <<= 2;
+  }
+  s64 early = isqrt64(early2);
+  s64 late = isqrt64(late2);
+
+  s64 num = (early - late) * (1 << 14);
+  s64 den = early + late;
+  return (s16)((num + (num < 0 ? -den : den) / 2) / den);
+}
+
+/** Initialise a fixed-point simple loop filter.
+ * The gains can be calculated using calc_loop_gains_q().
+ *
+ * \param s The loop filter state struct to initialise.
+ * \param y0 The initial value of the output variable, \f$y_0\f$.
+ * \param b0 First filter coefficient, \f$b_0\f$.
+ * \param b1 Second filter coefficient, \f$b_1\f$.
+ */
+void simple_lf_init_q(simple_lf_state_q_t *s, s32 y0, s32 b0, s32 b1)
+{
+  s->acc = (s64)y0 << LF_ACC_SHIFT;
+  s->y = y0;
+  s->prev_error = 0;
+  s->b0 = b0;
+  s->b1 = b1;
+}
+
+/** Update step for the fixed-point simple loop filter.
+ *
+ * As simple_lf_update().
+ *
+ * \param s The loop filter state struct.
+ * \param error The error output from the discriminator in Q15, \f$x_n\f$.
+ * \return The updated output variable, \f$y_n\f$.
+ */
+s32 simple_lf_update_q(simple_lf_state_q_t *s, s16 error)
+{
+  s->acc += (s64)s->b0 * error + (s64)s->b1 * s->prev_error;
+  s->y = sat_s32(round_shift(s->acc, LF_ACC_SHIFT));
+  s->prev_error = error;
+
+  return s->y;
+}
+
+/** Initialise a fixed-point integral aided loop filter.
+ *
+ * \param s The loop filter state struct to initialize.
+ * \param y0 The initial value of the output variable, \f$y_0\f$.
+ * \param b0 The proportional gain of the PI error term, \f$b_0\f$.
+ * \param b1 The integral gain of the PI error term, \f$b_1\f$.
+ * \param aiding_igain The integral gain of the aiding error term, \f$k_{ia}\f$.
+ */
+void aided_lf_init_q(aided_lf_state_q_t *s, s32 y0, s32 b0, s32 b1,
+                     s32 aiding_igain)
+{
+  s->acc = (s64)y0 << LF_ACC_SHIFT;
+  s->y = y0;
+  s->prev_error = 0;
+  s->b0 = b0;
+  s->b1 = b1;
+  s->aiding_igain = aiding_igain;
+}
+
+/** Update step for the fixed-point integral aided loop filter.
+ *
+ * As aided_lf_update().
+ *
+ * \param s The loop filter state struct.
+ * \param p_i_error The error output from the discriminator used in both P
+ *                  and I terms, Q15.
+ * \param aiding_error The error output from the discriminator use just in an
+ *                     I term, Q15.
+ * \return The updated output variable.
+ */
+s32 aided_lf_update_q(aided_lf_state_q_t *s, s16 p_i_error,
+                      s16 aiding_error)
+{
+  s->acc += (s64)s->b0 * p_i_error + (s64)s->b1 * s->prev_error
+            + (s64)s->aiding_igain * aiding_error;
+  s->y = sat_s32(round_shift(s->acc, LF_ACC_SHIFT));
+  s->prev_error = p_i_error;
+
+  return s->y;
+}
+
+/** Initialise a fixed-point simple tracking loop.
+ *
+ * Takes the same parameters as simple_tl_init(), the frequencies are
+ * converted with float_to_freq_q().
+ *
+ * \param s The tracking loop state struct to initialise.
+ * \param loop_freq The loop update frequency, \f$1/T\f$.
+ * \param code_freq The initial code phase rate (i.e. frequency).
+ * \param code_bw The code tracking loop noise bandwidth.
+ * \param code_zeta The code tracking loop damping ratio.
+ * \param code_k The code tracking loop gain.
+ * \param carr_freq The initial carrier frequency.
+ * \param carr_bw The carrier tracking loop noise bandwidth.
+ * \param carr_zeta The carrier tracking loop damping ratio.
+ * \param carr_k The carrier tracking loop gain.
+ */
+void simple_tl_init_q(simple_tl_state_q_t *s, float loop_freq,
+                      float code_freq, float code_bw,
+                      float code_zeta, float code_k,
+                      float carr_freq, float carr_bw,
+                      float carr_zeta, float carr_k)
+{
+  s32 b0, b1;
+
+  calc_loop_gains_q(code_bw, code_zeta, code_k, loop_freq, &b0, &b1);
+  s->code_freq = float_to_freq_q(code_freq);
+  simple_lf_init_q(&(s->code_filt), s->code_freq, b0, b1);
+
+  calc_loop_gains_q(carr_bw, carr_zeta, carr_k, loop_freq, &b0, &b1);
+  s->carr_freq = float_to_freq_q(carr_freq);
+  simple_lf_init_q(&(s->carr_filt), s->carr_freq, b0, b1);
+}
+
+/** Update step for the fixed-point simple tracking loop.
+ *
+ * As simple_tl_update().
+ *
+ * \param s The tracking loop state struct.
+ * \param cs An array [E, P, L] of correlation_q_t structs for the Early,
+ *           Prompt and Late correlations.
+ */
+void simple_tl_update_q(simple_tl_state_q_t *s, const correlation_q_t cs[3])
+{
+  s16 code_error = dll_discriminator_q15(cs);
+  s->code_freq = simple_lf_update_q(&(s->code_filt), -code_error);
+  s16 carr_error = costas_discriminator_q15(cs[1].I, cs[1].Q);
+  s->carr_freq = simple_lf_update_q(&(s->carr_filt), carr_error);
+}
+
+/** Initialise a fixed-point aided tracking loop.
+ *
+ * Takes the same parameters as aided_tl_init(), the frequencies are
+ * converted with float_to_freq_q().
+ *
+ * \param s The tracking loop state struct to initialise.
+ * \param loop_freq The loop update rate.
+ * \param code_freq The initial code phase rate (i.e. frequency).
+ * \param code_bw The code tracking loop noise bandwidth.
+ * \param code_zeta The code tracking loop damping ratio.
+ * \param code_k The code tracking loop gain.
+ * \param carr_to_code Ratio of carrier to code frequencies, at least one,
+ *                     or 0 to disable carrier aiding.
+ * \param carr_freq The initial carrier frequency.
+ * \param carr_bw The carrier tracking loop noise bandwidth.
+ * \param carr_zeta The carrier tracking loop damping ratio.
+ * \param carr_k The carrier tracking loop gain.
+ * \param carr_freq_b1 The integral gain of the aiding error term, \f$k_{ia}\f$.
+ */
+void aided_tl_init_q(aided_tl_state_q_t *s, float loop_freq,
+                     float code_freq,
+                     float code_bw, float code_zeta, float code_k,
+                     float carr_to_code,
+                     float carr_freq,
+                     float carr_bw, float carr_zeta, float carr_k,
+                     float carr_freq_b1)
+{
+  s32 b0, b1;
+
+  s->carr_freq = float_to_freq_q(carr_freq);
+  s->prev_I = 1;
+  s->prev_Q = 0;
+  calc_loop_gains_q(carr_bw, carr_zeta, carr_k, loop_freq, &b0, &b1);
+  aided_lf_init_q(&(s->carr_filt), s->carr_freq, b0, b1,
+                  float_to_gain_q(carr_freq_b1));
+
+  calc_loop_gains_q(code_bw, code_zeta, code_k, loop_freq, &b0, &b1);
+  s->code_freq = float_to_freq_q(code_freq);
+  s->code_per_carr = carr_to_code ?
+                     sat_s32(llround(Q31_ONE / (double)carr_to_code)) : 0;
+  /* If using carrier aiding, initialize code_freq in code loop filter
+     to zero to avoid double-counting. */
+  simple_lf_init_q(&(s->code_filt), carr_to_code ? 0 : s->code_freq, b0, b1);
+}
+
+/** Update step for the fixed-point aided tracking loop.
+ *
+ * As aided_tl_update().
+ *
+ * \param s The tracking loop state struct.
+ * \param cs An array [E, P, L] of correlation_q_t structs for the Early,
+ *           Prompt and Late correlations.
+ */
+void aided_tl_update_q(aided_tl_state_q_t *s, const correlation_q_t cs[3])
+{
+  /* Carrier loop */
+  s16 carr_error = costas_discriminator_q15(cs[1].I, cs[1].Q);
+  s16 freq_error = 0;
+  if (s->carr_filt.aiding_igain != 0) {
+    freq_error = frequency_discriminator_q15(cs[1].I, cs[1].Q,
+                                             s->prev_I, s->prev_Q);
+    s->prev_I = cs[1].I;
+    s->prev_Q = cs[1].Q;
+  }
+  s->carr_freq = aided_lf_update_q(&(s->carr_filt), carr_error, freq_error);
+
+  /* Code loop */
+  s16 code_error = dll_discriminator_q15(cs);
+  s->code_freq = simple_lf_update_q(&(s->code_filt), -code_error);
+  if (s->code_per_carr)
+    s->code_freq += (s32)round_shift((s64)s->carr_freq * s->code_per_carr,
+                                     31);
+}
+
+/** \} */
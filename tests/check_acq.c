@@ -0,0 +1,486 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <acq.h>
+#include <acq_sched.h>
+#include <acq_weak.h>
+#include <almanac.h>
+#include <constants.h>
+#include <coord_system.h>
+#include <fft.h>
+#include <prns.h>
+
+#include "check_utils.h"
+
+#define SAMPLE_FREQ 16.368e6
+#define IF_FREQ 4.092e6
+
+static s8 samples[20000];
+
+/* Generate one code period of a real IF signal plus noise. */
+static void gen_signal(u8 prn, double code_phase, double doppler, double amp)
+{
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+  u8 *ca = (u8 *)ca_code(prn);
+
+  seed_rng();
+  for (u32 i = 0; i < sizeof(samples); i++) {
+    u32 chip = (u32)(code_phase + i*code_step) % 1023;
+    double x = amp*get_chip(ca, chip)*sin(0.3 + i*carr_step)
+               + frand(-20, 20);
+    samples[i] = (s8)lround(x);
+  }
+}
+
+START_TEST(test_fft)
+{
+  fft_plan_t plan;
+  fft_cpx_t x[64], X[64];
+
+  fail_unless(fft_plan_init(&plan, 48) == -1,
+              "Non power of two lengths should be rejected");
+  fail_unless(fft_plan_init(&plan, 64) == 0);
+
+  seed_rng();
+  for (u32 i = 0; i < 64; i++) {
+    x[i].re = frand(-1, 1);
+    x[i].im = frand(-1, 1);
+    X[i] = x[i];
+  }
+  fft_forward(&plan, X);
+
+  /* Compare to a direct DFT. */
+  for (u32 k = 0; k < 64; k++) {
+    double re = 0, im = 0;
+    for (u32 n = 0; n < 64; n++) {
+      double a = -2*M_PI*k*n/64;
+      re += x[n].re*cos(a) - x[n].im*sin(a);
+      im += x[n].re*sin(a) + x[n].im*cos(a);
+    }
+    fail_unless(fabs(X[k].re - re) < 1e-4 && fabs(X[k].im - im) < 1e-4,
+                "Bin %u is (%f, %f), expected (%f, %f)",
+                k, X[k].re, X[k].im, re, im);
+  }
+
+  /* Round trip. */
+  fft_inverse(&plan, X);
+  for (u32 i = 0; i < 64; i++)
+    fail_unless(fabs(X[i].re/64 - x[i].re) < 1e-5 &&
+                fabs(X[i].im/64 - x[i].im) < 1e-5,
+                "Round trip differs at %u", i);
+
+  fft_plan_destroy(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_search)
+{
+  acq_plan_t plan;
+  acq_result_t res;
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+  fail_unless(plan.n_samples == 16368 && plan.n_fft == 16384,
+              "Unexpected plan sizes %u %u", plan.n_samples, plan.n_fft);
+
+  gen_signal(6, 345.6, 2250, 8);
+
+  u32 n_bins = acq_n_bins(-5000, 5000, 500);
+  fail_unless(n_bins == 21, "Expected 21 bins, got %u", n_bins);
+  float *grid = malloc(n_bins * plan.n_fft * sizeof(float));
+
+  fail_unless(acq_search(&plan, samples, 6, -5000, 5000, 500, grid, &res)
+              == 0);
+  double dcp = fabs(res.cp - 345.6);
+  fail_unless(dcp < 0.5 || dcp > 1022.5,
+              "Code phase %f, expected 345.6", res.cp);
+  fail_unless(fabs(res.cf - 2250) <= 250, "Doppler %f, expected 2250",
+              res.cf);
+  fail_unless(res.snr > 100, "SNR %f too low", res.snr);
+
+  /* The grid peak matches the result. */
+  float best = 0;
+  for (u32 i = 0; i < n_bins * plan.n_fft; i++)
+    best = MAX(best, grid[i]);
+  u32 b = lround((res.cf + 5000) / 500);
+  float peak = 0;
+  for (u32 k = 0; k < plan.n_fft; k++)
+    peak = MAX(peak, grid[b*plan.n_fft + k]);
+  fail_unless(peak == best, "Grid peak not in the reported Doppler bin");
+
+  /* A PRN that is not present. */
+  fail_unless(acq_search(&plan, samples, 20, -5000, 5000, 500, 0, &res)
+              == 0);
+  fail_unless(res.snr < 25, "SNR %f too high for absent PRN", res.snr);
+
+  free(grid);
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_spectrum_shift)
+{
+  acq_plan_t plan;
+  s32 shift;
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+
+  /* Bins a whole number of kHz apart are shifts of each other. */
+  fail_unless(acq_spectrum_shift_bins(&plan, -500, 2500, &shift) &&
+              shift == 3, "Expected a shift of 3 bins");
+  fail_unless(acq_spectrum_shift_bins(&plan, 1000, -4000, &shift) &&
+              shift == -5, "Expected a shift of -5 bins");
+  fail_unless(!acq_spectrum_shift_bins(&plan, 0, 500, &shift),
+              "Half a bin is not a shift");
+
+  gen_signal(6, 345.6, 2250, 8);
+
+  u32 n = plan.n_fft;
+  const fft_cpx_t* code = acq_code_spectrum_cached(&plan, 6);
+  fft_cpx_t* base = malloc(n * sizeof(fft_cpx_t));
+  fft_cpx_t* sig = malloc(n * sizeof(fft_cpx_t));
+  fft_cpx_t* work = malloc(n * sizeof(fft_cpx_t));
+  float* direct = malloc(n * sizeof(float));
+  float* shifted = malloc(n * sizeof(float));
+
+  /* The correlation of a shifted spectrum matches that of the spectrum
+   * computed directly, including the bin holding the signal. */
+  acq_signal_spectrum(&plan, samples, -750, base);
+  for (s32 m = -4; m <= 5; m++) {
+    float cf = -750 + 1000*m;
+    fail_unless(acq_spectrum_shift_bins(&plan, -750, cf, &shift) &&
+                shift == m, "Expected a shift of %d bins", m);
+
+    acq_signal_spectrum(&plan, samples, cf, sig);
+    acq_correlate(&plan, sig, code, work, direct);
+    acq_signal_spectrum_shift(&plan, base, shift, sig);
+    acq_correlate(&plan, sig, code, sig, shifted);
+
+    float peak = 0;
+    for (u32 k = 0; k < n; k++)
+      peak = MAX(peak, direct[k]);
+    for (u32 k = 0; k < n; k++)
+      fail_unless(fabs(shifted[k] - direct[k]) <= 1e-3 * peak,
+                  "Doppler %f index %u power %f, expected %f",
+                  cf, k, shifted[k], direct[k]);
+  }
+
+  free(base);
+  free(sig);
+  free(work);
+  free(direct);
+  free(shifted);
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_search_prns)
+{
+  acq_plan_t plan;
+  acq_pool_t pool;
+  u8 prns[5] = {6, 1, 20, 31, 12};
+  acq_result_t res[5], ref;
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+  fail_unless(acq_pool_init(&pool, 0) == -1);
+  fail_unless(acq_pool_init(&pool, 4) == 0);
+
+  gen_signal(6, 811.25, -3700, 8);
+
+  /* Without early stopping the results match a serial search. */
+  fail_unless(acq_search_prns(&pool, &plan, samples, 5, prns,
+                              -5000, 5000, 500, 0, res) == 0);
+  for (u8 i = 0; i < 5; i++) {
+    fail_unless(acq_search(&plan, samples, prns[i], -5000, 5000, 500,
+                           0, &ref) == 0);
+    fail_unless(res[i].cp == ref.cp && res[i].cf == ref.cf &&
+                fabs(res[i].snr - ref.snr) < 1e-3*ref.snr,
+                "PRN %d: (%f, %f, %f) != (%f, %f, %f)", prns[i],
+                res[i].cp, res[i].cf, res[i].snr, ref.cp, ref.cf, ref.snr);
+  }
+
+  /* With early stopping the present PRN is still found, though the search
+   * may stop in any bin within the 1 kHz main lobe of the peak. */
+  fail_unless(acq_search_prns(&pool, &plan, samples, 5, prns,
+                              -5000, 5000, 500, 50, res) == 0);
+  double dcp = fabs(res[0].cp - 811.25);
+  fail_unless((dcp < 1 || dcp > 1022) && fabs(res[0].cf + 3700) < 1000,
+              "Early stopped search found (%f, %f)", res[0].cp, res[0].cf);
+  for (u8 i = 1; i < 5; i++)
+    fail_unless(res[i].snr < 25, "PRN %d: SNR %f too high",
+                prns[i], res[i].snr);
+
+  acq_pool_destroy(&pool);
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_code_spectrum_cached)
+{
+  acq_plan_t plan;
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+  fft_cpx_t *ref = malloc(plan.n_fft * sizeof(fft_cpx_t));
+  acq_code_spectrum(&plan, 13, ref);
+
+  const fft_cpx_t *c1 = acq_code_spectrum_cached(&plan, 13);
+  const fft_cpx_t *c2 = acq_code_spectrum_cached(&plan, 13);
+  fail_unless(c1 != 0 && c1 == c2, "Spectrum should be computed once");
+  fail_unless(((uintptr_t)c1 & 31) == 0, "Spectrum should be aligned");
+  fail_unless(acq_code_spectrum_cached(&plan, 14) != c1);
+  for (u32 k = 0; k < plan.n_fft; k++)
+    fail_unless(c1[k].re == ref[k].re && c1[k].im == ref[k].im,
+                "Cached spectrum differs at %u", k);
+
+  free(ref);
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+/* Evenly spread GPS like orbits, satellite 3 unhealthy. */
+static void gen_almanac(almanac_t alm[MAX_SATS])
+{
+  for (u8 i = 0; i < MAX_SATS; i++) {
+    alm[i] = (almanac_t) {
+      .ecc = 0.005, .toa = 0, .inc = 0.96, .rora = -8e-9, .a = 26559700,
+      .raaw = (i % 6) * M_PI / 3, .argp = 0.3, .ma = i * 2 * M_PI / 5.3,
+      .af0 = 0, .af1 = 0, .week = 0, .prn = i, .healthy = (i != 3),
+      .valid = 1
+    };
+  }
+}
+
+START_TEST(test_acq_almanac_candidates)
+{
+  almanac_t alm[MAX_SATS];
+  acq_candidate_t cands[MAX_SATS];
+  double llh[3] = {37.77 * D2R, -122.42 * D2R, 30}, ref[3];
+  double t = 3600;
+
+  gen_almanac(alm);
+  wgsllh2ecef(llh, ref);
+
+  /* With exact position and time the candidates are exactly the healthy
+   * satellites above the mask, in elevation order. */
+  u8 n = acq_almanac_candidates(alm, MAX_SATS, t, 0, ref, 0, 0, 0,
+                                10 * D2R, cands);
+  fail_unless(n > 4 && n < 20, "Unexpected number of candidates %d", n);
+  for (u8 i = 0; i < n; i++) {
+    double az, el;
+    calc_sat_az_el_almanac(&alm[cands[i].prn], t, 0, ref, &az, &el);
+    fail_unless(el >= 10 * D2R && cands[i].prn != 3,
+                "PRN %d should not be a candidate", cands[i].prn);
+    fail_unless(i == 0 || cands[i].el <= cands[i-1].el,
+                "Candidates not in elevation order");
+    double dopp = -calc_sat_doppler_almanac(&alm[cands[i].prn], t, 0, ref);
+    fail_unless(fabs(cands[i].cf - dopp) < 1e-2 &&
+                fabs(cands[i].cf_min - dopp) < 1e-2 &&
+                fabs(cands[i].cf_max - dopp) < 1e-2,
+                "PRN %d Doppler %f, expected %f",
+                cands[i].prn, cands[i].cf, dopp);
+  }
+  u8 n_visible = 0;
+  for (u8 i = 0; i < MAX_SATS; i++) {
+    double az, el;
+    calc_sat_az_el_almanac(&alm[i], t, 0, ref, &az, &el);
+    n_visible += el >= 10 * D2R && i != 3;
+  }
+  fail_unless(n == n_visible, "%d candidates, %d visible", n, n_visible);
+
+  /* With uncertain position and time the windows cover the Doppler seen
+   * anywhere in the uncertainty but are still narrow. */
+  n = acq_almanac_candidates(alm, MAX_SATS, t, 0, ref, 50e3, 60, 100,
+                             10 * D2R, cands);
+  fail_unless(n >= n_visible);
+  seed_rng();
+  for (u8 i = 0; i < n; i++) {
+    fail_unless(cands[i].cf_max - cands[i].cf_min < 600,
+                "PRN %d window %f to %f too wide", cands[i].prn,
+                cands[i].cf_min, cands[i].cf_max);
+    for (u8 k = 0; k < 20; k++) {
+      double dir[3] = {frand(-1, 1), frand(-1, 1), frand(-1, 1)}, r[3];
+      double norm = sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+      for (u8 d = 0; d < 3; d++)
+        r[d] = ref[d] + 50e3 * dir[d] / norm;
+      double dopp = -calc_sat_doppler_almanac(&alm[cands[i].prn],
+                                              t + frand(-60, 60), 0, r);
+      fail_unless(dopp >= cands[i].cf_min + 100 - 1 &&
+                  dopp <= cands[i].cf_max - 100 + 1,
+                  "PRN %d Doppler %f outside %f to %f", cands[i].prn,
+                  dopp, cands[i].cf_min, cands[i].cf_max);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_acq_search_candidates)
+{
+  acq_plan_t plan;
+  acq_pool_t pool;
+  acq_candidate_t cands[3] = {
+    {.prn = 6, .cf_min = -3900, .cf_max = -3300},
+    {.prn = 1, .cf_min = 1000, .cf_max = 2000},
+    {.prn = 20, .cf_min = -3500, .cf_max = -3400},
+  };
+  acq_result_t res[3], ref;
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+  fail_unless(acq_pool_init(&pool, 3) == 0);
+
+  gen_signal(6, 811.25, -3700, 8);
+
+  /* Each candidate matches a serial search over its own bins. */
+  fail_unless(acq_search_candidates(&pool, &plan, samples, 3, cands, 250,
+                                    0, res) == 0);
+  float bins[3][2] = {{-3900, -3150}, {850, 2100}, {-3650, -3400}};
+  for (u8 i = 0; i < 3; i++) {
+    fail_unless(acq_search(&plan, samples, cands[i].prn, bins[i][0],
+                           bins[i][1], 250, 0, &ref) == 0);
+    fail_unless(res[i].cp == ref.cp && res[i].cf == ref.cf &&
+                fabs(res[i].snr - ref.snr) < 1e-3*ref.snr,
+                "PRN %d: (%f, %f, %f) != (%f, %f, %f)", cands[i].prn,
+                res[i].cp, res[i].cf, res[i].snr, ref.cp, ref.cf, ref.snr);
+  }
+  double dcp = fabs(res[0].cp - 811.25);
+  fail_unless((dcp < 1 || dcp > 1022) && fabs(res[0].cf + 3700) <= 125,
+              "Found (%f, %f)", res[0].cp, res[0].cf);
+  fail_unless(res[0].snr > 50 && res[1].snr < 25);
+
+  fail_unless(acq_search_candidates(&pool, &plan, samples, 0, cands, 250,
+                                    0, res) == 0);
+
+  acq_pool_destroy(&pool);
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+START_TEST(test_acq_weak_cost)
+{
+  acq_plan_t plan;
+  acq_weak_cost_t c1, c10, c20;
+  acq_weak_config_t cfg = {
+    .coh_len = 1, .n_noncoh = 1, .n_edges = 1,
+    .cf_min = -500, .cf_max = 500, .cf_bin_width = 500
+  };
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+
+  fail_unless(acq_weak_cost(&plan, &cfg, &c1) == 0);
+  fail_unless(c1.n_periods == 1 && c1.n_bins == 3 && c1.n_ffts == 6);
+  fail_unless(fabs(c1.coh_gain) < 1e-6 && fabs(c1.noncoh_gain) < 1e-6);
+
+  /* Longer integrations need more samples and work, but detect weaker
+   * signals. */
+  cfg = (acq_weak_config_t) {
+    .coh_len = 10, .n_noncoh = 10, .n_edges = 10,
+    .cf_min = -500, .cf_max = 500, .cf_bin_width = 50
+  };
+  fail_unless(acq_weak_cost(&plan, &cfg, &c10) == 0);
+  fail_unless(c10.n_periods == 109 && c10.n_bins == 21,
+              "%u periods, %u bins", c10.n_periods, c10.n_bins);
+  fail_unless(fabs(c10.coh_gain - 10) < 1e-6);
+  fail_unless(c10.noncoh_gain > 5 && c10.noncoh_gain < 10,
+              "Non-coherent gain %f", c10.noncoh_gain);
+  fail_unless(c10.flops > 100 * c1.flops);
+  fail_unless(c10.cn0_min < c1.cn0_min - 12, "%f vs %f",
+              c10.cn0_min, c1.cn0_min);
+
+  /* Trying fewer bit edges is cheaper but loses more. */
+  cfg.coh_len = 20;
+  cfg.n_noncoh = 5;
+  cfg.cf_bin_width = 25;
+  cfg.n_edges = 2;
+  fail_unless(acq_weak_cost(&plan, &cfg, &c20) == 0);
+  acq_weak_cost_t c20_all;
+  cfg.n_edges = 20;
+  fail_unless(acq_weak_cost(&plan, &cfg, &c20_all) == 0);
+  fail_unless(c20.loss > c20_all.loss + 1 && c20.flops < c20_all.flops);
+
+  cfg.coh_len = 3;
+  fail_unless(acq_weak_cost(&plan, &cfg, &c20) == -1,
+              "Blocks must divide a bit");
+  cfg.coh_len = 4;
+  cfg.n_edges = 5;
+  fail_unless(acq_weak_cost(&plan, &cfg, &c20) == -1);
+
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+#define WEAK_PERIODS 90
+static s8 weak_samples[WEAK_PERIODS * 16368];
+
+START_TEST(test_acq_search_weak)
+{
+  acq_plan_t plan;
+  acq_result_t res;
+  u8 edge;
+  double code_phase = 400.5, doppler = 3010;
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+  u8 *ca = (u8 *)ca_code(9);
+  s8 bits[8] = {1, -1, 1, 1, -1, -1, 1, -1};
+
+  /* Signal 20 dB below the noise with bit edges at 7 ms. */
+  seed_rng();
+  for (u32 i = 0; i < sizeof(weak_samples); i++) {
+    double cp = code_phase + i*code_step;
+    s8 bit = bits[(u32)((cp + 13*1023) / (20*1023)) % 8];
+    u32 chip = (u32)cp % 1023;
+    double x = bit*get_chip(ca, chip)*sin(i*carr_step) + frand(-60, 60);
+    weak_samples[i] = (s8)lround(x);
+  }
+
+  fail_unless(acq_plan_init(&plan, SAMPLE_FREQ, IF_FREQ) == 0);
+
+  /* A single period is not enough. */
+  acq_weak_config_t cfg = {
+    .coh_len = 1, .n_noncoh = 1, .n_edges = 1,
+    .cf_min = 2900, .cf_max = 3100, .cf_bin_width = 50
+  };
+  fail_unless(acq_search_weak(&plan, weak_samples, sizeof(weak_samples), 9,
+                              &cfg, &res, &edge) == 0);
+  fail_unless(res.snr < 20, "SNR %f too high", res.snr);
+
+  /* 10 ms blocks at every alignment find the signal and the bit edge. */
+  cfg.coh_len = 10;
+  cfg.n_noncoh = 8;
+  cfg.n_edges = 10;
+  fail_unless(acq_search_weak(&plan, weak_samples, sizeof(weak_samples), 9,
+                              &cfg, &res, &edge) == 0);
+  fail_unless(fabs(res.cp - code_phase) < 0.2,
+              "Code phase %f, expected %f", res.cp, code_phase);
+  fail_unless(fabs(res.cf - doppler) <= 25, "Doppler %f", res.cf);
+  fail_unless(res.snr > 20, "SNR %f too low", res.snr);
+  fail_unless(edge == 6 || edge == 7, "Bit edge %d", edge);
+
+  /* Not enough samples. */
+  cfg.n_noncoh = 9;
+  fail_unless(acq_search_weak(&plan, weak_samples, sizeof(weak_samples), 9,
+                              &cfg, &res, &edge) == -1);
+
+  acq_plan_destroy(&plan);
+}
+END_TEST
+
+Suite* acq_suite(void)
+{
+  Suite *s = suite_create("Acquisition");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_fft);
+  tcase_add_test(tc_core, test_acq_code_spectrum_cached);
+  tcase_add_test(tc_core, test_acq_search);
+  tcase_add_test(tc_core, test_acq_spectrum_shift);
+  tcase_add_test(tc_core, test_acq_search_prns);
+  tcase_add_test(tc_core, test_acq_almanac_candidates);
+  tcase_add_test(tc_core, test_acq_search_candidates);
+  tcase_add_test(tc_core, test_acq_weak_cost);
+  tcase_add_test(tc_core, test_acq_search_weak);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
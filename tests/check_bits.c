@@ -83,6 +83,31 @@ START_TEST(test_getbits)
 }
 END_TEST
 
+START_TEST(test_getbits_navword)
+{
+  /* Data bits 1-24 then six parity bits. */
+  u32 word = 0xFD5A80u << 6 | 0x15;
+
+  s32 ret;
+
+  ret = getbits_navword(word, 8, 8);
+  fail_unless(ret == -3,
+      "Test case 1 expected -3, got %d", ret);
+
+  ret = getbits_navword(word, 16, 8);
+  fail_unless(ret == 90,
+      "Test case 2 expected 90, got %d", ret);
+
+  ret = getbits_navword(word, 24, 8);
+  fail_unless(ret == -128,
+      "Test case 3 expected -128, got %d", ret);
+
+  ret = getbits_navword(word, 24, 24);
+  fail_unless(ret == -173440,
+      "Test case 4 expected -173440, got %d", ret);
+}
+END_TEST
+
 START_TEST(test_setbitu)
 {
   u8 test_data[10];
@@ -130,6 +155,7 @@ Suite* bits_suite(void)
   tcase_add_test(tc_core, test_parity);
   tcase_add_test(tc_core, test_getbitu);
   tcase_add_test(tc_core, test_getbits);
+  tcase_add_test(tc_core, test_getbits_navword);
   tcase_add_test(tc_core, test_setbitu);
   tcase_add_test(tc_core, test_setbits);
   suite_add_tcase(s, tc_core);
@@ -0,0 +1,460 @@
+#include <check.h>
+#include <math.h>
+
+#include <constants.h>
+#include <correlate.h>
+#include <prns.h>
+#include <replica.h>
+
+#include "check_utils.h"
+
+#define SAMPLE_FREQ 16.368e6
+#define IF_FREQ 4.092e6
+#define N_SAMPLES 100000
+
+/* Code phase increment per sample for a given Doppler. */
+#define CODE_STEP(doppler) \
+  (GPS_CA_CHIPPING_RATE * (1 + (doppler) / GPS_L1_HZ) / SAMPLE_FREQ)
+
+static s8 samples[N_SAMPLES];
+static s8 code[CA_CODE_UNPACKED_LEN];
+
+/* Generate a real IF signal with the given code phase and Doppler plus some
+ * uniform noise. */
+static void gen_signal(u8 prn, double code_phase, double doppler)
+{
+  double code_step = CODE_STEP(doppler);
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+  u8 *ca = (u8 *)ca_code(prn);
+
+  seed_rng();
+  for (u32 i = 0; i < N_SAMPLES; i++) {
+    u32 chip = (u32)(code_phase + i*code_step) % 1023;
+    double x = 20*get_chip(ca, chip)*sin(i*carr_step) + frand(-30, 30);
+    samples[i] = (s8)lround(x);
+  }
+}
+
+static void correlate_with(corr_impl_t impl, double code_phase,
+                           double carr_phase, double doppler,
+                           double corr[6], double *cp_out, double *carr_out,
+                           u32 *n)
+{
+  fail_unless(track_correlate_set_impl(impl) == 0);
+  *cp_out = code_phase;
+  *carr_out = carr_phase;
+  track_correlate(samples, code, cp_out, CODE_STEP(doppler),
+                  carr_out, 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ,
+                  &corr[0], &corr[1], &corr[2], &corr[3], &corr[4], &corr[5],
+                  n);
+}
+
+START_TEST(test_track_correlate_prompt)
+{
+  double corr[6], cp, carr;
+  u32 n;
+
+  ca_code_unpack(3, code);
+  gen_signal(3, 0, 1000);
+
+  correlate_with(CORR_IMPL_C, 0, 0, 1000, corr, &cp, &carr, &n);
+
+  fail_unless(n == 16368,
+              "Expected 16368 samples in one code period, got %u", n);
+  fail_unless(cp >= 0 && cp < CODE_STEP(1000),
+              "Code phase not wrapped correctly, got %f", cp);
+
+  double P = sqrt(corr[2]*corr[2] + corr[3]*corr[3]);
+  double E = sqrt(corr[0]*corr[0] + corr[1]*corr[1]);
+  double L = sqrt(corr[4]*corr[4] + corr[5]*corr[5]);
+  fail_unless(P > 1.5*E && P > 1.5*L,
+              "Prompt should dominate (E %f, P %f, L %f)", E, P, L);
+  fail_unless(fabs(corr[2]) > 5*fabs(corr[3]),
+              "Power should be in the in-phase arm (I %f, Q %f)",
+              corr[2], corr[3]);
+}
+END_TEST
+
+START_TEST(test_track_correlate_impls)
+{
+  double ref[6], corr[6], cp_ref, carr_ref, cp, carr;
+  u32 n_ref, n;
+
+  ca_code_unpack(17, code);
+  gen_signal(17, 400.3, -2200);
+
+  correlate_with(CORR_IMPL_C, 0.3, 0.7, -2200,
+                 ref, &cp_ref, &carr_ref, &n_ref);
+  double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+
+  for (corr_impl_t impl = CORR_IMPL_SSSE3; impl <= CORR_IMPL_AVX512; impl++) {
+    if (track_correlate_set_impl(impl) != 0)
+      continue;
+    correlate_with(impl, 0.3, 0.7, -2200, corr, &cp, &carr, &n);
+    fail_unless(n == n_ref, "impl %d: num_samples %u != %u", impl, n, n_ref);
+    fail_unless(fabs(cp - cp_ref) < 1e-9 && fabs(carr - carr_ref) < 1e-9,
+                "impl %d: phases differ", impl);
+    for (u8 i = 0; i < 6; i++)
+      fail_unless(fabs(corr[i] - ref[i]) < 1e-3*P + 1,
+                  "impl %d: corr[%d] %f != %f", impl, i, corr[i], ref[i]);
+  }
+
+  fail_unless(track_correlate_set_impl(CORR_IMPL_AUTO) == 0);
+  fail_unless(track_correlate_get_impl() >= CORR_IMPL_C);
+}
+END_TEST
+
+START_TEST(test_track_correlate_multi)
+{
+  static s8 codes[3][CA_CODE_UNPACKED_LEN];
+  corr_channel_t chans[3];
+  double dopp[3] = {1000, -3500, 200};
+  double cp0[3] = {0, 12.25, 1022.9};
+
+  ca_code_unpack(3, codes[0]);
+  ca_code_unpack(8, codes[1]);
+  ca_code_unpack(30, codes[2]);
+  gen_signal(3, 0, 1000);
+
+  for (u8 i = 0; i < 3; i++) {
+    chans[i].code = codes[i];
+    chans[i].code_phase = cp0[i];
+    chans[i].code_step = CODE_STEP(dopp[i]);
+    chans[i].carr_phase = 0.1*i;
+    chans[i].carr_step = 2*M_PI*(IF_FREQ + dopp[i]) / SAMPLE_FREQ;
+  }
+
+  fail_unless(track_correlate_set_impl(CORR_IMPL_AUTO) == 0);
+  track_correlate_multi(samples, 3, chans);
+
+  for (u8 i = 0; i < 3; i++) {
+    double corr[6], cp = cp0[i], carr = 0.1*i;
+    u32 n;
+    track_correlate(samples, codes[i], &cp, CODE_STEP(dopp[i]),
+                    &carr, 2*M_PI*(IF_FREQ + dopp[i]) / SAMPLE_FREQ,
+                    &corr[0], &corr[1], &corr[2], &corr[3], &corr[4], &corr[5],
+                    &n);
+    fail_unless(chans[i].num_samples == n,
+                "chan %d: num_samples %u != %u", i, chans[i].num_samples, n);
+    fail_unless(fabs(chans[i].code_phase - cp) < 1e-9 &&
+                fabs(chans[i].carr_phase - carr) < 1e-9,
+                "chan %d: phases differ", i);
+    for (u8 j = 0; j < 6; j++)
+      fail_unless(fabs(chans[i].corr[j] - corr[j]) < 1e-3*fabs(corr[j]) + 1,
+                  "chan %d: corr[%d] %f != %f", i, j, chans[i].corr[j], corr[j]);
+  }
+}
+END_TEST
+
+START_TEST(test_track_correlate_replica)
+{
+  code_replica_cache_t cache;
+  double ref[6], corr[6];
+  double doppler = 1800;
+  double code_step = CODE_STEP(doppler);
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  fail_unless(code_replica_cache_init(&cache, 2, 16400) == 0);
+  ca_code_unpack(22, code);
+  gen_signal(22, 3.7, doppler);
+
+  fail_unless(track_correlate_set_impl(CORR_IMPL_AUTO) == 0);
+
+  for (u8 k = 0; k < 2; k++) {
+    double cp_ref = 3.9, carr_ref = 0.2, cp = 3.9, carr = 0.2;
+    u32 n_ref, n;
+
+    track_correlate(samples, code, &cp_ref, code_step, &carr_ref, carr_step,
+                    &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                    &n_ref);
+
+    const code_replica_t *r = code_replica_get(&cache, 22, cp, code_step);
+    fail_unless(r != 0, "Replica lookup failed");
+    fail_unless(r->len >= n_ref, "Replica too short (%u < %u)", r->len, n_ref);
+    fail_unless(track_correlate_replica(samples, r, &cp, code_step,
+                                        &carr, carr_step,
+                                        &corr[0], &corr[1], &corr[2],
+                                        &corr[3], &corr[4], &corr[5],
+                                        &n) == 0,
+                "Replica correlation failed");
+
+    fail_unless(n == n_ref, "num_samples %u != %u", n, n_ref);
+    fail_unless(fabs(cp - cp_ref) < 1e-9 && fabs(carr - carr_ref) < 1e-9,
+                "Phases differ");
+    double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+    for (u8 i = 0; i < 6; i++)
+      fail_unless(fabs(corr[i] - ref[i]) < 0.02*P + 1,
+                  "corr[%d] %f != %f", i, corr[i], ref[i]);
+  }
+
+  fail_unless(cache.misses == 1 && cache.hits == 1,
+              "Expected one miss and one hit, got %u and %u",
+              cache.misses, cache.hits);
+
+  /* Different PRNs evict the least recently used replica. */
+  code_replica_get(&cache, 5, 3.9, code_step);
+  code_replica_get(&cache, 6, 3.9, code_step);
+  code_replica_get(&cache, 5, 3.9, code_step);
+  code_replica_get(&cache, 22, 3.9, code_step);
+  fail_unless(cache.misses == 4 && cache.hits == 2,
+              "Expected four misses and two hits, got %u and %u",
+              cache.misses, cache.hits);
+
+  fail_unless(code_replica_get(&cache, 22, 3.9, 2*code_step) != 0);
+  fail_unless(code_replica_get(&cache, 22, 3.9, code_step / 2) == 0,
+              "Replica longer than max_len should not be returned");
+
+  /* A replica shorter than the code period is rejected. */
+  const code_replica_t *r = code_replica_get(&cache, 22, 3.9, code_step);
+  fail_unless(r != 0, "Replica lookup failed");
+  code_replica_t short_r = *r;
+  double cp = 3.9, carr = 0.2;
+  u32 n = 0;
+  short_r.len = (u32)ceil((1023 - cp) / code_step) - 1;
+  fail_unless(track_correlate_replica(samples, &short_r, &cp, code_step,
+                                      &carr, carr_step,
+                                      &corr[0], &corr[1], &corr[2],
+                                      &corr[3], &corr[4], &corr[5],
+                                      &n) == -1,
+              "Short replica not rejected");
+  fail_unless(cp == 3.9 && carr == 0.2 && n == 0,
+              "Phases updated for a short replica");
+
+  code_replica_cache_destroy(&cache);
+}
+END_TEST
+
+START_TEST(test_track_correlate_int)
+{
+  double ref[6], cp_ref = 511.37, carr_ref = 1.1;
+  s32 corr[2][6];
+  u64 cp[2];
+  u32 carr[2], n_ref, n[2];
+  double doppler = -1300;
+  double code_step = CODE_STEP(doppler);
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  ca_code_unpack(11, code);
+  gen_signal(11, 511.37, doppler);
+
+  fail_unless(track_correlate_set_impl(CORR_IMPL_C) == 0);
+  track_correlate(samples, code, &cp_ref, code_step, &carr_ref, carr_step,
+                  &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                  &n_ref);
+
+  /* Every implementation must give exactly the same result. */
+  for (u8 k = 0; k < 2; k++) {
+    fail_unless(track_correlate_set_impl(k ? CORR_IMPL_AUTO : CORR_IMPL_C)
+                == 0);
+    cp[k] = (u64)llround(511.37 * CORR_INT_CODE_ONE);
+    carr[k] = (u32)llround(1.1 / (2*M_PI) * CORR_INT_CARR_CYCLE);
+    track_correlate_int(samples, code,
+                        &cp[k], (u64)llround(code_step * CORR_INT_CODE_ONE),
+                        &carr[k], (u32)llround(carr_step / (2*M_PI) *
+                                               CORR_INT_CARR_CYCLE),
+                        &corr[k][0], &corr[k][1], &corr[k][2], &corr[k][3],
+                        &corr[k][4], &corr[k][5], &n[k]);
+  }
+  fail_unless(n[0] == n[1] && cp[0] == cp[1] && carr[0] == carr[1],
+              "Integer implementations disagree on the NCO state");
+  for (u8 i = 0; i < 6; i++)
+    fail_unless(corr[0][i] == corr[1][i],
+                "corr[%d] %d != %d", i, corr[0][i], corr[1][i]);
+
+  /* And be close to the floating point correlator. */
+  fail_unless(n[0] == n_ref, "num_samples %u != %u", n[0], n_ref);
+  fail_unless(fabs((double)cp[0] / CORR_INT_CODE_ONE - cp_ref) < 1e-5,
+              "Code phase %f != %f", (double)cp[0] / CORR_INT_CODE_ONE, cp_ref);
+  double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+  for (u8 i = 0; i < 6; i++)
+    fail_unless(fabs((double)corr[0][i] / CORR_INT_CARR_AMP - ref[i])
+                < 0.03*P + 1,
+                "corr[%d] %f != %f", i,
+                (double)corr[0][i] / CORR_INT_CARR_AMP, ref[i]);
+}
+END_TEST
+
+START_TEST(test_track_correlate_taps)
+{
+  double ref[6], I[5], Q[5];
+  double offsets[5] = {-0.5, 0, 0.5, 1023.5, -2046.5};
+  double doppler = 2600;
+  double code_step = CODE_STEP(doppler);
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  ca_code_unpack(9, code);
+  gen_signal(9, 20.2, doppler);
+
+  for (corr_impl_t impl = CORR_IMPL_C; impl <= CORR_IMPL_AVX512; impl++) {
+    if (track_correlate_set_impl(impl) != 0)
+      continue;
+
+    double cp_ref = 20.2, carr_ref = 0.4, cp = 20.2, carr = 0.4;
+    u32 n_ref, n;
+    track_correlate(samples, code, &cp_ref, code_step, &carr_ref, carr_step,
+                    &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                    &n_ref);
+    fail_unless(track_correlate_taps(samples, code, &cp, code_step,
+                                     &carr, carr_step, 5, offsets,
+                                     I, Q, &n) == 0);
+
+    fail_unless(n == n_ref, "impl %d: num_samples %u != %u", impl, n, n_ref);
+    fail_unless(fabs(cp - cp_ref) < 1e-9 && fabs(carr - carr_ref) < 1e-9,
+                "impl %d: phases differ", impl);
+    double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+    for (u8 k = 0; k < 5; k++) {
+      /* Offsets a whole number of code periods apart are the same tap. */
+      u8 j = (k < 3) ? k : (k == 3) ? 2 : 0;
+      fail_unless(fabs(I[k] - ref[2*j]) < 1e-3*P + 1 &&
+                  fabs(Q[k] - ref[2*j+1]) < 1e-3*P + 1,
+                  "impl %d: tap %d (%f, %f) != (%f, %f)", impl, k,
+                  I[k], Q[k], ref[2*j], ref[2*j+1]);
+    }
+  }
+
+  double cp = 0, carr = 0;
+  u32 n;
+  double many[CORR_MAX_TAPS + 1] = {0};
+  double out[CORR_MAX_TAPS + 1];
+  fail_unless(track_correlate_taps(samples, code, &cp, code_step,
+                                   &carr, carr_step, CORR_MAX_TAPS + 1, many,
+                                   out, out, &n) == -1,
+              "Too many taps should be rejected");
+}
+END_TEST
+
+START_TEST(test_track_correlate_iq)
+{
+  static s8 iq[2*N_SAMPLES];
+  double doppler = -900;
+  double code_step = CODE_STEP(doppler);
+  double carr_step = 2*M_PI*doppler / SAMPLE_FREQ;
+  double ref[6] = {0, 0, 0, 0, 0, 0};
+  u8 *ca = (u8 *)ca_code(27);
+
+  ca_code_unpack(27, code);
+
+  seed_rng();
+  for (u32 i = 0; i < N_SAMPLES; i++) {
+    u32 chip = (u32)(0.6 + i*code_step) % 1023;
+    s8 c = get_chip(ca, chip);
+    iq[2*i] = (s8)lround(20*c*cos(i*carr_step) + frand(-30, 30));
+    iq[2*i+1] = (s8)lround(20*c*sin(i*carr_step) + frand(-30, 30));
+  }
+
+  for (corr_impl_t impl = CORR_IMPL_C; impl <= CORR_IMPL_AVX512; impl++) {
+    if (track_correlate_set_impl(impl) != 0)
+      continue;
+
+    double corr[6], cp = 0.6, carr = 0;
+    u32 n;
+    track_correlate_iq(iq, code, &cp, code_step, &carr, carr_step,
+                       &corr[0], &corr[1], &corr[2], &corr[3],
+                       &corr[4], &corr[5], &n);
+
+    if (impl == CORR_IMPL_C) {
+      fail_unless(n == (u32)ceil((1023 - 0.6) / code_step),
+                  "Wrong number of samples, got %u", n);
+      double P = sqrt(corr[2]*corr[2] + corr[3]*corr[3]);
+      double E = sqrt(corr[0]*corr[0] + corr[1]*corr[1]);
+      double L = sqrt(corr[4]*corr[4] + corr[5]*corr[5]);
+      fail_unless(P > 1.5*E && P > 1.5*L,
+                  "Prompt should dominate (E %f, P %f, L %f)", E, P, L);
+      fail_unless(corr[2] > 5*fabs(corr[3]),
+                  "Power should be in the in-phase arm (I %f, Q %f)",
+                  corr[2], corr[3]);
+      for (u8 i = 0; i < 6; i++)
+        ref[i] = corr[i];
+    } else {
+      double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+      for (u8 i = 0; i < 6; i++)
+        fail_unless(fabs(corr[i] - ref[i]) < 1e-3*P + 1,
+                    "impl %d: corr[%d] %f != %f", impl, i, corr[i], ref[i]);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_track_correlate_periods)
+{
+  double periods[6][6], sum[6];
+  double doppler = 3100;
+  double code_step = CODE_STEP(doppler);
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  ca_code_unpack(4, code);
+  gen_signal(4, 17.2, doppler);
+
+  /* The carrier is carried across the rollovers by each implementation's
+   * own kernel, compare them all against separate track_correlate() calls
+   * with the C correlator. */
+  for (corr_impl_t impl = CORR_IMPL_C; impl <= CORR_IMPL_AVX512; impl++) {
+    if (track_correlate_set_impl(impl))
+      continue;
+
+    double cp = 17.2, carr = 0.5;
+    u32 n;
+    u32 k = track_correlate_periods(samples, N_SAMPLES, code,
+                                    &cp, code_step, &carr, carr_step,
+                                    6, periods, sum, &n);
+    /* Only 6 whole periods fit in the buffer. */
+    fail_unless(k == 6, "impl %d: Expected 6 periods, got %u", impl, k);
+
+    fail_unless(track_correlate_set_impl(CORR_IMPL_C) == 0);
+    double cp_ref = 17.2, carr_ref = 0.5, total[6] = {0};
+    u32 n_ref = 0;
+    for (u32 j = 0; j < k; j++) {
+      double corr[6];
+      u32 n_j;
+      track_correlate(&samples[n_ref], code, &cp_ref, code_step,
+                      &carr_ref, carr_step,
+                      &corr[0], &corr[1], &corr[2], &corr[3], &corr[4],
+                      &corr[5], &n_j);
+      n_ref += n_j;
+      double P = sqrt(corr[2]*corr[2] + corr[3]*corr[3]);
+      for (u8 i = 0; i < 6; i++) {
+        fail_unless(fabs(periods[j][i] - corr[i]) < 1e-3*P + 1,
+                    "impl %d: Period %u corr[%d] %f != %f",
+                    impl, j, i, periods[j][i], corr[i]);
+        total[i] += corr[i];
+      }
+    }
+
+    fail_unless(n == n_ref, "impl %d: num_samples %u != %u", impl, n, n_ref);
+    fail_unless(fabs(cp - cp_ref) < 1e-9 && fabs(carr - carr_ref) < 1e-6,
+                "impl %d: Phases differ", impl);
+    double P = sqrt(total[2]*total[2] + total[3]*total[3]);
+    for (u8 i = 0; i < 6; i++)
+      fail_unless(fabs(sum[i] - total[i]) < 1e-3*P + 1,
+                  "impl %d: Sum corr[%d] %f != %f", impl, i, sum[i], total[i]);
+  }
+
+  fail_unless(track_correlate_set_impl(CORR_IMPL_AUTO) == 0);
+
+  /* Limit by number of samples. */
+  double cp = 17.2, carr = 0.5;
+  u32 n;
+  u32 k = track_correlate_periods(samples, 40000, code, &cp, code_step,
+                                  &carr, carr_step, 20, 0, sum, &n);
+  fail_unless(k == 2 && n <= 40000, "Expected 2 periods, got %u", k);
+}
+END_TEST
+
+Suite* correlate_suite(void)
+{
+  Suite *s = suite_create("Correlator");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_track_correlate_prompt);
+  tcase_add_test(tc_core, test_track_correlate_impls);
+  tcase_add_test(tc_core, test_track_correlate_multi);
+  tcase_add_test(tc_core, test_track_correlate_replica);
+  tcase_add_test(tc_core, test_track_correlate_int);
+  tcase_add_test(tc_core, test_track_correlate_taps);
+  tcase_add_test(tc_core, test_track_correlate_iq);
+  tcase_add_test(tc_core, test_track_correlate_periods);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
@@ -28,6 +28,18 @@ int main(void)
   srunner_add_suite(sr, set_suite());
   srunner_add_suite(sr, viterbi_suite());
   srunner_add_suite(sr, gpstime_test_suite());
+  srunner_add_suite(sr, correlate_suite());
+  srunner_add_suite(sr, samples_suite());
+  srunner_add_suite(sr, resample_suite());
+  srunner_add_suite(sr, acq_suite());
+  srunner_add_suite(sr, reacq_suite());
+  srunner_add_suite(sr, track_bank_suite());
+  srunner_add_suite(sr, track_fixed_suite());
+  srunner_add_suite(sr, track_engine_suite());
+  srunner_add_suite(sr, queue_suite());
+  srunner_add_suite(sr, receiver_suite());
+  srunner_add_suite(sr, nav_msg_suite());
+  srunner_add_suite(sr, nav_replay_suite());
 
   srunner_set_fork_status(sr, CK_NOFORK);
   srunner_run_all(sr, CK_NORMAL);
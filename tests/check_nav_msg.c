@@ -0,0 +1,437 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nav_msg.h>
+
+#include "check_utils.h"
+
+/* Random bits ahead of the first subframe, enough for bit sync. */
+#define LEAD_BITS 150
+#define N_BITS (LEAD_BITS + 3 * 300)
+#define N_MS (N_BITS * 20)
+/* Time of week of the start of the first subframe, in units of 6 s. */
+#define SF_TOW 1000
+/* More channels than nav_msg_update_batch() syncs together. */
+#define N_CHANNELS 37
+
+static u8 bits[N_BITS];
+
+/* Subframes with a preamble and the time of week, and random data. The last
+ * bit of each word holding the D30* of the next TLM or HOW is left as zero
+ * so no bits are inverted. */
+static void make_bits(void)
+{
+  for (u32 i = 0; i < N_BITS; i++)
+    bits[i] = rand() & 1;
+
+  for (u32 sf = 0; sf < 3; sf++) {
+    u8* b = &bits[LEAD_BITS + sf * 300];
+    for (u32 i = 0; i < 8; i++)
+      b[i] = 0x8B >> (7 - i) & 1;
+    for (u32 i = 0; i < 17; i++)
+      b[30 + i] = (SF_TOW + sf + 1) >> (16 - i) & 1;
+    b[29] = 0;
+    b[299] = 0;
+  }
+}
+
+/* Correlations integrated over `ms` ms, starting `offset` ms into the first
+ * bit. Returns the time of week in ms at the start of the first. */
+static s32 make_corrs(s32* corrs, u32 n_corr, u8 ms, u32 offset)
+{
+  for (u32 i = 0; i < n_corr; i++) {
+    corrs[i] = 0;
+    for (u32 j = 0; j < ms; j++) {
+      u32 t = offset + i * ms + j;
+      corrs[i] += (bits[t / 20] ? 1000 : -1000) + (s32)frand(-200, 200);
+    }
+  }
+  return SF_TOW * 6000 - LEAD_BITS * 20 + offset;
+}
+
+/* Checks that the block update matches nav_msg_update() over blocks of
+ * random length, and that the time of week is decoded. */
+static void check_block(u8 ms, u32 offset)
+{
+  static s32 corrs[N_MS];
+  nav_msg_t n_ref, n;
+  u32 n_corr = (N_MS - offset) / ms;
+  s32 t_0 = make_corrs(corrs, n_corr, ms, offset);
+  u32 n_tow = 0;
+
+  nav_msg_init(&n_ref);
+  nav_msg_init(&n);
+
+  for (u32 i = 0; i < n_corr; ) {
+    u32 len = 1 + sizerand(100);
+    len = MIN(n_corr - i, len);
+    s32 ref = TOW_INVALID;
+    for (u32 j = 0; j < len; j++) {
+      s32 TOW_ms = nav_msg_update(&n_ref, corrs[i + j], ms);
+      if (TOW_ms >= 0) {
+        fail_unless(TOW_ms == t_0 + (s32)((i + j + 1) * ms),
+                    "ms %u: decoded TOW %d, expected %d", ms, TOW_ms,
+                    t_0 + (i + j + 1) * ms);
+        ref = TOW_ms;
+        n_tow++;
+      } else if (ref >= 0) {
+        ref += ms;
+      } else if (TOW_ms != TOW_INVALID) {
+        ref = TOW_ms;
+      }
+    }
+
+    s32 TOW_ms = nav_msg_update_block(&n, len, &corrs[i], ms);
+    fail_unless(TOW_ms == ref, "ms %u: block returned %d, expected %d",
+                ms, TOW_ms, ref);
+    fail_unless(memcmp(&n, &n_ref, sizeof(n)) == 0,
+                "ms %u: state differs after correlation %u", ms, i + len);
+    i += len;
+  }
+
+  fail_unless(n.bit_phase_ref == (s8)((20 - offset % 20) % 20),
+              "ms %u: bit phase %d", ms, n.bit_phase_ref);
+  fail_unless(n_tow == 1, "ms %u: TOW decoded %u times", ms, n_tow);
+}
+
+START_TEST(test_nav_msg_update_block)
+{
+  seed_rng();
+  make_bits();
+  check_block(1, 0);
+  check_block(1, 7);
+  check_block(1, 13);
+}
+END_TEST
+
+START_TEST(test_nav_msg_update_multi_ms)
+{
+  static const u8 ms[] = {2, 4, 5, 10, 20};
+
+  seed_rng();
+  make_bits();
+  for (u8 i = 0; i < sizeof(ms); i++) {
+    check_block(ms[i], 0);
+    check_block(ms[i], ms[i] * sizerand(20 / ms[i]));
+  }
+}
+END_TEST
+
+START_TEST(test_nav_msg_update_batch)
+{
+  static s32 corrs[N_CHANNELS][N_MS];
+  static s32 batch[N_MS * N_CHANNELS];
+  nav_msg_t n_ref[N_CHANNELS], n[N_CHANNELS];
+  nav_msg_t *np[N_CHANNELS];
+  s32 TOW_ms[N_CHANNELS];
+  u32 n_corr = (N_MS - 20) / 2;
+
+  seed_rng();
+  make_bits();
+  for (u8 ch = 0; ch < N_CHANNELS; ch++) {
+    make_corrs(corrs[ch], n_corr, 2, 2 * ch);
+    for (u32 i = 0; i < n_corr; i++)
+      batch[i * N_CHANNELS + ch] = corrs[ch][i];
+    nav_msg_init(&n_ref[ch]);
+    nav_msg_init(&n[ch]);
+    np[ch] = &n[ch];
+    /* Start some channels at another bit phase. */
+    if (ch % 5 == 4) {
+      nav_msg_update(&n_ref[ch], 0, 2);
+      nav_msg_update(&n[ch], 0, 2);
+    }
+  }
+
+  for (u32 i = 0; i < n_corr; i += 50) {
+    u32 len = MIN(n_corr - i, 50);
+    nav_msg_update_batch(N_CHANNELS, np, len, &batch[i * N_CHANNELS], 2,
+                         TOW_ms);
+    for (u8 ch = 0; ch < N_CHANNELS; ch++) {
+      s32 ref = nav_msg_update_block(&n_ref[ch], len, &corrs[ch][i], 2);
+      fail_unless(TOW_ms[ch] == ref, "Channel %u returned %d, expected %d",
+                  ch, TOW_ms[ch], ref);
+      fail_unless(memcmp(&n[ch], &n_ref[ch], sizeof(nav_msg_t)) == 0,
+                  "Channel %u state differs", ch);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_nav_subframe_parity)
+{
+  u32 data[10], raw[10], words[10];
+
+  seed_rng();
+  for (u32 trial = 0; trial < 1000; trial++) {
+    u32 prev = rand();
+    u32 p = prev;
+    for (u8 i = 0; i < 10; i++) {
+      data[i] = rand() & 0xFFFFFF;
+      raw[i] = p = nav_word(data[i], p);
+    }
+
+    fail_unless(nav_subframe_parity(prev, raw, words) == 0);
+    for (u8 i = 0; i < 10; i++) {
+      fail_unless((words[i] >> 6 & 0xFFFFFF) == data[i],
+                  "Word %u data %06X, expected %06X",
+                  i + 1, words[i] >> 6 & 0xFFFFFF, data[i]);
+      fail_unless(words[i] >> 30 == ((i ? raw[i-1] : prev) & 3));
+    }
+
+    /* Any single bit error fails the word it hits. */
+    u8 w = rand() % 10;
+    u8 b = rand() % 30;
+    raw[w] ^= 1u << b;
+    u8 bad = nav_subframe_parity(prev, raw, words);
+    fail_unless(bad == w + 1, "Bit %u of word %u flipped, word %u failed",
+                29 - b, w + 1, bad);
+
+    /* An error in the previous word's D29 or D30 fails the first word. */
+    raw[w] ^= 1u << b;
+    fail_unless(nav_subframe_parity(prev ^ (1 + (trial & 1)), raw, words)
+                == 1);
+  }
+}
+END_TEST
+
+/* Subframe 1 stored at every position of the circular bit buffer, so that
+ * words wrap around, start at and end at the end of the buffer. Odd
+ * positions have the bits inverted. */
+START_TEST(test_process_subframe_wrap)
+{
+  const u16 buff_bits = NAV_MSG_SUBFRAME_BITS_LEN * 32;
+  u32 raw[10], words[10];
+  u32 prev = 0;
+
+  seed_rng();
+  for (u8 w = 0; w < 10; w++) {
+    u32 data = rand() & 0xFFFFFF;
+    if (w == 0)
+      data = 0x8B << 16;
+    else if (w == 1)
+      data = (SF_TOW + 1) << 7 | 1 << 2;
+    raw[w] = prev = nav_word(data, prev);
+  }
+  fail_unless(nav_subframe_parity(0, raw, words) == 0);
+
+  for (u16 start = 0; start < buff_bits; start++) {
+    nav_msg_t n;
+    ephemeris_t e;
+    u8 invert = start & 1;
+
+    nav_msg_init(&n);
+    for (u8 i = 0; i < NAV_MSG_SUBFRAME_BITS_LEN; i++)
+      n.subframe_bits[i] = rand();
+    for (u16 i = 0; i < 300; i++) {
+      u16 b = (start + i) % buff_bits;
+      u32 mask = 1u << (31 - b % 32);
+      if ((raw[i / 30] >> (29 - i % 30) & 1) ^ invert)
+        n.subframe_bits[b / 32] |= mask;
+      else
+        n.subframe_bits[b / 32] &= ~mask;
+    }
+    n.subframe_start_index = invert ? -(start + 1) : start + 1;
+
+    e.prn = 0;
+    s8 ret = process_subframe(&n, &e);
+    fail_unless(ret == 0, "Subframe at bit %u returned %d", start, ret);
+    fail_unless(memcmp(n.frame_words[0], &words[2],
+                       sizeof(n.frame_words[0])) == 0,
+                "Subframe at bit %u decoded wrongly", start);
+  }
+}
+END_TEST
+
+/* Put a field of `len` bits ending at data bit `last` (1-24) of a word. */
+static void put_field(u32 *data, u8 last, u8 len, s32 value)
+{
+  *data |= ((u32)value & ((1u << len) - 1)) << (24 - last);
+}
+
+/* Words 3 to 10 of subframe 5 with the almanac of SV 5. */
+static void make_almanac_page(u32 data[8])
+{
+  memset(data, 0, 8 * sizeof(u32));
+  put_field(&data[3-3], 2, 2, 1);
+  put_field(&data[3-3], 8, 6, 5);
+  put_field(&data[3-3], 24, 16, 0x1234);
+  put_field(&data[4-3], 8, 8, 0x93);
+  put_field(&data[4-3], 24, 16, -1000);
+  put_field(&data[5-3], 16, 16, -300);
+  put_field(&data[6-3], 24, 24, 10554675);
+  put_field(&data[7-3], 24, 24, -2000000);
+  put_field(&data[8-3], 24, 24, 1234567);
+  put_field(&data[9-3], 24, 24, -4000000);
+  put_field(&data[10-3], 8, 8, -500 >> 3);
+  put_field(&data[10-3], 19, 11, 100);
+  put_field(&data[10-3], 22, 3, -500);
+}
+
+/* Words 3 to 10 of subframe 4 page 18. */
+static void make_iono_utc_page(u32 data[8])
+{
+  memset(data, 0, 8 * sizeof(u32));
+  put_field(&data[3-3], 2, 2, 1);
+  put_field(&data[3-3], 8, 6, 56);
+  put_field(&data[3-3], 16, 8, -5);
+  put_field(&data[3-3], 24, 8, 3);
+  put_field(&data[4-3], 8, 8, -7);
+  put_field(&data[4-3], 16, 8, 9);
+  put_field(&data[4-3], 24, 8, 100);
+  put_field(&data[5-3], 8, 8, -20);
+  put_field(&data[5-3], 16, 8, 50);
+  put_field(&data[5-3], 24, 8, -60);
+  put_field(&data[6-3], 24, 24, -12345);
+  put_field(&data[7-3], 24, 24, -123456789 >> 8);
+  put_field(&data[8-3], 8, 8, -123456789);
+  put_field(&data[8-3], 16, 8, 77);
+  put_field(&data[8-3], 24, 8, 200);
+  put_field(&data[9-3], 8, 8, 18);
+  put_field(&data[9-3], 16, 8, 201);
+  put_field(&data[9-3], 24, 8, 7);
+  put_field(&data[10-3], 8, 8, 19);
+}
+
+static void check_almanac(const almanac_t *a, u16 week)
+{
+  fail_unless(a->valid && a->healthy);
+  fail_unless(a->prn == 4, "PRN %u", a->prn);
+  fail_unless(a->week == week, "Week %u, expected %u", a->week, week);
+  fail_unless(a->ecc == 0x1234 * pow(2, -21));
+  fail_unless(a->toa == 0x93 * 4096);
+  fail_unless(fabs(a->inc - (0.3 - 1000 * pow(2, -19)) * M_PI) < 1e-12);
+  fail_unless(fabs(a->rora + 300 * pow(2, -38) * M_PI) < 1e-20);
+  fail_unless(a->a == pow(10554675 * pow(2, -11), 2));
+  fail_unless(fabs(a->raaw + 2000000 * pow(2, -23) * M_PI) < 1e-12);
+  fail_unless(fabs(a->argp - 1234567 * pow(2, -23) * M_PI) < 1e-12);
+  fail_unless(fabs(a->ma + 4000000 * pow(2, -23) * M_PI) < 1e-12);
+  fail_unless(a->af0 == -500 * pow(2, -20), "af0 %g", a->af0);
+  fail_unless(a->af1 == 100 * pow(2, -38), "af1 %g", a->af1);
+}
+
+static void check_iono_utc(const ionosphere_t *i, const utc_params_t *u)
+{
+  fail_unless(i->valid && u->valid);
+  fail_unless(i->a0 == -5 * pow(2, -30) && i->a1 == 3 * pow(2, -27));
+  fail_unless(i->a2 == -7 * pow(2, -24) && i->a3 == 9 * pow(2, -24));
+  fail_unless(i->b0 == 100 * pow(2, 11) && i->b1 == -20 * pow(2, 14));
+  fail_unless(i->b2 == 50 * pow(2, 16) && i->b3 == -60 * pow(2, 16));
+  fail_unless(u->a1 == -12345 * pow(2, -50));
+  fail_unless(u->a0 == -123456789 * pow(2, -30), "A0 %g", u->a0);
+  fail_unless(u->tot == 77 * 4096 && u->wnt == 200);
+  fail_unless(u->dt_ls == 18 && u->wn_lsf == 201 && u->dn == 7);
+  fail_unless(u->dt_lsf == 19);
+}
+
+START_TEST(test_decode_pages)
+{
+  u32 data[8], words[8];
+  almanac_t a;
+  ionosphere_t iono;
+  utc_params_t utc;
+
+  make_almanac_page(data);
+  for (u8 i = 0; i < 8; i++)
+    words[i] = data[i] << 6;
+  fail_unless(decode_iono_utc(words, &iono, &utc) == -1);
+
+  /* The almanac week is that closest to the time of reception. */
+  gps_time_t t = {0x93 * 4096 - 1000, 1800};
+  fail_unless(decode_almanac(words, t, &a) == 0);
+  check_almanac(&a, 1800 % 1024);
+  t.tow = 1000;
+  fail_unless(decode_almanac(words, t, &a) == 0);
+  check_almanac(&a, 1799 % 1024);
+  t.tow = 0x93 * 4096 - 1000;
+  t.wn = 1024;
+  fail_unless(decode_almanac(words, t, &a) == 0);
+  check_almanac(&a, 0);
+
+  make_iono_utc_page(data);
+  for (u8 i = 0; i < 8; i++)
+    words[i] = data[i] << 6;
+  fail_unless(decode_almanac(words, t, &a) == -1);
+  fail_unless(decode_iono_utc(words, &iono, &utc) == 0);
+  check_iono_utc(&iono, &utc);
+}
+END_TEST
+
+START_TEST(test_process_page)
+{
+  static s32 corrs[N_MS];
+  u32 data[3][8];
+  nav_msg_t n;
+  almanac_t alm[32];
+  ionosphere_t iono;
+  utc_params_t utc;
+
+  /* Subframe 4 page 18, subframe 5 with an almanac, then subframe 1 whose
+   * preamble completes the subframe 5. */
+  seed_rng();
+  make_iono_utc_page(data[0]);
+  make_almanac_page(data[1]);
+  for (u8 w = 0; w < 8; w++)
+    data[2][w] = rand() & 0xFFFFFF;
+  for (u32 i = 0; i < N_BITS; i++)
+    bits[i] = rand() & 1;
+  u32 prev = 0;
+  for (u32 sf = 0; sf < 3; sf++) {
+    static const u8 sf_ids[3] = {4, 5, 1};
+    u32 raw[10];
+    raw[0] = prev = nav_word(0x8B << 16, prev);
+    raw[1] = prev = nav_word_zero_end((SF_TOW + sf + 1) << 7 | sf_ids[sf] << 2,
+                                      prev);
+    for (u8 w = 2; w < 10; w++)
+      raw[w] = prev = w < 9 ? nav_word(data[sf][w-2], prev)
+                            : nav_word_zero_end(data[sf][w-2], prev);
+    for (u32 i = 0; i < 300; i++)
+      bits[LEAD_BITS + sf * 300 + i] = raw[i / 30] >> (29 - i % 30) & 1;
+  }
+  make_corrs(corrs, N_MS, 1, 0);
+
+  memset(alm, 0, sizeof(alm));
+  memset(&iono, 0, sizeof(iono));
+  memset(&utc, 0, sizeof(utc));
+  nav_msg_init(&n);
+  fail_unless(process_page(&n, 1800, alm, &iono, &utc) == -1);
+
+  u8 n_pages = 0;
+  for (u32 i = 0; i < N_MS; i++) {
+    nav_msg_update(&n, corrs[i], 1);
+    if (!subframe_ready(&n))
+      continue;
+    ephemeris_t e;
+    e.prn = 4;
+    if (process_subframe(&n, &e) != 2)
+      continue;
+    s8 ret = process_page(&n, 1800, alm, &iono, &utc);
+    fail_unless(ret == 2 - n_pages, "Page %u returned %d", n_pages, ret);
+    fail_unless(process_page(&n, 1800, alm, &iono, &utc) == -1);
+    n_pages++;
+  }
+
+  fail_unless(n_pages == 2, "Processed %u pages", n_pages);
+  check_iono_utc(&iono, &utc);
+  /* Received at the start of week 1800, applicable at the end of 1799. */
+  check_almanac(&alm[4], 1799 % 1024);
+}
+END_TEST
+
+Suite* nav_msg_suite(void)
+{
+  Suite *s = suite_create("Nav message");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_nav_msg_update_block);
+  tcase_add_test(tc_core, test_nav_msg_update_multi_ms);
+  tcase_add_test(tc_core, test_nav_msg_update_batch);
+  tcase_add_test(tc_core, test_nav_subframe_parity);
+  tcase_add_test(tc_core, test_process_subframe_wrap);
+  tcase_add_test(tc_core, test_decode_pages);
+  tcase_add_test(tc_core, test_process_page);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,212 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nav_replay.h>
+
+#include "check_utils.h"
+
+/* Random bits before and after the frames. */
+#define LEAD_BITS 150
+#define TAIL_BITS 100
+#define N_FRAMES 3
+#define N_BITS (LEAD_BITS + N_FRAMES * 1500 + TAIL_BITS)
+#define N_SATS 3
+/* TOW count of the first subframe. */
+#define TOW_COUNT 1000
+
+static const u8 prns[N_SATS] = {3, 17, 31};
+static u8 bits[N_SATS][N_BITS];
+static u8 packed[N_SATS][(N_BITS + 7) / 8];
+/* Frames 0 and 1 broadcast ephemeris 0, frame 2 ephemeris 1. */
+static ephemeris_t ephs[N_SATS][2];
+
+static ephemeris_t decoded[2 * N_SATS];
+static u32 n_decoded;
+
+static void eph_callback(const ephemeris_t *e, void *context)
+{
+  fail_unless(context == &n_decoded);
+  fail_unless(n_decoded < 2 * N_SATS);
+  decoded[n_decoded++] = *e;
+}
+
+/* Encode subframes 1 to 5 of each frame with random data, except for the
+ * matching issues of data of subframes 1 to 3. Satellite 1 has its bits
+ * inverted. */
+static void make_bits(void)
+{
+  for (u8 s = 0; s < N_SATS; s++) {
+    u32 data[2][3][8];
+    for (u8 k = 0; k < 2; k++) {
+      u32 iode = rand() & 0xFF;
+      for (u8 sf = 0; sf < 3; sf++)
+        for (u8 w = 0; w < 8; w++)
+          data[k][sf][w] = rand() & 0xFFFFFF;
+      data[k][0][8-3] = (data[k][0][8-3] & 0xFFFF) | iode << 16;
+      data[k][1][3-3] = (data[k][1][3-3] & 0xFFFF) | iode << 16;
+      data[k][2][10-3] = (data[k][2][10-3] & 0xFFFF) | iode << 16;
+    }
+
+    for (u32 i = 0; i < N_BITS; i++)
+      bits[s][i] = rand() & 1;
+
+    u32 prev = 0;
+    for (u32 f = 0; f < N_FRAMES; f++) {
+      u8 k = f < 2 ? 0 : 1;
+      for (u32 sf = 0; sf < 5; sf++) {
+        u32 raw[10];
+        raw[0] = prev = nav_word(0x8B << 16 | (rand() & 0xFFFF), prev);
+        raw[1] = prev = nav_word_zero_end(
+          (TOW_COUNT + f * 5 + sf + 1) << 7 | (sf + 1) << 2, prev);
+        for (u8 w = 2; w < 10; w++) {
+          u32 d = sf < 3 ? data[k][sf][w-2] : (u32)rand();
+          raw[w] = prev = w < 9 ? nav_word(d, prev)
+                                : nav_word_zero_end(d, prev);
+        }
+        u8* b = &bits[s][LEAD_BITS + (f * 5 + sf) * 300];
+        for (u32 i = 0; i < 300; i++)
+          b[i] = (raw[i / 30] >> (29 - i % 30) & 1) ^ (s == 1);
+      }
+    }
+
+    /* The ephemerides decoded from the parity checked words. */
+    for (u8 k = 0; k < 2; k++) {
+      u32 frame_words[3][8];
+      prev = 0;
+      for (u8 sf = 0; sf < 3; sf++) {
+        u32 raw[10], words[10];
+        for (u8 w = 0; w < 10; w++) {
+          raw[w] = 0;
+          for (u8 i = 0; i < 30; i++)
+            raw[w] = raw[w] << 1 |
+              (bits[s][LEAD_BITS + (2 * k * 5 + sf) * 300 + w * 30 + i]
+               ^ (s == 1));
+        }
+        fail_unless(nav_subframe_parity(prev, raw, words) == 0);
+        memcpy(frame_words[sf], &words[2], sizeof(frame_words[sf]));
+        prev = raw[9];
+      }
+      decode_ephemeris(frame_words, &ephs[s][k]);
+      ephs[s][k].prn = prns[s];
+    }
+
+    memset(packed[s], 0, sizeof(packed[s]));
+    for (u32 i = 0; i < N_BITS; i++)
+      packed[s][i / 8] |= bits[s][i] << (7 - i % 8);
+  }
+}
+
+/* Check satellite `s` gave ephemeris 0 and then 1. */
+static void check_decoded(u8 s)
+{
+  u8 n = 0;
+  for (u32 i = 0; i < n_decoded; i++) {
+    if (decoded[i].prn != prns[s])
+      continue;
+    fail_unless(n < 2, "PRN %u decoded too many times", prns[s]);
+    fail_unless(ephemeris_equal(&decoded[i], &ephs[s][n]),
+                "PRN %u ephemeris %u wrong", prns[s], n);
+    n++;
+  }
+  fail_unless(n == 2, "PRN %u decoded %u ephemerides", prns[s], n);
+}
+
+START_TEST(test_nav_replay_bits)
+{
+  nav_replay_t r;
+
+  seed_rng();
+  make_bits();
+  /* A bit error in the first frame of satellite 0 loses that ephemeris. */
+  packed[0][(LEAD_BITS + 300 + 100) / 8] ^= 0x10;
+
+  n_decoded = 0;
+  nav_replay_init(&r, eph_callback, &n_decoded);
+  fail_unless(nav_replay_bits(&r, NAV_REPLAY_MAX_SATS, packed[0], 8) == -1);
+
+  /* Satellite 0 is fed in whole bytes, the others in pieces of any number
+   * of bits, taking turns. */
+  u32 pos[N_SATS] = {0};
+  bool done = false;
+  while (!done) {
+    done = true;
+    for (u8 s = 0; s < N_SATS; s++) {
+      if (pos[s] == N_BITS)
+        continue;
+      done = false;
+      u32 n = s ? sizerand(500) : 8 * sizerand(100);
+      n = MIN(N_BITS - pos[s], n);
+      /* Copy so that the piece starts at the start of a byte. */
+      u8 piece[1000];
+      memset(piece, 0, sizeof(piece));
+      for (u32 i = 0; i < n; i++)
+        piece[i / 8] |= bits[s][pos[s] + i] << (7 - i % 8);
+      if (s == 0)
+        memcpy(piece, &packed[0][pos[0] / 8], n / 8);
+      fail_unless(nav_replay_bits(&r, prns[s], piece, n) == 0);
+      pos[s] += n;
+    }
+  }
+
+  for (u8 s = 0; s < N_SATS; s++)
+    check_decoded(s);
+  fail_unless(r.stats.n_bits == N_SATS * N_BITS);
+  fail_unless(r.stats.n_subframes == N_SATS * N_FRAMES * 5 - 1,
+              "Found %u subframes", r.stats.n_subframes);
+  fail_unless(r.stats.n_ephemerides == N_SATS * N_FRAMES - 1,
+              "Decoded %u ephemerides", r.stats.n_ephemerides);
+  fail_unless(r.stats.n_unique == 2 * N_SATS);
+  fail_unless(r.stats.n_iode_mismatch == 0);
+  fail_unless(nav_replay_throughput(&r) > 0);
+}
+END_TEST
+
+START_TEST(test_nav_replay_corrs)
+{
+  static nav_replay_t r;
+  static s32 corrs[N_BITS * 20 * N_SATS];
+
+  seed_rng();
+  make_bits();
+  for (u32 i = 0; i < N_BITS * 20; i++)
+    for (u8 s = 0; s < N_SATS; s++)
+      corrs[i * N_SATS + s] = (bits[s][i / 20] ? 1000 : -1000)
+                              + (s32)frand(-200, 200);
+
+  n_decoded = 0;
+  nav_replay_init(&r, eph_callback, &n_decoded);
+  fail_unless(nav_replay_corrs(&r, N_SATS, prns, 1, corrs, 3) == -1);
+
+  for (u32 i = 0; i < N_BITS * 20; ) {
+    u32 n = sizerand(3000);
+    n = MIN(N_BITS * 20 - i, n);
+    fail_unless(nav_replay_corrs(&r, N_SATS, prns, n, &corrs[i * N_SATS], 1)
+                == 0);
+    i += n;
+  }
+
+  for (u8 s = 0; s < N_SATS; s++)
+    check_decoded(s);
+  fail_unless(r.stats.n_corrs == N_SATS * N_BITS * 20);
+  /* The nav message decoder needs the preamble of the following subframe,
+   * so misses the last one. */
+  fail_unless(r.stats.n_subframes == N_SATS * (N_FRAMES * 5 - 1),
+              "Found %u subframes", r.stats.n_subframes);
+  fail_unless(r.stats.n_ephemerides == N_SATS * N_FRAMES,
+              "Decoded %u ephemerides", r.stats.n_ephemerides);
+  fail_unless(r.stats.n_unique == 2 * N_SATS);
+}
+END_TEST
+
+Suite* nav_replay_suite(void)
+{
+  Suite *s = suite_create("Nav replay");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_nav_replay_bits);
+  tcase_add_test(tc_core, test_nav_replay_corrs);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,171 @@
+#include <check.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <queue.h>
+
+#define N_MSGS 200000
+#define N_PRODUCERS 4
+
+typedef struct {
+  u32 id;
+  u32 count;
+} msg_t;
+
+START_TEST(test_spsc_queue)
+{
+  spsc_queue_t q;
+  msg_t buff[8];
+  msg_t m;
+
+  fail_unless(spsc_queue_init(&q, buff, sizeof(msg_t), 6) == -1);
+  fail_unless(spsc_queue_init(&q, buff, sizeof(msg_t), 8) == 0);
+  fail_unless(spsc_queue_pop(&q, &m) == -1);
+
+  /* Run the indices around the storage a few times, filling the queue
+   * to a different level each lap. */
+  u32 pushed = 0, popped = 0;
+  for (u32 lap = 0; lap < 20; lap++) {
+    u32 n = 1 + lap % 8;
+    for (u32 i = 0; i < n; i++) {
+      m.id = 0;
+      m.count = pushed++;
+      fail_unless(spsc_queue_push(&q, &m) == 0);
+    }
+    fail_unless(spsc_queue_count(&q) == n);
+    if (n == 8) {
+      fail_unless(spsc_queue_push(&q, &m) == -1, "Pushed to a full queue");
+    }
+    for (u32 i = 0; i < n; i++) {
+      fail_unless(spsc_queue_pop(&q, &m) == 0);
+      fail_unless(m.count == popped++, "Popped %u, expected %u",
+                  m.count, popped - 1);
+    }
+    fail_unless(spsc_queue_pop(&q, &m) == -1);
+  }
+}
+END_TEST
+
+START_TEST(test_mpsc_queue)
+{
+  mpsc_queue_t q;
+  u8 buff[8 * MPSC_QUEUE_SLOT_SIZE(sizeof(msg_t))]
+    __attribute__((aligned(8)));
+  msg_t m;
+
+  fail_unless(mpsc_queue_init(&q, buff, sizeof(msg_t), 0) == -1);
+  fail_unless(mpsc_queue_init(&q, buff, sizeof(msg_t), 8) == 0);
+  fail_unless(mpsc_queue_pop(&q, &m) == -1);
+
+  u32 pushed = 0, popped = 0;
+  for (u32 lap = 0; lap < 20; lap++) {
+    u32 n = 1 + lap % 8;
+    for (u32 i = 0; i < n; i++) {
+      m.id = 0;
+      m.count = pushed++;
+      fail_unless(mpsc_queue_push(&q, &m) == 0);
+    }
+    if (n == 8) {
+      fail_unless(mpsc_queue_push(&q, &m) == -1, "Pushed to a full queue");
+    }
+    for (u32 i = 0; i < n; i++) {
+      fail_unless(mpsc_queue_pop(&q, &m) == 0);
+      fail_unless(m.count == popped++, "Popped %u, expected %u",
+                  m.count, popped - 1);
+    }
+    fail_unless(mpsc_queue_pop(&q, &m) == -1);
+  }
+}
+END_TEST
+
+static spsc_queue_t spsc_q;
+static msg_t spsc_buff[64];
+
+static void* spsc_producer(void* arg)
+{
+  (void)arg;
+  for (u32 i = 0; i < N_MSGS; i++) {
+    msg_t m = {0, i};
+    while (spsc_queue_push(&spsc_q, &m))
+      sched_yield();
+  }
+  return 0;
+}
+
+START_TEST(test_spsc_queue_threads)
+{
+  pthread_t producer;
+  msg_t m;
+
+  spsc_queue_init(&spsc_q, spsc_buff, sizeof(msg_t), 64);
+  fail_unless(pthread_create(&producer, 0, spsc_producer, 0) == 0);
+
+  for (u32 i = 0; i < N_MSGS; i++) {
+    while (spsc_queue_pop(&spsc_q, &m))
+      sched_yield();
+    fail_unless(m.count == i, "Popped %u, expected %u", m.count, i);
+  }
+
+  pthread_join(producer, 0);
+  fail_unless(spsc_queue_pop(&spsc_q, &m) == -1);
+}
+END_TEST
+
+static mpsc_queue_t mpsc_q;
+static u8 mpsc_buff[64 * MPSC_QUEUE_SLOT_SIZE(sizeof(msg_t))]
+  __attribute__((aligned(8)));
+
+static void* mpsc_producer(void* arg)
+{
+  u32 id = *(u32*)arg;
+  for (u32 i = 0; i < N_MSGS / N_PRODUCERS; i++) {
+    msg_t m = {id, i};
+    while (mpsc_queue_push(&mpsc_q, &m))
+      sched_yield();
+  }
+  return 0;
+}
+
+START_TEST(test_mpsc_queue_threads)
+{
+  pthread_t producers[N_PRODUCERS];
+  u32 ids[N_PRODUCERS];
+  u32 next[N_PRODUCERS] = {0};
+  msg_t m;
+
+  mpsc_queue_init(&mpsc_q, mpsc_buff, sizeof(msg_t), 64);
+  for (u32 i = 0; i < N_PRODUCERS; i++) {
+    ids[i] = i;
+    fail_unless(pthread_create(&producers[i], 0, mpsc_producer, &ids[i])
+                == 0);
+  }
+
+  /* Each producer's messages arrive complete and in order. */
+  for (u32 i = 0; i < N_PRODUCERS * (N_MSGS / N_PRODUCERS); i++) {
+    while (mpsc_queue_pop(&mpsc_q, &m))
+      sched_yield();
+    fail_unless(m.id < N_PRODUCERS);
+    fail_unless(m.count == next[m.id], "Producer %u sent %u, expected %u",
+                m.id, m.count, next[m.id]);
+    next[m.id]++;
+  }
+
+  for (u32 i = 0; i < N_PRODUCERS; i++)
+    pthread_join(producers[i], 0);
+  fail_unless(mpsc_queue_pop(&mpsc_q, &m) == -1);
+}
+END_TEST
+
+Suite* queue_suite(void)
+{
+  Suite *s = suite_create("Queues");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_spsc_queue);
+  tcase_add_test(tc_core, test_mpsc_queue);
+  tcase_add_test(tc_core, test_spsc_queue_threads);
+  tcase_add_test(tc_core, test_mpsc_queue_threads);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,141 @@
+#include <check.h>
+#include <math.h>
+
+#include <constants.h>
+#include <prns.h>
+#include <reacq.h>
+#include <track.h>
+
+#include "check_utils.h"
+
+#define SAMPLE_FREQ 16.368e6
+#define IF_FREQ 4.092e6
+#define N_SAMPLES 100000
+
+static s8 samples[N_SAMPLES];
+
+/* Generate a real IF signal with the given code phase and Doppler plus some
+ * uniform noise, with a data bit transition after 3 ms. */
+static void gen_signal(u8 prn, double code_phase, double doppler, double amp)
+{
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+  u8 *ca = (u8 *)ca_code(prn);
+
+  seed_rng();
+  for (u32 i = 0; i < N_SAMPLES; i++) {
+    double cp = code_phase + i*code_step;
+    s8 bit = cp < 3*1023 ? 1 : -1;
+    u32 chip = (u32)cp % 1023;
+    double x = amp*bit*get_chip(ca, chip)*sin(1.1 + i*carr_step)
+               + frand(-30, 30);
+    samples[i] = (s8)lround(x);
+  }
+}
+
+START_TEST(test_reacq_predict)
+{
+  channel_measurement_t meas = {
+    .prn = 4,
+    .code_phase_chips = 1000,
+    .code_phase_rate = GPS_CA_CHIPPING_RATE + 1.5,
+    .carrier_freq = 1.5 * GPS_L1_HZ / GPS_CA_CHIPPING_RATE,
+    .receiver_time = 10,
+  };
+  double cp, cf;
+
+  /* 2.5 s at 1.5 chips/s above the nominal rate, whole periods drop out. */
+  reacq_predict(&meas, 0, 12.5, &cp, &cf);
+  fail_unless(fabs(cp - fmod(1000 + 2.5*1.5, 1023)) < 1e-6,
+              "Code phase %f", cp);
+  fail_unless(fabs(cf - meas.carrier_freq) < 1e-9);
+
+  /* Constant Doppler rate. */
+  reacq_predict(&meas, 10, 12, &cp, &cf);
+  double dcp = 1000 + 2*1.5 + 0.5*10*4*GPS_CA_CHIPPING_RATE/GPS_L1_HZ;
+  fail_unless(fabs(cp - dcp) < 1e-6, "Code phase %f, expected %f", cp, dcp);
+  fail_unless(fabs(cf - (meas.carrier_freq + 20)) < 1e-9);
+
+  double cw, fw;
+  reacq_window(2, 50, 5, &cw, &fw);
+  fail_unless(fabs(fw - 60) < 1e-9);
+  fail_unless(fabs(cw - (0.5 + 110*GPS_CA_CHIPPING_RATE/GPS_L1_HZ)) < 1e-9);
+}
+END_TEST
+
+START_TEST(test_reacq_search)
+{
+  reacq_result_t r;
+
+  gen_signal(7, 612.3, 2345, 5);
+
+  /* Prediction off by 1.3 chips and 180 Hz. */
+  fail_unless(reacq_search(samples, N_SAMPLES, SAMPLE_FREQ, IF_FREQ, 7,
+                           613.6, 2165, 2, 400, 250, 5, &r) == 0);
+  fail_unless(fabs(r.code_phase - 612.3) < 0.1,
+              "Code phase %f, expected 612.3", r.code_phase);
+  fail_unless(fabs(r.carr_freq - 2345) < 20,
+              "Doppler %f, expected 2345", r.carr_freq);
+  fail_unless(fabs(r.code_freq - r.carr_freq / 1540) < 1e-9);
+  fail_unless(r.snr > 10, "SNR %f too low", r.snr);
+
+  /* Wider window than 16 taps, signal near the wrap. */
+  gen_signal(7, 1022.8, -800, 5);
+  fail_unless(reacq_search(samples, N_SAMPLES, SAMPLE_FREQ, IF_FREQ, 7,
+                           3.0, -700, 6, 250, 250, 5, &r) == 0);
+  double dcp = fabs(r.code_phase - 1022.8);
+  fail_unless(dcp < 0.1 || dcp > 1022.9,
+              "Code phase %f, expected 1022.8", r.code_phase);
+  fail_unless(fabs(r.carr_freq + 800) < 20,
+              "Doppler %f, expected -800", r.carr_freq);
+
+  /* Absent PRN. */
+  fail_unless(reacq_search(samples, N_SAMPLES, SAMPLE_FREQ, IF_FREQ, 8,
+                           3.0, -700, 6, 250, 250, 5, &r) == 0);
+  fail_unless(r.snr < 5, "SNR %f too high", r.snr);
+
+  /* Not enough samples. */
+  fail_unless(reacq_search(samples, 5*16368, SAMPLE_FREQ, IF_FREQ, 7,
+                           3.0, -700, 6, 250, 250, 5, &r) == -1);
+  fail_unless(reacq_search(samples, N_SAMPLES, SAMPLE_FREQ, IF_FREQ, 7,
+                           3.0, -700, 6, 250, 250, 0, &r) == -1);
+}
+END_TEST
+
+START_TEST(test_reacq_tl_restore)
+{
+  aided_tl_state_t s, ref;
+  reacq_result_t r = {.code_phase = 3, .carr_freq = 1200,
+                      .code_freq = 1200 / 1540.0, .snr = 100};
+
+  aided_tl_init(&s, 1000, 0.2, 1, 0.7, 1, 1540, 1000, 25, 0.7, 1, 5);
+  s.code_filt.y = 0.1;
+  s.carr_filt.prev_error = 0.3;
+  s.prev_I = -20;
+  reacq_tl_restore(&s, &r);
+
+  aided_tl_init(&ref, 1000, 0.2, 1, 0.7, 1, 1540, 1200, 25, 0.7, 1, 5);
+  fail_unless(s.carr_freq == 1200 && s.carr_filt.y == 1200);
+  fail_unless(s.carr_filt.prev_error == 0 && s.prev_I == 1 && s.prev_Q == 0);
+  fail_unless(s.carr_filt.b0 == ref.carr_filt.b0 &&
+              s.carr_filt.b1 == ref.carr_filt.b1 &&
+              s.code_filt.b0 == ref.code_filt.b0);
+  fail_unless(s.code_filt.y == 0.1f);
+  fail_unless(fabs(s.code_freq - (0.1 + 1200 / 1540.0)) < 1e-5,
+              "Code freq %f", s.code_freq);
+}
+END_TEST
+
+Suite* reacq_suite(void)
+{
+  Suite *s = suite_create("Reacquisition");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_reacq_predict);
+  tcase_add_test(tc_core, test_reacq_search);
+  tcase_add_test(tc_core, test_reacq_tl_restore);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
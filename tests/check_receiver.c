@@ -0,0 +1,227 @@
+#include <check.h>
+#include <math.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <constants.h>
+#include <coord_system.h>
+#include <linear_algebra.h>
+#include <prns.h>
+#include <receiver.h>
+
+#include "check_utils.h"
+
+#define SAMPLE_FREQ 2.048e6
+#define IF_FREQ 512e3
+#define CHUNK_LEN 2048
+#define RING_LEN (64 * CHUNK_LEN)
+#define N_SATS 6
+#define RUN_MS 10000
+#define N_SUBFRAMES 3
+
+/* Receiver clock time of sample zero as GPS time, about 2 s before a
+ * subframe starts so that bit sync is done by the first preamble. */
+#define WN 1800
+#define TOW_0 (6 * 60000 - 1.9)
+/* Transmit time of the first simulated subframe. */
+#define SF_0 (6 * 59999)
+
+static receiver_t rx;
+static s8 ring_buff[RING_LEN];
+static s8 chunk[CHUNK_LEN];
+
+static const double rx_llh[3] = {37.77 * D2R, -122.42 * D2R, 20};
+static double rx_ecef[3];
+
+static ephemeris_t ephs[N_SATS];
+static s8 codes[N_SATS][CA_CODE_UNPACKED_LEN];
+static u8 nav_bits[N_SATS][N_SUBFRAMES * 300];
+/* Range of each satellite at each ms boundary of receiver time. */
+static double ranges[N_SATS][RUN_MS + 1];
+
+/* Geometric range from a satellite to the receiver at a GPS time of
+ * reception, including the Earth's rotation during the time of flight. */
+static double sat_range(const ephemeris_t* e, double tow)
+{
+  double tau = 0.07;
+  for (u8 i = 0; i < 4; i++) {
+    gps_time_t t = {tow - tau, WN};
+    double pos[3], vel[3], clock_err, clock_rate_err;
+    calc_sat_state(e, t, pos, vel, &clock_err, &clock_rate_err);
+    double wt = GPS_OMEGAE_DOT * tau;
+    double p[3] = {pos[0] + wt * pos[1], pos[1] - wt * pos[0], pos[2]};
+    double d[3];
+    vector_subtract(3, p, rx_ecef, d);
+    tau = vector_norm(3, d) / GPS_C;
+  }
+  return tau * GPS_C;
+}
+
+/* Circular orbits in six planes, taking the first satellites well above
+ * the horizon. */
+static void make_constellation(void)
+{
+  u8 n = 0;
+  for (u8 plane = 0; plane < 6 && n < N_SATS; plane++) {
+    for (u8 slot = 0; slot < 8 && n < N_SATS; slot++) {
+      ephemeris_t* e = &ephs[n];
+      memset(e, 0, sizeof(*e));
+      e->sqrta = 5153.7;
+      e->inc = 55 * D2R;
+      e->omega0 = plane * M_PI / 3;
+      e->m0 = slot * M_PI / 4 + plane * 0.4;
+      e->toe.tow = e->toc.tow = 6 * 60000;
+      e->toe.wn = e->toc.wn = WN;
+      e->valid = 1;
+      e->healthy = 1;
+      e->prn = 3 * n + 1;
+
+      gps_time_t t = {TOW_0, WN};
+      double pos[3], vel[3], clock_err, clock_rate_err, az, el;
+      calc_sat_state(e, t, pos, vel, &clock_err, &clock_rate_err);
+      wgsecef2azel(pos, rx_ecef, &az, &el);
+      if (el > 20 * D2R)
+        n++;
+    }
+  }
+}
+
+/* Subframes with the right preamble and time of week and random data. */
+static void make_nav_bits(u8 s)
+{
+  u32 prev = 0;
+  for (u32 sf = 0; sf < N_SUBFRAMES; sf++) {
+    u32 tow_count = SF_0 / 6 + sf + 1;
+    u32 sf_id = 1 + (SF_0 / 6 + sf) % 5;
+    u32 words[10];
+    words[0] = prev = nav_word(0x8B << 16, prev);
+    words[1] = prev = nav_word_zero_end(tow_count << 7 | sf_id << 2, prev);
+    for (u8 w = 2; w < 9; w++)
+      words[w] = prev = nav_word(rand(), prev);
+    words[9] = prev = nav_word_zero_end(rand(), prev);
+    for (u32 i = 0; i < 300; i++)
+      nav_bits[s][sf * 300 + i] = words[i / 30] >> (29 - i % 30) & 1;
+  }
+}
+
+/* Generate one ms of signal of all satellites plus noise. The code and
+ * carrier phases are linear over the ms. */
+static void gen_chunk(u32 ms)
+{
+  double x[CHUNK_LEN];
+  for (u32 i = 0; i < CHUNK_LEN; i++)
+    x[i] = frand(-30, 30);
+
+  for (u8 s = 0; s < N_SATS; s++) {
+    double t0 = ms * 1e-3, t1 = t0 + 1e-3;
+    double tt0 = TOW_0 + t0 - ranges[s][ms] / GPS_C - SF_0;
+    double tt1 = TOW_0 + t1 - ranges[s][ms + 1] / GPS_C - SF_0;
+    double chips = tt0 * GPS_CA_CHIPPING_RATE;
+    double chip_step = (tt1 - tt0) * GPS_CA_CHIPPING_RATE / CHUNK_LEN;
+    double ph0 = IF_FREQ * t0 - GPS_L1_HZ * ranges[s][ms] / GPS_C;
+    double ph1 = IF_FREQ * t1 - GPS_L1_HZ * ranges[s][ms + 1] / GPS_C;
+    double dp = 2*M_PI * (ph1 - ph0) / CHUNK_LEN;
+    double c = cos(2*M_PI * (ph0 - floor(ph0)));
+    double sn = sin(2*M_PI * (ph0 - floor(ph0)));
+    double cd = cos(dp), sd = sin(dp);
+
+    for (u32 i = 0; i < CHUNK_LEN; i++) {
+      u64 chip = (u64)(chips + i * chip_step);
+      u32 bit = nav_bits[s][chip / 1023 / 20];
+      double v = codes[s][chip % 1023 + 1] * (bit ? 5 : -5);
+      x[i] += v * sn;
+      double c_next = c * cd - sn * sd;
+      sn = sn * cd + c * sd;
+      c = c_next;
+    }
+  }
+
+  for (u32 i = 0; i < CHUNK_LEN; i++)
+    chunk[i] = (s8)lround(x[i]);
+}
+
+START_TEST(test_receiver)
+{
+  seed_rng();
+  wgsllh2ecef(rx_llh, rx_ecef);
+  make_constellation();
+  for (u8 s = 0; s < N_SATS; s++) {
+    ca_code_unpack(ephs[s].prn, codes[s]);
+    make_nav_bits(s);
+    for (u32 ms = 0; ms <= RUN_MS; ms++)
+      ranges[s][ms] = sat_range(&ephs[s], TOW_0 + ms * 1e-3);
+  }
+
+  fail_unless(receiver_init(&rx, ring_buff, RING_LEN, SAMPLE_FREQ, IF_FREQ,
+                            N_SATS + 1, 2, 0, 0.1) == 0);
+  fail_unless(receiver_start_channel(&rx, N_SATS + 1, 0, 0, 0, 0) == -1);
+
+  /* Start from an acquisition result and the broadcast ephemerides. */
+  for (u8 s = 0; s < N_SATS; s++) {
+    double tt = TOW_0 - ranges[s][0] / GPS_C;
+    double cp = fmod(tt * GPS_CA_CHIPPING_RATE, 1023);
+    double dop = -(ranges[s][1] - ranges[s][0]) / 1e-3 / GPS_L1_LAMBDA;
+    fail_unless(receiver_start_channel(&rx, s, ephs[s].prn, 0,
+                                       fmod(cp + 0.1, 1023), dop - 30) == 0);
+    fail_unless(receiver_set_ephemeris(&rx, &ephs[s]) == 0);
+  }
+
+  receiver_fix_t fixes[RUN_MS / 100];
+  u32 n_fixes = 0;
+  receiver_fix_t fix;
+
+  for (u32 ms = 0; ms < RUN_MS; ms++) {
+    gen_chunk(ms);
+    while (receiver_ingest(&rx, chunk, CHUNK_LEN))
+      sched_yield();
+    while (!receiver_get_fix(&rx, &fix))
+      fixes[n_fixes++] = fix;
+  }
+
+  /* Wait for the last epoch to be solved. */
+  double last = (RUN_MS / 100 - 1) * 0.1;
+  while (n_fixes == 0 || fixes[n_fixes - 1].receiver_time < last - 1e-6) {
+    if (!receiver_get_fix(&rx, &fix))
+      fixes[n_fixes++] = fix;
+    else
+      sched_yield();
+  }
+  receiver_destroy(&rx);
+
+  /* Bit sync, then two preambles six seconds apart are needed for the time
+   * of week, so only the last second or so gives fixes. */
+  fail_unless(n_fixes >= 3, "Only %u fixes", n_fixes);
+  fail_unless(rx.fixes_dropped == 0);
+  for (u32 i = 0; i < n_fixes; i++) {
+    /* gnss_solution is packed, copy out the vectors before taking their
+     * address. */
+    double pos[3], vel[3], err[3];
+    memcpy(pos, fixes[i].soln.pos_ecef, sizeof(pos));
+    memcpy(vel, fixes[i].soln.vel_ecef, sizeof(vel));
+    vector_subtract(3, pos, rx_ecef, err);
+    fail_unless(vector_norm(3, err) < 30, "Fix %u position error %f m",
+                i, vector_norm(3, err));
+    fail_unless(vector_norm(3, vel) < 5, "Fix %u velocity %f m/s", i,
+                vector_norm(3, vel));
+    fail_unless(fixes[i].soln.n_used == N_SATS);
+    fail_unless(fixes[i].latency > 0 && fixes[i].latency < 1,
+                "Fix %u latency %f s", i, fixes[i].latency);
+    if (i > 0) {
+      fail_unless(fabs(fixes[i].receiver_time - fixes[i-1].receiver_time
+                       - 0.1) < 1e-6);
+    }
+  }
+}
+END_TEST
+
+Suite* receiver_suite(void)
+{
+  Suite *s = suite_create("Receiver");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_receiver);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,168 @@
+#include <check.h>
+#include <math.h>
+
+#include <constants.h>
+#include <correlate.h>
+#include <prns.h>
+#include <resample.h>
+
+#include "check_utils.h"
+
+#define FS_IN 26e6
+#define FS_OUT 16.368e6
+#define N_IN 40000
+
+static s8 in[N_IN];
+static s8 out[N_IN];
+static s8 out2[N_IN];
+
+START_TEST(test_resample_tone)
+{
+  static resampler_t r;
+  double f = 1.3e6;
+
+  for (u32 i = 0; i < N_IN; i++)
+    in[i] = (s8)lround(100*sin(2*M_PI*f*i/FS_IN));
+
+  fail_unless(resampler_init(&r, FS_IN, FS_OUT, 0) == 0);
+  u32 n = resampler_process(&r, in, N_IN, out);
+
+  double expected_n = (N_IN - r.n_taps + 1) * FS_OUT / FS_IN;
+  fail_unless(fabs(n - expected_n) < 2, "Expected %f outputs, got %u",
+              expected_n, n);
+  fail_unless(n <= resampler_max_out(&r, N_IN));
+
+  for (u32 k = 0; k < n; k++) {
+    double t = k * FS_IN / FS_OUT + r.delay;
+    double y = 100*sin(2*M_PI*f*t/FS_IN);
+    fail_unless(fabs(out[k] - y) < 3,
+                "Output %u is %d, expected %f", k, out[k], y);
+  }
+}
+END_TEST
+
+START_TEST(test_resample_alias)
+{
+  static resampler_t r;
+  /* Output rates for decimation ratios from 1.59 up to the largest. */
+  double fs_outs[3] = {FS_OUT, FS_IN / 4, FS_IN / RESAMPLE_MAX_RATIO};
+  /* Tones above the output Nyquist frequency, as fractions of the output
+   * rate, from the stopband edge up to the input Nyquist frequency. */
+  double tones[3] = {0.56, 0.7, 0.0};
+
+  for (u8 i = 0; i < 3; i++) {
+    double fs_out = fs_outs[i];
+    tones[2] = 0.49 * FS_IN / fs_out;
+
+    for (u8 j = 0; j < 3; j++) {
+      double f = tones[j] * fs_out;
+      for (u32 k = 0; k < N_IN; k++)
+        in[k] = (s8)lround(100*sin(2*M_PI*f*k/FS_IN));
+
+      /* Amplify the output so that the attenuated tone is well above the
+       * output quantisation. */
+      fail_unless(resampler_init(&r, FS_IN, fs_out, 5) == 0);
+      u32 n = resampler_process(&r, in, N_IN, out);
+
+      /* Measure the amplitude of the alias in the output band. */
+      double f_alias = fabs(f - fs_out * round(f / fs_out));
+      double I = 0, Q = 0;
+      for (u32 k = 0; k < n; k++) {
+        I += out[k] * cos(2*M_PI*f_alias*k/fs_out);
+        Q += out[k] * sin(2*M_PI*f_alias*k/fs_out);
+      }
+      double A = 2*sqrt(I*I + Q*Q) / n;
+      double atten = 20*log10(A / (100 << 5));
+      fail_unless(atten < -45,
+                  "Tone at %.3f fs_out with fs_in / fs_out = %.2f is only "
+                  "attenuated by %.1f dB", tones[j], FS_IN / fs_out, -atten);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_resample_streaming)
+{
+  static resampler_t r;
+
+  seed_rng();
+  for (u32 i = 0; i < N_IN; i++)
+    in[i] = (s8)lround(frand(-3, 3));
+
+  fail_unless(resampler_init(&r, FS_IN, FS_OUT, 3) == 0);
+  u32 n = resampler_process(&r, in, N_IN, out);
+
+  /* Same stream in blocks of varying size. */
+  fail_unless(resampler_init(&r, FS_IN, FS_OUT, 3) == 0);
+  u32 n2 = 0, i = 0, block = 1;
+  while (i < N_IN) {
+    u32 m = MIN(block, N_IN - i);
+    u32 n_out = resampler_process(&r, &in[i], m, &out2[n2]);
+    fail_unless(n_out <= resampler_max_out(&r, m));
+    n2 += n_out;
+    i += m;
+    block = (block * 7 + 3) % 3001;
+  }
+
+  fail_unless(n == n2, "Streamed %u outputs, expected %u", n2, n);
+  for (u32 k = 0; k < n; k++)
+    fail_unless(out[k] == out2[k], "Output %u differs", k);
+
+  fail_unless(resampler_init(&r, 100e6, 1e6, 0) == -1,
+              "Too large a decimation should be rejected");
+}
+END_TEST
+
+START_TEST(test_resample_correlate)
+{
+  static resampler_t r;
+  static s8 code[CA_CODE_UNPACKED_LEN];
+  u8 *ca = (u8 *)ca_code(19);
+  double if_in = 6e6;
+
+  /* Real IF signal at 26 MHz, resampled to 16.368 MHz. */
+  seed_rng();
+  for (u32 i = 0; i < N_IN; i++) {
+    double t = i / FS_IN;
+    u32 chip = (u32)(t * GPS_CA_CHIPPING_RATE) % 1023;
+    in[i] = (s8)lround(10*get_chip(ca, chip)*sin(2*M_PI*if_in*t)
+                       + frand(-20, 20));
+  }
+  fail_unless(resampler_init(&r, FS_IN, FS_OUT, 0) == 0);
+  u32 n = resampler_process(&r, in, N_IN, out);
+  fail_unless(n > 16368);
+
+  /* Account for the resampler delay in the code and carrier phases. */
+  double delay = r.delay / FS_IN;
+  double corr[6];
+  double cp = delay * GPS_CA_CHIPPING_RATE;
+  double carr = 2*M_PI*if_in*delay;
+  u32 n_corr;
+  ca_code_unpack(19, code);
+  track_correlate(out, code, &cp, GPS_CA_CHIPPING_RATE / FS_OUT,
+                  &carr, 2*M_PI*if_in / FS_OUT,
+                  &corr[0], &corr[1], &corr[2], &corr[3], &corr[4], &corr[5],
+                  &n_corr);
+
+  double E = sqrt(corr[0]*corr[0] + corr[1]*corr[1]);
+  double L = sqrt(corr[4]*corr[4] + corr[5]*corr[5]);
+  fail_unless(corr[2] > 1.5*E && corr[2] > 1.5*L &&
+              corr[2] > 5*fabs(corr[3]),
+              "Prompt should dominate (E %f, I_P %f, Q_P %f, L %f)",
+              E, corr[2], corr[3], L);
+}
+END_TEST
+
+Suite* resample_suite(void)
+{
+  Suite *s = suite_create("Resampling");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_resample_tone);
+  tcase_add_test(tc_core, test_resample_alias);
+  tcase_add_test(tc_core, test_resample_streaming);
+  tcase_add_test(tc_core, test_resample_correlate);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,347 @@
+#include <check.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include <constants.h>
+#include <correlate.h>
+#include <prns.h>
+#include <samples.h>
+
+#include "check_utils.h"
+
+#define SAMPLE_FREQ 16.368e6
+#define IF_FREQ 4.092e6
+#define N_SAMPLES 80000
+
+static s8 samples[N_SAMPLES];
+static u8 packed[N_SAMPLES / 4 + 1];
+
+/* Pack a buffer of +-1 or +-1/+-3 samples MSB first. */
+static void pack(sample_fmt_t fmt, const s8* in, u32 n, u8* out)
+{
+  u8 bits = sample_fmt_bits(fmt);
+  for (u32 i = 0; i < n; i++) {
+    u8 v;
+    if (fmt == SAMPLE_FMT_1BIT)
+      v = in[i] < 0;
+    else
+      v = ((in[i] < 0) << 1) | (abs(in[i]) == 3);
+    u32 shift = 8 - bits - (i * bits) % 8;
+    if (shift == 8u - bits)
+      out[i * bits / 8] = 0;
+    out[i * bits / 8] |= v << shift;
+  }
+}
+
+/* Quantise a real IF signal to the values of a sample format. */
+static void gen_signal(sample_fmt_t fmt, u8 prn, double doppler)
+{
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+  u8 *ca = (u8 *)ca_code(prn);
+
+  seed_rng();
+  for (u32 i = 0; i < N_SAMPLES; i++) {
+    u32 chip = (u32)(i*code_step) % 1023;
+    double x = 0.5*get_chip(ca, chip)*sin(i*carr_step) + frand(-1, 1);
+    if (fmt == SAMPLE_FMT_1BIT)
+      samples[i] = x < 0 ? -1 : 1;
+    else
+      samples[i] = (x < 0 ? -1 : 1) * (fabs(x) > 0.8 ? 3 : 1);
+  }
+}
+
+START_TEST(test_samples_unpack)
+{
+  static s8 out[N_SAMPLES];
+
+  for (sample_fmt_t fmt = SAMPLE_FMT_1BIT; fmt <= SAMPLE_FMT_2BIT; fmt++) {
+    gen_signal(fmt, 1, 0);
+    pack(fmt, samples, N_SAMPLES, packed);
+
+    u32 firsts[4] = {0, 1, 3, 4001};
+    u32 lens[4] = {N_SAMPLES, 7, 2, 1234};
+    for (u8 k = 0; k < 4; k++) {
+      samples_unpack(packed, fmt, firsts[k], lens[k], out);
+      for (u32 i = 0; i < lens[k]; i++)
+        fail_unless(out[i] == samples[firsts[k] + i],
+                    "fmt %d: sample %u unpacked to %d, expected %d",
+                    fmt, firsts[k] + i, out[i], samples[firsts[k] + i]);
+    }
+  }
+
+  /* Check the documented encodings. */
+  packed[0] = 0x1B; /* 00 01 10 11 */
+  samples_unpack(packed, SAMPLE_FMT_2BIT, 0, 4, out);
+  fail_unless(out[0] == 1 && out[1] == 3 && out[2] == -1 && out[3] == -3,
+              "Incorrect 2-bit sign/magnitude decoding");
+  packed[0] = 0x80;
+  samples_unpack(packed, SAMPLE_FMT_1BIT, 0, 2, out);
+  fail_unless(out[0] == -1 && out[1] == 1, "Incorrect 1-bit decoding");
+}
+END_TEST
+
+START_TEST(test_track_correlate_packed)
+{
+  static s8 code[CA_CODE_UNPACKED_LEN];
+  double doppler = 700;
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  ca_code_unpack(14, code);
+
+  for (sample_fmt_t fmt = SAMPLE_FMT_1BIT; fmt <= SAMPLE_FMT_2BIT; fmt++) {
+    gen_signal(fmt, 14, doppler);
+    pack(fmt, samples, N_SAMPLES, packed);
+
+    /* Every implementation, starting on and off a byte boundary. */
+    for (corr_impl_t impl = CORR_IMPL_C; impl <= CORR_IMPL_AVX512; impl++) {
+      if (track_correlate_set_impl(impl))
+        continue;
+
+      u32 offsets[2] = {3, 8};
+      for (u8 k = 0; k < 2; k++) {
+        u32 off = offsets[k];
+        double ref[6], corr[6];
+        double cp_ref = off*code_step, carr_ref = 0, cp = cp_ref, carr = 0;
+        u32 n_ref, n;
+        track_correlate(&samples[off], code, &cp_ref, code_step,
+                        &carr_ref, carr_step,
+                        &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                        &n_ref);
+        track_correlate_packed(packed, off, fmt, code, &cp, code_step,
+                               &carr, carr_step,
+                               &corr[0], &corr[1], &corr[2], &corr[3],
+                               &corr[4], &corr[5], &n);
+
+        fail_unless(n == n_ref, "fmt %d impl %d: num_samples %u != %u",
+                    fmt, impl, n, n_ref);
+        fail_unless(fabs(cp - cp_ref) < 1e-9 && fabs(carr - carr_ref) < 1e-9,
+                    "fmt %d impl %d: phases differ", fmt, impl);
+        double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+        fail_unless(P > 1000, "fmt %d impl %d: no correlation peak (%f)",
+                    fmt, impl, P);
+        for (u8 i = 0; i < 6; i++)
+          fail_unless(fabs(corr[i] - ref[i]) < 1e-3*P + 1,
+                      "fmt %d impl %d: corr[%d] %f != %f",
+                      fmt, impl, i, corr[i], ref[i]);
+      }
+    }
+  }
+
+  track_correlate_set_impl(CORR_IMPL_AUTO);
+}
+END_TEST
+
+START_TEST(test_sample_ring)
+{
+  static s8 buff[10000];
+  sample_ring_t ring;
+  const s8 *seg0, *seg1;
+  u32 n0;
+
+  gen_signal(SAMPLE_FMT_2BIT, 1, 0);
+  sample_ring_init(&ring, buff, sizeof(buff));
+
+  fail_unless(sample_ring_segments(&ring, 0, 1, &seg0, &n0, &seg1) == -1,
+              "Unwritten samples should not be readable");
+
+  sample_ring_write(&ring, samples, 7000);
+  sample_ring_write(&ring, &samples[7000], 7000);
+  fail_unless(sample_ring_head(&ring) == 14000);
+
+  /* Overwritten samples. */
+  fail_unless(sample_ring_segments(&ring, 3999, 10, &seg0, &n0, &seg1) == -1);
+
+  /* Samples count as overwritten as soon as a write over them starts. */
+  fail_unless(!sample_ring_overwritten(&ring, 4500));
+  sample_ring_reserve(&ring, 1000);
+  fail_unless(sample_ring_overwritten(&ring, 4500),
+              "Samples being written over not reported");
+  fail_unless(!sample_ring_overwritten(&ring, 5000));
+  fail_unless(sample_ring_segments(&ring, 4500, 10, &seg0, &n0, &seg1) == -1);
+  fail_unless(sample_ring_head(&ring) == 14000,
+              "Reserved samples should not be readable yet");
+  sample_ring_commit(&ring, 1000);
+  fail_unless(sample_ring_head(&ring) == 15000);
+
+  fail_unless(sample_ring_segments(&ring, 9000, 3000, &seg0, &n0, &seg1) == 0);
+  fail_unless(n0 == 1000, "Expected first segment of 1000, got %u", n0);
+  for (u32 i = 0; i < 3000; i++) {
+    s8 x = (i < n0) ? seg0[i] : seg1[i - n0];
+    fail_unless(x == samples[9000 + i], "Sample %u differs", 9000 + i);
+  }
+}
+END_TEST
+
+START_TEST(test_track_correlate_ring)
+{
+  static s8 code[CA_CODE_UNPACKED_LEN];
+  static s8 buff[50000];
+  sample_ring_t ring;
+  double doppler = -400;
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  ca_code_unpack(2, code);
+  gen_signal(SAMPLE_FMT_2BIT, 2, doppler);
+
+  /* Fill the ring so that the samples of interest wrap around. */
+  sample_ring_init(&ring, buff, sizeof(buff));
+  sample_ring_write(&ring, samples, 40000);
+  sample_ring_write(&ring, &samples[40000], 40000);
+
+  /* Two channels, each with its own cursor. */
+  u64 pos[2] = {45000, 60000};
+  for (u8 k = 0; k < 2; k++) {
+    double ref[6], corr[6];
+    double cp_ref = 0.1, carr_ref = 0.2, cp = 0.1, carr = 0.2;
+    u32 n_ref, n;
+    u32 start = pos[k];
+
+    track_correlate(&samples[start], code, &cp_ref, code_step,
+                    &carr_ref, carr_step,
+                    &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                    &n_ref);
+    fail_unless(track_correlate_ring(&ring, &pos[k], code, &cp, code_step,
+                                     &carr, carr_step,
+                                     &corr[0], &corr[1], &corr[2], &corr[3],
+                                     &corr[4], &corr[5], &n) == 0);
+
+    fail_unless(n == n_ref && pos[k] == start + n,
+                "Cursor not advanced correctly");
+    fail_unless(fabs(cp - cp_ref) < 1e-9 && fabs(carr - carr_ref) < 1e-9,
+                "Phases differ");
+    double P = sqrt(ref[2]*ref[2] + ref[3]*ref[3]);
+    for (u8 i = 0; i < 6; i++)
+      fail_unless(fabs(corr[i] - ref[i]) < 1e-3*P + 1,
+                  "corr[%d] %f != %f", i, corr[i], ref[i]);
+  }
+
+  /* Not enough samples written yet. */
+  double cp = 0, carr = 0, c[6];
+  u32 n;
+  u64 p = 75000;
+  fail_unless(track_correlate_ring(&ring, &p, code, &cp, code_step,
+                                   &carr, carr_step, &c[0], &c[1], &c[2],
+                                   &c[3], &c[4], &c[5], &n) == -1);
+  fail_unless(p == 75000 && cp == 0, "State changed on failure");
+
+  /* Multi-channel correlation across the wrap. */
+  corr_channel_t chans[2], refs[2];
+  for (u8 k = 0; k < 2; k++) {
+    chans[k].code = code;
+    chans[k].code_phase = 0.1 + 500*k;
+    chans[k].code_step = code_step;
+    chans[k].carr_phase = 0.2;
+    chans[k].carr_step = carr_step;
+    refs[k] = chans[k];
+  }
+  fail_unless(track_correlate_multi_ring(&ring, 45000, 2, chans) == 0);
+  track_correlate_multi(&samples[45000], 2, refs);
+  for (u8 k = 0; k < 2; k++)
+    for (u8 i = 0; i < 6; i++)
+      fail_unless(fabs(chans[k].corr[i] - refs[k].corr[i])
+                  < 1e-3*fabs(refs[k].corr[i]) + 1,
+                  "chan %d corr[%d] %f != %f", k, i,
+                  chans[k].corr[i], refs[k].corr[i]);
+}
+END_TEST
+
+#define OVERWRITE_ATTEMPTS 2000
+
+static sample_ring_t ov_ring;
+static s8 ov_buff[50000];
+static bool ov_stop;
+
+/* Keep writing the stream `samples[i % N_SAMPLES]` into the ring. Like a
+ * DMA engine the producer fills the storage in place, slowly enough that
+ * its writes overlap the readers' correlations. */
+static void* ring_producer(void* arg)
+{
+  (void)arg;
+  while (!__atomic_load_n(&ov_stop, __ATOMIC_ACQUIRE)) {
+    u64 head = sample_ring_head(&ov_ring);
+    sample_ring_reserve(&ov_ring, 1000);
+    for (u32 j = 0; j < 1000; j++) {
+      ov_buff[(head + j) % sizeof(ov_buff)] = samples[(head + j) % N_SAMPLES];
+      if (j % 100 == 99)
+        sched_yield();
+    }
+    sample_ring_commit(&ov_ring, 1000);
+  }
+  return 0;
+}
+
+START_TEST(test_track_correlate_ring_overwrite)
+{
+  static s8 code[CA_CODE_UNPACKED_LEN];
+  pthread_t producer;
+  double doppler = 1200;
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + doppler / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  double carr_step = 2*M_PI*(IF_FREQ + doppler) / SAMPLE_FREQ;
+
+  ca_code_unpack(9, code);
+  gen_signal(SAMPLE_FMT_2BIT, 9, doppler);
+  sample_ring_init(&ov_ring, ov_buff, sizeof(ov_buff));
+  sample_ring_write(&ov_ring, samples, sizeof(ov_buff));
+
+  __atomic_store_n(&ov_stop, false, __ATOMIC_RELEASE);
+  fail_unless(pthread_create(&producer, 0, ring_producer, 0) == 0);
+
+  /* Correlate the oldest samples in the ring, which the producer is about to
+   * write over. Whenever the correlation succeeds the samples must have been
+   * intact, i.e. the result must be exactly that of the original stream. */
+  for (u32 k = 0; k < OVERWRITE_ATTEMPTS; k++) {
+    u64 pos = sample_ring_head(&ov_ring) - sizeof(ov_buff) + rand() % 2000;
+    double cp_ref = 0.4, carr_ref = 0.3, cp = 0.4, carr = 0.3;
+    double ref[6], corr[6];
+    u32 n_ref, n;
+
+    /* Keep the run contiguous in both the ring and the stream, so that the
+     * correlator is called exactly as for the reference. */
+    u32 len = ceil((1023 - cp) / code_step);
+    if (pos % sizeof(ov_buff) + len > sizeof(ov_buff) ||
+        pos % N_SAMPLES + len > N_SAMPLES)
+      continue;
+
+    track_correlate(&samples[pos % N_SAMPLES], code, &cp_ref, code_step,
+                    &carr_ref, carr_step,
+                    &ref[0], &ref[1], &ref[2], &ref[3], &ref[4], &ref[5],
+                    &n_ref);
+    if (track_correlate_ring(&ov_ring, &pos, code, &cp, code_step,
+                             &carr, carr_step, &corr[0], &corr[1], &corr[2],
+                             &corr[3], &corr[4], &corr[5], &n))
+      continue;
+
+    for (u8 i = 0; i < 6; i++)
+      fail_unless(corr[i] == ref[i],
+                  "Overwritten samples correlated: corr[%d] %f != %f",
+                  i, corr[i], ref[i]);
+  }
+
+  __atomic_store_n(&ov_stop, true, __ATOMIC_RELEASE);
+  pthread_join(producer, 0);
+}
+END_TEST
+
+Suite* samples_suite(void)
+{
+  Suite *s = suite_create("Samples");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_samples_unpack);
+  tcase_add_test(tc_core, test_track_correlate_packed);
+  tcase_add_test(tc_core, test_sample_ring);
+  tcase_add_test(tc_core, test_track_correlate_ring);
+  tcase_add_test(tc_core, test_track_correlate_ring_overwrite);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
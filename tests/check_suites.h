@@ -19,5 +19,17 @@ Suite* ephemeris_suite(void);
 Suite* set_suite(void);
 Suite* viterbi_suite(void);
 Suite* gpstime_test_suite(void);
+Suite* correlate_suite(void);
+Suite* samples_suite(void);
+Suite* resample_suite(void);
+Suite* acq_suite(void);
+Suite* reacq_suite(void);
+Suite* track_bank_suite(void);
+Suite* track_fixed_suite(void);
+Suite* track_engine_suite(void);
+Suite* queue_suite(void);
+Suite* receiver_suite(void);
+Suite* nav_msg_suite(void);
+Suite* nav_replay_suite(void);
 
 #endif /* CHECK_SUITES_H */
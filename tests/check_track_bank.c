@@ -0,0 +1,139 @@
+#include <check.h>
+#include <float.h>
+#include <math.h>
+
+#include <track.h>
+#include <track_bank.h>
+
+#include "check_utils.h"
+
+#define N_CHANNELS 37
+
+START_TEST(test_track_bank_atan)
+{
+  double max_err = 0;
+  for (s32 k = -100000; k <= 100000; k++) {
+    float x = k * 1e-4f;
+    max_err = MAX(max_err, fabs(track_bank_atan(x) - atan(x)));
+    max_err = MAX(max_err, fabs(track_bank_atan(1/x) - atan(1/x)));
+  }
+  fail_unless(max_err < 3e-6, "Max error %g", max_err);
+  fail_unless(fabs(track_bank_atan(INFINITY) - M_PI_2) < 1e-6);
+  fail_unless(fabs(track_bank_atan(-INFINITY) + M_PI_2) < 1e-6);
+}
+END_TEST
+
+START_TEST(test_track_bank_log10)
+{
+  double max_err = 0;
+  for (float x = 0.5f; x < 2; x += 1e-5f)
+    max_err = MAX(max_err, fabs(track_bank_log10(x) - log10(x)));
+  fail_unless(max_err < 5e-8, "Max error %g", max_err);
+  for (float x = FLT_MIN; x < FLT_MAX / 1.01f; x *= 1.01f)
+    max_err = MAX(max_err, fabs(track_bank_log10(x) - log10(x)));
+  fail_unless(max_err < 2e-6, "Max error %g", max_err);
+
+  float denorm = FLT_MIN / 1000;
+  fail_unless(fabs(track_bank_log10(denorm) - log10(denorm)) < 1e-5);
+  fail_unless(track_bank_log10(0) == -INFINITY);
+  fail_unless(track_bank_log10(INFINITY) == INFINITY);
+  fail_unless(isnan(track_bank_log10(-1)));
+  fail_unless(isnan(track_bank_log10(NAN)));
+}
+END_TEST
+
+START_TEST(test_track_bank_update)
+{
+  for (track_bank_impl_t impl = TRACK_BANK_IMPL_C;
+       impl <= TRACK_BANK_IMPL_AVX512; impl++) {
+    if (track_bank_set_impl(impl))
+      continue;
+
+    track_bank_t bank;
+    aided_tl_state_t tl[N_CHANNELS], tl_b;
+    lock_detect_t ld[N_CHANNELS], ld_b;
+    cn0_est_state_t cn0[N_CHANNELS];
+    correlation_t cs[N_CHANNELS][3];
+    float cn0_ref[N_CHANNELS];
+
+    fail_unless(track_bank_init(&bank, N_CHANNELS) == 0);
+    fail_unless(bank.capacity % TRACK_BANK_LANES == 0 &&
+                bank.capacity >= N_CHANNELS);
+
+    seed_rng();
+    for (u32 i = 0; i < N_CHANNELS; i++) {
+      /* Mix of aided and simple loops. */
+      aided_tl_init(&tl[i], 1000, frand(-2, 2), 1, 0.7, 1,
+                    i % 3 ? 1540 : 0, frand(-4000, 4000), 20, 0.7, 1,
+                    i % 2 ? 5 : 0);
+      lock_detect_init(&ld[i], 0.0247, 1.5, 150, 50);
+      cn0_est_init(&cn0[i], 1e3, 40, 5, 1e3);
+      track_bank_set(&bank, i, &tl[i], &ld[i], &cn0[i]);
+    }
+
+    for (u32 k = 0; k < 300; k++) {
+      for (u32 i = 0; i < N_CHANNELS; i++) {
+        /* Strong signals on most channels, noise on the rest. */
+        float amp = i % 4 ? 5000 : 0;
+        for (u8 t = 0; t < 3; t++) {
+          cs[i][t].I = (t == 1 ? amp : amp/2) + frand(-500, 500);
+          cs[i][t].Q = frand(-500, 500);
+        }
+        if (k == 10)
+          cs[i][1].I = 0;
+        aided_tl_update(&tl[i], cs[i]);
+        lock_detect_update(&ld[i], cs[i][1].I, cs[i][1].Q, 1e-3);
+        cn0_ref[i] = cn0_est(&cn0[i], cs[i][1].I, cs[i][1].Q);
+      }
+      track_bank_update(&bank, cs, 1e-3);
+
+      for (u32 i = 0; i < N_CHANNELS; i++) {
+        track_bank_get(&bank, i, &tl_b, &ld_b, 0);
+        fail_unless(fabs(tl_b.carr_freq - tl[i].carr_freq) < 1e-2,
+                    "Impl %d channel %u carr_freq %f, expected %f", impl, i,
+                    tl_b.carr_freq, tl[i].carr_freq);
+        fail_unless(fabs(tl_b.code_freq - tl[i].code_freq) < 1e-3,
+                    "Impl %d channel %u code_freq %f, expected %f", impl, i,
+                    tl_b.code_freq, tl[i].code_freq);
+        fail_unless(tl_b.prev_I == tl[i].prev_I &&
+                    tl_b.prev_Q == tl[i].prev_Q);
+        fail_unless(ld_b.outo == ld[i].outo && ld_b.outp == ld[i].outp &&
+                    ld_b.pcount1 == ld[i].pcount1 &&
+                    ld_b.pcount2 == ld[i].pcount2,
+                    "Impl %d channel %u lock detector differs", impl, i);
+        /* The estimates differ by the error of track_bank_log10(), at
+         * most 2e-6 so 2e-5 dB, and by float rounding of large values.
+         * A NaN must not slip through. */
+        fail_unless(isfinite(bank.cn0[i]) && isfinite(cn0_ref[i]) &&
+                    fabs(bank.cn0[i] - cn0_ref[i])
+                    <= MAX(2e-5, 1e-6 * fabs(cn0_ref[i])),
+                    "Impl %d channel %u C/N0 %.7f, expected %.7f", impl, i,
+                    bank.cn0[i], cn0_ref[i]);
+      }
+    }
+
+    /* The lock detectors should have settled. */
+    for (u32 i = 0; i < N_CHANNELS; i++)
+      fail_unless(bank.lock_outp[i] == (i % 4 != 0),
+                  "Impl %d channel %u lock %d", impl, i,
+                  bank.lock_outp[i]);
+
+    track_bank_destroy(&bank);
+  }
+
+  fail_unless(track_bank_set_impl(TRACK_BANK_IMPL_AUTO) == 0);
+}
+END_TEST
+
+Suite* track_bank_suite(void)
+{
+  Suite *s = suite_create("Tracking bank");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_track_bank_atan);
+  tcase_add_test(tc_core, test_track_bank_log10);
+  tcase_add_test(tc_core, test_track_bank_update);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,158 @@
+#include <check.h>
+#include <math.h>
+#include <sched.h>
+
+#include <constants.h>
+#include <prns.h>
+#include <track_engine.h>
+
+#include "check_utils.h"
+
+#define SAMPLE_FREQ 16.368e6
+#define IF_FREQ 4.092e6
+#define PERIOD_LEN 16368
+#define RING_LEN (16 * PERIOD_LEN)
+#define N_SATS 3
+
+static s8 ring_buff[RING_LEN];
+static s8 chunk[PERIOD_LEN];
+
+static const u8 sat_prn[N_SATS] = {2, 13, 27};
+static const double sat_cp[N_SATS] = {100.2, 700.9, 1010.4};
+static const double sat_dop[N_SATS] = {1200, -2750, 333};
+
+/* True code phase of a satellite at a sample index. */
+static double true_code_phase(u8 s, double i)
+{
+  double code_step = GPS_CA_CHIPPING_RATE * (1 + sat_dop[s] / GPS_L1_HZ)
+                     / SAMPLE_FREQ;
+  return fmod(sat_cp[s] + i * code_step, 1023);
+}
+
+/* Generate the next period of samples of all satellites plus noise. */
+static void gen_chunk(u64 first)
+{
+  for (u32 i = 0; i < PERIOD_LEN; i++) {
+    double x = frand(-30, 30);
+    for (u8 s = 0; s < N_SATS; s++) {
+      u32 chip = (u32)true_code_phase(s, first + i);
+      double carr = 2*M_PI * (IF_FREQ + sat_dop[s]) / SAMPLE_FREQ
+                    * (first + i);
+      x += 5 * get_chip((u8 *)ca_code(sat_prn[s]), chip) * sin(carr);
+    }
+    chunk[i] = (s8)lround(x);
+  }
+}
+
+/* Feed `n_periods` of signal, keeping behind the slowest channel. */
+static void feed(sample_ring_t* ring, track_engine_t* e, u32 n_periods)
+{
+  for (u32 k = 0; k < n_periods; k++) {
+    gen_chunk(sample_ring_head(ring));
+    while (sample_ring_head(ring) + PERIOD_LEN
+           > track_engine_tail(e) + RING_LEN)
+      sched_yield();
+    sample_ring_write(ring, chunk, PERIOD_LEN);
+    track_engine_notify(e);
+  }
+}
+
+START_TEST(test_track_engine)
+{
+  sample_ring_t ring;
+  track_engine_t e;
+  channel_measurement_t meas[4];
+
+  seed_rng();
+  sample_ring_init(&ring, ring_buff, RING_LEN);
+  fail_unless(track_engine_init(&e, &ring, SAMPLE_FREQ, IF_FREQ, 4, 2, 0)
+              == 0);
+
+  /* Start from an acquisition result, off by a fraction of a chip and
+   * some tens of Hz. */
+  for (u8 s = 0; s < N_SATS; s++)
+    fail_unless(track_engine_start_channel(&e, s, sat_prn[s], 0,
+                                           sat_cp[s] + 0.1,
+                                           sat_dop[s] - 40) == 0);
+  fail_unless(track_engine_start_channel(&e, 4, 0, 0, 0, 0) == -1);
+
+  /* Nothing is reported before lock. */
+  fail_unless(track_engine_measure(&e, 0, meas) == 0);
+
+  feed(&ring, &e, 400);
+  /* Wait for the channels to catch up. */
+  while (track_engine_tail(&e) + PERIOD_LEN < sample_ring_head(&ring))
+    sched_yield();
+
+  double t = 399.5e-3;
+  fail_unless(track_engine_measure(&e, t, meas) == N_SATS,
+              "Not all channels locked");
+  for (u8 s = 0; s < N_SATS; s++) {
+    fail_unless(meas[s].prn == sat_prn[s]);
+    fail_unless(fabs(meas[s].carrier_freq - sat_dop[s]) < 5,
+                "PRN %d Doppler %f, expected %f", sat_prn[s],
+                meas[s].carrier_freq, sat_dop[s]);
+    double cp_err = meas[s].code_phase_chips
+                    - true_code_phase(s, t * SAMPLE_FREQ);
+    cp_err -= 1023 * round(cp_err / 1023);
+    fail_unless(fabs(cp_err) < 0.05, "PRN %d code phase error %f",
+                sat_prn[s], cp_err);
+    /* The 1 Hz code loop is still pulling in the initial offset. */
+    fail_unless(fabs(meas[s].code_phase_rate - GPS_CA_CHIPPING_RATE
+                     * (1 + sat_dop[s] / GPS_L1_HZ)) < 0.5,
+                "PRN %d code phase rate %f", sat_prn[s],
+                meas[s].code_phase_rate);
+    fail_unless(meas[s].receiver_time == t);
+    fail_unless(meas[s].snr > 45 && meas[s].snr < 60,
+                "PRN %d C/N0 %f", sat_prn[s], meas[s].snr);
+    fail_unless((s32)meas[s].time_of_week_ms == TOW_INVALID);
+    fail_unless(meas[s].lock_counter >= 1);
+  }
+
+  /* Stopped channels drop out of the measurements. */
+  track_engine_stop_channel(&e, 1);
+  fail_unless(track_engine_measure(&e, t, meas) == N_SATS - 1);
+  fail_unless(meas[1].prn == sat_prn[2]);
+
+  track_engine_destroy(&e);
+  for (u8 s = 0; s < N_SATS; s++) {
+    fail_unless(!e.channels[s].overrun);
+    fail_unless(e.channels[s].n_periods >= 398);
+  }
+}
+END_TEST
+
+START_TEST(test_track_engine_overrun)
+{
+  sample_ring_t ring;
+  track_engine_t e;
+
+  sample_ring_init(&ring, ring_buff, RING_LEN);
+  fail_unless(track_engine_init(&e, &ring, SAMPLE_FREQ, IF_FREQ, 1, 1, 0)
+              == 0);
+
+  /* Overwrite the start of the ring before the channel starts. */
+  for (u32 k = 0; k < 20; k++)
+    sample_ring_write(&ring, chunk, PERIOD_LEN);
+  fail_unless(track_engine_start_channel(&e, 0, 5, 0, 0, 0) == 0);
+  while (track_engine_tail(&e) != sample_ring_head(&ring))
+    sched_yield();
+
+  track_engine_destroy(&e);
+  fail_unless(e.channels[0].overrun);
+  fail_unless(!e.channels[0].active);
+}
+END_TEST
+
+Suite* track_engine_suite(void)
+{
+  Suite *s = suite_create("Tracking engine");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_set_timeout(tc_core, 60);
+  tcase_add_test(tc_core, test_track_engine);
+  tcase_add_test(tc_core, test_track_engine_overrun);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
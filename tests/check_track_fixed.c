@@ -0,0 +1,252 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <track.h>
+#include <track_fixed.h>
+
+#include "check_utils.h"
+
+START_TEST(test_atan2_q15)
+{
+  double max_err = 0;
+  for (s32 k = 0; k < 100000; k++) {
+    double t = 2*M_PI * k / 100000;
+    double r = k % 2 ? 1e9 : 3e3;
+    s64 y = llround(r * sin(t)), x = llround(r * cos(t));
+    double err = atan2_q15(y, x) - atan2(y, x) / (2*M_PI) * Q15_ONE;
+    /* Wrap the +/- half cycle ambiguity. */
+    err = fmod(err + 1.5*Q15_ONE, Q15_ONE) - 0.5*Q15_ONE;
+    max_err = MAX(max_err, fabs(err));
+  }
+  fail_unless(max_err <= 1, "Max error %f LSB", max_err);
+
+  fail_unless(atan2_q15(0, 0) == 0);
+  fail_unless(atan2_q15(5, 0) == Q15_ONE / 4);
+  fail_unless(atan2_q15(-5, 0) == -Q15_ONE / 4);
+  fail_unless(atan2_q15(0, -5) == Q15_ONE / 2);
+  fail_unless(atan2_q15(INT64_MAX, INT64_MAX) == Q15_ONE / 8);
+  fail_unless(atan2_q15(-INT64_MAX, 1) == -Q15_ONE / 4);
+}
+END_TEST
+
+START_TEST(test_discriminators_q15)
+{
+  seed_rng();
+  for (u32 k = 0; k < 10000; k++) {
+    float scale = k % 2 ? 2e9 : 1e4;
+    correlation_q_t cq[3];
+    correlation_t cf[3];
+    for (u8 i = 0; i < 3; i++) {
+      cq[i].I = (s32)frand(-scale, scale);
+      cq[i].Q = (s32)frand(-scale, scale);
+      cf[i].I = cq[i].I;
+      cf[i].Q = cq[i].Q;
+    }
+
+    float costas = costas_discriminator(cf[1].I, cf[1].Q) * Q15_ONE;
+    fail_unless(fabs(costas_discriminator_q15(cq[1].I, cq[1].Q) - costas)
+                <= 1, "Costas %d, expected %f",
+                costas_discriminator_q15(cq[1].I, cq[1].Q), costas);
+
+    float freq = frequency_discriminator(cf[1].I, cf[1].Q,
+                                         cf[0].I, cf[0].Q) * Q15_ONE;
+    s16 freq_q = frequency_discriminator_q15(cq[1].I, cq[1].Q,
+                                             cq[0].I, cq[0].Q);
+    fail_unless(fabs(freq_q - freq) <= 1.5,
+                "Frequency %d, expected %f", freq_q, freq);
+
+    float dll = dll_discriminator(cf) * Q15_ONE;
+    fail_unless(fabs(dll_discriminator_q15(cq) - dll) <= 1,
+                "DLL %d, expected %f", dll_discriminator_q15(cq), dll);
+  }
+
+  correlation_q_t zero[3] = {{0, 0}, {0, 0}, {0, 0}};
+  fail_unless(costas_discriminator_q15(0, 100) == 0);
+  fail_unless(dll_discriminator_q15(zero) == 0);
+  fail_unless(frequency_discriminator_q15(0, 0, 0, 0) == 0);
+}
+END_TEST
+
+START_TEST(test_calc_loop_gains_q)
+{
+  float b0, b1;
+  s32 b0_q, b1_q;
+
+  calc_loop_gains(20, 0.7, 1, 1000, &b0, &b1);
+  calc_loop_gains_q(20, 0.7, 1, 1000, &b0_q, &b1_q);
+  fail_unless(fabs((double)b0_q / TRACK_FIXED_GAIN_ONE - b0)
+              <= 0.5 / TRACK_FIXED_GAIN_ONE);
+  fail_unless(fabs((double)b1_q / TRACK_FIXED_GAIN_ONE - b1)
+              <= 0.5 / TRACK_FIXED_GAIN_ONE);
+
+  fail_unless(float_to_freq_q(-1.5) == -3 * TRACK_FIXED_FREQ_ONE / 2);
+  fail_unless(float_to_freq_q(1e10) == INT32_MAX);
+  fail_unless(float_to_freq_q(-1e10) == INT32_MIN);
+}
+END_TEST
+
+/* Prompt correlation of a signal with the given phase error in cycles and
+ * the early and late correlations for the given code error in chips. */
+static void gen_corrs(double phase, double code, double amp,
+                      correlation_t cf[3], correlation_q_t cq[3])
+{
+  double a[3] = {1 - fabs(code + 0.5), 1 - fabs(code), 1 - fabs(code - 0.5)};
+  for (u8 i = 0; i < 3; i++) {
+    cq[i].I = lround(amp * a[i] * cos(2*M_PI*phase) + frand(-amp, amp)/10);
+    cq[i].Q = lround(amp * a[i] * sin(2*M_PI*phase) + frand(-amp, amp)/10);
+    cf[i].I = cq[i].I;
+    cf[i].Q = cq[i].Q;
+  }
+}
+
+/* Loop filter in double precision, as a reference for the fixed-point
+ * filters. The float filters can't be used as they only resolve a carrier
+ * frequency of a kHz or so to about 1e-4 Hz, and drift by that each update. */
+typedef struct {
+  double b0, b1, prev_error, y;
+} lf_ref_t;
+
+static void lf_ref_init(lf_ref_t *f, double y0, float bw)
+{
+  float b0, b1;
+  calc_loop_gains(bw, 0.7, 1, 1000, &b0, &b1);
+  f->b0 = b0;
+  f->b1 = b1;
+  f->prev_error = 0;
+  f->y = y0;
+}
+
+/* Update with an error and an aiding term, the aiding gain times the
+ * aiding error. */
+static double lf_ref_update(lf_ref_t *f, double error, double aiding)
+{
+  f->y += f->b0 * error + f->b1 * f->prev_error + aiding;
+  f->prev_error = error;
+  return f->y;
+}
+
+/* Bound on the difference of a fixed-point loop filter output from the
+ * reference after `n` updates. The Q15 discriminators are rounded, so are
+ * within one LSB of the float ones and differ by 1/sqrt(12) LSB rms. The
+ * proportional gain `kp` passes that straight through, and the integral
+ * gain `ki` sums it into a random walk. Allow twice the first and five
+ * standard deviations of the second. */
+static double lf_bound(double kp, double ki, u32 n)
+{
+  return (2 * fabs(kp) + 5 * fabs(ki) * sqrt(n / 12.)) / Q15_ONE;
+}
+
+#define N_UPDATES 2000
+
+START_TEST(test_aided_tl_q)
+{
+  aided_tl_state_t tl;
+  aided_tl_state_q_t tl_q;
+  correlation_t cf[3];
+  correlation_q_t cq[3];
+  lf_ref_t carr_ref, code_ref;
+
+  aided_tl_init(&tl, 1000, 1.2, 1, 0.7, 1, 1540, 1500, 20, 0.7, 1, 5);
+  aided_tl_init_q(&tl_q, 1000, 1.2, 1, 0.7, 1, 1540, 1500, 20, 0.7, 1, 5);
+  fail_unless(tl_q.carr_freq == float_to_freq_q(1500));
+  fail_unless(fabs(tl_q.code_per_carr / (double)Q31_ONE - 1/1540.) < 1e-9);
+  lf_ref_init(&carr_ref, 1500, 20);
+  lf_ref_init(&code_ref, 0, 1);
+
+  seed_rng();
+  double phase = 0.05, code = 0.1;
+  double prev_I = 1, prev_Q = 0;
+  double max_carr = 0, max_code = 0;
+  for (u32 k = 0; k < N_UPDATES; k++) {
+    gen_corrs(phase, code, 1e6, cf, cq);
+    aided_tl_update(&tl, cf);
+    aided_tl_update_q(&tl_q, cq);
+
+    double freq_error = frequency_discriminator(cf[1].I, cf[1].Q,
+                                                prev_I, prev_Q);
+    prev_I = cf[1].I;
+    prev_Q = cf[1].Q;
+    double carr = lf_ref_update(&carr_ref,
+                                costas_discriminator(cf[1].I, cf[1].Q),
+                                5 * freq_error);
+    double code_freq = lf_ref_update(&code_ref, -dll_discriminator(cf), 0)
+                       + carr / 1540;
+
+    /* Let the float loop drive a slowly drifting signal. */
+    phase += (1510 - tl.carr_freq) * 1e-3;
+    phase -= round(phase);
+    code += (1510 / 1540. + 0.1 - tl.code_freq) * 1e-3;
+    max_carr = MAX(max_carr, fabs(freq_q_to_float(tl_q.carr_freq) - carr));
+    max_code = MAX(max_code, fabs(freq_q_to_float(tl_q.code_freq)
+                                  - code_freq));
+  }
+  fail_unless(fabs(tl.carr_freq - 1510) < 2, "Carrier %f", tl.carr_freq);
+  double carr_bound = lf_bound(carr_ref.b0, carr_ref.b0 + carr_ref.b1 + 5,
+                               N_UPDATES);
+  fail_unless(max_carr < carr_bound, "Max carrier difference %f, bound %f",
+              max_carr, carr_bound);
+  double code_bound = lf_bound(code_ref.b0, code_ref.b0 + code_ref.b1,
+                               N_UPDATES) + carr_bound / 1540;
+  fail_unless(max_code < code_bound, "Max code difference %g, bound %g",
+              max_code, code_bound);
+}
+END_TEST
+
+START_TEST(test_simple_tl_q)
+{
+  simple_tl_state_t tl;
+  simple_tl_state_q_t tl_q;
+  correlation_t cf[3];
+  correlation_q_t cq[3];
+  lf_ref_t carr_ref, code_ref;
+
+  simple_tl_init(&tl, 1000, 0.5, 1, 0.7, 1, -800, 20, 0.7, 1);
+  simple_tl_init_q(&tl_q, 1000, 0.5, 1, 0.7, 1, -800, 20, 0.7, 1);
+  lf_ref_init(&carr_ref, -800, 20);
+  lf_ref_init(&code_ref, 0.5, 1);
+
+  seed_rng();
+  double phase = -0.1, code = -0.2;
+  double max_carr = 0, max_code = 0;
+  for (u32 k = 0; k < N_UPDATES; k++) {
+    gen_corrs(phase, code, 3e4, cf, cq);
+    simple_tl_update(&tl, cf);
+    simple_tl_update_q(&tl_q, cq);
+    double carr = lf_ref_update(&carr_ref,
+                                costas_discriminator(cf[1].I, cf[1].Q), 0);
+    double code_freq = lf_ref_update(&code_ref, -dll_discriminator(cf), 0);
+
+    phase += (-790 - tl.carr_freq) * 1e-3;
+    phase -= round(phase);
+    code += (0.3 - tl.code_freq) * 1e-3;
+    max_carr = MAX(max_carr, fabs(freq_q_to_float(tl_q.carr_freq) - carr));
+    max_code = MAX(max_code, fabs(freq_q_to_float(tl_q.code_freq)
+                                  - code_freq));
+  }
+  fail_unless(fabs(tl.carr_freq + 790) < 2, "Carrier %f", tl.carr_freq);
+  double carr_bound = lf_bound(carr_ref.b0, carr_ref.b0 + carr_ref.b1,
+                               N_UPDATES);
+  fail_unless(max_carr < carr_bound, "Max carrier difference %f, bound %f",
+              max_carr, carr_bound);
+  double code_bound = lf_bound(code_ref.b0, code_ref.b0 + code_ref.b1,
+                               N_UPDATES);
+  fail_unless(max_code < code_bound, "Max code difference %g, bound %g",
+              max_code, code_bound);
+}
+END_TEST
+
+Suite* track_fixed_suite(void)
+{
+  Suite *s = suite_create("Fixed-point tracking loops");
+
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_test(tc_core, test_atan2_q15);
+  tcase_add_test(tc_core, test_discriminators_q15);
+  tcase_add_test(tc_core, test_calc_loop_gains_q);
+  tcase_add_test(tc_core, test_aided_tl_q);
+  tcase_add_test(tc_core, test_simple_tl_q);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
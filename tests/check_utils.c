@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <math.h>
 
+#include <bits.h>
+
 #include "check_utils.h"
 
 /*#define epsilon 0.0001*/
@@ -44,3 +46,28 @@ u32 sizerand(u32 sizemax) {
   double f = (double)random() / RAND_MAX;
   return (u32) ceil(f * sizemax);
 }
+
+/* Add parity to a 24 bit word of nav data following the word ending in bits
+ * D29* and D30*, returning the 30 transmitted bits. */
+u32 nav_word(u32 data, u32 prev) {
+  static const u32 masks[6] = {0xBB1F34A0, 0x5D8F9A50, 0xAEC7CD08,
+                               0x5763E684, 0x6BB1F342, 0x8B7A89C1};
+  u32 w = (prev & 3) << 30 | (data & 0xFFFFFF) << 6;
+  for (u8 i = 0; i < 6; i++)
+    w |= (u32)parity(w & masks[i] & ~0x3Fu) << (5 - i);
+  if (w & 1 << 30)
+    w ^= 0x3FFFFFC0;
+  return w & 0x3FFFFFFF;
+}
+
+/* Add parity to a word whose last two data bits are free, choosing them so
+ * that the word ends in zeros, as for the HOW and word 10. */
+u32 nav_word_zero_end(u32 data, u32 prev) {
+  u32 w = 0;
+  for (u32 t = 0; t < 4; t++) {
+    w = nav_word((data & ~3u) | t, prev);
+    if (!(w & 3))
+      break;
+  }
+  return w;
+}
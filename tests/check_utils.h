@@ -6,3 +6,5 @@ void seed_rng(void);
 double frand(double fmin, double fmax);
 void arr_frand(u32 n, double fmin, double fmax, double *v);
 u32 sizerand(u32 sizemax);
+u32 nav_word(u32 data, u32 prev);
+u32 nav_word_zero_end(u32 data, u32 prev);